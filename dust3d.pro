@@ -152,12 +152,12 @@ HEADERS += src/autosaver.h
 SOURCES += src/documentsaver.cpp
 HEADERS += src/documentsaver.h
 
-SOURCES += src/normalanddepthmapsgenerator.cpp
-HEADERS += src/normalanddepthmapsgenerator.h
-
 SOURCES += src/modeloffscreenrender.cpp
 HEADERS += src/modeloffscreenrender.h
 
+SOURCES += src/modelsoftwarerender.cpp
+HEADERS += src/modelsoftwarerender.h
+
 SOURCES += src/modelshaderprogram.cpp
 HEADERS += src/modelshaderprogram.h
 
@@ -200,6 +200,12 @@ HEADERS += src/snapshot.h
 SOURCES += src/snapshotxml.cpp
 HEADERS += src/snapshotxml.h
 
+SOURCES += src/snapshotbinary.cpp
+HEADERS += src/snapshotbinary.h
+
+SOURCES += src/snapshothistory.cpp
+HEADERS += src/snapshothistory.h
+
 SOURCES += src/ds3file.cpp
 HEADERS += src/ds3file.h
 
@@ -215,6 +221,9 @@ HEADERS += src/model.h
 SOURCES += src/texturegenerator.cpp
 HEADERS += src/texturegenerator.h
 
+SOURCES += src/texturerasterizer.cpp
+HEADERS += src/texturerasterizer.h
+
 SOURCES += src/object.cpp
 HEADERS += src/object.h
 
@@ -269,6 +278,9 @@ HEADERS += src/rigtype.h
 SOURCES += src/riggenerator.cpp
 HEADERS += src/riggenerator.h
 
+SOURCES += src/positionkdtree.cpp
+HEADERS += src/positionkdtree.h
+
 SOURCES += src/skinnedmeshcreator.cpp
 HEADERS += src/skinnedmeshcreator.h
 
@@ -290,6 +302,15 @@ HEADERS += src/motionwidget.h
 SOURCES += src/motionsgenerator.cpp
 HEADERS += src/motionsgenerator.h
 
+SOURCES += src/motionclip.cpp
+HEADERS += src/motionclip.h
+
+SOURCES += src/motionskinner.cpp
+HEADERS += src/motionskinner.h
+
+SOURCES += src/motionclipcompressor.cpp
+HEADERS += src/motionclipcompressor.h
+
 SOURCES += src/texturetype.cpp
 HEADERS += src/texturetype.h
 
@@ -352,6 +373,9 @@ HEADERS += src/preferences.h
 
 HEADERS += src/shadervertex.h
 
+SOURCES += src/shadervertexpacker.cpp
+HEADERS += src/shadervertexpacker.h
+
 SOURCES += src/scripteditwidget.cpp
 HEADERS += src/scripteditwidget.h
 
@@ -382,6 +406,9 @@ HEADERS += src/imagepreviewwidget.h
 SOURCES += src/texturepainter.cpp
 HEADERS += src/texturepainter.h
 
+SOURCES += src/trianglebvh.cpp
+HEADERS += src/trianglebvh.h
+
 SOURCES += src/paintmode.cpp
 HEADERS += src/paintmode.h
 
@@ -484,6 +511,9 @@ HEADERS += src/rigxml.h
 SOURCES += src/ragdoll.cpp
 HEADERS += src/ragdoll.h
 
+SOURCES += src/verletsolver.cpp
+HEADERS += src/verletsolver.h
+
 SOURCES += src/motionbuilder.cpp
 HEADERS += src/motionbuilder.h
 
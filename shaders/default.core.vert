@@ -1,12 +1,10 @@
 #version 330
 layout(location = 0) in vec4 vertex;
-layout(location = 1) in vec3 normal;
-layout(location = 2) in vec3 color;
+layout(location = 1) in vec2 octNormal;
+layout(location = 2) in vec4 color;
 layout(location = 3) in vec2 texCoord;
-layout(location = 4) in float metalness;
-layout(location = 5) in float roughness;
-layout(location = 6) in vec3 tangent;
-layout(location = 7) in float alpha;
+layout(location = 4) in vec2 material;
+layout(location = 6) in vec2 octTangent;
 out vec3 vert;
 out vec3 vertRaw;
 out vec3 vertNormal;
@@ -33,13 +31,25 @@ mat3 transpose(mat3 m)
                 m[0][2], m[1][2], m[2][2]);
 }
 
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 v = vec3(encoded.x, encoded.y, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (v.z < 0.0) {
+        vec2 signs = vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+        v.xy = (1.0 - abs(v.yx)) * signs;
+    }
+    return normalize(v);
+}
+
 void main()
 {
+    vec3 normal = decodeOctahedral(octNormal);
+    vec3 tangent = decodeOctahedral(octTangent);
     vert = (modelMatrix * vertex).xyz;
     vertRaw = vert;
     vertNormal = normalize((modelMatrix * vec4(normal, 1.0)).xyz);
-    vertColor = color;
-    vertAlpha = alpha;
+    vertColor = color.rgb;
+    vertAlpha = color.a;
     cameraPos = eyePos;
 
     firstLightPos = vec3(5.0, 5.0, 5.0);
@@ -63,6 +73,6 @@ void main()
     }
 
     vertTexCoord = texCoord;
-    vertMetalness = metalness;
-    vertRoughness = roughness;
+    vertMetalness = material.x;
+    vertRoughness = material.y;
 }
\ No newline at end of file
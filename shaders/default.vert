@@ -1,12 +1,10 @@
 #version 110
 attribute vec4 vertex;
-attribute vec3 normal;
-attribute vec3 color;
+attribute vec2 octNormal;
+attribute vec4 color;
 attribute vec2 texCoord;
-attribute float metalness;
-attribute float roughness;
-attribute vec3 tangent;
-attribute float alpha;
+attribute vec2 material;
+attribute vec2 octTangent;
 varying vec3 vert;
 varying vec3 vertRaw;
 varying vec3 vertNormal;
@@ -33,13 +31,25 @@ mat3 transpose(mat3 m)
                 m[0][2], m[1][2], m[2][2]);
 }
 
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 v = vec3(encoded.x, encoded.y, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (v.z < 0.0) {
+        vec2 signs = vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+        v.xy = (1.0 - abs(v.yx)) * signs;
+    }
+    return normalize(v);
+}
+
 void main()
 {
+    vec3 normal = decodeOctahedral(octNormal);
+    vec3 tangent = decodeOctahedral(octTangent);
     vert = (modelMatrix * vertex).xyz;
     vertRaw = vert;
     vertNormal = normalize((modelMatrix * vec4(normal, 1.0)).xyz);
-    vertColor = color;
-    vertAlpha = alpha;
+    vertColor = color.rgb;
+    vertAlpha = color.a;
     cameraPos = eyePos;
 
     firstLightPos = vec3(5.0, 5.0, 5.0);
@@ -63,6 +73,6 @@ void main()
     }
 
     vertTexCoord = texCoord;
-    vertMetalness = metalness;
-    vertRoughness = roughness;
+    vertMetalness = material.x;
+    vertRoughness = material.y;
 }
\ No newline at end of file
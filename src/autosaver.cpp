@@ -10,6 +10,7 @@
 #include "documentsaver.h"
 #include "snapshotxml.h"
 #include "document.h"
+#include "preferences.h"
 
 AutoSaver::AutoSaver(Document *document) :
     m_document(document)
@@ -131,7 +132,9 @@ void AutoSaver::check()
         textures,
         turnaroundPngByteArray,
         script,
-        scriptVariables);
+        scriptVariables,
+        Preferences::instance().binarySnapshot(),
+        Preferences::instance().compressedDocument());
     m_documentSaver->moveToThread(thread);
     connect(thread, &QThread::started, m_documentSaver, &DocumentSaver::process);
     connect(m_documentSaver, &DocumentSaver::finished, this, &AutoSaver::autoSaveDone);
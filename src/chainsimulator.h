@@ -2,7 +2,7 @@
 #define DUST3D_CHAIN_SIMULATOR_H
 #include <vector>
 #include <QVector3D>
-#include <unordered_map>
+#include "verletsolver.h"
 
 class ChainSimulator
 {
@@ -20,16 +20,9 @@ public:
         double restLength;
     };
     
-    struct VertexMotion
-    {
-        QVector3D position;
-        QVector3D lastPosition;
-        QVector3D force;
-        bool fixed = false;
-    };
-
     ChainSimulator(const std::vector<QVector3D> *vertices) :
-        m_vertices(vertices)
+        m_vertices(vertices),
+        m_solver(*vertices)
     {
     }
     
@@ -45,7 +38,7 @@ public:
     
     void start();
     void simulate(double stepSize);
-    const VertexMotion &getVertexMotion(size_t vertexIndex);
+    QVector3D getVertexPosition(size_t vertexIndex) const;
     void updateVertexPosition(size_t vertexIndex, const QVector3D &position);
     void fixVertexPosition(size_t vertexIndex);
     
@@ -53,16 +46,11 @@ private:
     Parameters m_parameters;
     std::vector<Chain> m_chains;
     const std::vector<QVector3D> *m_vertices = nullptr;
-    std::unordered_map<size_t, VertexMotion> m_vertexMotions;
+    VerletSolver m_solver;
     QVector3D m_externalForce;
     double m_groundY = 0.0;
     
-    void initializeVertexMotions();
     void prepareChains();
-    void updateVertexForces();
-    void applyConstraints();
-    void doVerletIntegration(double stepSize);
-    void applyBoundingConstraints(QVector3D *position);
     
     void outputChainsForDebug(const char *filename, const std::vector<Chain> &springs);
 };
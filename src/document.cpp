@@ -9,6 +9,7 @@
 #include <functional>
 #include <QtCore/qbuffer.h>
 #include <QElapsedTimer>
+#include <QPainter>
 #include <queue>
 #include "document.h"
 #include "util.h"
@@ -19,6 +20,7 @@
 #include "scriptrunner.h"
 #include "imageforever.h"
 #include "meshgenerator.h"
+#include "uvunwrap.h"
 
 unsigned long Document::m_maxSnapshot = 1000;
 
@@ -68,8 +70,11 @@ Document::~Document()
     delete textureRoughnessImageByteArray;
     delete textureAmbientOcclusionImage;
     delete textureAmbientOcclusionImageByteArray;
+    delete m_textureMetalnessRoughnessAmbientOcclusionImage;
     delete m_resultTextureMesh;
     delete m_resultRigWeightMesh;
+    delete m_textureGeneratedCacheContext;
+    delete m_uvUnwrapCacheContext;
 }
 
 void Document::uiReady()
@@ -289,6 +294,8 @@ void Document::updateTextureMetalnessImage(QImage *image)
     
     delete textureMetalnessImage;
     textureMetalnessImage = image;
+    
+    updateTextureMetalnessRoughnessAmbientOcclusionImage(nullptr);
 }
 
 void Document::updateTextureRoughnessImage(QImage *image)
@@ -298,6 +305,8 @@ void Document::updateTextureRoughnessImage(QImage *image)
     
     delete textureRoughnessImage;
     textureRoughnessImage = image;
+    
+    updateTextureMetalnessRoughnessAmbientOcclusionImage(nullptr);
 }
 
 void Document::updateTextureAmbientOcclusionImage(QImage *image)
@@ -307,6 +316,25 @@ void Document::updateTextureAmbientOcclusionImage(QImage *image)
     
     delete textureAmbientOcclusionImage;
     textureAmbientOcclusionImage = image;
+    
+    updateTextureMetalnessRoughnessAmbientOcclusionImage(nullptr);
+}
+
+void Document::updateTextureMetalnessRoughnessAmbientOcclusionImage(QImage *image)
+{
+    delete m_textureMetalnessRoughnessAmbientOcclusionImage;
+    m_textureMetalnessRoughnessAmbientOcclusionImage = image;
+}
+
+const QImage *Document::textureMetalnessRoughnessAmbientOcclusionImage()
+{
+    if (nullptr == m_textureMetalnessRoughnessAmbientOcclusionImage) {
+        m_textureMetalnessRoughnessAmbientOcclusionImage = TextureGenerator::combineMetalnessRoughnessAmbientOcclusionImages(
+            textureMetalnessImage,
+            textureRoughnessImage,
+            textureAmbientOcclusionImage);
+    }
+    return m_textureMetalnessRoughnessAmbientOcclusionImage;
 }
 
 void Document::setEditMode(SkeletonDocumentEditMode mode)
@@ -352,7 +380,269 @@ void Document::setPaintMode(PaintMode mode)
     m_paintMode = mode;
     emit paintModeChanged();
     
-    paint();
+    pickMouseTarget(m_mouseRayNear, m_mouseRayFar);
+}
+
+static void partToSnapshot(const SkeletonPart &part, std::map<QString, QString> *attributes)
+{
+    (*attributes)["id"] = part.id.toString();
+    (*attributes)["visible"] = part.visible ? "true" : "false";
+    (*attributes)["locked"] = part.locked ? "true" : "false";
+    (*attributes)["subdived"] = part.subdived ? "true" : "false";
+    (*attributes)["disabled"] = part.disabled ? "true" : "false";
+    (*attributes)["xMirrored"] = part.xMirrored ? "true" : "false";
+    if (part.zMirrored)
+        (*attributes)["zMirrored"] = part.zMirrored ? "true" : "false";
+    if (part.base != PartBase::XYZ)
+        (*attributes)["base"] = PartBaseToString(part.base);
+    (*attributes)["rounded"] = part.rounded ? "true" : "false";
+    (*attributes)["chamfered"] = part.chamfered ? "true" : "false";
+    if (PartTarget::Model != part.target)
+        (*attributes)["target"] = PartTargetToString(part.target);
+    if (part.cutRotationAdjusted())
+        (*attributes)["cutRotation"] = QString::number(part.cutRotation);
+    if (part.cutFaceAdjusted()) {
+        if (CutFace::UserDefined == part.cutFace) {
+            if (!part.cutFaceLinkedId.isNull()) {
+                (*attributes)["cutFace"] = part.cutFaceLinkedId.toString();
+            }
+        } else {
+            (*attributes)["cutFace"] = CutFaceToString(part.cutFace);
+        }
+    }
+    if (!part.fillMeshLinkedId.isNull())
+        (*attributes)["fillMesh"] = part.fillMeshLinkedId.toString();
+    (*attributes)["__dirty"] = part.dirty ? "true" : "false";
+    if (part.hasColor)
+        (*attributes)["color"] = part.color.name(QColor::HexArgb);
+    if (part.colorSolubilityAdjusted())
+        (*attributes)["colorSolubility"] = QString::number(part.colorSolubility);
+    if (part.metalnessAdjusted())
+        (*attributes)["metallic"] = QString::number(part.metalness);
+    if (part.roughnessAdjusted())
+        (*attributes)["roughness"] = QString::number(part.roughness);
+    if (part.deformThicknessAdjusted())
+        (*attributes)["deformThickness"] = QString::number(part.deformThickness);
+    if (part.deformWidthAdjusted())
+        (*attributes)["deformWidth"] = QString::number(part.deformWidth);
+    if (part.deformUnified)
+        (*attributes)["deformUnified"] = "true";
+    if (!part.deformMapImageId.isNull())
+        (*attributes)["deformMapImageId"] = part.deformMapImageId.toString();
+    if (part.deformMapScaleAdjusted())
+        (*attributes)["deformMapScale"] = QString::number(part.deformMapScale);
+    if (part.hollowThicknessAdjusted())
+        (*attributes)["hollowThickness"] = QString::number(part.hollowThickness);
+    if (!part.name.isEmpty())
+        (*attributes)["name"] = part.name;
+    if (part.materialAdjusted())
+        (*attributes)["materialId"] = part.materialId.toString();
+    if (part.countershaded)
+        (*attributes)["countershaded"] = "true";
+    if (part.smooth)
+        (*attributes)["smooth"] = "true";
+}
+
+static void nodeToSnapshot(const SkeletonNode &node, std::map<QString, QString> *attributes)
+{
+    (*attributes)["id"] = node.id.toString();
+    (*attributes)["radius"] = QString::number(node.radius);
+    (*attributes)["x"] = QString::number(node.getX());
+    (*attributes)["y"] = QString::number(node.getY());
+    (*attributes)["z"] = QString::number(node.getZ());
+    (*attributes)["partId"] = node.partId.toString();
+    if (node.boneMark != BoneMark::None)
+        (*attributes)["boneMark"] = BoneMarkToString(node.boneMark);
+    if (node.hasCutFaceSettings) {
+        (*attributes)["cutRotation"] = QString::number(node.cutRotation);
+        if (CutFace::UserDefined == node.cutFace) {
+            if (!node.cutFaceLinkedId.isNull()) {
+                (*attributes)["cutFace"] = node.cutFaceLinkedId.toString();
+            }
+        } else {
+            (*attributes)["cutFace"] = CutFaceToString(node.cutFace);
+        }
+    }
+    if (!node.name.isEmpty())
+        (*attributes)["name"] = node.name;
+}
+
+static void edgeToSnapshot(const SkeletonEdge &edge, std::map<QString, QString> *attributes)
+{
+    (*attributes)["id"] = edge.id.toString();
+    (*attributes)["from"] = edge.nodeIds[0].toString();
+    (*attributes)["to"] = edge.nodeIds[1].toString();
+    (*attributes)["partId"] = edge.partId.toString();
+    if (!edge.name.isEmpty())
+        (*attributes)["name"] = edge.name;
+}
+
+static void componentToSnapshot(const SkeletonComponent &component, std::map<QString, QString> *attributes)
+{
+    (*attributes)["id"] = component.id.toString();
+    if (!component.name.isEmpty())
+        (*attributes)["name"] = component.name;
+    (*attributes)["expanded"] = component.expanded ? "true" : "false";
+    (*attributes)["combineMode"] = CombineModeToString(component.combineMode);
+    (*attributes)["__dirty"] = component.dirty ? "true" : "false";
+    QStringList childIdList;
+    for (const auto &childId: component.childrenIds) {
+        childIdList.append(childId.toString());
+    }
+    QString children = childIdList.join(",");
+    if (!children.isEmpty())
+        (*attributes)["children"] = children;
+    QString linkData = component.linkData();
+    if (!linkData.isEmpty()) {
+        (*attributes)["linkData"] = linkData;
+        (*attributes)["linkDataType"] = component.linkDataType();
+    }
+    if (!component.name.isEmpty())
+        (*attributes)["name"] = component.name;
+}
+
+// Hashes of every field the serializers above read, the undo history only serializes elements whose hash changed
+class HistoryHasher
+{
+public:
+    template <typename T>
+    void add(const T &value)
+    {
+        m_hash = crc64(m_hash, (const unsigned char *)&value, sizeof(value));
+    }
+    void add(const QString &value)
+    {
+        add(value.size());
+        m_hash = crc64(m_hash, (const unsigned char *)value.constData(), value.size() * sizeof(QChar));
+    }
+    void add(const std::vector<QUuid> &ids)
+    {
+        add(ids.size());
+        for (const auto &id: ids)
+            add(id);
+    }
+    quint64 hash() const
+    {
+        return m_hash;
+    }
+private:
+    quint64 m_hash = 0;
+};
+
+static quint64 historyHash(const SkeletonPart &part)
+{
+    HistoryHasher hasher;
+    hasher.add(part.id);
+    hasher.add(part.name);
+    hasher.add(part.visible);
+    hasher.add(part.locked);
+    hasher.add(part.subdived);
+    hasher.add(part.disabled);
+    hasher.add(part.xMirrored);
+    hasher.add(part.zMirrored);
+    hasher.add(part.base);
+    hasher.add(part.rounded);
+    hasher.add(part.chamfered);
+    hasher.add(part.target);
+    hasher.add(part.cutRotation);
+    hasher.add(part.cutFace);
+    hasher.add(part.cutFaceLinkedId);
+    hasher.add(part.fillMeshLinkedId);
+    hasher.add(part.hasColor);
+    hasher.add(part.color.rgba());
+    hasher.add(part.colorSolubility);
+    hasher.add(part.metalness);
+    hasher.add(part.roughness);
+    hasher.add(part.deformThickness);
+    hasher.add(part.deformWidth);
+    hasher.add(part.deformUnified);
+    hasher.add(part.deformMapImageId);
+    hasher.add(part.deformMapScale);
+    hasher.add(part.hollowThickness);
+    hasher.add(part.materialId);
+    hasher.add(part.countershaded);
+    hasher.add(part.smooth);
+    return hasher.hash();
+}
+
+static quint64 historyHash(const SkeletonNode &node)
+{
+    HistoryHasher hasher;
+    hasher.add(node.id);
+    hasher.add(node.name);
+    hasher.add(node.radius);
+    hasher.add(node.getX());
+    hasher.add(node.getY());
+    hasher.add(node.getZ());
+    hasher.add(node.partId);
+    hasher.add(node.boneMark);
+    hasher.add(node.hasCutFaceSettings);
+    hasher.add(node.cutRotation);
+    hasher.add(node.cutFace);
+    hasher.add(node.cutFaceLinkedId);
+    return hasher.hash();
+}
+
+static quint64 historyHash(const SkeletonEdge &edge)
+{
+    HistoryHasher hasher;
+    hasher.add(edge.id);
+    hasher.add(edge.name);
+    hasher.add(edge.partId);
+    hasher.add(edge.nodeIds);
+    return hasher.hash();
+}
+
+static quint64 historyHash(const SkeletonComponent &component)
+{
+    HistoryHasher hasher;
+    hasher.add(component.id);
+    hasher.add(component.name);
+    hasher.add(component.expanded);
+    hasher.add(component.combineMode);
+    hasher.add(component.childrenIds);
+    hasher.add(component.linkToPartId);
+    return hasher.hash();
+}
+
+// Walks the elements and the hashes of the last history state side by side, both are ordered by id
+template <typename T>
+static void stageChangedElements(SnapshotHistory *history, SnapshotHistory::Section section,
+    const std::map<QUuid, T> &elements, std::map<QUuid, quint64> *hashes,
+    std::function<bool (const T &, std::map<QString, QString> *)> serialize)
+{
+    auto stageElement = [&](const T &element) {
+        std::map<QString, QString> attributes;
+        if (serialize(element, &attributes)) {
+            attributes.erase("__dirty");
+            history->stage(section, element.id.toString(), &attributes);
+        } else {
+            history->stage(section, element.id.toString(), nullptr);
+        }
+    };
+    auto hashIt = hashes->begin();
+    for (const auto &it: elements) {
+        while (hashIt != hashes->end() && hashIt->first < it.first) {
+            history->stage(section, hashIt->first.toString(), nullptr);
+            hashIt = hashes->erase(hashIt);
+        }
+        quint64 hash = historyHash(it.second);
+        if (hashIt != hashes->end() && hashIt->first == it.first) {
+            if (hashIt->second != hash) {
+                stageElement(it.second);
+                hashIt->second = hash;
+            }
+            ++hashIt;
+        } else {
+            stageElement(it.second);
+            hashIt = hashes->insert(hashIt, {it.first, hash});
+            ++hashIt;
+        }
+    }
+    while (hashIt != hashes->end()) {
+        history->stage(section, hashIt->first.toString(), nullptr);
+        hashIt = hashes->erase(hashIt);
+    }
 }
 
 void Document::toSnapshot(Snapshot *snapshot, const std::set<QUuid> &limitNodeIds,
@@ -383,90 +673,14 @@ void Document::toSnapshot(Snapshot *snapshot, const std::set<QUuid> &limitNodeId
         for (const auto &partIt : partMap) {
             if (!limitPartIds.empty() && limitPartIds.find(partIt.first) == limitPartIds.end())
                 continue;
-            std::map<QString, QString> part;
-            part["id"] = partIt.second.id.toString();
-            part["visible"] = partIt.second.visible ? "true" : "false";
-            part["locked"] = partIt.second.locked ? "true" : "false";
-            part["subdived"] = partIt.second.subdived ? "true" : "false";
-            part["disabled"] = partIt.second.disabled ? "true" : "false";
-            part["xMirrored"] = partIt.second.xMirrored ? "true" : "false";
-            if (partIt.second.zMirrored)
-                part["zMirrored"] = partIt.second.zMirrored ? "true" : "false";
-            if (partIt.second.base != PartBase::XYZ)
-                part["base"] = PartBaseToString(partIt.second.base);
-            part["rounded"] = partIt.second.rounded ? "true" : "false";
-            part["chamfered"] = partIt.second.chamfered ? "true" : "false";
-            if (PartTarget::Model != partIt.second.target)
-                part["target"] = PartTargetToString(partIt.second.target);
-            if (partIt.second.cutRotationAdjusted())
-                part["cutRotation"] = QString::number(partIt.second.cutRotation);
-            if (partIt.second.cutFaceAdjusted()) {
-                if (CutFace::UserDefined == partIt.second.cutFace) {
-                    if (!partIt.second.cutFaceLinkedId.isNull()) {
-                        part["cutFace"] = partIt.second.cutFaceLinkedId.toString();
-                    }
-                } else {
-                    part["cutFace"] = CutFaceToString(partIt.second.cutFace);
-                }
-            }
-            if (!partIt.second.fillMeshLinkedId.isNull())
-                part["fillMesh"] = partIt.second.fillMeshLinkedId.toString();
-            part["__dirty"] = partIt.second.dirty ? "true" : "false";
-            if (partIt.second.hasColor)
-                part["color"] = partIt.second.color.name(QColor::HexArgb);
-            if (partIt.second.colorSolubilityAdjusted())
-                part["colorSolubility"] = QString::number(partIt.second.colorSolubility);
-            if (partIt.second.metalnessAdjusted())
-                part["metallic"] = QString::number(partIt.second.metalness);
-            if (partIt.second.roughnessAdjusted())
-                part["roughness"] = QString::number(partIt.second.roughness);
-            if (partIt.second.deformThicknessAdjusted())
-                part["deformThickness"] = QString::number(partIt.second.deformThickness);
-            if (partIt.second.deformWidthAdjusted())
-                part["deformWidth"] = QString::number(partIt.second.deformWidth);
-            if (partIt.second.deformUnified)
-                part["deformUnified"] = "true";
-            if (!partIt.second.deformMapImageId.isNull())
-                part["deformMapImageId"] = partIt.second.deformMapImageId.toString();
-            if (partIt.second.deformMapScaleAdjusted())
-                part["deformMapScale"] = QString::number(partIt.second.deformMapScale);
-            if (partIt.second.hollowThicknessAdjusted())
-                part["hollowThickness"] = QString::number(partIt.second.hollowThickness);
-            if (!partIt.second.name.isEmpty())
-                part["name"] = partIt.second.name;
-            if (partIt.second.materialAdjusted())
-                part["materialId"] = partIt.second.materialId.toString();
-            if (partIt.second.countershaded)
-                part["countershaded"] = "true";
-            if (partIt.second.smooth)
-                part["smooth"] = "true";
-            snapshot->parts[part["id"]] = part;
+            auto &part = snapshot->parts[partIt.second.id.toString()];
+            partToSnapshot(partIt.second, &part);
         }
         for (const auto &nodeIt: nodeMap) {
             if (!limitNodeIds.empty() && limitNodeIds.find(nodeIt.first) == limitNodeIds.end())
                 continue;
-            std::map<QString, QString> node;
-            node["id"] = nodeIt.second.id.toString();
-            node["radius"] = QString::number(nodeIt.second.radius);
-            node["x"] = QString::number(nodeIt.second.getX());
-            node["y"] = QString::number(nodeIt.second.getY());
-            node["z"] = QString::number(nodeIt.second.getZ());
-            node["partId"] = nodeIt.second.partId.toString();
-            if (nodeIt.second.boneMark != BoneMark::None)
-                node["boneMark"] = BoneMarkToString(nodeIt.second.boneMark);
-            if (nodeIt.second.hasCutFaceSettings) {
-                node["cutRotation"] = QString::number(nodeIt.second.cutRotation);
-                if (CutFace::UserDefined == nodeIt.second.cutFace) {
-                    if (!nodeIt.second.cutFaceLinkedId.isNull()) {
-                        node["cutFace"] = nodeIt.second.cutFaceLinkedId.toString();
-                    }
-                } else {
-                    node["cutFace"] = CutFaceToString(nodeIt.second.cutFace);
-                }
-            }
-            if (!nodeIt.second.name.isEmpty())
-                node["name"] = nodeIt.second.name;
-            snapshot->nodes[node["id"]] = node;
+            auto &node = snapshot->nodes[nodeIt.second.id.toString()];
+            nodeToSnapshot(nodeIt.second, &node);
         }
         for (const auto &edgeIt: edgeMap) {
             if (edgeIt.second.nodeIds.size() != 2)
@@ -475,40 +689,14 @@ void Document::toSnapshot(Snapshot *snapshot, const std::set<QUuid> &limitNodeId
                     (limitNodeIds.find(edgeIt.second.nodeIds[0]) == limitNodeIds.end() ||
                         limitNodeIds.find(edgeIt.second.nodeIds[1]) == limitNodeIds.end()))
                 continue;
-            std::map<QString, QString> edge;
-            edge["id"] = edgeIt.second.id.toString();
-            edge["from"] = edgeIt.second.nodeIds[0].toString();
-            edge["to"] = edgeIt.second.nodeIds[1].toString();
-            edge["partId"] = edgeIt.second.partId.toString();
-            if (!edgeIt.second.name.isEmpty())
-                edge["name"] = edgeIt.second.name;
-            snapshot->edges[edge["id"]] = edge;
+            auto &edge = snapshot->edges[edgeIt.second.id.toString()];
+            edgeToSnapshot(edgeIt.second, &edge);
         }
         for (const auto &componentIt: componentMap) {
             if (!limitComponentIds.empty() && limitComponentIds.find(componentIt.first) == limitComponentIds.end())
                 continue;
-            std::map<QString, QString> component;
-            component["id"] = componentIt.second.id.toString();
-            if (!componentIt.second.name.isEmpty())
-                component["name"] = componentIt.second.name;
-            component["expanded"] = componentIt.second.expanded ? "true" : "false";
-            component["combineMode"] = CombineModeToString(componentIt.second.combineMode);
-            component["__dirty"] = componentIt.second.dirty ? "true" : "false";
-            QStringList childIdList;
-            for (const auto &childId: componentIt.second.childrenIds) {
-                childIdList.append(childId.toString());
-            }
-            QString children = childIdList.join(",");
-            if (!children.isEmpty())
-                component["children"] = children;
-            QString linkData = componentIt.second.linkData();
-            if (!linkData.isEmpty()) {
-                component["linkData"] = linkData;
-                component["linkDataType"] = componentIt.second.linkDataType();
-            }
-            if (!componentIt.second.name.isEmpty())
-                component["name"] = componentIt.second.name;
-            snapshot->components[component["id"]] = component;
+            auto &component = snapshot->components[componentIt.second.id.toString()];
+            componentToSnapshot(componentIt.second, &component);
         }
         if (limitComponentIds.empty() || limitComponentIds.find(QUuid()) != limitComponentIds.end()) {
             QStringList childIdList;
@@ -568,16 +756,21 @@ void Document::toSnapshot(Snapshot *snapshot, const std::set<QUuid> &limitNodeId
     }
     if (DocumentToSnapshotFor::Document == forWhat) {
         std::map<QString, QString> canvas;
-        canvas["originX"] = QString::number(getOriginX());
-        canvas["originY"] = QString::number(getOriginY());
-        canvas["originZ"] = QString::number(getOriginZ());
-        canvas["rigType"] = RigTypeToString(rigType);
-        if (this->objectLocked)
-            canvas["objectLocked"] = "true";
+        canvasToSnapshot(&canvas);
         snapshot->canvas = canvas;
     }
 }
 
+void Document::canvasToSnapshot(std::map<QString, QString> *canvas) const
+{
+    (*canvas)["originX"] = QString::number(getOriginX());
+    (*canvas)["originY"] = QString::number(getOriginY());
+    (*canvas)["originZ"] = QString::number(getOriginZ());
+    (*canvas)["rigType"] = RigTypeToString(rigType);
+    if (this->objectLocked)
+        (*canvas)["objectLocked"] = "true";
+}
+
 void Document::updateObject(Object *object)
 {
     delete m_postProcessedObject;
@@ -630,7 +823,7 @@ void Document::addFromSnapshot(const Snapshot &snapshot, enum SnapshotSource sou
             continue;
         }
         QUuid oldMaterialId = QUuid(valueOfKeyInMapOrEmpty(materialAttributes, "id"));
-        QUuid newMaterialId = SnapshotSource::Import == source ? oldMaterialId : QUuid::createUuid();
+        QUuid newMaterialId = SnapshotSource::Paste != source ? oldMaterialId : QUuid::createUuid();
         oldNewIdMap[oldMaterialId] = newMaterialId;
         if (materialMap.end() == materialMap.find(newMaterialId)) {
             auto &newMaterial = materialMap[newMaterialId];
@@ -666,8 +859,15 @@ void Document::addFromSnapshot(const Snapshot &snapshot, enum SnapshotSource sou
         }
     }
     std::map<QUuid, QUuid> cutFaceLinkedIdModifyMap;
+    // Whole document loads keep the ids, so the undo history can match elements across restores
+    auto keepOrCreateId = [&](const QUuid &oldId, bool exists) {
+        if (SnapshotSource::Unknown == source && !oldId.isNull() && !exists)
+            return oldId;
+        return QUuid::createUuid();
+    };
     for (const auto &partKv: snapshot.parts) {
-        const auto newUuid = QUuid::createUuid();
+        QUuid oldPartId = QUuid(partKv.first);
+        const auto newUuid = keepOrCreateId(oldPartId, partMap.find(oldPartId) != partMap.end());
         SkeletonPart &part = partMap[newUuid];
         part.id = newUuid;
         oldNewIdMap[QUuid(partKv.first)] = part.id;
@@ -831,7 +1031,9 @@ void Document::addFromSnapshot(const Snapshot &snapshot, enum SnapshotSource sou
     for (const auto &componentKv: snapshot.components) {
         QString linkData = valueOfKeyInMapOrEmpty(componentKv.second, "linkData");
         QString linkDataType = valueOfKeyInMapOrEmpty(componentKv.second, "linkDataType");
-        SkeletonComponent component(QUuid(), linkData, linkDataType);
+        QUuid oldComponentId = QUuid(componentKv.first);
+        SkeletonComponent component(keepOrCreateId(oldComponentId, componentMap.find(oldComponentId) != componentMap.end()),
+            linkData, linkDataType);
         oldNewIdMap[QUuid(componentKv.first)] = component.id;
         component.name = valueOfKeyInMapOrEmpty(componentKv.second, "name");
         component.expanded = isTrueValueString(valueOfKeyInMapOrEmpty(componentKv.second, "expanded"));
@@ -881,7 +1083,7 @@ void Document::addFromSnapshot(const Snapshot &snapshot, enum SnapshotSource sou
     }
     for (const auto &motionKv: snapshot.motions) {
         QUuid oldMotionId = QUuid(motionKv.first);
-        QUuid newMotionId = QUuid::createUuid();
+        QUuid newMotionId = keepOrCreateId(oldMotionId, motionMap.find(oldMotionId) != motionMap.end());
         auto &motion = motionMap[newMotionId];
         motion.id = newMotionId;
         oldNewIdMap[oldMotionId] = motion.id;
@@ -1082,10 +1284,7 @@ void Document::meshReady()
                 if (nullptr != textureNormalImage)
                     model->setNormalMapImage(new QImage(*textureNormalImage));
                 if (nullptr != textureMetalnessImage || nullptr != textureRoughnessImage || nullptr != textureAmbientOcclusionImage) {
-                    model->setMetalnessRoughnessAmbientOcclusionImage(TextureGenerator::combineMetalnessRoughnessAmbientOcclusionImages(
-                        textureMetalnessImage,
-                        textureRoughnessImage,
-                        textureAmbientOcclusionImage));
+                    model->setMetalnessRoughnessAmbientOcclusionImage(new QImage(*textureMetalnessRoughnessAmbientOcclusionImage()));
                     model->setHasMetalnessInImage(nullptr != textureMetalnessImage);
                     model->setHasRoughnessInImage(nullptr != textureRoughnessImage);
                     model->setHasAmbientOcclusionInImage(nullptr != textureAmbientOcclusionImage);
@@ -1200,6 +1399,9 @@ void Document::generateTexture()
     
     QThread *thread = new QThread;
     m_textureGenerator = new TextureGenerator(*m_postProcessedObject, snapshot);
+    if (nullptr == m_textureGeneratedCacheContext)
+        m_textureGeneratedCacheContext = new TextureGeneratedCacheContext;
+    m_textureGenerator->setGeneratedCacheContext(m_textureGeneratedCacheContext);
     m_textureGenerator->moveToThread(thread);
     connect(thread, &QThread::started, m_textureGenerator, &TextureGenerator::process);
     connect(m_textureGenerator, &TextureGenerator::finished, this, &Document::textureReady);
@@ -1215,6 +1417,7 @@ void Document::textureReady()
     updateTextureMetalnessImage(m_textureGenerator->takeResultTextureMetalnessImage());
     updateTextureRoughnessImage(m_textureGenerator->takeResultTextureRoughnessImage());
     updateTextureAmbientOcclusionImage(m_textureGenerator->takeResultTextureAmbientOcclusionImage());
+    updateTextureMetalnessRoughnessAmbientOcclusionImage(m_textureGenerator->takeResultTextureMetalnessRoughnessAmbientOcclusionImage());
     
     delete m_resultTextureMesh;
     m_resultTextureMesh = m_textureGenerator->takeResultMesh();
@@ -1260,6 +1463,9 @@ void Document::postProcess()
 
     QThread *thread = new QThread;
     m_postProcessor = new MeshResultPostProcessor(*m_currentObject);
+    if (nullptr == m_uvUnwrapCacheContext)
+        m_uvUnwrapCacheContext = new UvUnwrapCacheContext;
+    m_postProcessor->setUvUnwrapCacheContext(m_uvUnwrapCacheContext);
     m_postProcessor->moveToThread(thread);
     connect(thread, &QThread::started, m_postProcessor, &MeshResultPostProcessor::process);
     connect(m_postProcessor, &MeshResultPostProcessor::finished, this, &Document::postProcessedMeshResultReady);
@@ -1290,17 +1496,18 @@ void Document::pickMouseTarget(const QVector3D &nearPosition, const QVector3D &f
     m_mouseRayNear = nearPosition;
     m_mouseRayFar = farPosition;
     
+    // Outside of painting only the latest ray matters, while painting every queued ray becomes a dab of the next stroke job
+    if (SkeletonDocumentEditMode::Paint != editMode || PaintMode::None == m_paintMode)
+        m_pendingPaintStrokes.clear();
+    m_pendingPaintStrokes.push_back({nearPosition, farPosition});
+    
     paint();
 }
 
 void Document::paint()
 {
-    if (nullptr != m_texturePainter) {
-        m_isMouseTargetResultObsolete = true;
+    if (nullptr != m_texturePainter)
         return;
-    }
-    
-    m_isMouseTargetResultObsolete = false;
     
     if (!m_postProcessedObject) {
         qDebug() << "Model is null";
@@ -1310,10 +1517,14 @@ void Document::paint()
     if (nullptr == textureImage)
         return;
     
+    if (m_pendingPaintStrokes.empty())
+        return;
+    
     //qDebug() << "Mouse picking..";
 
     QThread *thread = new QThread;
-    m_texturePainter = new TexturePainter(m_mouseRayNear, m_mouseRayFar);
+    m_texturePainter = new TexturePainter(m_pendingPaintStrokes);
+    m_pendingPaintStrokes.clear();
     if (nullptr == m_texturePainterContext) {
         m_texturePainterContext = new TexturePainterContext;
         m_texturePainterContext->object = new Object(*m_postProcessedObject);
@@ -1321,6 +1532,8 @@ void Document::paint()
     } else if (m_texturePainterContext->object->meshId != m_postProcessedObject->meshId) {
         delete m_texturePainterContext->object;
         m_texturePainterContext->object = new Object(*m_postProcessedObject);
+        delete m_texturePainterContext->triangleBvh;
+        m_texturePainterContext->triangleBvh = nullptr;
         delete m_texturePainterContext->colorImage;
         m_texturePainterContext->colorImage = new QImage(*textureImage);
     }
@@ -1343,10 +1556,18 @@ void Document::paintReady()
 {
     m_mouseTargetPosition = m_texturePainter->targetPosition();
     
-    QImage *paintedTextureImage = m_texturePainter->takeColorImage();
-    if (nullptr != paintedTextureImage) {
-        updateTextureImage(paintedTextureImage);
-        emit resultColorTextureChanged();
+    QImage *dirtyColorImage = m_texturePainter->takeDirtyColorImage();
+    if (nullptr != dirtyColorImage) {
+        QRect dirtyRect = m_texturePainter->dirtyRect();
+        {
+            QPainter painter(textureImage);
+            painter.setCompositionMode(QPainter::CompositionMode_Source);
+            painter.drawImage(dirtyRect.topLeft(), *dirtyColorImage);
+        }
+        delete dirtyColorImage;
+        delete textureImageByteArray;
+        textureImageByteArray = nullptr;
+        emit resultColorTextureChanged(dirtyRect);
         emit optionsChanged();
     }
     
@@ -1355,9 +1576,7 @@ void Document::paintReady()
     
     emit mouseTargetChanged();
 
-    if (m_isMouseTargetResultObsolete) {
-        pickMouseTarget(m_mouseRayNear, m_mouseRayFar);
-    }
+    paint();
 }
 
 const QVector3D &Document::mouseTargetPosition() const
@@ -1757,43 +1976,94 @@ void Document::setPartColorState(QUuid partId, bool hasColor, QColor color)
     emit skeletonChanged();
 }
 
+void Document::stageHistory()
+{
+    stageChangedElements<SkeletonNode>(&m_history, SnapshotHistory::Section::Node, nodeMap, &m_historyNodeHashes,
+        [](const SkeletonNode &node, std::map<QString, QString> *attributes) {
+            nodeToSnapshot(node, attributes);
+            return true;
+        });
+    stageChangedElements<SkeletonEdge>(&m_history, SnapshotHistory::Section::Edge, edgeMap, &m_historyEdgeHashes,
+        [](const SkeletonEdge &edge, std::map<QString, QString> *attributes) {
+            if (edge.nodeIds.size() != 2)
+                return false;
+            edgeToSnapshot(edge, attributes);
+            return true;
+        });
+    stageChangedElements<SkeletonPart>(&m_history, SnapshotHistory::Section::Part, partMap, &m_historyPartHashes,
+        [](const SkeletonPart &part, std::map<QString, QString> *attributes) {
+            partToSnapshot(part, attributes);
+            return true;
+        });
+    stageChangedElements<SkeletonComponent>(&m_history, SnapshotHistory::Section::Component, componentMap, &m_historyComponentHashes,
+        [](const SkeletonComponent &component, std::map<QString, QString> *attributes) {
+            componentToSnapshot(component, attributes);
+            return true;
+        });
+    
+    std::map<QString, QString> rootComponentAttributes;
+    QStringList childIdList;
+    for (const auto &childId: rootComponent.childrenIds) {
+        childIdList.append(childId.toString());
+    }
+    QString children = childIdList.join(",");
+    if (!children.isEmpty())
+        rootComponentAttributes["children"] = children;
+    m_history.stage(SnapshotHistory::Section::RootComponent, "root", &rootComponentAttributes);
+    
+    std::map<QString, QString> canvas;
+    canvasToSnapshot(&canvas);
+    m_history.stage(SnapshotHistory::Section::Canvas, "canvas", &canvas);
+    
+    Snapshot materialsAndMotions;
+    toSnapshot(&materialsAndMotions, std::set<QUuid>(), DocumentToSnapshotFor::Materials);
+    toSnapshot(&materialsAndMotions, std::set<QUuid>(), DocumentToSnapshotFor::Motions);
+    m_history.stageMaterials(materialsAndMotions.materials);
+    m_history.stageAll(SnapshotHistory::Section::Motion, materialsAndMotions.motions);
+}
+
 void Document::saveSnapshot()
 {
-    HistoryItem item;
-    QElapsedTimer elapsedTimer;
-    elapsedTimer.start();
-    toSnapshot(&item.snapshot);
-    if (m_undoItems.size() + 1 > m_maxSnapshot)
-        m_undoItems.pop_front();
-    m_undoItems.push_back(item);
+    stageHistory();
+    m_history.commit();
+}
+
+void Document::restoreFromHistory()
+{
+    Snapshot snapshot;
+    m_history.toSnapshot(&snapshot);
+    fromSnapshot(snapshot);
+    
+    // Rehash the rebuilt document, it normally serializes back to the very same state
+    m_historyNodeHashes.clear();
+    m_historyEdgeHashes.clear();
+    m_historyPartHashes.clear();
+    m_historyComponentHashes.clear();
+    stageHistory();
+    m_history.settle();
 }
 
 void Document::undo()
 {
-    if (!undoable())
+    if (!m_history.undo())
         return;
-    m_redoItems.push_back(m_undoItems.back());
-    m_undoItems.pop_back();
-    const auto &item = m_undoItems.back();
-    fromSnapshot(item.snapshot);
-    qDebug() << "Undo/Redo items:" << m_undoItems.size() << m_redoItems.size();
+    restoreFromHistory();
 }
 
 void Document::redo()
 {
-    if (m_redoItems.empty())
+    if (!m_history.redo())
         return;
-    m_undoItems.push_back(m_redoItems.back());
-    const auto &item = m_redoItems.back();
-    fromSnapshot(item.snapshot);
-    m_redoItems.pop_back();
-    qDebug() << "Undo/Redo items:" << m_undoItems.size() << m_redoItems.size();
+    restoreFromHistory();
 }
 
 void Document::clearHistories()
 {
-    m_undoItems.clear();
-    m_redoItems.clear();
+    m_history.clear();
+    m_historyNodeHashes.clear();
+    m_historyEdgeHashes.clear();
+    m_historyPartHashes.clear();
+    m_historyComponentHashes.clear();
 }
 
 void Document::paste()
@@ -1844,12 +2114,12 @@ bool Document::hasPastableMotionsInClipboard() const
 
 bool Document::undoable() const
 {
-    return m_undoItems.size() >= 2;
+    return m_history.undoable();
 }
 
 bool Document::redoable() const
 {
-    return !m_redoItems.empty();
+    return m_history.redoable();
 }
 
 bool Document::isNodeEditable(QUuid nodeId) const
@@ -2065,7 +2335,7 @@ void Document::motionsReady()
         if (motion != motionMap.end()) {
             auto resultPreviewMesh = m_motionsGenerator->takeResultSnapshotMesh(motionId);
             motion->second.updatePreviewMesh(resultPreviewMesh);
-            motion->second.jointNodeTrees = m_motionsGenerator->takeResultJointNodeTrees(motionId);
+            motion->second.motionClip = m_motionsGenerator->takeResultMotionClip(motionId);
             emit motionPreviewChanged(motionId);
             emit motionResultChanged(motionId);
         }
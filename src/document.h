@@ -11,6 +11,7 @@
 #include <algorithm>
 #include <QPolygon>
 #include "snapshot.h"
+#include "snapshothistory.h"
 #include "model.h"
 #include "theme.h"
 #include "texturegenerator.h"
@@ -20,6 +21,7 @@
 #include "rigtype.h"
 #include "texturetype.h"
 #include "jointnodetree.h"
+#include "motionclip.h"
 #include "skeletondocument.h"
 #include "combinemode.h"
 #include "preferences.h"
@@ -33,12 +35,8 @@ class MotionsGenerator;
 class ScriptRunner;
 class MeshGenerator;
 class GeneratedCacheContext;
-
-class HistoryItem
-{
-public:
-    Snapshot snapshot;
-};
+class TextureGeneratedCacheContext;
+class UvUnwrapCacheContext;
 
 class Motion
 {
@@ -54,7 +52,7 @@ public:
     QString name;
     bool dirty = true;
     std::map<QString, QString> parameters;
-    std::vector<std::pair<float, JointNodeTree>> jointNodeTrees;
+    MotionClip motionClip;
     void updatePreviewMesh(Model *mesh)
     {
         delete m_previewMesh;
@@ -126,7 +124,7 @@ signals:
     void paintModeChanged();
     //void resultSkeletonChanged();
     void resultTextureChanged();
-    void resultColorTextureChanged();
+    void resultColorTextureChanged(const QRect &changedRect);
     //void resultBakedTextureChanged();
     void postProcessedResultChanged();
     void resultRigChanged();
@@ -252,6 +250,8 @@ public:
     void updateTextureMetalnessImage(QImage *image);
     void updateTextureRoughnessImage(QImage *image);
     void updateTextureAmbientOcclusionImage(QImage *image);
+    void updateTextureMetalnessRoughnessAmbientOcclusionImage(QImage *image);
+    const QImage *textureMetalnessRoughnessAmbientOcclusionImage();
     bool hasPastableMaterialsInClipboard() const;
     bool hasPastableMotionsInClipboard() const;
     const Object &currentPostProcessedObject() const;
@@ -362,6 +362,9 @@ private:
     void checkExportReadyState();
     void removeRigResults();
     bool updateDefaultVariables(const std::map<QString, std::map<QString, QString>> &defaultVariables);
+    void canvasToSnapshot(std::map<QString, QString> *canvas) const;
+    void stageHistory();
+    void restoreFromHistory();
 private:
     bool m_isResultMeshObsolete = false;
     MeshGenerator *m_meshGenerator = nullptr;
@@ -395,18 +398,24 @@ private:
     ScriptRunner *m_scriptRunner = nullptr;
     bool m_isScriptResultObsolete = false;
     TexturePainter *m_texturePainter = nullptr;
-    bool m_isMouseTargetResultObsolete = false;
     PaintMode m_paintMode = PaintMode::None;
     float m_mousePickRadius = 0.02f;
     GeneratedCacheContext *m_generatedCacheContext = nullptr;
+    TextureGeneratedCacheContext *m_textureGeneratedCacheContext = nullptr;
+    UvUnwrapCacheContext *m_uvUnwrapCacheContext = nullptr;
+    QImage *m_textureMetalnessRoughnessAmbientOcclusionImage = nullptr;
     TexturePainterContext *m_texturePainterContext = nullptr;
 private:
     static unsigned long m_maxSnapshot;
-    std::deque<HistoryItem> m_undoItems;
-    std::deque<HistoryItem> m_redoItems;
+    SnapshotHistory m_history = SnapshotHistory(m_maxSnapshot - 1);
+    std::map<QUuid, quint64> m_historyNodeHashes;
+    std::map<QUuid, quint64> m_historyEdgeHashes;
+    std::map<QUuid, quint64> m_historyPartHashes;
+    std::map<QUuid, quint64> m_historyComponentHashes;
     std::vector<std::pair<QtMsgType, QString>> m_resultRigMessages;
     QVector3D m_mouseRayNear;
     QVector3D m_mouseRayFar;
+    std::vector<TexturePainterStroke> m_pendingPaintStrokes;
     QVector3D m_mouseTargetPosition;
     QString m_scriptError;
     QString m_scriptConsoleLog;
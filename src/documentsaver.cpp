@@ -2,28 +2,72 @@
 #include <set>
 #include <QGuiApplication>
 #include <QtCore/qbuffer.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include "documentsaver.h"
 #include "imageforever.h"
 #include "ds3file.h"
 #include "snapshotxml.h"
+#include "snapshotbinary.h"
 #include "variablesxml.h"
 #include "fileforever.h"
 #include "objectXml.h"
 
+namespace
+{
+
+struct TextureItem
+{
+    const QImage *image;
+    QByteArray **byteArray;
+    QString name;
+};
+
+class AssetEncoder
+{
+public:
+    AssetEncoder(std::vector<TextureItem> *textureItems) :
+        m_textureItems(textureItems)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+            TextureItem &textureItem = (*m_textureItems)[i];
+            if (nullptr == textureItem.image || textureItem.image->isNull() ||
+                    nullptr != *textureItem.byteArray)
+                continue;
+            QByteArray *byteArray = new QByteArray;
+            QBuffer pngBuffer(byteArray);
+            pngBuffer.open(QIODevice::WriteOnly);
+            textureItem.image->save(&pngBuffer, "PNG");
+            *textureItem.byteArray = byteArray;
+        }
+    }
+private:
+    std::vector<TextureItem> *m_textureItems = nullptr;
+};
+
+}
+
 DocumentSaver::DocumentSaver(const QString *filename, 
         Snapshot *snapshot,
         Object *object,
         DocumentSaver::Textures *textures,
         QByteArray *turnaroundPngByteArray,
         QString *script,
-        std::map<QString, std::map<QString, QString>> *variables) :
+        std::map<QString, std::map<QString, QString>> *variables,
+        bool binarySnapshot,
+        bool compressed) :
     m_filename(filename),
     m_snapshot(snapshot),
     m_object(object),
     m_textures(textures),
     m_turnaroundPngByteArray(turnaroundPngByteArray),
     m_script(script),
-    m_variables(variables)
+    m_variables(variables),
+    m_binarySnapshot(binarySnapshot),
+    m_compressed(compressed)
 {
 }
 
@@ -45,7 +89,9 @@ void DocumentSaver::process()
         m_textures,
         m_turnaroundPngByteArray,
         m_script,
-        m_variables);
+        m_variables,
+        m_binarySnapshot,
+        m_compressed);
     emit finished();
 }
 
@@ -84,9 +130,8 @@ void DocumentSaver::collectUsedResourceIds(const Snapshot *snapshot,
         const QByteArray *byteArray = FileForever::getContent(fileId);
         if (nullptr == byteArray)
             continue;
-        QXmlStreamReader stream(*byteArray);
         Snapshot fileSnapshot;
-        loadSkeletonFromXmlStream(&fileSnapshot, stream, SNAPSHOT_ITEM_CANVAS | SNAPSHOT_ITEM_COMPONENT);
+        loadSkeletonFromByteArray(&fileSnapshot, *byteArray, SNAPSHOT_ITEM_CANVAS | SNAPSHOT_ITEM_COMPONENT);
         collectUsedResourceIds(&fileSnapshot, imageIds, fileIds);
     }
 }
@@ -97,16 +142,24 @@ bool DocumentSaver::save(const QString *filename,
         Textures *textures,
         const QByteArray *turnaroundPngByteArray,
         const QString *script,
-        const std::map<QString, std::map<QString, QString>> *variables)
+        const std::map<QString, std::map<QString, QString>> *variables,
+        bool binarySnapshot,
+        bool compressed)
 {
+    // Compressed items can't be read by older builds, so compression is only used when asked for
     Ds3FileWriter ds3Writer;
     
-    {
+    if (binarySnapshot) {
+        QByteArray modelBinary;
+        saveSkeletonToBinary(snapshot, &modelBinary);
+        if (modelBinary.size() > 0)
+            ds3Writer.add("model.bin", "model", &modelBinary, compressed);
+    } else {
         QByteArray modelXml;
         QXmlStreamWriter stream(&modelXml);
         saveSkeletonToXmlStream(snapshot, &stream);
         if (modelXml.size() > 0)
-            ds3Writer.add("model.xml", "model", &modelXml);
+            ds3Writer.add("model.xml", "model", &modelXml, compressed);
     }
     
     if (nullptr != object) {
@@ -114,60 +167,30 @@ bool DocumentSaver::save(const QString *filename,
         QXmlStreamWriter stream(&objectXml);
         saveObjectToXmlStream(object, &stream);
         if (objectXml.size() > 0)
-            ds3Writer.add("object.xml", "object", &objectXml);
+            ds3Writer.add("object.xml", "object", &objectXml, compressed);
     }
     
+    std::vector<TextureItem> textureItems;
     if (nullptr != object && nullptr != textures) {
-        if (nullptr != textures->textureImage && !textures->textureImage->isNull()) {
-            if (nullptr == textures->textureImageByteArray) {
-                textures->textureImageByteArray = new QByteArray;
-                QBuffer pngBuffer(textures->textureImageByteArray);
-                pngBuffer.open(QIODevice::WriteOnly);
-                textures->textureImage->save(&pngBuffer, "PNG");
-            }
-            if (textures->textureImageByteArray->size() > 0)
-                ds3Writer.add("object_color.png", "asset", textures->textureImageByteArray);
-        }
-        if (nullptr != textures->textureNormalImage && !textures->textureNormalImage->isNull()) {
-            if (nullptr == textures->textureNormalImageByteArray) {
-                textures->textureNormalImageByteArray = new QByteArray;
-                QBuffer pngBuffer(textures->textureNormalImageByteArray);
-                pngBuffer.open(QIODevice::WriteOnly);
-                textures->textureNormalImage->save(&pngBuffer, "PNG");
-            }
-            if (textures->textureNormalImageByteArray->size() > 0)
-                ds3Writer.add("object_normal.png", "asset", textures->textureNormalImageByteArray);
-        }
-        if (nullptr != textures->textureMetalnessImage && !textures->textureMetalnessImage->isNull()) {
-            if (nullptr == textures->textureMetalnessImageByteArray) {
-                textures->textureMetalnessImageByteArray = new QByteArray;
-                QBuffer pngBuffer(textures->textureMetalnessImageByteArray);
-                pngBuffer.open(QIODevice::WriteOnly);
-                textures->textureMetalnessImage->save(&pngBuffer, "PNG");
-            }
-            if (textures->textureMetalnessImageByteArray->size() > 0)
-                ds3Writer.add("object_metallic.png", "asset", textures->textureMetalnessImageByteArray);
-        }
-        if (nullptr != textures->textureRoughnessImage && !textures->textureRoughnessImage->isNull()) {
-            if (nullptr == textures->textureRoughnessImageByteArray) {
-                textures->textureRoughnessImageByteArray = new QByteArray;
-                QBuffer pngBuffer(textures->textureRoughnessImageByteArray);
-                pngBuffer.open(QIODevice::WriteOnly);
-                textures->textureRoughnessImage->save(&pngBuffer, "PNG");
-            }
-            if (textures->textureRoughnessImageByteArray->size() > 0)
-                ds3Writer.add("object_roughness.png", "asset", textures->textureRoughnessImageByteArray);
-        }
-        if (nullptr != textures->textureAmbientOcclusionImage && !textures->textureAmbientOcclusionImage->isNull()) {
-            if (nullptr == textures->textureAmbientOcclusionImageByteArray) {
-                textures->textureAmbientOcclusionImageByteArray = new QByteArray;
-                QBuffer pngBuffer(textures->textureAmbientOcclusionImageByteArray);
-                pngBuffer.open(QIODevice::WriteOnly);
-                textures->textureAmbientOcclusionImage->save(&pngBuffer, "PNG");
-            }
-            if (textures->textureAmbientOcclusionImageByteArray->size() > 0)
-                ds3Writer.add("object_ao.png", "asset", textures->textureAmbientOcclusionImageByteArray);
-        }
+        textureItems = {
+            {textures->textureImage, &textures->textureImageByteArray, "object_color.png"},
+            {textures->textureNormalImage, &textures->textureNormalImageByteArray, "object_normal.png"},
+            {textures->textureMetalnessImage, &textures->textureMetalnessImageByteArray, "object_metallic.png"},
+            {textures->textureRoughnessImage, &textures->textureRoughnessImageByteArray, "object_roughness.png"},
+            {textures->textureAmbientOcclusionImage, &textures->textureAmbientOcclusionImageByteArray, "object_ao.png"}
+        };
+    }
+    
+    std::set<QUuid> imageIds;
+    std::set<QUuid> fileIds;
+    collectUsedResourceIds(snapshot, imageIds, fileIds);
+    
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, textureItems.size()),
+        AssetEncoder(&textureItems));
+    
+    for (const auto &textureItem: textureItems) {
+        if (nullptr != *textureItem.byteArray && (*textureItem.byteArray)->size() > 0)
+            ds3Writer.add(textureItem.name, "asset", *textureItem.byteArray);
     }
     
     if (nullptr != turnaroundPngByteArray && turnaroundPngByteArray->size() > 0)
@@ -175,7 +198,7 @@ bool DocumentSaver::save(const QString *filename,
     
     if (nullptr != script && !script->isEmpty()) {
         auto scriptByteArray = script->toUtf8();
-        ds3Writer.add("model.js", "script", &scriptByteArray);
+        ds3Writer.add("model.js", "script", &scriptByteArray, compressed);
     }
     
     if (nullptr != variables && !variables->empty()) {
@@ -183,13 +206,9 @@ bool DocumentSaver::save(const QString *filename,
         QXmlStreamWriter variablesXmlStream(&variablesXml);
         saveVariablesToXmlStream(*variables, &variablesXmlStream);
         if (variablesXml.size() > 0)
-            ds3Writer.add("variables.xml", "variable", &variablesXml);
+            ds3Writer.add("variables.xml", "variable", &variablesXml, compressed);
     }
     
-    std::set<QUuid> imageIds;
-    std::set<QUuid> fileIds;
-    collectUsedResourceIds(snapshot, imageIds, fileIds);
-
     for (const auto &imageId: imageIds) {
         const QByteArray *pngByteArray = ImageForever::getPngByteArray(imageId);
         if (nullptr == pngByteArray)
@@ -210,7 +229,7 @@ bool DocumentSaver::save(const QString *filename,
                 suffix = name->mid(suffixBegin);
         }
         if (byteArray->size() > 0)
-            ds3Writer.add("files/" + fileId.toString() + suffix, "asset", byteArray);
+            ds3Writer.add("files/" + fileId.toString() + suffix, "asset", byteArray, compressed);
     }
     
     return ds3Writer.save(*filename);
@@ -48,7 +48,9 @@ public:
         Textures *textures,
         QByteArray *turnaroundPngByteArray,
         QString *script,
-        std::map<QString, std::map<QString, QString>> *variables);
+        std::map<QString, std::map<QString, QString>> *variables,
+        bool binarySnapshot=false,
+        bool compressed=false);
     ~DocumentSaver();
     static bool save(const QString *filename, 
         Snapshot *snapshot,
@@ -56,7 +58,9 @@ public:
         Textures *textures,
         const QByteArray *turnaroundPngByteArray,
         const QString *script,
-        const std::map<QString, std::map<QString, QString>> *variables);
+        const std::map<QString, std::map<QString, QString>> *variables,
+        bool binarySnapshot=false,
+        bool compressed=false);
     static void collectUsedResourceIds(const Snapshot *snapshot,
         std::set<QUuid> &imageIds,
         std::set<QUuid> &fileIds);
@@ -72,6 +76,8 @@ private:
     QByteArray *m_turnaroundPngByteArray = nullptr;
     QString *m_script = nullptr;
     std::map<QString, std::map<QString, QString>> *m_variables = nullptr;
+    bool m_binarySnapshot = false;
+    bool m_compressed = false;
 };
 
 #endif
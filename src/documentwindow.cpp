@@ -28,6 +28,7 @@
 #include "ds3file.h"
 #include "snapshot.h"
 #include "snapshotxml.h"
+#include "snapshotbinary.h"
 #include "logbrowser.h"
 #include "util.h"
 #include "aboutwidget.h"
@@ -46,6 +47,7 @@
 #include "variablesxml.h"
 #include "updatescheckwidget.h"
 #include "modeloffscreenrender.h"
+#include "modelsoftwarerender.h"
 #include "fileforever.h"
 #include "documentsaver.h"
 #include "objectxml.h"
@@ -368,6 +370,7 @@ DocumentWindow::DocumentWindow()
     if (!Preferences::instance().toonShading())
 		m_modelRenderWidget->toggleWireframe();
     m_modelRenderWidget->enableEnvironmentLight();
+    m_modelRenderWidget->enableToonMaps(true);
     m_modelRenderWidget->disableCullFace();
     m_modelRenderWidget->setEyePosition(QVector3D(0.0, 0.0, -4.0));
     m_modelRenderWidget->setMoveToPosition(QVector3D(-0.5, -0.5, 0.0));
@@ -403,7 +406,6 @@ DocumentWindow::DocumentWindow()
         m_modelRenderWidget->setMousePickTargetPositionInModelSpace(m_document->mouseTargetPosition());
     });
     
-    connect(m_modelRenderWidget, &ModelWidget::renderParametersChanged, this, &DocumentWindow::delayedGenerateNormalAndDepthMaps);
     
     m_shapeGraphicsWidget->setModelWidget(m_modelRenderWidget);
     m_boneGraphicsWidget->setModelWidget(m_modelRenderWidget);
@@ -1093,9 +1095,9 @@ DocumentWindow::DocumentWindow()
             resultTextureMesh->removeColor();
         m_modelRenderWidget->updateMesh(resultTextureMesh);
     });
-    connect(m_document, &Document::resultColorTextureChanged, [=]() {
+    connect(m_document, &Document::resultColorTextureChanged, [=](const QRect &changedRect) {
         if (nullptr != m_document->textureImage)
-            m_modelRenderWidget->updateColorTexture(new QImage(*m_document->textureImage));
+            m_modelRenderWidget->updateColorTextureRect(new QImage(m_document->textureImage->copy(changedRect)), changedRect);
     });
     
     connect(m_document, &Document::resultMeshChanged, [=]() {
@@ -1468,7 +1470,9 @@ void DocumentWindow::saveTo(const QString &saveAsFilename)
             (!m_document->turnaround.isNull() && m_document->turnaroundPngByteArray.size() > 0) ? 
                 &m_document->turnaroundPngByteArray : nullptr,
             (!m_document->script().isEmpty()) ? &m_document->script() : nullptr,
-            (!m_document->variables().empty()) ? &m_document->variables() : nullptr)) {
+            (!m_document->variables().empty()) ? &m_document->variables() : nullptr,
+            Preferences::instance().binarySnapshot(),
+            Preferences::instance().compressedDocument())) {
         setCurrentFilename(filename);
     }
     if (saveObject) {
@@ -1522,8 +1526,7 @@ void DocumentWindow::importPath(const QString &path)
                 if (!imageId.isNull()) {
                     QByteArray data;
                     ds3Reader.loadItem(item.name, &data);
-                    QImage image = QImage::fromData(data, "PNG");
-                    (void)ImageForever::add(&image, imageId);
+                    (void)ImageForever::addPng(data, imageId);
                 }
             }
         }
@@ -1535,20 +1538,18 @@ void DocumentWindow::importPath(const QString &path)
             {
                 QByteArray data;
                 ds3Reader.loadItem(item.name, &data);
-                QXmlStreamReader stream(data);
             
                 Snapshot snapshot;
-                loadSkeletonFromXmlStream(&snapshot, stream, SNAPSHOT_ITEM_MATERIAL);
+                loadSkeletonFromByteArray(&snapshot, data, SNAPSHOT_ITEM_MATERIAL);
                 m_document->addFromSnapshot(snapshot, Document::SnapshotSource::Import);
                 documentChanged = true;
             }
             {
                 QByteArray data;
                 ds3Reader.loadItem(item.name, &data);
-                QXmlStreamReader stream(data);
                 
                 Snapshot snapshot;
-                loadSkeletonFromXmlStream(&snapshot, stream, SNAPSHOT_ITEM_CANVAS | SNAPSHOT_ITEM_COMPONENT);
+                loadSkeletonFromByteArray(&snapshot, data, SNAPSHOT_ITEM_CANVAS | SNAPSHOT_ITEM_COMPONENT);
 
                 QByteArray modelXml;
                 QXmlStreamWriter modelStream(&modelXml);
@@ -1645,6 +1646,8 @@ void DocumentWindow::openPathAs(const QString &path, const QString &asName)
         m_document->saveSnapshot();
     } else {
         Ds3FileReader ds3Reader(path);
+        std::vector<QString> fileNames;
+        std::vector<QUuid> fileIds;
         
         for (int i = 0; i < ds3Reader.items().size(); ++i) {
             Ds3ReaderItem item = ds3Reader.items().at(i);
@@ -1656,30 +1659,34 @@ void DocumentWindow::openPathAs(const QString &path, const QString &asName)
                     if (!imageId.isNull()) {
                         QByteArray data;
                         ds3Reader.loadItem(item.name, &data);
-                        QImage image = QImage::fromData(data, "PNG");
-                        (void)ImageForever::add(&image, imageId);
+                        (void)ImageForever::addPng(data, imageId);
                     }
                 } else if (item.name.startsWith("files/")) {
                     QString filename = item.name.split("/")[1];
                     QString fileIdString = filename.split(".")[0];
                     QUuid fileId = QUuid(fileIdString);
                     if (!fileId.isNull()) {
-                        QByteArray data;
-                        ds3Reader.loadItem(item.name, &data);
-                        (void)FileForever::add(item.name, data, fileId);
+                        fileNames.push_back(item.name);
+                        fileIds.push_back(fileId);
                     }
                 }
             }
         }
         
+        std::vector<QByteArray> fileContents;
+        ds3Reader.loadItems(fileNames, &fileContents);
+        for (size_t i = 0; i < fileNames.size(); ++i) {
+            const QByteArray &data = fileContents[i];
+            (void)FileForever::add(fileNames[i], QByteArray(data.constData(), data.size()), fileIds[i]);
+        }
+        
         for (int i = 0; i < ds3Reader.items().size(); ++i) {
             Ds3ReaderItem item = ds3Reader.items().at(i);
             if (item.type == "model") {
                 QByteArray data;
                 ds3Reader.loadItem(item.name, &data);
-                QXmlStreamReader stream(data);
                 Snapshot snapshot;
-                loadSkeletonFromXmlStream(&snapshot, stream);
+                loadSkeletonFromByteArray(&snapshot, data);
                 m_document->fromSnapshot(snapshot);
                 m_document->saveSnapshot();
             } else if (item.type == "asset") {
@@ -1712,7 +1719,7 @@ void DocumentWindow::openPathAs(const QString &path, const QString &asName)
                 if (item.name == "model.js") {
                     QByteArray script;
                     ds3Reader.loadItem(item.name, &script);
-                    m_document->initScript(QString::fromUtf8(script.constData()));
+                    m_document->initScript(QString::fromUtf8(script.constData(), script.size()));
                 }
             } else if (item.type == "variable") {
                 if (item.name == "variables.xml") {
@@ -1886,9 +1893,9 @@ void DocumentWindow::exportFbxToFilename(const QString &filename)
     }
     QApplication::setOverrideCursor(Qt::WaitCursor);
     Object skeletonResult = m_document->currentPostProcessedObject();
-    std::vector<std::pair<QString, std::vector<std::pair<float, JointNodeTree>>>> exportMotions;
+    std::vector<std::pair<QString, MotionClip>> exportMotions;
     for (const auto &motionIt: m_document->motionMap) {
-        exportMotions.push_back({motionIt.second.name, motionIt.second.jointNodeTrees});
+        exportMotions.push_back({motionIt.second.name, motionIt.second.motionClip});
     }
     FbxFileWriter fbxFileWriter(skeletonResult, m_document->resultRigBones(), m_document->resultRigWeights(), filename,
         m_document->textureImage,
@@ -1931,18 +1938,14 @@ void DocumentWindow::exportGlbToFilename(const QString &filename)
     }
     QApplication::setOverrideCursor(Qt::WaitCursor);
     Object skeletonResult = m_document->currentPostProcessedObject();
-    std::vector<std::pair<QString, std::vector<std::pair<float, JointNodeTree>>>> exportMotions;
+    std::vector<std::pair<QString, MotionClip>> exportMotions;
     for (const auto &motionIt: m_document->motionMap) {
-        exportMotions.push_back({motionIt.second.name, motionIt.second.jointNodeTrees});
+        exportMotions.push_back({motionIt.second.name, motionIt.second.motionClip});
     }
-    QImage *textureMetalnessRoughnessAmbientOcclusionImage = 
-        TextureGenerator::combineMetalnessRoughnessAmbientOcclusionImages(m_document->textureMetalnessImage,
-            m_document->textureRoughnessImage,
-            m_document->textureAmbientOcclusionImage);
+    const QImage *textureMetalnessRoughnessAmbientOcclusionImage = m_document->textureMetalnessRoughnessAmbientOcclusionImage();
     GlbFileWriter glbFileWriter(skeletonResult, m_document->resultRigBones(), m_document->resultRigWeights(), filename,
         m_document->textureImage, m_document->textureNormalImage, textureMetalnessRoughnessAmbientOcclusionImage, exportMotions.empty() ? nullptr : &exportMotions);
     glbFileWriter.save();
-    delete textureMetalnessRoughnessAmbientOcclusionImage;
     QApplication::restoreOverrideCursor();
 }
 
@@ -1985,20 +1988,21 @@ void DocumentWindow::exportDs3objToFilename(const QString &filename)
                 writer->writeStartElement("motion");
                     writer->writeAttribute("name", motionIt.second.name);
                     writer->writeStartElement("frames");
-                        for (const auto &it: motionIt.second.jointNodeTrees) {
+                        const auto &motionClip = motionIt.second.motionClip;
+                        for (size_t frameIndex = 0; frameIndex < motionClip.frameCount(); ++frameIndex) {
                             writer->writeStartElement("frame");
-                                writer->writeAttribute("duration", QString::number(it.first));
+                                writer->writeAttribute("duration", QString::number(motionClip.frameDuration(frameIndex)));
                                 writer->writeStartElement("bones");
-                                    const auto &nodes = it.second.nodes();
-                                    for (size_t boneIndex = 0; boneIndex < nodes.size(); ++boneIndex) {
-                                        const auto &node = nodes[boneIndex];
+                                    for (size_t boneIndex = 0; boneIndex < motionClip.boneCount(); ++boneIndex) {
+                                        const auto &translation = motionClip.translation(boneIndex, frameIndex);
+                                        const auto &rotation = motionClip.rotation(boneIndex, frameIndex);
                                         writer->writeStartElement("bone");
                                         writer->writeAttribute("index", QString::number(boneIndex));
                                         {
                                             QMatrix4x4 translationMatrix;
-                                            translationMatrix.translate(node.translation);
+                                            translationMatrix.translate(translation);
                                             QMatrix4x4 rotationMatrix;
-                                            rotationMatrix.rotate(node.rotation);
+                                            rotationMatrix.rotate(rotation);
                                             QMatrix4x4 matrix = translationMatrix * rotationMatrix;
                                             const float *floatArray = matrix.constData();
                                             QStringList matrixItemList;
@@ -2009,16 +2013,16 @@ void DocumentWindow::exportDs3objToFilename(const QString &filename)
                                         }
                                         {
                                             writer->writeAttribute("translation", 
-                                                QString::number(node.translation.x()) + "," +
-                                                QString::number(node.translation.y()) + "," +
-                                                QString::number(node.translation.z()));
+                                                QString::number(translation.x()) + "," +
+                                                QString::number(translation.y()) + "," +
+                                                QString::number(translation.z()));
                                         }
                                         {
                                             writer->writeAttribute("rotation", 
-                                                QString::number(node.rotation.x()) + "," +
-                                                QString::number(node.rotation.y()) + "," +
-                                                QString::number(node.rotation.z()) + "," +
-                                                QString::number(node.rotation.scalar()));
+                                                QString::number(rotation.x()) + "," +
+                                                QString::number(rotation.y()) + "," +
+                                                QString::number(rotation.z()) + "," +
+                                                QString::number(rotation.scalar()));
                                         }
                                         writer->writeEndElement();
                                     }
@@ -2281,62 +2285,44 @@ void DocumentWindow::checkExportWaitingList()
     }
 }
 
-void DocumentWindow::normalAndDepthMapsReady()
+void DocumentWindow::enableSoftwareRender(bool enabled)
 {
-    QImage *normalMap = m_normalAndDepthMapsGenerator->takeNormalMap();
-    QImage *depthMap = m_normalAndDepthMapsGenerator->takeDepthMap();
-
-    m_modelRenderWidget->updateToonNormalAndDepthMaps(normalMap, depthMap);
-
-    delete m_normalAndDepthMapsGenerator;
-    m_normalAndDepthMapsGenerator = nullptr;
-    
-    qDebug() << "Normal and depth maps generation done";
-    
-    if (m_isNormalAndDepthMapsObsolete) {
-        generateNormalAndDepthMaps();
-    }
+    m_softwareRenderEnabled = enabled;
 }
 
-void DocumentWindow::generateNormalAndDepthMaps()
+void DocumentWindow::exportImageBySoftwareRender(const QString &filename)
 {
-    if (nullptr != m_normalAndDepthMapsGenerator) {
-        m_isNormalAndDepthMapsObsolete = true;
-        return;
-    }
-    
-    m_isNormalAndDepthMapsObsolete = false;
-    
-    auto resultMesh = m_document->takeResultMesh();
+    Model *resultMesh = m_document->takeResultTextureMesh();
+    if (nullptr == resultMesh)
+        resultMesh = m_document->takeResultMesh();
     if (nullptr == resultMesh)
-		return;
-    
-    qDebug() << "Normal and depth maps generating...";
-    
-    QThread *thread = new QThread;
-    m_normalAndDepthMapsGenerator = new NormalAndDepthMapsGenerator(m_modelRenderWidget);
-    m_normalAndDepthMapsGenerator->updateMesh(resultMesh);
-    m_normalAndDepthMapsGenerator->moveToThread(thread);
-    m_normalAndDepthMapsGenerator->setRenderThread(thread);
-    connect(thread, &QThread::started, m_normalAndDepthMapsGenerator, &NormalAndDepthMapsGenerator::process);
-    connect(m_normalAndDepthMapsGenerator, &NormalAndDepthMapsGenerator::finished, this, &DocumentWindow::normalAndDepthMapsReady);
-    connect(m_normalAndDepthMapsGenerator, &NormalAndDepthMapsGenerator::finished, thread, &QThread::quit);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-    thread->start();
-}
-
-void DocumentWindow::delayedGenerateNormalAndDepthMaps()
-{
-    if (!Preferences::instance().toonShading())
-        return;
-    if (ToonLine::WithoutLine == Preferences::instance().toonLine())
         return;
-    generateNormalAndDepthMaps();
+    ModelSoftwareRender softwareRender;
+    softwareRender.setXRotation(m_modelRenderWidget->xRot());
+    softwareRender.setYRotation(m_modelRenderWidget->yRot());
+    softwareRender.setZRotation(m_modelRenderWidget->zRot());
+    softwareRender.setEyePosition(m_modelRenderWidget->eyePosition());
+    softwareRender.setMoveToPosition(m_modelRenderWidget->moveToPosition());
+    if (m_modelRenderWidget->isWireframeVisible())
+        softwareRender.enableWireframe();
+    softwareRender.setToonShading(Preferences::instance().toonShading());
+    softwareRender.setToonLine(Preferences::instance().toonLine());
+    softwareRender.updateMesh(resultMesh);
+    QSize size(m_modelRenderWidget->widthInPixels(),
+        m_modelRenderWidget->heightInPixels());
+    if (size.isEmpty())
+        size = m_modelRenderWidget->size() * m_modelRenderWidget->devicePixelRatio();
+    softwareRender.toImage(size).save(filename);
 }
 
 void DocumentWindow::exportImageToFilename(const QString &filename)
 {
     QApplication::setOverrideCursor(Qt::WaitCursor);
+    if (m_softwareRenderEnabled || !m_modelRenderWidget->isValid()) {
+        exportImageBySoftwareRender(filename);
+        QApplication::restoreOverrideCursor();
+        return;
+    }
     Model *resultMesh = m_modelRenderWidget->fetchCurrentMesh();
     if (nullptr != resultMesh) {
         ModelOffscreenRender *offlineRender = new ModelOffscreenRender(m_modelRenderWidget->format());
@@ -16,7 +16,6 @@
 #include "bonemark.h"
 #include "preferenceswidget.h"
 #include "graphicscontainerwidget.h"
-#include "normalanddepthmapsgenerator.h"
 #include "autosaver.h"
 #include "partpreviewimagesgenerator.h"
 #include "QtColorWidgets/ColorWheel"
@@ -101,15 +100,13 @@ public slots:
     void setExportWaitingList(const QStringList &filenames);
     void checkExportWaitingList();
     void exportImageToFilename(const QString &filename);
+    void enableSoftwareRender(bool enabled);
     void exportObjToFilename(const QString &filename);
     void exportFbxToFilename(const QString &filename);
     void exportGlbToFilename(const QString &filename);
     void exportTexturesToDirectory(const QString &directory);
     void exportDs3objToFilename(const QString &filename);
     void toggleRotation();
-    void generateNormalAndDepthMaps();
-    void delayedGenerateNormalAndDepthMaps();
-    void normalAndDepthMapsReady();
     void autoRecover();
     void import();
     void importPath(const QString &filename);
@@ -125,6 +122,7 @@ private:
     void initializeLockButton(QPushButton *button);
     void setCurrentFilename(const QString &filename);
     void updateTitle();
+    void exportImageBySoftwareRender(const QString &filename);
     void createPartSnapshotForFillMesh(const QUuid &fillMeshFileId, Snapshot *snapshot);
     void initializeShortcuts();
     void initializeToolShortcuts(SkeletonGraphicsWidget *graphicsWidget);
@@ -141,6 +139,7 @@ private:
     bool m_isLastMeshGenerationSucceed = true;
     quint64 m_currentUpdatedMeshId = 0;
     QStringList m_waitingForExportToFilenames;
+    bool m_softwareRenderEnabled = false;
     color_widgets::ColorWheel *m_colorWheelWidget = nullptr;
 private:
     QString m_currentFilename;
@@ -210,9 +209,6 @@ private:
     
     QMetaObject::Connection m_partListDockerVisibleSwitchConnection;
     
-    NormalAndDepthMapsGenerator *m_normalAndDepthMapsGenerator = nullptr;
-    bool m_isNormalAndDepthMapsObsolete = false;
-    
     AutoSaver *m_autoSaver = nullptr;
     
     PartPreviewImagesGenerator *m_partPreviewImagesGenerator = nullptr;
@@ -1,32 +1,107 @@
 #include <QFile>
-#include <QTextStream>
+#include <QSaveFile>
 #include <QXmlStreamReader>
+#include <cstring>
+#include <vector>
+#include <tuple>
+#include <limits>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include "miniz.h"
 #include "ds3file.h"
 
+static const long long g_maxInflatedItemSize = 256LL * 1024 * 1024;
+static const long long g_maxDeflateRatio = 1032;
+
+struct Ds3Blob
+{
+    QByteArray byteArray;
+    bool compress;
+    long long offset;
+    QByteArray compressed;
+    
+    const QByteArray &storedByteArray() const
+    {
+        return compressed.isNull() ? byteArray : compressed;
+    }
+};
+
+class Ds3BlobCompressor
+{
+public:
+    Ds3BlobCompressor(std::vector<Ds3Blob> *blobs) :
+        m_blobs(blobs)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+            Ds3Blob &blob = (*m_blobs)[i];
+            if (!blob.compress || blob.byteArray.isEmpty())
+                continue;
+            mz_ulong compressedSize = mz_compressBound(blob.byteArray.size());
+            QByteArray compressed(compressedSize, Qt::Uninitialized);
+            if (MZ_OK != mz_compress2((unsigned char *)compressed.data(), &compressedSize,
+                    (const unsigned char *)blob.byteArray.constData(), blob.byteArray.size(), MZ_DEFAULT_LEVEL))
+                continue;
+            // Incompressible items are kept as they are
+            if (compressedSize >= (mz_ulong)blob.byteArray.size())
+                continue;
+            compressed.resize(compressedSize);
+            blob.compressed = compressed;
+        }
+    }
+private:
+    std::vector<Ds3Blob> *m_blobs = nullptr;
+};
+
+class Ds3ItemLoader
+{
+public:
+    Ds3ItemLoader(Ds3FileReader *reader, const std::vector<QString> *names, std::vector<QByteArray> *byteArrays) :
+        m_reader(reader),
+        m_names(names),
+        m_byteArrays(byteArrays)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i)
+            m_reader->loadItem((*m_names)[i], &(*m_byteArrays)[i]);
+    }
+private:
+    Ds3FileReader *m_reader = nullptr;
+    const std::vector<QString> *m_names = nullptr;
+    std::vector<QByteArray> *m_byteArrays = nullptr;
+};
+
 QString Ds3FileReader::m_applicationName = QString("DUST3D");
 QString Ds3FileReader::m_fileFormatVersion = QString("1.0");
 QString Ds3FileReader::m_headFormat = QString("xml");
 
-QString Ds3FileReader::readFirstLine()
-{
-    QString firstLine;
-    QFile file(m_filename);
-    if (file.open(QIODevice::ReadOnly)) {
-       QTextStream in(&file);
-       if (!in.atEnd()) {
-          firstLine = in.readLine();
-       }
-       file.close();
-    }
-    return firstLine;
-}
-
 Ds3FileReader::Ds3FileReader(const QString &filename) :
+    m_file(filename),
     m_headerIsGood(false),
     m_binaryOffset(0)
 {
-    m_filename = filename;
-    QString firstLine = readFirstLine();
+    if (!m_file.open(QIODevice::ReadOnly))
+        return;
+    m_dataSize = m_file.size();
+    uchar *mapped = m_dataSize > 0 ? m_file.map(0, m_dataSize) : nullptr;
+    if (nullptr != mapped) {
+        m_data = (const char *)mapped;
+    } else {
+        // Compressed resources and some special files cannot be mapped
+        m_unmappedData = m_file.readAll();
+        m_data = m_unmappedData.constData();
+        m_dataSize = m_unmappedData.size();
+    }
+    
+    const char *firstLineEnd = (const char *)memchr(m_data, '\n', m_dataSize);
+    if (nullptr == firstLineEnd)
+        return;
+    long long firstLineSize = firstLineEnd - m_data + 1;
+    QString firstLine = QString::fromUtf8(m_data, firstLineSize).trimmed();
     QStringList tokens = firstLine.split(" ");
     if (tokens.length() < 4) {
         return;
@@ -41,11 +116,13 @@ Ds3FileReader::Ds3FileReader(const QString &filename) :
         return;
     }
     m_binaryOffset = tokens[3].toLongLong();
-    QFile file(m_filename);
-    if (!file.open(QIODevice::ReadOnly)) {
+    if (m_binaryOffset < firstLineSize || m_binaryOffset > m_dataSize)
         return;
-    }
-    QString header = QString::fromUtf8(file.read(m_binaryOffset).constData()).mid(firstLine.size()).trimmed();
+    parseHeader(QByteArray::fromRawData(m_data + firstLineSize, m_binaryOffset - firstLineSize));
+}
+
+void Ds3FileReader::parseHeader(const QByteArray &header)
+{
     QXmlStreamReader xml(header);
     bool ds3TagEntered = false;
     while (!xml.atEnd()) {
@@ -61,6 +138,8 @@ Ds3FileReader::Ds3FileReader(const QString &filename) :
                     readerItem.name = xml.attributes().value("name").toString().trimmed();
                     readerItem.offset = xml.attributes().value("offset").toLongLong();
                     readerItem.size = xml.attributes().value("size").toLongLong();
+                    readerItem.codec = xml.attributes().value("codec").toString();
+                    readerItem.originalSize = xml.attributes().value("originalSize").toLongLong();
                     m_items.push_back(readerItem);
                     m_itemsMap[readerItem.name] = readerItem;
                 }
@@ -78,18 +157,45 @@ void Ds3FileReader::loadItem(const QString &name, QByteArray *byteArray)
     byteArray->clear();
     if (!m_headerIsGood)
         return;
-    if (m_itemsMap.find(name) == m_itemsMap.end()) {
+    auto findItem = m_itemsMap.find(name);
+    if (findItem == m_itemsMap.end()) {
         return;
     }
-    Ds3ReaderItem readerItem = m_itemsMap[name];
-    QFile file(m_filename);
-    if (!file.open(QIODevice::ReadOnly)) {
+    const Ds3ReaderItem &readerItem = findItem->second;
+    if (readerItem.offset < 0 || readerItem.size < 0 ||
+            readerItem.size > std::numeric_limits<int>::max() ||
+            readerItem.offset > m_dataSize ||
+            m_binaryOffset + readerItem.offset + readerItem.size > m_dataSize) {
         return;
     }
-    if (!file.seek(m_binaryOffset + readerItem.offset)) {
+    const char *data = m_data + m_binaryOffset + readerItem.offset;
+    if (readerItem.codec.isEmpty()) {
+        *byteArray = QByteArray::fromRawData(data, readerItem.size);
         return;
     }
-    *byteArray = file.read(readerItem.size);
+    // originalSize comes from the file, so it is bounded by what deflate can actually expand
+    // the stored bytes to before anything is allocated for it
+    if (readerItem.codec != "zlib" || readerItem.originalSize < 0 ||
+            readerItem.originalSize > g_maxInflatedItemSize ||
+            readerItem.originalSize > readerItem.size * g_maxDeflateRatio + 64)
+        return;
+    QByteArray inflated((int)readerItem.originalSize, Qt::Uninitialized);
+    if ((long long)inflated.size() != readerItem.originalSize)
+        return;
+    mz_ulong inflatedSize = (mz_ulong)inflated.size();
+    if (MZ_OK != mz_uncompress((unsigned char *)inflated.data(), &inflatedSize,
+                (const unsigned char *)data, readerItem.size) ||
+            inflatedSize != (mz_ulong)readerItem.originalSize)
+        return;
+    *byteArray = inflated;
+}
+
+void Ds3FileReader::loadItems(const std::vector<QString> &names, std::vector<QByteArray> *byteArrays)
+{
+    byteArrays->clear();
+    byteArrays->resize(names.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, names.size()),
+        Ds3ItemLoader(this, &names, byteArrays));
 }
 
 const QList<Ds3ReaderItem> &Ds3FileReader::items()
@@ -97,27 +203,43 @@ const QList<Ds3ReaderItem> &Ds3FileReader::items()
     return m_items;
 }
 
-bool Ds3FileWriter::add(const QString &name, const QString &type, const QByteArray *byteArray)
+bool Ds3FileWriter::add(const QString &name, const QString &type, const QByteArray *byteArray, bool compress)
 {
-    if (m_itemsMap.find(name) != m_itemsMap.end()) {
+    if (!m_names.insert(name).second) {
         return false;
     }
     Ds3WriterItem writerItem;
     writerItem.type = type;
     writerItem.name = name;
     writerItem.byteArray = *byteArray;
-    m_itemsMap[name] = writerItem;
+    writerItem.compress = compress;
     m_items.push_back(writerItem);
     return true;
 }
 
 bool Ds3FileWriter::save(const QString &filename)
 {
-    QFile file(filename);
+    QSaveFile file(filename);
     if (!file.open(QIODevice::WriteOnly)) {
         return false;
     }
     
+    // Items sharing the same bytes, such as images aliased by ImageForever, are stored once
+    std::map<std::tuple<const char *, int, bool>, size_t> blobIndices;
+    std::vector<size_t> itemBlobs(m_items.size());
+    std::vector<Ds3Blob> blobs;
+    for (int i = 0; i < m_items.size(); i++) {
+        const Ds3WriterItem *writerItem = &m_items[i];
+        auto blobKey = std::make_tuple(writerItem->byteArray.constData(), writerItem->byteArray.size(), writerItem->compress);
+        auto insertResult = blobIndices.insert({blobKey, blobs.size()});
+        if (insertResult.second)
+            blobs.push_back({writerItem->byteArray, writerItem->compress, 0, QByteArray()});
+        itemBlobs[i] = insertResult.first->second;
+    }
+    
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, blobs.size()),
+        Ds3BlobCompressor(&blobs));
+    
     QByteArray headerXml;
     {
         QXmlStreamWriter stream(&headerXml);
@@ -126,13 +248,21 @@ bool Ds3FileWriter::save(const QString &filename)
         stream.writeStartElement("ds3");
         
         long long offset = 0;
+        for (auto &blob: blobs) {
+            blob.offset = offset;
+            offset += blob.storedByteArray().size();
+        }
         for (int i = 0; i < m_items.size(); i++) {
-            Ds3WriterItem *writerItem = &m_items[i];
+            const Ds3WriterItem *writerItem = &m_items[i];
+            const Ds3Blob &blob = blobs[itemBlobs[i]];
             stream.writeStartElement(writerItem->type);
                 stream.writeAttribute("name", QString("%1").arg(writerItem->name));
-                stream.writeAttribute("offset", QString("%1").arg(offset));
-                stream.writeAttribute("size", QString("%1").arg(writerItem->byteArray.size()));
-                offset += writerItem->byteArray.size();
+                stream.writeAttribute("offset", QString("%1").arg(blob.offset));
+                stream.writeAttribute("size", QString("%1").arg(blob.storedByteArray().size()));
+                if (!blob.compressed.isNull()) {
+                    stream.writeAttribute("codec", "zlib");
+                    stream.writeAttribute("originalSize", QString("%1").arg(blob.byteArray.size()));
+                }
             stream.writeEndElement();
         }
         
@@ -150,11 +280,13 @@ bool Ds3FileWriter::save(const QString &filename)
     file.write(firstLine, firstLineSizeExcludeSizeSelf);
     file.write(headerSizeString, strlen(headerSizeString));
     file.write(headerXml);
-    for (int i = 0; i < m_items.size(); i++) {
-        Ds3WriterItem *writerItem = &m_items[i];
-        file.write(writerItem->byteArray);
+    for (const auto &blob: blobs) {
+        const QByteArray &byteArray = blob.storedByteArray();
+        if (file.write(byteArray) != byteArray.size()) {
+            file.cancelWriting();
+            return false;
+        }
     }
     
-    return true;
+    return file.commit();
 }
-
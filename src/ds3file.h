@@ -3,7 +3,10 @@
 #include <QObject>
 #include <QString>
 #include <QByteArray>
+#include <QFile>
 #include <map>
+#include <set>
+#include <vector>
 
 /*
 DUST3D 1.0 xml 12345
@@ -11,6 +14,7 @@ DUST3D 1.0 xml 12345
 <ds3>
     <model name="ant.xml" offset="0" size="1024"/>
     <asset name="ant.jpg" offset="1024" size="279306"/>
+    <object name="object.xml" offset="280330" size="4096" codec="zlib" originalSize="65536"/>
 </ds3>
 ... Binary content ...
 */
@@ -22,14 +26,20 @@ public:
     QString name;
     long long offset;
     long long size;
+    QString codec;
+    long long originalSize;
 };
 
+// The file is memory mapped, loadItem() hands out views into the mapping for
+// uncompressed items, so the loaded byte arrays must not outlive the reader;
+// compressed items are inflated when loaded
 class Ds3FileReader : public QObject
 {
     Q_OBJECT
 public:
     Ds3FileReader(const QString &filename);
     void loadItem(const QString &name, QByteArray *byteArray);
+    void loadItems(const std::vector<QString> &names, std::vector<QByteArray> *byteArrays);
     const QList<Ds3ReaderItem> &items();
     static QString m_applicationName;
     static QString m_fileFormatVersion;
@@ -37,9 +47,12 @@ public:
 private:
     std::map<QString, Ds3ReaderItem> m_itemsMap;
     QList<Ds3ReaderItem> m_items;
-    QString m_filename;
+    QFile m_file;
+    QByteArray m_unmappedData;
+    const char *m_data = nullptr;
+    long long m_dataSize = 0;
 private:
-    QString readFirstLine();
+    void parseHeader(const QByteArray &header);
     bool m_headerIsGood;
     long long m_binaryOffset;
 };
@@ -50,18 +63,20 @@ public:
     QString type;
     QString name;
     QByteArray byteArray;
+    bool compress;
 };
 
+// Items share the added byte arrays instead of copying them, save() streams them
+// into a temporary file next to the target and renames it over the target on success
 class Ds3FileWriter : public QObject
 {
     Q_OBJECT
 public:
-    bool add(const QString &name, const QString &type, const QByteArray *byteArray);
+    bool add(const QString &name, const QString &type, const QByteArray *byteArray, bool compress=false);
     bool save(const QString &filename);
 private:
-    std::map<QString, Ds3WriterItem> m_itemsMap;
+    std::set<QString> m_names;
     QList<Ds3WriterItem> m_items;
-    QString m_filename;
 };
 
 #endif
@@ -8,6 +8,7 @@
 #include "fbxfile.h"
 #include "version.h"
 #include "jointnodetree.h"
+#include "motionclipcompressor.h"
 #include "util.h"
 #include "modelshaderprogram.h"
 #include "document.h"
@@ -2210,7 +2211,7 @@ FbxFileWriter::FbxFileWriter(Object &object,
         QImage *metalnessImage,
         QImage *roughnessImage,
         QImage *ambientOcclusionImage,
-        const std::vector<std::pair<QString, std::vector<std::pair<float, JointNodeTree>>>> *motions) :
+        const std::vector<std::pair<QString, MotionClip>> *motions) :
     m_filename(filename),
     m_baseName(QFileInfo(m_filename).baseName())
 {
@@ -3622,9 +3623,10 @@ FbxFileWriter::FbxFileWriter(Object &object,
     std::vector<FBXNode> animationCurves;
     
     if (hasAnimation) {
-        std::set<int> rotatedJoints;
-        std::set<int> translatedJoints;
-    
+        std::vector<QVector3D> restTranslations;
+        for (const auto &boneNode: boneNodes)
+            restTranslations.push_back(boneNode.translation);
+        
         for (int animationIndex = 0; animationIndex < (int)motions->size(); ++animationIndex) {
             const auto &motion = (*motions)[animationIndex];
             
@@ -3711,239 +3713,63 @@ FbxFileWriter::FbxFileWriter(Object &object,
                 connections.addChild(p);
             }
             
-            for (const auto &keyframe: motion.second) {
-                for (int i = 0; i < (int)keyframe.second.nodes().size() && i < (int)boneNodes.size(); ++i) {
-                    const auto &src = boneNodes[i];
-                    const auto &dest = keyframe.second.nodes()[i];
-                    if (!qFuzzyCompare(src.rotation, dest.rotation))
-                        rotatedJoints.insert(i);
-                    if (!qFuzzyCompare(src.translation, dest.translation))
-                        translatedJoints.insert(i);
-                }
-            }
-            
-            for (const auto &jointIndex: translatedJoints) {
+            auto addChannel = [&](int jointIndex, const std::vector<uint8_t> &curveNodeName, const char *propertyName,
+                    const std::vector<float> &times, const std::vector<float> *values) {
+                const char *componentNames[3] = {"d|X", "d|Y", "d|Z"};
                 int64_t animationCurveIds[3];
-                std::vector<int64_t> ktimes;
-                std::vector<float> values[3];
                 for (int curveIndex = 0; curveIndex < 3; ++curveIndex) {
                     animationCurveIds[curveIndex] = m_next64Id++;
                 }
-                double timePoint = 0;
-                for (int frame = 0; frame < (int)motion.second.size(); frame++) {
-                    const auto &keyframe = motion.second[frame];
-                    const auto &translation = keyframe.second.nodes()[jointIndex].translation;
-                    double x = translation.x();
-                    double y = translation.y();
-                    double z = translation.z();
-                    
-                    values[0].push_back(x);
-                    values[1].push_back(y);
-                    values[2].push_back(z);
+                std::vector<int64_t> ktimes;
+                for (const auto &timePoint: times)
                     ktimes.push_back(secondsToKtime(timePoint));
-                    timePoint += keyframe.first;
-                    
-                    FBXNode animationCurveNode("AnimationCurveNode");
-                    int64_t animationCurveNodeId = m_next64Id++;
-                    animationCurveNode.addProperty(animationCurveNodeId);
-                    animationCurveNode.addProperty(std::vector<uint8_t>({'T',0,1,'A','n','i','m','C','u','r','v','e','N','o','d','e'}), 'S');
-                    animationCurveNode.addProperty("");
-                    {
-                        FBXNode properties("Properties70");
-                        {
-                            FBXNode p("P");
-                            p.addProperty("d|X");
-                            p.addProperty("Number");
-                            p.addProperty("");
-                            p.addProperty("A");
-                            p.addProperty((double)x);
-                            properties.addChild(p);
-                        }
-                        {
-                            FBXNode p("P");
-                            p.addProperty("d|Y");
-                            p.addProperty("Number");
-                            p.addProperty("");
-                            p.addProperty("A");
-                            p.addProperty((double)y);
-                            properties.addChild(p);
-                        }
-                        {
-                            FBXNode p("P");
-                            p.addProperty("d|Z");
-                            p.addProperty("Number");
-                            p.addProperty("");
-                            p.addProperty("A");
-                            p.addProperty((double)z);
-                            properties.addChild(p);
-                        }
-                        properties.addChild(FBXNode());
-                        animationCurveNode.addChild(properties);
-                    }
-                    animationCurveNode.addChild(FBXNode());
-                    animationCurveNodes.push_back(animationCurveNode);
-                    
-                    {
-                        FBXNode p("C");
-                        p.addProperty("OO");
-                        p.addProperty(animationCurveNodeId);
-                        p.addProperty(animationLayerId);
-                        connections.addChild(p);
-                    }
-                    {
-                        FBXNode p("C");
-                        p.addProperty("OP");
-                        p.addProperty(animationCurveNodeId);
-                        p.addProperty(limbNodeIds[1 + jointIndex]);
-                        p.addProperty("Lcl Translation");
-                        connections.addChild(p);
-                    }
-                    {
-                        FBXNode p("C");
-                        p.addProperty("OP");
-                        p.addProperty(animationCurveIds[0]);
-                        p.addProperty(animationCurveNodeId);
-                        p.addProperty("d|X");
-                        connections.addChild(p);
-                    }
-                    {
-                        FBXNode p("C");
-                        p.addProperty("OP");
-                        p.addProperty(animationCurveIds[1]);
-                        p.addProperty(animationCurveNodeId);
-                        p.addProperty("d|Y");
-                        connections.addChild(p);
-                    }
-                    {
-                        FBXNode p("C");
-                        p.addProperty("OP");
-                        p.addProperty(animationCurveIds[2]);
-                        p.addProperty(animationCurveNodeId);
-                        p.addProperty("d|Z");
-                        connections.addChild(p);
+                
+                FBXNode animationCurveNode("AnimationCurveNode");
+                int64_t animationCurveNodeId = m_next64Id++;
+                animationCurveNode.addProperty(animationCurveNodeId);
+                animationCurveNode.addProperty(curveNodeName, 'S');
+                animationCurveNode.addProperty("");
+                {
+                    FBXNode properties("Properties70");
+                    for (int curveIndex = 0; curveIndex < 3; ++curveIndex) {
+                        FBXNode p("P");
+                        p.addProperty(componentNames[curveIndex]);
+                        p.addProperty("Number");
+                        p.addProperty("");
+                        p.addProperty("A");
+                        p.addProperty((double)values[curveIndex][0]);
+                        properties.addChild(p);
                     }
+                    properties.addChild(FBXNode());
+                    animationCurveNode.addChild(properties);
                 }
+                animationCurveNode.addChild(FBXNode());
+                animationCurveNodes.push_back(animationCurveNode);
                 
-                for (int curveIndex = 0; curveIndex < 3; ++curveIndex)
                 {
-                    FBXNode animationCurve("AnimationCurve");
-                    animationCurve.addProperty(animationCurveIds[curveIndex]);
-                    animationCurve.addProperty(std::vector<uint8_t>({'C','u','r','v','e',(uint8_t)('1'+curveIndex),0,1,'A','n','i','m','C','u','r','v','e'}), 'S');
-                    animationCurve.addProperty("");
-                    animationCurve.addPropertyNode("Default", (double)0.000000);
-                    animationCurve.addPropertyNode("KeyVer", (int32_t)4008);
-                    animationCurve.addPropertyNode("KeyTime", ktimes);
-                    animationCurve.addPropertyNode("KeyValueFloat", values[curveIndex]);
-                    animationCurve.addPropertyNode("KeyAttrFlags", std::vector<int>(1, 24836));
-                    animationCurve.addPropertyNode("KeyAttrDataFloat", std::vector<float>(4, 0.000000));
-                    animationCurve.addPropertyNode("KeyAttrRefCount", std::vector<int32_t>(1, ktimes.size()));
-                    animationCurve.addChild(FBXNode());
-                    animationCurves.push_back(animationCurve);
+                    FBXNode p("C");
+                    p.addProperty("OO");
+                    p.addProperty(animationCurveNodeId);
+                    p.addProperty(animationLayerId);
+                    connections.addChild(p);
                 }
-            }
-            
-            for (const auto &jointIndex: rotatedJoints) {
-                int64_t animationCurveIds[3];
-                std::vector<int64_t> ktimes;
-                std::vector<float> values[3];
-                for (int curveIndex = 0; curveIndex < 3; ++curveIndex) {
-                    animationCurveIds[curveIndex] = m_next64Id++;
+                {
+                    FBXNode p("C");
+                    p.addProperty("OP");
+                    p.addProperty(animationCurveNodeId);
+                    p.addProperty(limbNodeIds[1 + jointIndex]);
+                    p.addProperty(propertyName);
+                    connections.addChild(p);
                 }
-                double timePoint = 0;
-                for (int frame = 0; frame < (int)motion.second.size(); frame++) {
-                    const auto &keyframe = motion.second[frame];
-                    const auto &rotation = keyframe.second.nodes()[jointIndex].rotation;
-                    double pitch = 0;
-                    double yaw = 0;
-                    double roll = 0;
-                    quaternionToFbxEulerAngles(rotation, &pitch, &yaw, &roll);
-
-                    values[0].push_back(pitch);
-                    values[1].push_back(yaw);
-                    values[2].push_back(roll);
-                    ktimes.push_back(secondsToKtime(timePoint));
-                    timePoint += keyframe.first;
-                    
-                    FBXNode animationCurveNode("AnimationCurveNode");
-                    int64_t animationCurveNodeId = m_next64Id++;
-                    animationCurveNode.addProperty(animationCurveNodeId);
-                    animationCurveNode.addProperty(std::vector<uint8_t>({'R',0,1,'A','n','i','m','C','u','r','v','e','N','o','d','e'}), 'S');
-                    animationCurveNode.addProperty("");
-                    {
-                        FBXNode properties("Properties70");
-                        {
-                            FBXNode p("P");
-                            p.addProperty("d|X");
-                            p.addProperty("Number");
-                            p.addProperty("");
-                            p.addProperty("A");
-                            p.addProperty((double)pitch);
-                            properties.addChild(p);
-                        }
-                        {
-                            FBXNode p("P");
-                            p.addProperty("d|Y");
-                            p.addProperty("Number");
-                            p.addProperty("");
-                            p.addProperty("A");
-                            p.addProperty((double)yaw);
-                            properties.addChild(p);
-                        }
-                        {
-                            FBXNode p("P");
-                            p.addProperty("d|Z");
-                            p.addProperty("Number");
-                            p.addProperty("");
-                            p.addProperty("A");
-                            p.addProperty((double)roll);
-                            properties.addChild(p);
-                        }
-                        properties.addChild(FBXNode());
-                        animationCurveNode.addChild(properties);
-                    }
-                    animationCurveNode.addChild(FBXNode());
-                    animationCurveNodes.push_back(animationCurveNode);
-                    
-                    {
-                        FBXNode p("C");
-                        p.addProperty("OO");
-                        p.addProperty(animationCurveNodeId);
-                        p.addProperty(animationLayerId);
-                        connections.addChild(p);
-                    }
-                    {
-                        FBXNode p("C");
-                        p.addProperty("OP");
-                        p.addProperty(animationCurveNodeId);
-                        p.addProperty(limbNodeIds[1 + jointIndex]);
-                        p.addProperty("Lcl Rotation");
-                        connections.addChild(p);
-                    }
-                    {
-                        FBXNode p("C");
-                        p.addProperty("OP");
-                        p.addProperty(animationCurveIds[0]);
-                        p.addProperty(animationCurveNodeId);
-                        p.addProperty("d|X");
-                        connections.addChild(p);
-                    }
-                    {
-                        FBXNode p("C");
-                        p.addProperty("OP");
-                        p.addProperty(animationCurveIds[1]);
-                        p.addProperty(animationCurveNodeId);
-                        p.addProperty("d|Y");
-                        connections.addChild(p);
-                    }
-                    {
-                        FBXNode p("C");
-                        p.addProperty("OP");
-                        p.addProperty(animationCurveIds[2]);
-                        p.addProperty(animationCurveNodeId);
-                        p.addProperty("d|Z");
-                        connections.addChild(p);
-                    }
+                for (int curveIndex = 0; curveIndex < 3; ++curveIndex) {
+                    FBXNode p("C");
+                    p.addProperty("OP");
+                    p.addProperty(animationCurveIds[curveIndex]);
+                    p.addProperty(animationCurveNodeId);
+                    p.addProperty(componentNames[curveIndex]);
+                    connections.addChild(p);
                 }
+                
                 for (int curveIndex = 0; curveIndex < 3; ++curveIndex)
                 {
                     FBXNode animationCurve("AnimationCurve");
@@ -3960,6 +3786,47 @@ FbxFileWriter::FbxFileWriter(Object &object,
                     animationCurve.addChild(FBXNode());
                     animationCurves.push_back(animationCurve);
                 }
+            };
+            
+            MotionClipCompressor compressor(motion.second, resultRigBones);
+            compressor.setRestTranslations(restTranslations);
+            compressor.setEulerAngles([this](const QQuaternion &rotation) {
+                double pitch = 0;
+                double yaw = 0;
+                double roll = 0;
+                quaternionToFbxEulerAngles(rotation, &pitch, &yaw, &roll);
+                return QVector3D(pitch, yaw, roll);
+            }, [](const QVector3D &angles) {
+                return QQuaternion::fromAxisAndAngle(0, 0, 1, angles.z()) *
+                    QQuaternion::fromAxisAndAngle(0, 1, 0, angles.y()) *
+                    QQuaternion::fromAxisAndAngle(1, 0, 0, angles.x());
+            });
+            compressor.compress();
+            
+            for (const auto &translationChannel: compressor.translationChannels()) {
+                std::vector<float> values[3];
+                for (const auto &translation: translationChannel.values) {
+                    values[0].push_back(translation.x());
+                    values[1].push_back(translation.y());
+                    values[2].push_back(translation.z());
+                }
+                addChannel(translationChannel.boneIndex,
+                    std::vector<uint8_t>({'T',0,1,'A','n','i','m','C','u','r','v','e','N','o','d','e'}),
+                    "Lcl Translation",
+                    translationChannel.times, values);
+            }
+            
+            for (const auto &rotationChannel: compressor.rotationChannels()) {
+                std::vector<float> values[3];
+                for (const auto &angles: rotationChannel.eulerAngles) {
+                    values[0].push_back(angles.x());
+                    values[1].push_back(angles.y());
+                    values[2].push_back(angles.z());
+                }
+                addChannel(rotationChannel.boneIndex,
+                    std::vector<uint8_t>({'R',0,1,'A','n','i','m','C','u','r','v','e','N','o','d','e'}),
+                    "Lcl Rotation",
+                    rotationChannel.times, values);
             }
         }
         
@@ -9,6 +9,7 @@
 #include "object.h"
 #include "rig.h"
 #include "jointnodetree.h"
+#include "motionclip.h"
 
 class FbxFileWriter : public QObject
 {
@@ -23,7 +24,7 @@ public:
         QImage *metalnessImage=nullptr,
         QImage *roughnessImage=nullptr,
         QImage *ambientOcclusionImage=nullptr,
-        const std::vector<std::pair<QString, std::vector<std::pair<float, JointNodeTree>>>> *motions=nullptr);
+        const std::vector<std::pair<QString, MotionClip>> *motions=nullptr);
     bool save();
 
 private:
@@ -1,6 +1,7 @@
 #include <map>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QCryptographicHash>
 #include <QtCore/qbuffer.h>
 #include <QFile>
 #include "fileforever.h"
@@ -9,9 +10,11 @@ struct FileForeverItem
 {
     QString name;
     QUuid id;
-    QByteArray *byteArray;
+    const QByteArray *byteArray;
 };
+// Ids of identical files share one byte array, each id keeps its own name
 static std::map<QUuid, FileForeverItem> g_foreverMap;
+static std::map<QByteArray, std::pair<QUuid, const QByteArray *>> g_contentMap;
 static QMutex g_mapMutex;
 
 const QString *FileForever::getName(const QUuid &id)
@@ -34,21 +37,22 @@ const QByteArray *FileForever::getContent(const QUuid &id)
 
 QUuid FileForever::add(const QString &name, const QByteArray &content, QUuid toId)
 {
+    QByteArray contentHash = QCryptographicHash::hash(content, QCryptographicHash::Sha1);
     QMutexLocker locker(&g_mapMutex);
-    QUuid newId = toId.isNull() ? QUuid::createUuid() : toId;
-    if (g_foreverMap.find(newId) != g_foreverMap.end())
+    if (!toId.isNull() && g_foreverMap.find(toId) != g_foreverMap.end())
+        return toId;
+    auto findContent = g_contentMap.find(contentHash);
+    if (findContent != g_contentMap.end()) {
+        const QUuid &existId = findContent->second.first;
+        if (toId.isNull() && g_foreverMap[existId].name == name)
+            return existId;
+        QUuid newId = toId.isNull() ? QUuid::createUuid() : toId;
+        g_foreverMap[newId] = {name, newId, findContent->second.second};
         return newId;
-    QByteArray *byteArray = new QByteArray(content);
+    }
+    QUuid newId = toId.isNull() ? QUuid::createUuid() : toId;
+    const QByteArray *byteArray = new QByteArray(content);
     g_foreverMap[newId] = {name, newId, byteArray};
+    g_contentMap[contentHash] = {newId, byteArray};
     return newId;
 }
-
-void FileForever::remove(const QUuid &id)
-{
-    QMutexLocker locker(&g_mapMutex);
-    auto findFile = g_foreverMap.find(id);
-    if (findFile == g_foreverMap.end())
-        return;
-    delete findFile->second.byteArray;
-    g_foreverMap.erase(id);
-}
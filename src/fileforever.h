@@ -10,7 +10,6 @@ public:
     static const QString *getName(const QUuid &id);
     static const QByteArray *getContent(const QUuid &id);
     static QUuid add(const QString &name, const QByteArray &content, QUuid toId=QUuid());
-    static void remove(const QUuid &id);
 };
 
 #endif
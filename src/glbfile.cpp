@@ -5,10 +5,12 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QtCore/qbuffer.h>
+#include <map>
 #include "glbfile.h"
 #include "version.h"
 #include "util.h"
 #include "jointnodetree.h"
+#include "motionclipcompressor.h"
 #include "model.h"
 
 // Play with glTF online:
@@ -26,10 +28,10 @@ GlbFileWriter::GlbFileWriter(Object &object,
         const std::vector<RigBone> *resultRigBones,
         const std::map<int, RigVertexWeights> *resultRigWeights,
         const QString &filename,
-        QImage *textureImage,
-        QImage *normalImage,
-        QImage *ormImage,
-        const std::vector<std::pair<QString, std::vector<std::pair<float, JointNodeTree>>>> *motions) :
+        const QImage *textureImage,
+        const QImage *normalImage,
+        const QImage *ormImage,
+        const std::vector<std::pair<QString, MotionClip>> *motions) :
     m_filename(filename)
 {
     const std::vector<std::vector<QVector3D>> *triangleVertexNormals = object.triangleVertexNormals();
@@ -367,28 +369,22 @@ GlbFileWriter::GlbFileWriter(Object &object,
     }
     
     if (m_outputAnimation) {
-        for (int animationIndex = 0; animationIndex < (int)motions->size(); ++animationIndex) {
-            const auto &motion = (*motions)[animationIndex];
-            
-            m_json["animations"][animationIndex]["name"] = motion.first.toUtf8().constData();
-            
+        // Channels with identical key times share one input accessor
+        std::map<std::vector<float>, int> timeAccessors;
+        auto addTimeAccessor = [&](const std::vector<float> &times) {
+            auto findTimeAccessor = timeAccessors.find(times);
+            if (findTimeAccessor != timeAccessors.end())
+                return findTimeAccessor->second;
             int input = bufferViewIndex;
+            timeAccessors.insert({times, input});
             bufferViewFromOffset = (int)m_binByteArray.size();
             m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
             m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
-            float minTime = 1000000.0;
-            float maxTime = 0.0;
             QStringList timeList;
-            float timePoint = 0;
-            for (const auto &keyframe: motion.second) {
+            for (const auto &timePoint: times) {
                 binStream << (float)timePoint;
-                if (timePoint < minTime)
-                    minTime = timePoint;
-                if (timePoint > maxTime)
-                    maxTime = timePoint;
                 if (m_enableComment)
                     timeList.append(QString::number(timePoint));
-                timePoint += keyframe.first;
             }
             m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
             alignBin();
@@ -397,54 +393,51 @@ GlbFileWriter::GlbFileWriter(Object &object,
             m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
             m_json["accessors"][bufferViewIndex]["byteOffset"] = 0;
             m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
-            m_json["accessors"][bufferViewIndex]["count"] =  motion.second.size();
+            m_json["accessors"][bufferViewIndex]["count"] = times.size();
             m_json["accessors"][bufferViewIndex]["type"] = "SCALAR";
-            m_json["accessors"][bufferViewIndex]["max"][0] = maxTime;
-            m_json["accessors"][bufferViewIndex]["min"][0] = minTime;
+            m_json["accessors"][bufferViewIndex]["max"][0] = times.back();
+            m_json["accessors"][bufferViewIndex]["min"][0] = times.front();
             bufferViewIndex++;
+            return input;
+        };
+        
+        int animationIndex = 0;
+        for (const auto &motion: *motions) {
+            MotionClipCompressor compressor(motion.second, resultRigBones);
+            compressor.compress();
+            if (compressor.translationChannels().empty() && compressor.rotationChannels().empty())
+                continue;
             
-            std::set<int> rotatedJoints;
-            std::set<int> translatedJoints;
-            
-            for (const auto &keyframe: motion.second) {
-                for (int i = 0; i < (int)keyframe.second.nodes().size() && i < (int)boneNodes.size(); ++i) {
-                    const auto &src = boneNodes[i];
-                    const auto &dest = keyframe.second.nodes()[i];
-                    if (!qFuzzyCompare(src.rotation, dest.rotation))
-                        rotatedJoints.insert(i);
-                    if (!qFuzzyCompare(src.translation, dest.translation))
-                        translatedJoints.insert(i);
-                }
-            }
+            m_json["animations"][animationIndex]["name"] = motion.first.toUtf8().constData();
             
             int sampler = 0;
             int channel = 0;
             
-            for (const auto &jointIndex: rotatedJoints) {
+            for (const auto &rotationChannel: compressor.rotationChannels()) {
+                int input = addTimeAccessor(rotationChannel.times);
                 int output = bufferViewIndex;
                 bufferViewFromOffset = (int)m_binByteArray.size();
                 m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
                 m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
                 QStringList rotationList;
-                for (int frame = 0; frame < (int)motion.second.size(); frame++) {
-                    const auto &keyframe = motion.second[frame];
-                    const auto &rotation = keyframe.second.nodes()[jointIndex].rotation;
+                for (size_t key = 0; key < rotationChannel.values.size(); ++key) {
+                    const auto &rotation = rotationChannel.values[key];
                     float x = rotation.x();
                     float y = rotation.y();
                     float z = rotation.z();
                     float w = rotation.scalar();
                     binStream << (float)x << (float)y << (float)z << (float)w;
                     if (m_enableComment)
-                        rotationList.append(QString("%1:<%2,%3,%4,%5>").arg(QString::number(frame)).arg(QString::number(x)).arg(QString::number(y)).arg(QString::number(z)).arg(QString::number(w)));
+                        rotationList.append(QString("%1:<%2,%3,%4,%5>").arg(QString::number(key)).arg(QString::number(x)).arg(QString::number(y)).arg(QString::number(z)).arg(QString::number(w)));
                 }
                 m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
                 alignBin();
                 if (m_enableComment)
-                    m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: rotation %2").arg(QString::number(bufferViewIndex)).arg(rotationList.join(" ")).toUtf8().constData();
+                    m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: rotation (max error %2) %3").arg(QString::number(bufferViewIndex)).arg(QString::number(rotationChannel.maxError)).arg(rotationList.join(" ")).toUtf8().constData();
                 m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
                 m_json["accessors"][bufferViewIndex]["byteOffset"] = 0;
                 m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
-                m_json["accessors"][bufferViewIndex]["count"] =  motion.second.size();
+                m_json["accessors"][bufferViewIndex]["count"] = rotationChannel.values.size();
                 m_json["accessors"][bufferViewIndex]["type"] = "VEC4";
                 bufferViewIndex++;
 
@@ -453,45 +446,46 @@ GlbFileWriter::GlbFileWriter(Object &object,
                 m_json["animations"][animationIndex]["samplers"][sampler]["output"] = output;
                 
                 m_json["animations"][animationIndex]["channels"][channel]["sampler"] = sampler;
-                m_json["animations"][animationIndex]["channels"][channel]["target"]["node"] = skeletonNodeStartIndex + jointIndex;
+                m_json["animations"][animationIndex]["channels"][channel]["target"]["node"] = skeletonNodeStartIndex + rotationChannel.boneIndex;
                 m_json["animations"][animationIndex]["channels"][channel]["target"]["path"] = "rotation";
                 
                 sampler++;
                 channel++;
-                
-                for (const auto &jointIndex: translatedJoints) {
-                    int output = bufferViewIndex;
-                    bufferViewFromOffset = (int)m_binByteArray.size();
-                    m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-                    m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
-                    for (int frame = 0; frame < (int)motion.second.size(); frame++) {
-                        const auto &keyframe = motion.second[frame];
-                        const auto &translation = keyframe.second.nodes()[jointIndex].translation;
-                        binStream << (float)translation.x() << (float)translation.y() << (float)translation.z();
-                    }
-                    m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
-                    alignBin();
-                    if (m_enableComment)
-                        m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: translation").arg(QString::number(bufferViewIndex)).toUtf8().constData();
-                    m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
-                    m_json["accessors"][bufferViewIndex]["byteOffset"] = 0;
-                    m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
-                    m_json["accessors"][bufferViewIndex]["count"] =  motion.second.size();
-                    m_json["accessors"][bufferViewIndex]["type"] = "VEC3";
-                    bufferViewIndex++;
-
-                    m_json["animations"][animationIndex]["samplers"][sampler]["input"] = input;
-                    m_json["animations"][animationIndex]["samplers"][sampler]["interpolation"] = "LINEAR";
-                    m_json["animations"][animationIndex]["samplers"][sampler]["output"] = output;
-                    
-                    m_json["animations"][animationIndex]["channels"][channel]["sampler"] = sampler;
-                    m_json["animations"][animationIndex]["channels"][channel]["target"]["node"] = skeletonNodeStartIndex + jointIndex;
-                    m_json["animations"][animationIndex]["channels"][channel]["target"]["path"] = "translation";
-                    
-                    sampler++;
-                    channel++;
+            }
+            
+            for (const auto &translationChannel: compressor.translationChannels()) {
+                int input = addTimeAccessor(translationChannel.times);
+                int output = bufferViewIndex;
+                bufferViewFromOffset = (int)m_binByteArray.size();
+                m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
+                m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
+                for (const auto &translation: translationChannel.values) {
+                    binStream << (float)translation.x() << (float)translation.y() << (float)translation.z();
                 }
+                m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
+                alignBin();
+                if (m_enableComment)
+                    m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: translation (max error %2)").arg(QString::number(bufferViewIndex)).arg(QString::number(translationChannel.maxError)).toUtf8().constData();
+                m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
+                m_json["accessors"][bufferViewIndex]["byteOffset"] = 0;
+                m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
+                m_json["accessors"][bufferViewIndex]["count"] = translationChannel.values.size();
+                m_json["accessors"][bufferViewIndex]["type"] = "VEC3";
+                bufferViewIndex++;
+
+                m_json["animations"][animationIndex]["samplers"][sampler]["input"] = input;
+                m_json["animations"][animationIndex]["samplers"][sampler]["interpolation"] = "LINEAR";
+                m_json["animations"][animationIndex]["samplers"][sampler]["output"] = output;
+                
+                m_json["animations"][animationIndex]["channels"][channel]["sampler"] = sampler;
+                m_json["animations"][animationIndex]["channels"][channel]["target"]["node"] = skeletonNodeStartIndex + translationChannel.boneIndex;
+                m_json["animations"][animationIndex]["channels"][channel]["target"]["path"] = "translation";
+                
+                sampler++;
+                channel++;
             }
+            
+            animationIndex++;
         }
     }
     
@@ -10,6 +10,7 @@
 #include "object.h"
 #include "json.hpp"
 #include "document.h"
+#include "motionclip.h"
 
 class GlbFileWriter : public QObject
 {
@@ -19,10 +20,10 @@ public:
         const std::vector<RigBone> *resultRigBones,
         const std::map<int, RigVertexWeights> *resultRigWeights,
         const QString &filename,
-        QImage *textureImage=nullptr,
-        QImage *normalImage=nullptr,
-        QImage *ormImage=nullptr,
-        const std::vector<std::pair<QString, std::vector<std::pair<float, JointNodeTree>>>> *motions=nullptr);
+        const QImage *textureImage=nullptr,
+        const QImage *normalImage=nullptr,
+        const QImage *ormImage=nullptr,
+        const std::vector<std::pair<QString, MotionClip>> *motions=nullptr);
     bool save();
 private:
     QString m_filename;
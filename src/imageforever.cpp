@@ -1,34 +1,81 @@
 #include <map>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QCryptographicHash>
 #include <QtCore/qbuffer.h>
 #include "imageforever.h"
 
 struct ImageForeverItem
 {
     QImage *image;
-    QUuid id;
     QByteArray *imageByteArray;
 };
-static std::map<QUuid, ImageForeverItem> g_foreverMap;
+// Ids of images with identical PNG bytes share one item
+static std::map<QUuid, ImageForeverItem *> g_foreverMap;
+static std::map<QByteArray, std::pair<QUuid, ImageForeverItem *>> g_contentMap;
 static QMutex g_mapMutex;
 
+static QUuid addImageItem(QImage *image, QByteArray *imageByteArray, QUuid toId)
+{
+    QByteArray contentHash = QCryptographicHash::hash(*imageByteArray, QCryptographicHash::Sha1);
+    QMutexLocker locker(&g_mapMutex);
+    if (!toId.isNull() && g_foreverMap.find(toId) != g_foreverMap.end()) {
+        delete image;
+        delete imageByteArray;
+        return toId;
+    }
+    auto findContent = g_contentMap.find(contentHash);
+    if (findContent != g_contentMap.end()) {
+        delete image;
+        delete imageByteArray;
+        if (toId.isNull())
+            return findContent->second.first;
+        g_foreverMap[toId] = findContent->second.second;
+        return toId;
+    }
+    QUuid newId = toId.isNull() ? QUuid::createUuid() : toId;
+    ImageForeverItem *item = new ImageForeverItem {image, imageByteArray};
+    g_foreverMap[newId] = item;
+    g_contentMap[contentHash] = {newId, item};
+    return newId;
+}
+
 const QImage *ImageForever::get(const QUuid &id)
 {
+    QByteArray imageByteArray;
+    {
+        QMutexLocker locker(&g_mapMutex);
+        auto findResult = g_foreverMap.find(id);
+        if (findResult == g_foreverMap.end())
+            return nullptr;
+        if (nullptr != findResult->second->image)
+            return findResult->second->image;
+        imageByteArray = *findResult->second->imageByteArray;
+    }
+    
+    // Images added as PNG are decoded on first use, outside of the lock like the encoding
+    QImage *image = new QImage(QImage::fromData(imageByteArray, "PNG"));
+    
     QMutexLocker locker(&g_mapMutex);
     auto findResult = g_foreverMap.find(id);
-    if (findResult == g_foreverMap.end())
+    if (findResult == g_foreverMap.end()) {
+        delete image;
         return nullptr;
-    return findResult->second.image;
+    }
+    if (nullptr != findResult->second->image) {
+        delete image;
+        return findResult->second->image;
+    }
+    findResult->second->image = image;
+    return image;
 }
 
 void ImageForever::copy(const QUuid &id, QImage &image)
 {
-    QMutexLocker locker(&g_mapMutex);
-    auto findResult = g_foreverMap.find(id);
-    if (findResult == g_foreverMap.end())
+    const QImage *foreverImage = get(id);
+    if (nullptr == foreverImage)
         return;
-    image = *findResult->second.image;
+    image = *foreverImage;
 }
 
 const QByteArray *ImageForever::getPngByteArray(const QUuid &id)
@@ -37,33 +84,24 @@ const QByteArray *ImageForever::getPngByteArray(const QUuid &id)
     auto findResult = g_foreverMap.find(id);
     if (findResult == g_foreverMap.end())
         return nullptr;
-    return findResult->second.imageByteArray;
+    return findResult->second->imageByteArray;
 }
 
 QUuid ImageForever::add(const QImage *image, QUuid toId)
 {
-    QMutexLocker locker(&g_mapMutex);
     if (nullptr == image)
         return QUuid();
-    QUuid newId = toId.isNull() ? QUuid::createUuid() : toId;
-    if (g_foreverMap.find(newId) != g_foreverMap.end())
-        return newId;
-    QImage *newImage = new QImage(*image);
+    // Encode outside of the lock, the PNG bytes identify the image like the ones from addPng
     QByteArray *imageByteArray = new QByteArray();
     QBuffer pngBuffer(imageByteArray);
     pngBuffer.open(QIODevice::WriteOnly);
-    newImage->save(&pngBuffer, "PNG");
-    g_foreverMap[newId] = {newImage, newId, imageByteArray};
-    return newId;
+    image->save(&pngBuffer, "PNG");
+    return addImageItem(new QImage(*image), imageByteArray, toId);
 }
 
-void ImageForever::remove(const QUuid &id)
+QUuid ImageForever::addPng(const QByteArray &pngByteArray, QUuid toId)
 {
-    QMutexLocker locker(&g_mapMutex);
-    auto findImage = g_foreverMap.find(id);
-    if (findImage == g_foreverMap.end())
-        return;
-    delete findImage->second.image;
-    delete findImage->second.imageByteArray;
-    g_foreverMap.erase(id);
+    if (pngByteArray.isEmpty())
+        return QUuid();
+    return addImageItem(nullptr, new QByteArray(pngByteArray.constData(), pngByteArray.size()), toId);
 }
@@ -11,7 +11,8 @@ public:
     static void copy(const QUuid &id, QImage &image);
     static const QByteArray *getPngByteArray(const QUuid &id);
     static QUuid add(const QImage *image, QUuid toId=QUuid());
-    static void remove(const QUuid &id);
+    // Keeps the PNG bytes only, the image is decoded on the first get()
+    static QUuid addPng(const QByteArray &pngByteArray, QUuid toId=QUuid());
 };
 
 #endif
@@ -18,11 +18,19 @@ void JointNodeTree::updateTranslation(int index, const QVector3D &translation)
 }
 
 void JointNodeTree::updateMatrix(int index, const QMatrix4x4 &matrix)
+{
+    QVector3D translation;
+    QQuaternion rotation;
+    decomposeMatrix(matrix, &translation, &rotation);
+    updateTranslation(index, translation);
+    updateRotation(index, rotation);
+}
+
+void JointNodeTree::decomposeMatrix(const QMatrix4x4 &matrix, QVector3D *translation, QQuaternion *rotation)
 {
     const QMatrix4x4 &localMatrix = matrix;
     
-    updateTranslation(index, 
-        QVector3D(localMatrix(0, 3), localMatrix(1, 3), localMatrix(2, 3)));
+    *translation = QVector3D(localMatrix(0, 3), localMatrix(1, 3), localMatrix(2, 3));
     
     float scalar = std::sqrt(std::max(0.0f, 1.0f + localMatrix(0, 0) + localMatrix(1, 1) + localMatrix(2, 2))) / 2.0f;
     float x = std::sqrt(std::max(0.0f, 1.0f + localMatrix(0, 0) - localMatrix(1, 1) - localMatrix(2, 2))) / 2.0f;
@@ -32,8 +40,7 @@ void JointNodeTree::updateMatrix(int index, const QMatrix4x4 &matrix)
     y *= y * (localMatrix(0, 2) - localMatrix(2, 0)) > 0 ? 1 : -1;
     z *= z * (localMatrix(1, 0) - localMatrix(0, 1)) > 0 ? 1 : -1;
     float length = std::sqrt(scalar * scalar + x * x + y * y + z * z);
-    updateRotation(index, 
-        QQuaternion(scalar / length, x / length, y / length, z / length));
+    *rotation = QQuaternion(scalar / length, x / length, y / length, z / length);
 }
 
 JointNodeTree::JointNodeTree(const std::vector<RigBone> *resultRigBones)
@@ -26,6 +26,7 @@ public:
     void updateRotation(int index, const QQuaternion &rotation);
     void updateTranslation(int index, const QVector3D &translation);
     void updateMatrix(int index, const QMatrix4x4 &matrix);
+    static void decomposeMatrix(const QMatrix4x4 &matrix, QVector3D *translation, QQuaternion *rotation);
 private:
     std::vector<JointNode> m_boneNodes;
 };
@@ -8,7 +8,7 @@
 #include "dust3d.h"
 #include "meshgenerator.h"
 #include "snapshot.h"
-#include "snapshotxml.h"
+#include "snapshotbinary.h"
 #include "model.h"
 #include "version.h"
 
@@ -59,17 +59,14 @@ DUST3D_DLL dust3d * DUST3D_API dust3dOpenFromMemory(const char *documentType, co
     delete ds3->object;
     ds3->object = new Object;
     
-    if (0 == strcmp(documentType, "xml")) {
-        QByteArray data(buffer, size);
-        
-        QXmlStreamReader stream(data);
+    if (0 == strcmp(documentType, "xml") || 0 == strcmp(documentType, "binary")) {
+        QByteArray data = QByteArray::fromRawData(buffer, size);
         
         delete ds3->snapshot;
         ds3->snapshot = new Snapshot;
         
-        loadSkeletonFromXmlStream(ds3->snapshot, stream);
-        
-        ds3->error = DUST3D_OK;
+        if (loadSkeletonFromByteArray(ds3->snapshot, data))
+            ds3->error = DUST3D_OK;
     } else {
         ds3->error = DUST3D_UNSUPPORTED;
     }
@@ -71,6 +71,7 @@ int main(int argc, char ** argv)
     struct RenderOptions
     {
         bool enableWireframe = true;
+        bool enableSoftwareRender = false;
         QVector3D rotation = QVector3D(ModelWidget::m_defaultXRotation,
             ModelWidget::m_defaultYRotation,
             ModelWidget::m_defaultZRotation);
@@ -90,6 +91,11 @@ int main(int argc, char ** argv)
                 if (i < argc)
                     renderOptions.enableWireframe = isTrueValueString(QString(argv[i]));
                 continue;
+            } else if (0 == strcmp(argv[i], "-software")) {
+                ++i;
+                if (i < argc)
+                    renderOptions.enableSoftwareRender = isTrueValueString(QString(argv[i]));
+                continue;
             } else if (0 == strcmp(argv[i], "-rotate")) {
                 ++i;
                 if (i < argc) {
@@ -141,6 +147,7 @@ int main(int argc, char ** argv)
                 modelWidget->setEyePosition(renderOptions.camera);
                 if (!renderOptions.enableWireframe)
                     modelWidget->toggleWireframe();
+                windowList[i]->enableSoftwareRender(renderOptions.enableSoftwareRender);
                 
                 QObject::connect(windowList[i], &DocumentWindow::waitingExportFinished, &app, [&](const QString &filename, bool isSuccessful) {
                     qDebug() << "Export to" << filename << (isSuccessful ? "isSuccessful" : "failed");
@@ -2,7 +2,7 @@
 #include <QElapsedTimer>
 #include "materialpreviewsgenerator.h"
 #include "meshgenerator.h"
-#include "snapshotxml.h"
+#include "snapshotbinary.h"
 #include "ds3file.h"
 #include "texturegenerator.h"
 #include "imageforever.h"
@@ -47,8 +47,7 @@ void MaterialPreviewsGenerator::generate()
         if (item.type == "model") {
             QByteArray data;
             ds3Reader.loadItem(item.name, &data);
-            QXmlStreamReader stream(data);
-            loadSkeletonFromXmlStream(snapshot, stream);
+            loadSkeletonFromByteArray(snapshot, data);
             for (const auto &item: snapshot->parts) {
                 partIds.push_back(QUuid(item.first));
             }
@@ -19,7 +19,7 @@
 #include "document.h"
 #include "meshstroketifier.h"
 #include "fileforever.h"
-#include "snapshotxml.h"
+#include "snapshotbinary.h"
 #include "fixholes.h"
 #include "modeloffscreenrender.h"
 
@@ -826,9 +826,8 @@ bool MeshGenerator::fillPartWithMesh(GeneratedPart &partCache,
     if (nullptr == fillMeshByteArray)
         return false;
     
-    QXmlStreamReader fillMeshStream(*fillMeshByteArray);  
     Snapshot *fillMeshSnapshot = new Snapshot;
-    loadSkeletonFromXmlStream(fillMeshSnapshot, fillMeshStream);
+    loadSkeletonFromByteArray(fillMeshSnapshot, *fillMeshByteArray);
     
     GeneratedCacheContext *fillMeshCacheContext = new GeneratedCacheContext();
     MeshGenerator *meshGenerator = new MeshGenerator(fillMeshSnapshot);
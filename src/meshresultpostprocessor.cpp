@@ -21,6 +21,11 @@ Object *MeshResultPostProcessor::takePostProcessedObject()
     return object;
 }
 
+void MeshResultPostProcessor::setUvUnwrapCacheContext(UvUnwrapCacheContext *cacheContext)
+{
+    m_uvUnwrapCacheContext = cacheContext;
+}
+
 void MeshResultPostProcessor::poseProcess()
 {
 #ifndef NDEBUG
@@ -31,7 +36,7 @@ void MeshResultPostProcessor::poseProcess()
             std::vector<std::vector<QVector2D>> triangleVertexUvs;
             std::set<int> seamVertices;
             std::map<QUuid, std::vector<QRectF>> partUvRects;
-            uvUnwrap(*m_object, triangleVertexUvs, seamVertices, partUvRects);
+            uvUnwrap(*m_object, triangleVertexUvs, seamVertices, partUvRects, m_uvUnwrapCacheContext);
             m_object->setTriangleVertexUvs(triangleVertexUvs);
             m_object->setPartUvRects(partUvRects);
         }
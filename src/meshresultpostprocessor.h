@@ -3,6 +3,8 @@
 #include <QObject>
 #include "object.h"
 
+class UvUnwrapCacheContext;
+
 class MeshResultPostProcessor : public QObject
 {
     Q_OBJECT
@@ -10,6 +12,7 @@ public:
     MeshResultPostProcessor(const Object &object);
     ~MeshResultPostProcessor();
     Object *takePostProcessedObject();
+    void setUvUnwrapCacheContext(UvUnwrapCacheContext *cacheContext);
     void poseProcess();
 signals:
     void finished();
@@ -17,6 +20,7 @@ public slots:
     void process();
 private:
     Object *m_object = nullptr;
+    UvUnwrapCacheContext *m_uvUnwrapCacheContext = nullptr;
 };
 
 #endif
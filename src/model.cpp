@@ -2,7 +2,9 @@
 #include <QTextStream>
 #include <QFile>
 #include <cmath>
+#include <algorithm>
 #include "model.h"
+#include "shadervertexpacker.h"
 #include "version.h"
 
 float Model::m_defaultMetalness = 0.0;
@@ -22,6 +24,12 @@ Model::Model(const Model &mesh) :
         for (int i = 0; i < mesh.m_triangleVertexCount; i++)
             this->m_triangleVertices[i] = mesh.m_triangleVertices[i];
     }
+    if (mesh.m_triangleVerticesPacked) {
+        this->m_packedTriangleVertices = mesh.m_packedTriangleVertices;
+        this->m_triangleIndices = mesh.m_triangleIndices;
+        this->m_triangleVertexCount = mesh.m_triangleVertexCount;
+        this->m_triangleVerticesPacked = true;
+    }
     if (nullptr != mesh.m_edgeVertices &&
             mesh.m_edgeVertexCount > 0) {
         this->m_edgeVertices = new ShaderVertex[mesh.m_edgeVertexCount];
@@ -29,6 +37,12 @@ Model::Model(const Model &mesh) :
         for (int i = 0; i < mesh.m_edgeVertexCount; i++)
             this->m_edgeVertices[i] = mesh.m_edgeVertices[i];
     }
+    if (mesh.m_edgesPacked) {
+        this->m_packedEdgeVertices = mesh.m_packedEdgeVertices;
+        this->m_edgeIndices = mesh.m_edgeIndices;
+        this->m_edgeVertexCount = mesh.m_edgeVertexCount;
+        this->m_edgesPacked = true;
+    }
     if (nullptr != mesh.m_toolVertices &&
             mesh.m_toolVertexCount > 0) {
         this->m_toolVertices = new ShaderVertex[mesh.m_toolVertexCount];
@@ -70,11 +84,20 @@ void Model::removeColor()
     this->m_hasRoughnessInImage = false;
     this->m_hasAmbientOcclusionInImage = false;
     
-    for (int i = 0; i < this->m_triangleVertexCount; ++i) {
-        auto &vertex = this->m_triangleVertices[i];
-        vertex.colorR = 1.0;
-        vertex.colorG = 1.0;
-        vertex.colorB = 1.0;
+    if (nullptr != this->m_triangleVertices) {
+        for (int i = 0; i < this->m_triangleVertexCount; ++i) {
+            auto &vertex = this->m_triangleVertices[i];
+            vertex.colorR = 1.0;
+            vertex.colorG = 1.0;
+            vertex.colorB = 1.0;
+        }
+        invalidatePackedTriangleVertices();
+        return;
+    }
+    for (auto &vertex: this->m_packedTriangleVertices) {
+        vertex.colorR = 255;
+        vertex.colorG = 255;
+        vertex.colorB = 255;
     }
 }
 
@@ -180,34 +203,7 @@ Model::Model(Object &object) :
         }
     }
     
-    size_t edgeCount = 0;
-    for (const auto &face: object.triangleAndQuads) {
-        edgeCount += face.size();
-    }
-    m_edgeVertexCount = edgeCount * 2;
-    m_edgeVertices = new ShaderVertex[m_edgeVertexCount];
-    size_t edgeVertexIndex = 0;
-    for (size_t faceIndex = 0; faceIndex < object.triangleAndQuads.size(); ++faceIndex) {
-        const auto &face = object.triangleAndQuads[faceIndex];
-        for (size_t i = 0; i < face.size(); ++i) {
-            for (size_t x = 0; x < 2; ++x) {
-                size_t sourceIndex = face[(i + x) % face.size()];
-                const QVector3D *srcVert = &object.vertices[sourceIndex];
-                ShaderVertex *dest = &m_edgeVertices[edgeVertexIndex];
-                memset(dest, 0, sizeof(ShaderVertex));
-                dest->colorR = 0.0;
-                dest->colorG = 0.0;
-                dest->colorB = 0.0;
-                dest->alpha = 1.0;
-                dest->posX = srcVert->x();
-                dest->posY = srcVert->y();
-                dest->posZ = srcVert->z();
-                dest->metalness = m_defaultMetalness;
-                dest->roughness = m_defaultRoughness;
-                edgeVertexIndex++;
-            }
-        }
-    }
+    packTriangleVertices();
 }
 
 Model::Model() :
@@ -262,6 +258,36 @@ int Model::triangleVertexCount()
     return m_triangleVertexCount;
 }
 
+void Model::packTriangleVertices()
+{
+    if (m_triangleVerticesPacked)
+        return;
+    packIndexedShaderVertices(m_triangleVertices, m_triangleVertexCount,
+        &m_packedTriangleVertices, &m_triangleIndices);
+    m_triangleVerticesPacked = true;
+    delete[] m_triangleVertices;
+    m_triangleVertices = nullptr;
+}
+
+void Model::invalidatePackedTriangleVertices()
+{
+    m_triangleVerticesPacked = false;
+    m_packedTriangleVertices.clear();
+    m_triangleIndices.clear();
+}
+
+const std::vector<PackedShaderVertex> &Model::packedTriangleVertices()
+{
+    packTriangleVertices();
+    return m_packedTriangleVertices;
+}
+
+const std::vector<GLuint> &Model::triangleIndices()
+{
+    packTriangleVertices();
+    return m_triangleIndices;
+}
+
 ShaderVertex *Model::edgeVertices()
 {
     return m_edgeVertices;
@@ -272,6 +298,65 @@ int Model::edgeVertexCount()
     return m_edgeVertexCount;
 }
 
+void Model::packEdges()
+{
+    if (m_edgesPacked)
+        return;
+    m_edgesPacked = true;
+    
+    if (nullptr != m_edgeVertices) {
+        packIndexedShaderVertices(m_edgeVertices, m_edgeVertexCount,
+            &m_packedEdgeVertices, &m_edgeIndices);
+        delete[] m_edgeVertices;
+        m_edgeVertices = nullptr;
+        return;
+    }
+    
+    // Wireframe lines index one vertex per model vertex; edges shared by two faces are drawn once
+    ShaderVertex edgeVertex;
+    memset(&edgeVertex, 0, sizeof(ShaderVertex));
+    edgeVertex.alpha = 1.0;
+    edgeVertex.metalness = m_defaultMetalness;
+    edgeVertex.roughness = m_defaultRoughness;
+    m_packedEdgeVertices.resize(m_vertices.size());
+    for (size_t i = 0; i < m_vertices.size(); ++i) {
+        edgeVertex.posX = m_vertices[i].x();
+        edgeVertex.posY = m_vertices[i].y();
+        edgeVertex.posZ = m_vertices[i].z();
+        packShaderVertex(edgeVertex, &m_packedEdgeVertices[i]);
+    }
+    
+    std::vector<std::pair<GLuint, GLuint>> edges;
+    for (const auto &face: m_faces) {
+        for (size_t i = 0; i < face.size(); ++i) {
+            GLuint first = face[i];
+            GLuint second = face[(i + 1) % face.size()];
+            if (first > second)
+                std::swap(first, second);
+            edges.push_back({first, second});
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    m_edgeIndices.reserve(edges.size() * 2);
+    for (const auto &edge: edges) {
+        m_edgeIndices.push_back(edge.first);
+        m_edgeIndices.push_back(edge.second);
+    }
+}
+
+const std::vector<PackedShaderVertex> &Model::packedEdgeVertices()
+{
+    packEdges();
+    return m_packedEdgeVertices;
+}
+
+const std::vector<GLuint> &Model::edgeIndices()
+{
+    packEdges();
+    return m_edgeIndices;
+}
+
 ShaderVertex *Model::toolVertices()
 {
     return m_toolVertices;
@@ -386,6 +471,10 @@ void Model::updateEdges(ShaderVertex *edgeVertices, int edgeVertexCount)
     
     m_edgeVertices = edgeVertices;
     m_edgeVertexCount = edgeVertexCount;
+    
+    m_edgesPacked = false;
+    m_packedEdgeVertices.clear();
+    m_edgeIndices.clear();
 }
 
 void Model::updateTriangleVertices(ShaderVertex *triangleVertices, int triangleVertexCount)
@@ -396,6 +485,7 @@ void Model::updateTriangleVertices(ShaderVertex *triangleVertices, int triangleV
     
     m_triangleVertices = triangleVertices;
     m_triangleVertexCount = triangleVertexCount;
+    invalidatePackedTriangleVertices();
 }
 
 quint64 Model::meshId() const
@@ -28,10 +28,15 @@ public:
     Model(const Model &mesh);
     Model();
     ~Model();
+    // The full vertices are released once packed, afterwards this is nullptr
     ShaderVertex *triangleVertices();
     int triangleVertexCount();
+    const std::vector<PackedShaderVertex> &packedTriangleVertices();
+    const std::vector<GLuint> &triangleIndices();
     ShaderVertex *edgeVertices();
     int edgeVertexCount();
+    const std::vector<PackedShaderVertex> &packedEdgeVertices();
+    const std::vector<GLuint> &edgeIndices();
     ShaderVertex *toolVertices();
     int toolVertexCount();
     const std::vector<QVector3D> &vertices();
@@ -63,8 +68,14 @@ public:
 private:
     ShaderVertex *m_triangleVertices = nullptr;
     int m_triangleVertexCount = 0;
+    bool m_triangleVerticesPacked = false;
+    std::vector<PackedShaderVertex> m_packedTriangleVertices;
+    std::vector<GLuint> m_triangleIndices;
     ShaderVertex *m_edgeVertices = nullptr;
     int m_edgeVertexCount = 0;
+    bool m_edgesPacked = false;
+    std::vector<PackedShaderVertex> m_packedEdgeVertices;
+    std::vector<GLuint> m_edgeIndices;
     ShaderVertex *m_toolVertices = nullptr;
     int m_toolVertexCount = 0;
     std::vector<QVector3D> m_vertices;
@@ -78,6 +89,10 @@ private:
     bool m_hasRoughnessInImage = false;
     bool m_hasAmbientOcclusionInImage = false;
     quint64 m_meshId = 0;
+    
+    void packTriangleVertices();
+    void invalidatePackedTriangleVertices();
+    void packEdges();
 };
 
 #endif
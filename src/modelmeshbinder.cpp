@@ -3,21 +3,47 @@
 #include <QTextStream>
 #include <QFileInfo>
 #include <map>
+#include <cstddef>
+#include <limits>
 #include <QDebug>
 #include <QDir>
 #include <QSurfaceFormat>
+#include <QOpenGLFramebufferObjectFormat>
 #include "modelmeshbinder.h"
+#include "shadervertexpacker.h"
 #include "ddsfile.h"
 #include "preferences.h"
 
 ModelMeshBinder::ModelMeshBinder(bool toolEnabled) :
     m_toolEnabled(toolEnabled)
 {
+    for (int i = 0; i < 2; ++i) {
+        m_iboTriangle[i].buffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+        m_iboEdge[i].buffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+    }
+}
+
+void ModelMeshBinder::setupPackedVertexAttributes()
+{
+    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+    f->glEnableVertexAttribArray(0);
+    f->glEnableVertexAttribArray(1);
+    f->glEnableVertexAttribArray(2);
+    f->glEnableVertexAttribArray(3);
+    f->glEnableVertexAttribArray(4);
+    f->glEnableVertexAttribArray(6);
+    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedShaderVertex), reinterpret_cast<void *>(offsetof(PackedShaderVertex, posX)));
+    f->glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedShaderVertex), reinterpret_cast<void *>(offsetof(PackedShaderVertex, normX)));
+    f->glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedShaderVertex), reinterpret_cast<void *>(offsetof(PackedShaderVertex, colorR)));
+    f->glVertexAttribPointer(3, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedShaderVertex), reinterpret_cast<void *>(offsetof(PackedShaderVertex, texU)));
+    f->glVertexAttribPointer(4, 2, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedShaderVertex), reinterpret_cast<void *>(offsetof(PackedShaderVertex, metalness)));
+    f->glVertexAttribPointer(6, 2, GL_SHORT, GL_TRUE, sizeof(PackedShaderVertex), reinterpret_cast<void *>(offsetof(PackedShaderVertex, tangentX)));
 }
 
 ModelMeshBinder::~ModelMeshBinder()
 {
     delete m_mesh;
+    delete m_pendingMesh;
     delete m_newMesh;
     delete m_texture;
     delete m_normalMap;
@@ -30,7 +56,11 @@ ModelMeshBinder::~ModelMeshBinder()
     delete m_newToonDepthMap;
     delete m_currentToonNormalMap;
     delete m_currentToonDepthMap;
+    delete m_toonNormalMapFramebuffer;
+    delete m_toonDepthMapFramebuffer;
     delete m_colorTextureImage;
+    for (auto &it: m_colorTextureRectImages)
+        delete it.first;
 }
 
 void ModelMeshBinder::updateMesh(Model *mesh)
@@ -48,6 +78,15 @@ void ModelMeshBinder::updateColorTexture(QImage *colorTextureImage)
     QMutexLocker lock(&m_colorTextureMutex);
     delete m_colorTextureImage;
     m_colorTextureImage = colorTextureImage;
+    for (auto &it: m_colorTextureRectImages)
+        delete it.first;
+    m_colorTextureRectImages.clear();
+}
+
+void ModelMeshBinder::updateColorTextureRect(QImage *colorTextureImage, const QRect &rect)
+{
+    QMutexLocker lock(&m_colorTextureMutex);
+    m_colorTextureRectImages.push_back({colorTextureImage, rect});
 }
 
 void ModelMeshBinder::reloadMesh()
@@ -65,10 +104,125 @@ void ModelMeshBinder::reloadMesh()
 
 void ModelMeshBinder::initialize()
 {
-    m_vaoTriangle.create();
-    m_vaoEdge.create();
-    if (m_toolEnabled)
-        m_vaoTool.create();
+    for (int i = 0; i < 2; ++i) {
+        m_vaoTriangle[i].create();
+        m_vaoEdge[i].create();
+        if (m_toolEnabled)
+            m_vaoTool[i].create();
+    }
+}
+
+void ModelMeshBinder::enableIncrementalUpload()
+{
+    m_incrementalUploadEnabled = true;
+}
+
+bool ModelMeshBinder::isUploading()
+{
+    return m_newMeshComing || nullptr != m_pendingMesh;
+}
+
+quint64 ModelMeshBinder::meshGeneration()
+{
+    return m_meshGeneration;
+}
+
+bool ModelMeshBinder::streamToBuffer(StreamingBuffer *target, const void *data, int size, int *budget, bool *bound)
+{
+    if (nullptr != bound)
+        *bound = false;
+    if (target->uploaded < 0) {
+        if (*budget <= 0 && size > 0)
+            return false;
+        if (!target->buffer.isCreated()) {
+            target->buffer.create();
+            target->capacity = 0;
+        }
+        target->buffer.bind();
+        if (nullptr != bound)
+            *bound = true;
+        // Grow by doubling so steady editing settles on a fixed allocation;
+        // otherwise orphan the old storage, so the driver never waits on draws still reading it
+        if (size > target->capacity)
+            target->capacity = qMax(size, target->capacity * 2);
+        target->buffer.allocate(target->capacity);
+        target->uploaded = 0;
+    } else {
+        target->buffer.bind();
+        if (nullptr != bound)
+            *bound = true;
+    }
+    int chunkSize = qMin(size - target->uploaded, *budget);
+    if (chunkSize > 0) {
+        target->buffer.write(target->uploaded, (const char *)data + target->uploaded, chunkSize);
+        target->uploaded += chunkSize;
+        *budget -= chunkSize;
+    }
+    return target->uploaded >= size;
+}
+
+bool ModelMeshBinder::uploadEdges(Model *mesh, int bufferIndex, int *budget)
+{
+    const auto &packedVertices = mesh->packedEdgeVertices();
+    const auto &indices = mesh->edgeIndices();
+    bool finished = true;
+    QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoEdge[bufferIndex]);
+    bool bound = false;
+    if (!streamToBuffer(&m_vboEdge[bufferIndex], packedVertices.data(),
+            packedVertices.size() * sizeof(PackedShaderVertex), budget, &bound))
+        finished = false;
+    if (bound) {
+        setupPackedVertexAttributes();
+        m_vboEdge[bufferIndex].buffer.release();
+    }
+    if (!streamToBuffer(&m_iboEdge[bufferIndex], indices.data(),
+            indices.size() * sizeof(GLuint), budget))
+        finished = false;
+    return finished;
+}
+
+bool ModelMeshBinder::uploadPendingMesh()
+{
+    int back = 1 - m_frontBuffer;
+    int budget = m_incrementalUploadEnabled ? m_maxUploadBytesPerFrame : std::numeric_limits<int>::max();
+    bool finished = true;
+    {
+        const auto &packedVertices = m_pendingMesh->packedTriangleVertices();
+        const auto &indices = m_pendingMesh->triangleIndices();
+        QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoTriangle[back]);
+        bool bound = false;
+        if (!streamToBuffer(&m_vboTriangle[back], packedVertices.data(),
+                packedVertices.size() * sizeof(PackedShaderVertex), &budget, &bound))
+            finished = false;
+        // Attribute pointers are only recorded against the vertex buffer once it is bound
+        if (bound) {
+            setupPackedVertexAttributes();
+            m_vboTriangle[back].buffer.release();
+        }
+        // The element buffer binding is recorded in the VAO, so it stays bound
+        if (!streamToBuffer(&m_iboTriangle[back], indices.data(),
+                indices.size() * sizeof(GLuint), &budget))
+            finished = false;
+    }
+    // Edges are only streamed along while the wireframe is visible, otherwise they are built on first use
+    m_pendingEdgesUploaded = false;
+    if (m_showWireframe) {
+        m_pendingEdgesUploaded = uploadEdges(m_pendingMesh, back, &budget);
+        if (!m_pendingEdgesUploaded)
+            finished = false;
+    }
+    if (m_toolEnabled) {
+        QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoTool[back]);
+        bool bound = false;
+        if (!streamToBuffer(&m_vboTool[back], m_pendingToolVertices.data(),
+                m_pendingToolVertices.size() * sizeof(PackedShaderVertex), &budget, &bound))
+            finished = false;
+        if (bound) {
+            setupPackedVertexAttributes();
+            m_vboTool[back].buffer.release();
+        }
+    }
+    return finished;
 }
 
 void ModelMeshBinder::enableEnvironmentLight()
@@ -126,149 +280,91 @@ void ModelMeshBinder::paint(ModelShaderProgram *program)
 				m_newToonDepthMap = nullptr;
             }
             
+            m_toonMapsInFramebuffers = false;
             m_newToonMapsComing = false;
         }
     }
-    {
-        QMutexLocker lock(&m_meshMutex);
-        if (hasNewMesh) {
+    if (hasNewMesh) {
+        delete m_pendingMesh;
+        m_pendingMesh = newMesh;
+        m_pendingToolVertices.clear();
+        int back = 1 - m_frontBuffer;
+        m_vboTriangle[back].uploaded = -1;
+        m_iboTriangle[back].uploaded = -1;
+        m_vboEdge[back].uploaded = -1;
+        m_iboEdge[back].uploaded = -1;
+        m_vboTool[back].uploaded = -1;
+        if (nullptr == m_pendingMesh) {
+            QMutexLocker lock(&m_meshMutex);
             delete m_mesh;
-            m_mesh = newMesh;
-            if (m_mesh) {
-                m_hasTexture = nullptr != m_mesh->textureImage();
-                delete m_texture;
-                m_texture = nullptr;
-                if (m_hasTexture) {
-                    if (m_checkUvEnabled) {
-                        static QImage *s_checkUv = nullptr;
-                        if (nullptr == s_checkUv)
-                            s_checkUv = new QImage(":/resources/checkuv.png");
-                        m_texture = new QOpenGLTexture(*s_checkUv);
-                    } else {
-                        m_texture = new QOpenGLTexture(*m_mesh->textureImage());
-                    }
-                }
-                
-                m_hasNormalMap = nullptr != m_mesh->normalMapImage();
-                delete m_normalMap;
-                m_normalMap = nullptr;
-                if (m_hasNormalMap)
-                    m_normalMap = new QOpenGLTexture(*m_mesh->normalMapImage());
-                
-                m_hasMetalnessMap = m_mesh->hasMetalnessInImage();
-                m_hasRoughnessMap = m_mesh->hasRoughnessInImage();
-                m_hasAmbientOcclusionMap = m_mesh->hasAmbientOcclusionInImage();
-                delete m_metalnessRoughnessAmbientOcclusionMap;
-                m_metalnessRoughnessAmbientOcclusionMap = nullptr;
-                if (nullptr != m_mesh->metalnessRoughnessAmbientOcclusionImage() &&
-                        (m_hasMetalnessMap || m_hasRoughnessMap || m_hasAmbientOcclusionMap))
-                    m_metalnessRoughnessAmbientOcclusionMap = new QOpenGLTexture(*m_mesh->metalnessRoughnessAmbientOcclusionImage());
-                
-                //delete m_environmentIrradianceMap;
-                //m_environmentIrradianceMap = nullptr;
-                //delete m_environmentSpecularMap;
-                //m_environmentSpecularMap = nullptr;
-                if (program->isCoreProfile() && 
-                        m_environmentLightEnabled/* &&
-                        (m_hasMetalnessMap || m_hasRoughnessMap)*/) {
-                    if (nullptr == m_environmentIrradianceMap) {
-                        DdsFileReader irradianceFile(":/resources/cedar_bridge_irradiance.dds");
-                        m_environmentIrradianceMap = irradianceFile.createOpenGLTexture();
-                    }
-                    
-                    if (nullptr == m_environmentSpecularMap) {
-                        DdsFileReader specularFile(":/resources/cedar_bridge_specular.dds");
-                        m_environmentSpecularMap = specularFile.createOpenGLTexture();
-                    }
-                }
-                
-                {
-                    QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoTriangle);
-                    if (m_vboTriangle.isCreated())
-                        m_vboTriangle.destroy();
-                    m_vboTriangle.create();
-                    m_vboTriangle.bind();
-                    m_vboTriangle.allocate(m_mesh->triangleVertices(), m_mesh->triangleVertexCount() * sizeof(ShaderVertex));
-                    m_renderTriangleVertexCount = m_mesh->triangleVertexCount();
-                    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
-                    f->glEnableVertexAttribArray(0);
-                    f->glEnableVertexAttribArray(1);
-                    f->glEnableVertexAttribArray(2);
-                    f->glEnableVertexAttribArray(3);
-                    f->glEnableVertexAttribArray(4);
-                    f->glEnableVertexAttribArray(5);
-                    f->glEnableVertexAttribArray(6);
-                    f->glEnableVertexAttribArray(7);
-                    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), 0);
-                    f->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(6 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(9 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(11 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(12 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(13 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(16 * sizeof(GLfloat)));
-                    m_vboTriangle.release();
-                }
-                {
-                    QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoEdge);
-                    if (m_vboEdge.isCreated())
-                        m_vboEdge.destroy();
-                    m_vboEdge.create();
-                    m_vboEdge.bind();
-                    m_vboEdge.allocate(m_mesh->edgeVertices(), m_mesh->edgeVertexCount() * sizeof(ShaderVertex));
-                    m_renderEdgeVertexCount = m_mesh->edgeVertexCount();
-                    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
-                    f->glEnableVertexAttribArray(0);
-                    f->glEnableVertexAttribArray(1);
-                    f->glEnableVertexAttribArray(2);
-                    f->glEnableVertexAttribArray(3);
-                    f->glEnableVertexAttribArray(4);
-                    f->glEnableVertexAttribArray(5);
-                    f->glEnableVertexAttribArray(6);
-                    f->glEnableVertexAttribArray(7);
-                    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), 0);
-                    f->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(6 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(9 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(11 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(12 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(13 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(16 * sizeof(GLfloat)));
-                    m_vboEdge.release();
-                }
-                if (m_toolEnabled) {
-                    QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoTool);
-                    if (m_vboTool.isCreated())
-                        m_vboTool.destroy();
-                    m_vboTool.create();
-                    m_vboTool.bind();
-                    m_vboTool.allocate(m_mesh->toolVertices(), m_mesh->toolVertexCount() * sizeof(ShaderVertex));
-                    m_renderToolVertexCount = m_mesh->toolVertexCount();
-                    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
-                    f->glEnableVertexAttribArray(0);
-                    f->glEnableVertexAttribArray(1);
-                    f->glEnableVertexAttribArray(2);
-                    f->glEnableVertexAttribArray(3);
-                    f->glEnableVertexAttribArray(4);
-                    f->glEnableVertexAttribArray(5);
-                    f->glEnableVertexAttribArray(6);
-                    f->glEnableVertexAttribArray(7);
-                    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), 0);
-                    f->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(6 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(9 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(11 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(12 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(13 * sizeof(GLfloat)));
-                    f->glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), reinterpret_cast<void *>(16 * sizeof(GLfloat)));
-                    m_vboTool.release();
-                } else {
-                    m_renderToolVertexCount = 0;
-                }
+            m_mesh = nullptr;
+            m_renderTriangleIndexCount = 0;
+            m_renderEdgeIndexCount = 0;
+            m_renderToolVertexCount = 0;
+            m_edgesUploaded = false;
+            ++m_meshGeneration;
+        } else {
+            if (m_toolEnabled)
+                packShaderVertices(m_pendingMesh->toolVertices(), m_pendingMesh->toolVertexCount(), &m_pendingToolVertices);
+        }
+    }
+    if (nullptr != m_pendingMesh && uploadPendingMesh()) {
+        QMutexLocker lock(&m_meshMutex);
+        delete m_mesh;
+        m_mesh = m_pendingMesh;
+        m_pendingMesh = nullptr;
+        m_frontBuffer = 1 - m_frontBuffer;
+        ++m_meshGeneration;
+        m_renderTriangleIndexCount = m_mesh->triangleIndices().size();
+        m_edgesUploaded = m_pendingEdgesUploaded;
+        m_renderEdgeIndexCount = m_edgesUploaded ? m_mesh->edgeIndices().size() : 0;
+        m_renderToolVertexCount = m_pendingToolVertices.size();
+        m_pendingToolVertices.clear();
+        
+        m_hasTexture = nullptr != m_mesh->textureImage();
+        delete m_texture;
+        m_texture = nullptr;
+        if (m_hasTexture) {
+            if (m_checkUvEnabled) {
+                static QImage *s_checkUv = nullptr;
+                if (nullptr == s_checkUv)
+                    s_checkUv = new QImage(":/resources/checkuv.png");
+                m_texture = new QOpenGLTexture(*s_checkUv);
             } else {
-                m_renderTriangleVertexCount = 0;
-                m_renderEdgeVertexCount = 0;
-                m_renderToolVertexCount = 0;
+                m_texture = new QOpenGLTexture(*m_mesh->textureImage());
+            }
+        }
+        
+        m_hasNormalMap = nullptr != m_mesh->normalMapImage();
+        delete m_normalMap;
+        m_normalMap = nullptr;
+        if (m_hasNormalMap)
+            m_normalMap = new QOpenGLTexture(*m_mesh->normalMapImage());
+        
+        m_hasMetalnessMap = m_mesh->hasMetalnessInImage();
+        m_hasRoughnessMap = m_mesh->hasRoughnessInImage();
+        m_hasAmbientOcclusionMap = m_mesh->hasAmbientOcclusionInImage();
+        delete m_metalnessRoughnessAmbientOcclusionMap;
+        m_metalnessRoughnessAmbientOcclusionMap = nullptr;
+        if (nullptr != m_mesh->metalnessRoughnessAmbientOcclusionImage() &&
+                (m_hasMetalnessMap || m_hasRoughnessMap || m_hasAmbientOcclusionMap))
+            m_metalnessRoughnessAmbientOcclusionMap = new QOpenGLTexture(*m_mesh->metalnessRoughnessAmbientOcclusionImage());
+        
+        //delete m_environmentIrradianceMap;
+        //m_environmentIrradianceMap = nullptr;
+        //delete m_environmentSpecularMap;
+        //m_environmentSpecularMap = nullptr;
+        if (program->isCoreProfile() && 
+                m_environmentLightEnabled/* &&
+                (m_hasMetalnessMap || m_hasRoughnessMap)*/) {
+            if (nullptr == m_environmentIrradianceMap) {
+                DdsFileReader irradianceFile(":/resources/cedar_bridge_irradiance.dds");
+                m_environmentIrradianceMap = irradianceFile.createOpenGLTexture();
+            }
+            
+            if (nullptr == m_environmentSpecularMap) {
+                DdsFileReader specularFile(":/resources/cedar_bridge_specular.dds");
+                m_environmentSpecularMap = specularFile.createOpenGLTexture();
             }
         }
     }
@@ -280,8 +376,19 @@ void ModelMeshBinder::paint(ModelShaderProgram *program)
     program->setUniformValue(program->toonNormalMapIdLoc(), 5);
     program->setUniformValue(program->toonDepthMapIdLoc(), 6);
     if (m_showWireframe) {
-        if (m_renderEdgeVertexCount > 0) {
-            QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoEdge);
+        if (!m_edgesUploaded && nullptr != m_mesh) {
+            int budget = std::numeric_limits<int>::max();
+            m_iboEdge[m_frontBuffer].uploaded = -1;
+            m_vboEdge[m_frontBuffer].uploaded = -1;
+            {
+                QMutexLocker lock(&m_meshMutex);
+                m_mesh->edgeIndices();
+            }
+            m_edgesUploaded = uploadEdges(m_mesh, m_frontBuffer, &budget);
+            m_renderEdgeIndexCount = m_mesh->edgeIndices().size();
+        }
+        if (m_renderEdgeIndexCount > 0) {
+            QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoEdge[m_frontBuffer]);
 			QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
             // glDrawArrays GL_LINES crashes on Mesa GL
             if (program->isCoreProfile()) {
@@ -294,12 +401,12 @@ void ModelMeshBinder::paint(ModelShaderProgram *program)
                     program->setUniformValue(program->environmentIrradianceMapEnabledLoc(), 0);
                     program->setUniformValue(program->environmentSpecularMapEnabledLoc(), 0);
                 }
-                f->glDrawArrays(GL_LINES, 0, m_renderEdgeVertexCount);
+                f->glDrawElements(GL_LINES, m_renderEdgeIndexCount, GL_UNSIGNED_INT, 0);
             }
         }
     }
-    if (m_renderTriangleVertexCount > 0) {
-        QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoTriangle);
+    if (m_renderTriangleIndexCount > 0) {
+        QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoTriangle[m_frontBuffer]);
 		QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
         if (m_hasTexture) {
             {
@@ -310,6 +417,25 @@ void ModelMeshBinder::paint(ModelShaderProgram *program)
                     delete m_colorTextureImage;
                     m_colorTextureImage = nullptr;
                 }
+                if (!m_colorTextureRectImages.empty()) {
+                    if (m_texture && !m_checkUvEnabled) {
+                        QRect textureRect(0, 0, m_texture->width(), m_texture->height());
+                        m_texture->bind(0);
+                        for (const auto &it: m_colorTextureRectImages) {
+                            if (!textureRect.contains(it.second) || it.first->size() != it.second.size())
+                                continue;
+                            QImage image = it.first->convertToFormat(QImage::Format_RGBA8888);
+                            f->glTexSubImage2D(GL_TEXTURE_2D, 0, it.second.x(), it.second.y(),
+                                it.second.width(), it.second.height(),
+                                GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+                        }
+                        if (m_texture->mipLevels() > 1)
+                            m_texture->generateMipMaps();
+                    }
+                    for (auto &it: m_colorTextureRectImages)
+                        delete it.first;
+                    m_colorTextureRectImages.clear();
+                }
             }
             if (m_texture)
                 m_texture->bind(0);
@@ -345,16 +471,23 @@ void ModelMeshBinder::paint(ModelShaderProgram *program)
                 program->setUniformValue(program->environmentSpecularMapEnabledLoc(), 0);
             }
         }
-        if (nullptr != m_toonNormalMap && nullptr != m_toonDepthMap) {
+        if (m_toonMapsInFramebuffers) {
+            f->glActiveTexture(GL_TEXTURE5);
+            f->glBindTexture(GL_TEXTURE_2D, m_toonNormalMapFramebuffer->texture());
+            f->glActiveTexture(GL_TEXTURE6);
+            f->glBindTexture(GL_TEXTURE_2D, m_toonDepthMapFramebuffer->texture());
+            f->glActiveTexture(GL_TEXTURE0);
+            program->setUniformValue(program->toonEdgeEnabledLoc(), (int)Preferences::instance().toonLine());
+        } else if (nullptr != m_toonNormalMap && nullptr != m_toonDepthMap) {
             m_toonNormalMap->bind(5);
             m_toonDepthMap->bind(6);
             program->setUniformValue(program->toonEdgeEnabledLoc(), (int)Preferences::instance().toonLine());
         }
-        f->glDrawArrays(GL_TRIANGLES, 0, m_renderTriangleVertexCount);
+        f->glDrawElements(GL_TRIANGLES, m_renderTriangleIndexCount, GL_UNSIGNED_INT, 0);
     }
     if (m_toolEnabled) {
         if (m_renderToolVertexCount > 0) {
-            QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoTool);
+            QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoTool[m_frontBuffer]);
             QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
             program->setUniformValue(program->textureEnabledLoc(), 0);
             program->setUniformValue(program->normalMapEnabledLoc(), 0);
@@ -370,9 +503,68 @@ void ModelMeshBinder::paint(ModelShaderProgram *program)
     }
 }
 
+void ModelMeshBinder::paintToonNormalAndDepthMaps(ModelShaderProgram *program, const QSize &size, GLuint defaultFramebuffer)
+{
+    if (m_renderTriangleIndexCount <= 0 || size.isEmpty())
+        return;
+    
+    if (nullptr == m_toonNormalMapFramebuffer || m_toonNormalMapFramebuffer->size() != size) {
+        delete m_toonNormalMapFramebuffer;
+        delete m_toonDepthMapFramebuffer;
+        QOpenGLFramebufferObjectFormat format;
+        format.setAttachment(QOpenGLFramebufferObject::Depth);
+        m_toonNormalMapFramebuffer = new QOpenGLFramebufferObject(size, format);
+        m_toonDepthMapFramebuffer = new QOpenGLFramebufferObject(size, format);
+    }
+    
+    QOpenGLVertexArrayObject::Binder vaoBinder(&m_vaoTriangle[m_frontBuffer]);
+    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+    GLfloat clearColor[4];
+    f->glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    f->glDisable(GL_BLEND);
+    f->glClearColor(0, 0, 0, 0);
+    f->glViewport(0, 0, size.width(), size.height());
+    
+    program->setUniformValue(program->textureEnabledLoc(), 0);
+    program->setUniformValue(program->toonEdgeEnabledLoc(), 0);
+    if (m_hasNormalMap && nullptr != m_normalMap) {
+        m_normalMap->bind(1);
+        program->setUniformValue(program->normalMapIdLoc(), 1);
+        program->setUniformValue(program->normalMapEnabledLoc(), 1);
+    } else {
+        program->setUniformValue(program->normalMapEnabledLoc(), 0);
+    }
+    
+    QOpenGLFramebufferObject *framebuffers[] = {m_toonNormalMapFramebuffer, m_toonDepthMapFramebuffer};
+    for (int i = 0; i < 2; ++i) {
+        framebuffers[i]->bind();
+        f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        program->setUniformValue(program->renderPurposeLoc(), i + 1);
+        f->glDrawElements(GL_TRIANGLES, m_renderTriangleIndexCount, GL_UNSIGNED_INT, 0);
+    }
+    
+    f->glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer);
+    program->setUniformValue(program->renderPurposeLoc(), 0);
+    f->glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    f->glEnable(GL_BLEND);
+    
+    QMutexLocker lock(&m_toonNormalAndDepthMapMutex);
+    m_toonMapsInFramebuffers = true;
+}
+
 void ModelMeshBinder::fetchCurrentToonNormalAndDepthMaps(QImage *normalMap, QImage *depthMap)
 {
     QMutexLocker lock(&m_toonNormalAndDepthMapMutex);
+    if (m_toonMapsInFramebuffers) {
+        // Read back only when another context asks for the maps
+        if (nullptr == QOpenGLContext::currentContext())
+            return;
+        if (nullptr != normalMap)
+            *normalMap = m_toonNormalMapFramebuffer->toImage();
+        if (nullptr != depthMap)
+            *depthMap = m_toonDepthMapFramebuffer->toImage();
+        return;
+    }
     if (nullptr != normalMap && nullptr != m_currentToonNormalMap)
         *normalMap = *m_currentToonNormalMap;
     if (nullptr != depthMap && nullptr != m_currentToonDepthMap)
@@ -394,13 +586,13 @@ void ModelMeshBinder::updateToonNormalAndDepthMaps(QImage *normalMap, QImage *de
 
 void ModelMeshBinder::cleanup()
 {
-    if (m_vboTriangle.isCreated())
-        m_vboTriangle.destroy();
-    if (m_vboEdge.isCreated())
-        m_vboEdge.destroy();
-    if (m_toolEnabled) {
-        if (m_vboTool.isCreated())
-            m_vboTool.destroy();
+    for (int i = 0; i < 2; ++i) {
+        for (auto &it: {&m_vboTriangle[i], &m_iboTriangle[i], &m_vboEdge[i], &m_iboEdge[i], &m_vboTool[i]}) {
+            if (it->buffer.isCreated())
+                it->buffer.destroy();
+            it->capacity = 0;
+            it->uploaded = -1;
+        }
     }
     delete m_texture;
     m_texture = nullptr;
@@ -416,6 +608,11 @@ void ModelMeshBinder::cleanup()
     m_toonNormalMap = nullptr;
     delete m_toonDepthMap;
     m_toonDepthMap = nullptr;
+    delete m_toonNormalMapFramebuffer;
+    m_toonNormalMapFramebuffer = nullptr;
+    delete m_toonDepthMapFramebuffer;
+    m_toonDepthMapFramebuffer = nullptr;
+    m_toonMapsInFramebuffers = false;
 }
 
 void ModelMeshBinder::showWireframe()
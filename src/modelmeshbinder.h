@@ -5,6 +5,9 @@
 #include <QOpenGLBuffer>
 #include <QString>
 #include <QOpenGLTexture>
+#include <QOpenGLFramebufferObject>
+#include <QRect>
+#include <vector>
 #include "model.h"
 #include "modelshaderprogram.h"
 
@@ -16,6 +19,7 @@ public:
     Model *fetchCurrentMesh();
     void updateMesh(Model *mesh);
     void updateColorTexture(QImage *colorTextureImage);
+    void updateColorTextureRect(QImage *colorTextureImage, const QRect &rect);
     void initialize();
     void paint(ModelShaderProgram *program);
     void cleanup();
@@ -28,13 +32,17 @@ public:
     bool isEnvironmentLightEnabled();
     bool isCheckUvEnabled();
     void reloadMesh();
+    void enableIncrementalUpload();
+    bool isUploading();
     void fetchCurrentToonNormalAndDepthMaps(QImage *normalMap, QImage *depthMap);
     void updateToonNormalAndDepthMaps(QImage *normalMap, QImage *depthMap);
+    void paintToonNormalAndDepthMaps(ModelShaderProgram *program, const QSize &size, GLuint defaultFramebuffer);
+    quint64 meshGeneration();
 private:
     Model *m_mesh = nullptr;
     Model *m_newMesh = nullptr;
-    int m_renderTriangleVertexCount = 0;
-    int m_renderEdgeVertexCount = 0;
+    int m_renderTriangleIndexCount = 0;
+    int m_renderEdgeIndexCount = 0;
     int m_renderToolVertexCount = 0;
     bool m_newMeshComing = false;
     bool m_showWireframe = false;
@@ -58,18 +66,45 @@ private:
     QImage *m_currentToonNormalMap = nullptr;
     QImage *m_currentToonDepthMap = nullptr;
     QImage *m_colorTextureImage = nullptr;
+    std::vector<std::pair<QImage *, QRect>> m_colorTextureRectImages;
     bool m_newToonMapsComing = false;
+    QOpenGLFramebufferObject *m_toonNormalMapFramebuffer = nullptr;
+    QOpenGLFramebufferObject *m_toonDepthMapFramebuffer = nullptr;
+    bool m_toonMapsInFramebuffers = false;
+    quint64 m_meshGeneration = 0;
+    Model *m_pendingMesh = nullptr;
+    std::vector<PackedShaderVertex> m_pendingToolVertices;
+    bool m_pendingEdgesUploaded = false;
+    bool m_edgesUploaded = false;
+    bool m_incrementalUploadEnabled = false;
+    int m_maxUploadBytesPerFrame = 4 * 1024 * 1024;
 private:
-    QOpenGLVertexArrayObject m_vaoTriangle;
-    QOpenGLBuffer m_vboTriangle;
-    QOpenGLVertexArrayObject m_vaoEdge;
-    QOpenGLBuffer m_vboEdge;
-    QOpenGLVertexArrayObject m_vaoTool;
-    QOpenGLBuffer m_vboTool;
+    struct StreamingBuffer
+    {
+        QOpenGLBuffer buffer;
+        int capacity = 0;
+        int uploaded = -1;
+    };
+    
+    // The front set is drawn while the pending mesh streams into the back set
+    int m_frontBuffer = 0;
+    QOpenGLVertexArrayObject m_vaoTriangle[2];
+    StreamingBuffer m_vboTriangle[2];
+    StreamingBuffer m_iboTriangle[2];
+    QOpenGLVertexArrayObject m_vaoEdge[2];
+    StreamingBuffer m_vboEdge[2];
+    StreamingBuffer m_iboEdge[2];
+    QOpenGLVertexArrayObject m_vaoTool[2];
+    StreamingBuffer m_vboTool[2];
     QMutex m_meshMutex;
     QMutex m_newMeshMutex;
     QMutex m_toonNormalAndDepthMapMutex;
     QMutex m_colorTextureMutex;
+    
+    static void setupPackedVertexAttributes();
+    static bool streamToBuffer(StreamingBuffer *target, const void *data, int size, int *budget, bool *bound=nullptr);
+    bool uploadEdges(Model *mesh, int bufferIndex, int *budget);
+    bool uploadPendingMesh();
 };
 
 #endif
@@ -19,6 +19,8 @@ ModelOffscreenRender::~ModelOffscreenRender()
     // FIXME: If delete m_renderFbo inside toImage, 
     // sometimes, the application will freeze, maybe there are dead locks inside the destruction call
     // move it here can make sure it will be deleted on the main GUI thread to avoid dead locks
+    for (auto &it: m_retiredFbos)
+        delete it;
     delete m_renderFbo;
     
     destroy();
@@ -92,10 +94,8 @@ void ModelOffscreenRender::updateToonNormalAndDepthMaps(QImage *normalMap, QImag
     m_depthMap = depthMap;
 }
 
-QImage ModelOffscreenRender::toImage(const QSize &size)
+bool ModelOffscreenRender::createContext()
 {
-	QImage image;
-	
 	m_context = new QOpenGLContext();
     m_context->setFormat(format());
     if (!m_context->create()) {
@@ -103,7 +103,7 @@ QImage ModelOffscreenRender::toImage(const QSize &size)
 		m_context = nullptr;
 		
         qDebug() << "QOpenGLContext create failed";
-        return image;
+        return false;
 	}
     
     if (!m_context->makeCurrent(this)) {
@@ -111,32 +111,189 @@ QImage ModelOffscreenRender::toImage(const QSize &size)
 		m_context = nullptr;
 		
         qDebug() << "QOpenGLContext makeCurrent failed";
-        return image;
+        return false;
     }
     
+    return true;
+}
+
+void ModelOffscreenRender::destroyContext()
+{
+    m_renderFbo->release();
+    
+    m_context->doneCurrent();
+    delete m_context;
+    m_context = nullptr;
+}
+
+void ModelOffscreenRender::createFramebuffer(const QSize &size)
+{
+    // Every context gets its own framebuffer, the one of a deleted context is never bound again
+    // and is only deleted in the destructor, see the FIXME there
+    if (nullptr != m_renderFbo)
+        m_retiredFbos.push_back(m_renderFbo);
     QOpenGLFramebufferObjectFormat format;
     format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
     format.setSamples(4);
     format.setTextureTarget(GL_TEXTURE_2D);
     format.setInternalTextureFormat(GL_RGBA32F_ARB);
     m_renderFbo = new QOpenGLFramebufferObject(size, format);
+}
+
+bool ModelOffscreenRender::isCoreProfile()
+{
+    const char *versionString = (const char *)m_context->functions()->glGetString(GL_VERSION);
+    if (nullptr != versionString &&
+            '\0' != versionString[0] &&
+            0 == strstr(versionString, "Mesa")) {
+        return m_context->format().profile() == QSurfaceFormat::CoreProfile;
+    }
+    return false;
+}
+
+void ModelOffscreenRender::enableRenderStates()
+{
+    m_context->functions()->glEnable(GL_BLEND);
+    m_context->functions()->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    m_context->functions()->glEnable(GL_DEPTH_TEST);
+    //m_context->functions()->glEnable(GL_CULL_FACE);
+#ifdef GL_LINE_SMOOTH
+    m_context->functions()->glEnable(GL_LINE_SMOOTH);
+#endif
+}
+
+void ModelOffscreenRender::setupProgram(ModelShaderProgram *program, const QSize &size, int xRotation, int yRotation)
+{
+    QMatrix4x4 projection;
+    QMatrix4x4 world;
+    QMatrix4x4 camera;
+    
+    world.setToIdentity();
+    world.rotate(xRotation / 16.0f, 1, 0, 0);
+    world.rotate(yRotation / 16.0f, 0, 1, 0);
+    world.rotate(m_zRot / 16.0f, 0, 0, 1);
+
+    projection.setToIdentity();
+    projection.translate(m_moveToPosition.x(), m_moveToPosition.y(), m_moveToPosition.z());
+    projection.perspective(45.0f, GLfloat(size.width()) / size.height(), 0.01f, 100.0f);
+    
+    camera.setToIdentity();
+    camera.translate(m_eyePosition);
+    
+    program->bind();
+    program->setUniformValue(program->eyePosLoc(), m_eyePosition);
+    program->setUniformValue(program->toonShadingEnabledLoc(), m_toonShading ? 1 : 0);
+    program->setUniformValue(program->projectionMatrixLoc(), projection);
+    program->setUniformValue(program->modelMatrixLoc(), world);
+    QMatrix3x3 normalMatrix = world.normalMatrix();
+    program->setUniformValue(program->normalMatrixLoc(), normalMatrix);
+    program->setUniformValue(program->viewMatrixLoc(), camera);
+    program->setUniformValue(program->textureEnabledLoc(), 0);
+    program->setUniformValue(program->normalMapEnabledLoc(), 0);
+    program->setUniformValue(program->mousePickEnabledLoc(), 0);
+    program->setUniformValue(program->renderPurposeLoc(), m_renderPurpose);
+    
+    program->setUniformValue(program->toonEdgeEnabledLoc(), 0);
+    program->setUniformValue(program->screenWidthLoc(), (GLfloat)size.width());
+    program->setUniformValue(program->screenHeightLoc(), (GLfloat)size.height());
+    program->setUniformValue(program->toonNormalMapIdLoc(), 0);
+    program->setUniformValue(program->toonDepthMapIdLoc(), 0);
+}
+
+std::vector<QImage> ModelOffscreenRender::toImages(std::vector<BatchItem> *items, const QSize &tileSize)
+{
+    std::vector<QImage> images(items->size());
+    if (items->empty())
+        return images;
+    
+    if (!createContext()) {
+        for (auto &it: *items) {
+            delete it.mesh;
+            it.mesh = nullptr;
+        }
+        return images;
+    }
+    
+    // Tiles are laid out on a grid inside an atlas of at most maxAtlasSize squared;
+    // when there are more tiles than one atlas can hold, the atlas is reused page by page
+    GLint maxTextureSize = 0;
+    m_context->functions()->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    int maxAtlasSize = qBound(qMax(tileSize.width(), tileSize.height()), (int)maxTextureSize, 4096);
+    int columns = qMax(1, maxAtlasSize / tileSize.width());
+    int maxRows = qMax(1, maxAtlasSize / tileSize.height());
+    columns = qMin(columns, (int)items->size());
+    int rows = qMin(maxRows, (int)(items->size() + columns - 1) / columns);
+    QSize atlasSize(columns * tileSize.width(), rows * tileSize.height());
+    size_t tilesPerPage = columns * rows;
+    
+    createFramebuffer(atlasSize);
     m_renderFbo->bind();
-    m_context->functions()->glViewport(0, 0, size.width(), size.height());
     
-    if (nullptr != m_mesh) {
-        QMatrix4x4 projection;
-        QMatrix4x4 world;
-        QMatrix4x4 camera;
+    ModelShaderProgram *program = new ModelShaderProgram(isCoreProfile());
+    ModelMeshBinder meshBinder;
+    meshBinder.initialize();
+    if (m_isWireframeVisible)
+        meshBinder.showWireframe();
+    else
+        meshBinder.hideWireframe();
+    if (m_isEnvironmentLightEnabled)
+        meshBinder.enableEnvironmentLight();
+    
+    for (size_t pageBegin = 0; pageBegin < items->size(); pageBegin += tilesPerPage) {
+        size_t pageEnd = qMin(items->size(), pageBegin + tilesPerPage);
+        
+        m_context->functions()->glViewport(0, 0, atlasSize.width(), atlasSize.height());
+        m_context->functions()->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        enableRenderStates();
         
-        bool isCoreProfile = false;
-        const char *versionString = (const char *)m_context->functions()->glGetString(GL_VERSION);
-        if (nullptr != versionString &&
-                '\0' != versionString[0] &&
-                0 == strstr(versionString, "Mesa")) {
-            isCoreProfile = m_context->format().profile() == QSurfaceFormat::CoreProfile;
+        for (size_t i = pageBegin; i < pageEnd; ++i) {
+            auto &item = (*items)[i];
+            size_t tileIndex = i - pageBegin;
+            int column = tileIndex % columns;
+            int row = tileIndex / columns;
+            m_context->functions()->glViewport(column * tileSize.width(), row * tileSize.height(),
+                tileSize.width(), tileSize.height());
+            setupProgram(program, tileSize, item.xRotation, item.yRotation);
+            meshBinder.updateMesh(item.mesh);
+            item.mesh = nullptr;
+            meshBinder.paint(program);
+            program->release();
         }
         
-        ModelShaderProgram *program = new ModelShaderProgram(isCoreProfile);
+        m_context->functions()->glFlush();
+        
+        // The readback is flipped to top-left origin, so GL row zero is the last tile row in the image
+        QImage atlas = m_renderFbo->toImage();
+        for (size_t i = pageBegin; i < pageEnd; ++i) {
+            size_t tileIndex = i - pageBegin;
+            int column = tileIndex % columns;
+            int row = tileIndex / columns;
+            images[i] = atlas.copy(column * tileSize.width(), atlasSize.height() - (row + 1) * tileSize.height(),
+                tileSize.width(), tileSize.height());
+        }
+    }
+    
+    meshBinder.cleanup();
+    delete program;
+    
+    destroyContext();
+    
+    return images;
+}
+
+QImage ModelOffscreenRender::toImage(const QSize &size)
+{
+	QImage image;
+	
+	if (!createContext())
+        return image;
+    
+    createFramebuffer(size);
+    m_renderFbo->bind();
+    m_context->functions()->glViewport(0, 0, size.width(), size.height());
+    
+    if (nullptr != m_mesh) {
+        ModelShaderProgram *program = new ModelShaderProgram(isCoreProfile());
         ModelMeshBinder meshBinder;
         meshBinder.initialize();
         if (m_isWireframeVisible)
@@ -152,44 +309,9 @@ QImage ModelOffscreenRender::toImage(const QSize &size)
         }
 		
         m_context->functions()->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        m_context->functions()->glEnable(GL_BLEND);
-        m_context->functions()->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        m_context->functions()->glEnable(GL_DEPTH_TEST);
-        //m_context->functions()->glEnable(GL_CULL_FACE);
-#ifdef GL_LINE_SMOOTH
-        m_context->functions()->glEnable(GL_LINE_SMOOTH);
-#endif
+        enableRenderStates();
 
-        world.setToIdentity();
-        world.rotate(m_xRot / 16.0f, 1, 0, 0);
-        world.rotate(m_yRot / 16.0f, 0, 1, 0);
-        world.rotate(m_zRot / 16.0f, 0, 0, 1);
-
-        projection.setToIdentity();
-        projection.translate(m_moveToPosition.x(), m_moveToPosition.y(), m_moveToPosition.z());
-        projection.perspective(45.0f, GLfloat(size.width()) / size.height(), 0.01f, 100.0f);
-        
-        camera.setToIdentity();
-        camera.translate(m_eyePosition);
-        
-        program->bind();
-        program->setUniformValue(program->eyePosLoc(), m_eyePosition);
-        program->setUniformValue(program->toonShadingEnabledLoc(), m_toonShading ? 1 : 0);
-        program->setUniformValue(program->projectionMatrixLoc(), projection);
-        program->setUniformValue(program->modelMatrixLoc(), world);
-        QMatrix3x3 normalMatrix = world.normalMatrix();
-        program->setUniformValue(program->normalMatrixLoc(), normalMatrix);
-        program->setUniformValue(program->viewMatrixLoc(), camera);
-        program->setUniformValue(program->textureEnabledLoc(), 0);
-        program->setUniformValue(program->normalMapEnabledLoc(), 0);
-        program->setUniformValue(program->mousePickEnabledLoc(), 0);
-        program->setUniformValue(program->renderPurposeLoc(), m_renderPurpose);
-        
-        program->setUniformValue(program->toonEdgeEnabledLoc(), 0);
-        program->setUniformValue(program->screenWidthLoc(), (GLfloat)size.width());
-        program->setUniformValue(program->screenHeightLoc(), (GLfloat)size.height());
-        program->setUniformValue(program->toonNormalMapIdLoc(), 0);
-        program->setUniformValue(program->toonDepthMapIdLoc(), 0);
+        setupProgram(program, size, m_xRot, m_yRot);
 
         meshBinder.updateMesh(m_mesh);
         meshBinder.paint(program);
@@ -206,11 +328,7 @@ QImage ModelOffscreenRender::toImage(const QSize &size)
     
     image = m_renderFbo->toImage();
     
-    m_renderFbo->release();
-
-    m_context->doneCurrent();
-    delete m_context;
-    m_context = nullptr;
+    destroyContext();
 
     return image;
 }
@@ -7,6 +7,7 @@
 #include <QImage>
 #include <QThread>
 #include <QOpenGLFramebufferObject>
+#include <vector>
 #include "modelshaderprogram.h"
 #include "modelmeshbinder.h"
 #include "model.h"
@@ -29,6 +30,14 @@ public:
     void updateToonNormalAndDepthMaps(QImage *normalMap, QImage *depthMap);
     void setToonShading(bool toonShading);
     QImage toImage(const QSize &size);
+    
+    struct BatchItem
+    {
+        Model *mesh = nullptr;
+        int xRotation = 0;
+        int yRotation = 0;
+    };
+    std::vector<QImage> toImages(std::vector<BatchItem> *items, const QSize &tileSize);
 private:
     int m_xRot = 0;
     int m_yRot = 0;
@@ -38,12 +47,20 @@ private:
     int m_renderPurpose = 0;
     QOpenGLContext *m_context = nullptr;
     QOpenGLFramebufferObject *m_renderFbo = nullptr;
+    std::vector<QOpenGLFramebufferObject *> m_retiredFbos;
     Model *m_mesh = nullptr;
     QImage *m_normalMap = nullptr;
     QImage *m_depthMap = nullptr;
     bool m_toonShading = false;
     bool m_isWireframeVisible = false;
     bool m_isEnvironmentLightEnabled = false;
+    
+    bool createContext();
+    void destroyContext();
+    void createFramebuffer(const QSize &size);
+    bool isCoreProfile();
+    void enableRenderStates();
+    void setupProgram(ModelShaderProgram *program, const QSize &size, int xRotation, int yRotation);
 };
 
 #endif
@@ -32,13 +32,11 @@ ModelShaderProgram::ModelShaderProgram(bool isCoreProfile)
         this->addShaderFromSourceCode(QOpenGLShader::Fragment, loadShaderSource(":/shaders/default.frag"));
     }
     this->bindAttributeLocation("vertex", 0);
-    this->bindAttributeLocation("normal", 1);
+    this->bindAttributeLocation("octNormal", 1);
     this->bindAttributeLocation("color", 2);
     this->bindAttributeLocation("texCoord", 3);
-    this->bindAttributeLocation("metalness", 4);
-    this->bindAttributeLocation("roughness", 5);
-    this->bindAttributeLocation("tangent", 6);
-    this->bindAttributeLocation("alpha", 7);
+    this->bindAttributeLocation("material", 4);
+    this->bindAttributeLocation("octTangent", 6);
     this->link();
 
     this->bind();
@@ -0,0 +1,707 @@
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <QVector4D>
+#include <cmath>
+#include <algorithm>
+#include "modelsoftwarerender.h"
+#include "shadervertexpacker.h"
+
+class SoftwareVertexTransformer
+{
+public:
+    SoftwareVertexTransformer(ModelSoftwareRender *render) :
+        m_render(render)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i)
+            m_render->transformVertex(m_render->m_triangleVertices[i], &m_render->m_transformedVertices[i]);
+    }
+private:
+    ModelSoftwareRender *m_render = nullptr;
+};
+
+class SoftwareTileRasterizer
+{
+public:
+    SoftwareTileRasterizer(ModelSoftwareRender *render) :
+        m_render(render)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i)
+            m_render->rasterizeTile(i);
+    }
+private:
+    ModelSoftwareRender *m_render = nullptr;
+};
+
+class SoftwareToonMapBuilder
+{
+public:
+    SoftwareToonMapBuilder(ModelSoftwareRender *render) :
+        m_render(render)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i)
+            m_render->buildToonMaps((int)i);
+    }
+private:
+    ModelSoftwareRender *m_render = nullptr;
+};
+
+class SoftwarePixelShader
+{
+public:
+    SoftwarePixelShader(ModelSoftwareRender *render) :
+        m_render(render)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i)
+            m_render->shadeRow((int)i);
+    }
+private:
+    ModelSoftwareRender *m_render = nullptr;
+};
+
+// Mirrors the lights and the metal/rough model of shaders/default.core.frag
+
+struct SoftwareLight
+{
+    QVector3D position;
+    float intensity;
+    float constantAttenuation;
+    float linearAttenuation;
+    float quadraticAttenuation;
+};
+
+static const SoftwareLight s_lights[] = {
+    {QVector3D(5.0, 5.0, 5.0), 3.0, 1.0, 0.0, 0.0025},
+    {QVector3D(-5.0, 5.0, 5.0), 0.1, 0.0, 0.0, 0.0},
+    {QVector3D(0.0, -5.0, -5.0), 0.05, 0.0, 0.0, 0.0}
+};
+
+static const float s_gamma = 2.2f;
+
+static float remapRoughness(float roughness)
+{
+    const float maxSpecPower = 999999.0f;
+    const float minRoughness = std::sqrt(2.0f / (maxSpecPower + 2.0f));
+    return std::max(roughness * roughness, minRoughness);
+}
+
+static float normalDistribution(const QVector3D &n, const QVector3D &h, float alpha)
+{
+    float specPower = 2.0f / (alpha * alpha) - 2.0f;
+    return (specPower + 2.0f) / (2.0f * 3.14159f) * std::pow(std::max(QVector3D::dotProduct(n, h), 0.0f), specPower);
+}
+
+static QVector3D fresnelFactor(const QVector3D &f, float cosineFactor)
+{
+    float weight = std::pow(std::max(1.0f - cosineFactor, 0.0f), 5.0f);
+    QVector3D result;
+    for (int i = 0; i < 3; ++i)
+        result[i] = std::min(std::max(f[i] + (1.0f - f[i]) * weight, f[i]), 1.0f);
+    return result;
+}
+
+static QVector3D specularModel(const QVector3D &F0, float sDotH, float sDotN, float vDotN)
+{
+    float sDotNPrime = std::max(sDotN, 0.001f);
+    float vDotNPrime = std::max(vDotN, 0.001f);
+    QVector3D F = fresnelFactor(F0, sDotH);
+    float G = sDotNPrime * vDotNPrime;
+    QVector3D cSpec = F * G / (4.0f * sDotNPrime * vDotNPrime);
+    for (int i = 0; i < 3; ++i)
+        cSpec[i] = std::min(std::max(cSpec[i], 0.0f), 1.0f);
+    return cSpec;
+}
+
+static QVector3D pbrModel(const SoftwareLight &light,
+    const QVector3D &position,
+    const QVector3D &n,
+    const QVector3D &v,
+    const QVector3D &baseColor,
+    float metalness,
+    float alpha,
+    float ambientOcclusion)
+{
+    float vDotN = QVector3D::dotProduct(v, n);
+    QVector3D sUnnormalized = light.position - position;
+    QVector3D s = sUnnormalized.normalized();
+    float sDotN = QVector3D::dotProduct(s, n);
+    float att = 1.0f;
+    if (sDotN > 0.0f) {
+        if (light.constantAttenuation != 0.0f ||
+                light.linearAttenuation != 0.0f ||
+                light.quadraticAttenuation != 0.0f) {
+            float dist = sUnnormalized.length();
+            att = 1.0f / (light.constantAttenuation +
+                light.linearAttenuation * dist +
+                light.quadraticAttenuation * dist * dist);
+        }
+    }
+    QVector3D h = (s + v).normalized();
+    float sDotH = QVector3D::dotProduct(s, h);
+
+    QVector3D diffuse = (1.0f - metalness) * baseColor * std::max(sDotN, 0.0f) / 3.14159f;
+
+    QVector3D F0 = QVector3D(0.04f, 0.04f, 0.04f) * (1.0f - metalness) + baseColor * metalness;
+    QVector3D specular;
+    if (sDotN > 0.0f)
+        specular = specularModel(F0, sDotH, sDotN, vDotN) * normalDistribution(n, h, alpha);
+
+    return att * light.intensity * (specular + diffuse * (QVector3D(1.0f, 1.0f, 1.0f) - specular)) * ambientOcclusion;
+}
+
+static QVector3D rgb2hsv(const QVector3D &c)
+{
+    QVector4D K(0.0f, -1.0f / 3.0f, 2.0f / 3.0f, -1.0f);
+    QVector4D p = c.z() <= c.y() ?
+        QVector4D(c.y(), c.z(), K.x(), K.y()) :
+        QVector4D(c.z(), c.y(), K.w(), K.z());
+    QVector4D q = p.x() <= c.x() ?
+        QVector4D(c.x(), p.y(), p.z(), p.x()) :
+        QVector4D(p.x(), p.y(), p.w(), c.x());
+    float d = q.x() - std::min(q.w(), q.y());
+    float e = 1.0e-10f;
+    return QVector3D(std::abs(q.z() + (q.w() - q.y()) / (6.0f * d + e)), d / (q.x() + e), q.x());
+}
+
+static QVector3D hsv2rgb(const QVector3D &c)
+{
+    QVector3D result;
+    const float offsets[3] = {1.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    for (int i = 0; i < 3; ++i) {
+        float value = c.x() + offsets[i];
+        float p = std::abs((value - std::floor(value)) * 6.0f - 3.0f);
+        float channel = std::min(std::max(p - 1.0f, 0.0f), 1.0f);
+        result[i] = c.z() * (1.0f + (channel - 1.0f) * c.y());
+    }
+    return result;
+}
+
+static QVector4D sampleImage(const QImage &image, float u, float v)
+{
+    int x = std::min(std::max((int)(u * image.width()), 0), image.width() - 1);
+    int y = std::min(std::max((int)(v * image.height()), 0), image.height() - 1);
+    QRgb color = ((const QRgb *)image.constScanLine(y))[x];
+    return QVector4D(qRed(color), qGreen(color), qBlue(color), qAlpha(color)) / 255.0f;
+}
+
+static float smoothStep(float edge0, float edge1, float x)
+{
+    float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+static float quantizeToByte(float value)
+{
+    return std::round(std::min(std::max(value, 0.0f), 1.0f) * 255.0f) / 255.0f;
+}
+
+ModelSoftwareRender::~ModelSoftwareRender()
+{
+    delete m_mesh;
+}
+
+void ModelSoftwareRender::setXRotation(int angle)
+{
+    m_xRot = angle;
+}
+
+void ModelSoftwareRender::setYRotation(int angle)
+{
+    m_yRot = angle;
+}
+
+void ModelSoftwareRender::setZRotation(int angle)
+{
+    m_zRot = angle;
+}
+
+void ModelSoftwareRender::setEyePosition(const QVector3D &eyePosition)
+{
+    m_eyePosition = eyePosition;
+}
+
+void ModelSoftwareRender::setMoveToPosition(const QVector3D &moveToPosition)
+{
+    m_moveToPosition = moveToPosition;
+}
+
+void ModelSoftwareRender::enableWireframe()
+{
+    m_isWireframeVisible = true;
+}
+
+void ModelSoftwareRender::setToonShading(bool toonShading)
+{
+    m_toonShading = toonShading;
+}
+
+void ModelSoftwareRender::setToonLine(ToonLine toonLine)
+{
+    m_toonLine = toonLine;
+}
+
+void ModelSoftwareRender::updateMesh(Model *mesh)
+{
+    delete m_mesh;
+    m_mesh = mesh;
+}
+
+void ModelSoftwareRender::transformVertex(const ShaderVertex &vertex, TransformedVertex *transformed) const
+{
+    transformed->position = m_world.map(QVector3D(vertex.posX, vertex.posY, vertex.posZ));
+    transformed->normal = m_world.mapVector(QVector3D(vertex.normX, vertex.normY, vertex.normZ));
+    transformed->tangent = m_world.mapVector(QVector3D(vertex.tangentX, vertex.tangentY, vertex.tangentZ));
+    transformed->clip = m_viewProjection * QVector4D(transformed->position, 1.0f);
+}
+
+void ModelSoftwareRender::projectVertex(const QVector4D &clip, RasterVertex *vertex) const
+{
+    vertex->inverseW = 1.0f / clip.w();
+    vertex->screenX = (clip.x() * vertex->inverseW * 0.5f + 0.5f) * m_width;
+    vertex->screenY = (0.5f - clip.y() * vertex->inverseW * 0.5f) * m_height;
+    vertex->depth = clip.z() * vertex->inverseW;
+}
+
+void ModelSoftwareRender::clipTriangle(int triangleIndex)
+{
+    struct ClipVertex
+    {
+        QVector4D clip;
+        float barycentricU;
+        float barycentricV;
+    };
+    const TransformedVertex *v = &m_transformedVertices[triangleIndex * 3];
+    ClipVertex corners[3] = {
+        {v[0].clip, 0.0f, 0.0f},
+        {v[1].clip, 1.0f, 0.0f},
+        {v[2].clip, 0.0f, 1.0f}
+    };
+
+    // Sutherland-Hodgman against the near plane only, z + w >= 0 in clip space,
+    // the other planes are handled by the screen bounds and the depth test
+    float distances[3];
+    int insideCount = 0;
+    for (int i = 0; i < 3; ++i) {
+        distances[i] = corners[i].clip.z() + corners[i].clip.w();
+        if (distances[i] >= 0.0f)
+            ++insideCount;
+    }
+    if (0 == insideCount)
+        return;
+    ClipVertex polygon[4];
+    int polygonSize = 0;
+    for (int i = 0; i < 3; ++i) {
+        int j = (i + 1) % 3;
+        if (distances[i] >= 0.0f)
+            polygon[polygonSize++] = corners[i];
+        if ((distances[i] >= 0.0f) != (distances[j] >= 0.0f)) {
+            float t = distances[i] / (distances[i] - distances[j]);
+            ClipVertex &intersection = polygon[polygonSize++];
+            intersection.clip = corners[i].clip + (corners[j].clip - corners[i].clip) * t;
+            intersection.barycentricU = corners[i].barycentricU + (corners[j].barycentricU - corners[i].barycentricU) * t;
+            intersection.barycentricV = corners[i].barycentricV + (corners[j].barycentricV - corners[i].barycentricV) * t;
+        }
+    }
+
+    for (int i = 1; i + 1 < polygonSize; ++i) {
+        RasterTriangle triangle;
+        triangle.triangleIndex = triangleIndex;
+        const ClipVertex *fan[3] = {&polygon[0], &polygon[i], &polygon[i + 1]};
+        for (int k = 0; k < 3; ++k) {
+            projectVertex(fan[k]->clip, &triangle.vertices[k]);
+            triangle.vertices[k].barycentricU = fan[k]->barycentricU;
+            triangle.vertices[k].barycentricV = fan[k]->barycentricV;
+        }
+        m_rasterTriangles.push_back(triangle);
+    }
+}
+
+void ModelSoftwareRender::binTriangles()
+{
+    m_tileColumns = (m_width + m_tileSize - 1) / m_tileSize;
+    int tileRows = (m_height + m_tileSize - 1) / m_tileSize;
+    m_tileTriangles.clear();
+    m_tileTriangles.resize(m_tileColumns * tileRows);
+    m_rasterTriangles.clear();
+    int triangleCount = m_transformedVertices.size() / 3;
+    for (int t = 0; t < triangleCount; ++t)
+        clipTriangle(t);
+    for (int t = 0; t < (int)m_rasterTriangles.size(); ++t) {
+        const RasterVertex *v = m_rasterTriangles[t].vertices;
+        float minX = std::min(v[0].screenX, std::min(v[1].screenX, v[2].screenX));
+        float maxX = std::max(v[0].screenX, std::max(v[1].screenX, v[2].screenX));
+        float minY = std::min(v[0].screenY, std::min(v[1].screenY, v[2].screenY));
+        float maxY = std::max(v[0].screenY, std::max(v[1].screenY, v[2].screenY));
+        if (maxX < 0 || maxY < 0 || minX >= m_width || minY >= m_height)
+            continue;
+        int fromTileX = std::max((int)minX, 0) / m_tileSize;
+        int toTileX = std::min((int)maxX, m_width - 1) / m_tileSize;
+        int fromTileY = std::max((int)minY, 0) / m_tileSize;
+        int toTileY = std::min((int)maxY, m_height - 1) / m_tileSize;
+        for (int tileY = fromTileY; tileY <= toTileY; ++tileY) {
+            for (int tileX = fromTileX; tileX <= toTileX; ++tileX)
+                m_tileTriangles[tileY * m_tileColumns + tileX].push_back(t);
+        }
+    }
+}
+
+void ModelSoftwareRender::rasterizeTile(size_t tileIndex)
+{
+    int tileLeft = (tileIndex % m_tileColumns) * m_tileSize;
+    int tileTop = (tileIndex / m_tileColumns) * m_tileSize;
+    int tileRight = std::min(tileLeft + m_tileSize, m_width) - 1;
+    int tileBottom = std::min(tileTop + m_tileSize, m_height) - 1;
+    for (const auto &t: m_tileTriangles[tileIndex]) {
+        const RasterTriangle &triangle = m_rasterTriangles[t];
+        const RasterVertex *v = triangle.vertices;
+        float x0 = v[0].screenX, y0 = v[0].screenY;
+        float x1 = v[1].screenX, y1 = v[1].screenY;
+        float x2 = v[2].screenX, y2 = v[2].screenY;
+        float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+        if (std::abs(area) < 1e-8f)
+            continue;
+        float inverseArea = 1.0f / area;
+        int left = std::max(tileLeft, (int)std::floor(std::min(x0, std::min(x1, x2))));
+        int right = std::min(tileRight, (int)std::ceil(std::max(x0, std::max(x1, x2))));
+        int top = std::max(tileTop, (int)std::floor(std::min(y0, std::min(y1, y2))));
+        int bottom = std::min(tileBottom, (int)std::ceil(std::max(y0, std::max(y1, y2))));
+        for (int y = top; y <= bottom; ++y) {
+            float cy = y + 0.5f;
+            Fragment *row = &m_fragments[y * m_width];
+            for (int x = left; x <= right; ++x) {
+                float cx = x + 0.5f;
+                float w0 = ((x1 - cx) * (y2 - cy) - (y1 - cy) * (x2 - cx)) * inverseArea;
+                float w1 = ((x2 - cx) * (y0 - cy) - (y2 - cy) * (x0 - cx)) * inverseArea;
+                float w2 = 1.0f - w0 - w1;
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+                float depth = w0 * v[0].depth + w1 * v[1].depth + w2 * v[2].depth;
+                if (depth < -1.0f || depth >= row[x].depth)
+                    continue;
+                // Barycentrics are corrected for perspective, gl_FragCoord.w is interpolated linearly on screen
+                float p0 = w0 * v[0].inverseW;
+                float p1 = w1 * v[1].inverseW;
+                float p2 = w2 * v[2].inverseW;
+                float sum = p0 + p1 + p2;
+                Fragment &fragment = row[x];
+                fragment.triangleIndex = triangle.triangleIndex;
+                fragment.barycentricU = (p0 * v[0].barycentricU + p1 * v[1].barycentricU + p2 * v[2].barycentricU) / sum;
+                fragment.barycentricV = (p0 * v[0].barycentricV + p1 * v[1].barycentricV + p2 * v[2].barycentricV) / sum;
+                fragment.depth = depth;
+                fragment.inverseW = sum;
+            }
+        }
+    }
+}
+
+void ModelSoftwareRender::rasterizeEdges()
+{
+    const auto &edgeVertices = m_mesh->packedEdgeVertices();
+    const auto &edgeIndices = m_mesh->edgeIndices();
+    std::vector<TransformedVertex> transformed(edgeVertices.size());
+    for (size_t i = 0; i < edgeVertices.size(); ++i) {
+        ShaderVertex vertex = {};
+        vertex.posX = edgeVertices[i].posX;
+        vertex.posY = edgeVertices[i].posY;
+        vertex.posZ = edgeVertices[i].posZ;
+        transformVertex(vertex, &transformed[i]);
+    }
+    // Lines are as wide as one output pixel
+    int halfWidth = m_supersampling / 2;
+    for (size_t i = 0; i + 1 < edgeIndices.size(); i += 2) {
+        QVector4D fromClip = transformed[edgeIndices[i]].clip;
+        QVector4D toClip = transformed[edgeIndices[i + 1]].clip;
+        float fromDistance = fromClip.z() + fromClip.w();
+        float toDistance = toClip.z() + toClip.w();
+        if (fromDistance < 0.0f && toDistance < 0.0f)
+            continue;
+        if (fromDistance < 0.0f)
+            fromClip += (toClip - fromClip) * (fromDistance / (fromDistance - toDistance));
+        else if (toDistance < 0.0f)
+            toClip += (fromClip - toClip) * (toDistance / (toDistance - fromDistance));
+        RasterVertex from, to;
+        projectVertex(fromClip, &from);
+        projectVertex(toClip, &to);
+        float dx = to.screenX - from.screenX;
+        float dy = to.screenY - from.screenY;
+        int steps = std::max(1, (int)std::ceil(std::max(std::abs(dx), std::abs(dy))));
+        for (int step = 0; step <= steps; ++step) {
+            float t = (float)step / steps;
+            int centerX = (int)(from.screenX + dx * t);
+            int centerY = (int)(from.screenY + dy * t);
+            float depth = from.depth + (to.depth - from.depth) * t;
+            for (int y = centerY - halfWidth; y < centerY - halfWidth + m_supersampling; ++y) {
+                if (y < 0 || y >= m_height)
+                    continue;
+                for (int x = centerX - halfWidth; x < centerX - halfWidth + m_supersampling; ++x) {
+                    if (x < 0 || x >= m_width)
+                        continue;
+                    Fragment &fragment = m_fragments[y * m_width + x];
+                    if (depth <= fragment.depth + 1e-4f)
+                        fragment.isLine = true;
+                }
+            }
+        }
+    }
+}
+
+void ModelSoftwareRender::buildToonMaps(int y)
+{
+    // Same content as NormalAndDepthMapsGenerator produces, including the 8-bit readback
+    for (int x = 0; x < m_width; ++x) {
+        size_t pixelIndex = y * m_width + x;
+        const Fragment &fragment = m_fragments[pixelIndex];
+        if (fragment.triangleIndex < 0) {
+            m_toonNormals[pixelIndex] = 0.0f;
+            m_toonDepths[pixelIndex] = 0.0f;
+            continue;
+        }
+        const TransformedVertex *v = &m_transformedVertices[fragment.triangleIndex * 3];
+        float b0 = 1.0f - fragment.barycentricU - fragment.barycentricV;
+        QVector3D normal = v[0].normal * b0 + v[1].normal * fragment.barycentricU + v[2].normal * fragment.barycentricV;
+        m_toonNormals[pixelIndex] = quantizeToByte(normal.x()) + quantizeToByte(normal.y()) + quantizeToByte(normal.z());
+        m_toonDepths[pixelIndex] = quantizeToByte(fragment.inverseW);
+    }
+}
+
+bool ModelSoftwareRender::isToonEdge(int x, int y) const
+{
+    static const float sobelV[9] = {-1, 0, 1, -2, 0, 2, -1, 0, 1};
+    static const float sobelH[9] = {-1, -2, -1, 0, 0, 0, 1, 2, 1};
+    float normalV = 0, normalH = 0;
+    float depthV = 0, depthH = 0;
+    for (int row = 0; row < 3; ++row) {
+        int sampleY = std::min(std::max(y + (row - 1) * m_supersampling, 0), m_height - 1);
+        for (int column = 0; column < 3; ++column) {
+            int sampleX = std::min(std::max(x + (column - 1) * m_supersampling, 0), m_width - 1);
+            size_t sampleIndex = sampleY * m_width + sampleX;
+            int i = row * 3 + column;
+            normalV += sobelV[i] * m_toonNormals[sampleIndex];
+            normalH += sobelH[i] * m_toonNormals[sampleIndex];
+            depthV += sobelV[i] * m_toonDepths[sampleIndex];
+            depthH += sobelH[i] * m_toonDepths[sampleIndex];
+        }
+    }
+    float normalEdge = smoothStep(0.0f, 1.0f, std::sqrt(normalV * normalV + normalH * normalH));
+    float depthEdge = smoothStep(0.0f, 1.0f, std::sqrt(depthV * depthV * 10.0f + depthH * depthH * 10.0f));
+    return depthEdge >= 0.009f || normalEdge >= 0.7f;
+}
+
+void ModelSoftwareRender::shadeRow(int y)
+{
+    int toonEdgeEnabled = (m_toonShading && !m_toonNormals.empty()) ? (int)m_toonLine : 0;
+    for (int x = 0; x < m_width; ++x) {
+        size_t pixelIndex = y * m_width + x;
+        const Fragment &fragment = m_fragments[pixelIndex];
+        if (fragment.isLine) {
+            m_pixels[pixelIndex] = qRgba(0, 0, 0, 255);
+            continue;
+        }
+        if (fragment.triangleIndex < 0) {
+            m_pixels[pixelIndex] = 0;
+            continue;
+        }
+        const ShaderVertex *source = &m_triangleVertices[fragment.triangleIndex * 3];
+        const TransformedVertex *v = &m_transformedVertices[fragment.triangleIndex * 3];
+        float b[3] = {1.0f - fragment.barycentricU - fragment.barycentricV,
+            fragment.barycentricU, fragment.barycentricV};
+
+        QVector3D color;
+        float alpha = 0.0f;
+        float texU = 0.0f, texV = 0.0f;
+        float metalness = 0.0f, roughness = 0.0f;
+        QVector3D position, normal, tangent;
+        for (int i = 0; i < 3; ++i) {
+            color += QVector3D(source[i].colorR, source[i].colorG, source[i].colorB) * b[i];
+            alpha += source[i].alpha * b[i];
+            texU += source[i].texU * b[i];
+            texV += source[i].texV * b[i];
+            metalness += source[i].metalness * b[i];
+            roughness += source[i].roughness * b[i];
+            position += v[i].position * b[i];
+            normal += v[i].normal * b[i];
+            tangent += v[i].tangent * b[i];
+        }
+
+        if (!m_textureImage.isNull()) {
+            QVector4D textureColor = sampleImage(m_textureImage, texU, texV);
+            color = textureColor.toVector3D();
+            alpha = textureColor.w();
+        }
+        for (int i = 0; i < 3; ++i)
+            color[i] = std::pow(color[i], s_gamma);
+
+        if (!m_normalMapImage.isNull()) {
+            // Same TBN as shaders/default.core.vert, the sample is taken from tangent space to world space
+            QVector3D n = normal.normalized();
+            QVector3D t = tangent.normalized();
+            t = (t - QVector3D::dotProduct(t, n) * n).normalized();
+            if (!t.isNull()) {
+                QVector3D bitangent = QVector3D::crossProduct(n, t);
+                QVector3D sample = (sampleImage(m_normalMapImage, texU, texV).toVector3D() * 2.0f - QVector3D(1.0f, 1.0f, 1.0f)).normalized();
+                normal = (t * sample.x() + bitangent * sample.y() + n * sample.z()).normalized();
+            }
+        }
+
+        float ambientOcclusion = 1.0f;
+        if (!m_metalnessRoughnessAmbientOcclusionImage.isNull()) {
+            QVector4D material = sampleImage(m_metalnessRoughnessAmbientOcclusionImage, texU, texV);
+            if (m_hasMetalnessInImage)
+                metalness = material.z();
+            if (m_hasRoughnessInImage)
+                roughness = material.y();
+            if (m_hasAmbientOcclusionInImage)
+                ambientOcclusion = material.x();
+        }
+        roughness = std::min(0.99f, roughness);
+        metalness = std::min(0.99f, metalness);
+
+        QVector3D linear;
+        if (!m_toonShading) {
+            float roughnessAlpha = remapRoughness(roughness);
+            QVector3D view = (m_eyePosition - position).normalized();
+            for (const auto &light: s_lights)
+                linear += pbrModel(light, position, normal, view, color, metalness, roughnessAlpha, ambientOcclusion);
+        } else {
+            float intensity = QVector3D::dotProduct(QVector3D(1.0f, 1.0f, 1.0f), normal);
+            QVector3D hsv = rgb2hsv(color);
+            if (intensity > 0.966f)
+                linear = hsv2rgb(QVector3D(hsv.x(), hsv.y(), hsv.z() * 2.0f));
+            else
+                linear = hsv2rgb(QVector3D(hsv.x(), hsv.y(), hsv.z() * 0.1f));
+            if (toonEdgeEnabled > 0) {
+                if (isToonEdge(x, y)) {
+                    linear = hsv2rgb(QVector3D(hsv.x(), hsv.y(), hsv.z() * 0.02f));
+                } else if ((int)ToonLine::LineOnly == toonEdgeEnabled) {
+                    m_pixels[pixelIndex] = 0;
+                    continue;
+                }
+            }
+        }
+
+        alpha = std::min(std::max(alpha, 0.0f), 1.0f);
+        int channels[3];
+        for (int i = 0; i < 3; ++i) {
+            float toneMapped = linear[i] / (linear[i] + 1.0f);
+            float gammaCorrected = std::pow(std::max(toneMapped, 0.0f), 1.0f / s_gamma);
+            channels[i] = (int)std::round(std::min(gammaCorrected, 1.0f) * alpha * 255.0f);
+        }
+        m_pixels[pixelIndex] = qRgba(channels[0], channels[1], channels[2], (int)std::round(alpha * 255.0f));
+    }
+}
+
+QImage ModelSoftwareRender::toImage(const QSize &size)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    if (nullptr == m_mesh || size.isEmpty())
+        return image;
+
+    m_width = size.width() * m_supersampling;
+    m_height = size.height() * m_supersampling;
+
+    m_world.setToIdentity();
+    m_world.rotate(m_xRot / 16.0f, 1, 0, 0);
+    m_world.rotate(m_yRot / 16.0f, 0, 1, 0);
+    m_world.rotate(m_zRot / 16.0f, 0, 0, 1);
+
+    QMatrix4x4 projection;
+    projection.translate(m_moveToPosition.x(), m_moveToPosition.y(), m_moveToPosition.z());
+    projection.perspective(45.0f, GLfloat(size.width()) / size.height(), 0.01f, 100.0f);
+
+    QMatrix4x4 camera;
+    camera.translate(m_eyePosition);
+
+    m_viewProjection = projection * camera;
+
+    if (nullptr != m_mesh->textureImage())
+        m_textureImage = m_mesh->textureImage()->convertToFormat(QImage::Format_ARGB32);
+    if (nullptr != m_mesh->normalMapImage())
+        m_normalMapImage = m_mesh->normalMapImage()->convertToFormat(QImage::Format_ARGB32);
+    m_hasMetalnessInImage = m_mesh->hasMetalnessInImage();
+    m_hasRoughnessInImage = m_mesh->hasRoughnessInImage();
+    m_hasAmbientOcclusionInImage = m_mesh->hasAmbientOcclusionInImage();
+    if (nullptr != m_mesh->metalnessRoughnessAmbientOcclusionImage() &&
+            (m_hasMetalnessInImage || m_hasRoughnessInImage || m_hasAmbientOcclusionInImage))
+        m_metalnessRoughnessAmbientOcclusionImage = m_mesh->metalnessRoughnessAmbientOcclusionImage()->convertToFormat(QImage::Format_ARGB32);
+
+    m_triangleVertices = m_mesh->triangleVertices();
+    if (nullptr == m_triangleVertices) {
+        const auto &packedVertices = m_mesh->packedTriangleVertices();
+        const auto &indices = m_mesh->triangleIndices();
+        m_unpackedTriangleVertices.resize(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+            unpackShaderVertex(packedVertices[indices[i]], &m_unpackedTriangleVertices[i]);
+        m_triangleVertices = m_unpackedTriangleVertices.data();
+    }
+    m_transformedVertices.resize(m_mesh->triangleVertexCount());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, m_transformedVertices.size()),
+        SoftwareVertexTransformer(this));
+
+    binTriangles();
+    m_fragments.assign((size_t)m_width * m_height, Fragment());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, m_tileTriangles.size()),
+        SoftwareTileRasterizer(this));
+
+    if (m_isWireframeVisible)
+        rasterizeEdges();
+
+    if (m_toonShading && ToonLine::WithoutLine != m_toonLine) {
+        m_toonNormals.resize(m_fragments.size());
+        m_toonDepths.resize(m_fragments.size());
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, m_height),
+            SoftwareToonMapBuilder(this));
+    }
+
+    m_pixels.resize(m_fragments.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, m_height),
+        SoftwarePixelShader(this));
+
+    // Box filter the supersamples down to the output size; pixels are premultiplied
+    int sampleCount = m_supersampling * m_supersampling;
+    for (int y = 0; y < size.height(); ++y) {
+        QRgb *line = (QRgb *)image.scanLine(y);
+        for (int x = 0; x < size.width(); ++x) {
+            int red = 0, green = 0, blue = 0, alpha = 0;
+            for (int sy = 0; sy < m_supersampling; ++sy) {
+                const QRgb *samples = &m_pixels[(y * m_supersampling + sy) * m_width + x * m_supersampling];
+                for (int sx = 0; sx < m_supersampling; ++sx) {
+                    red += qRed(samples[sx]);
+                    green += qGreen(samples[sx]);
+                    blue += qBlue(samples[sx]);
+                    alpha += qAlpha(samples[sx]);
+                }
+            }
+            line[x] = qRgba(red / sampleCount, green / sampleCount, blue / sampleCount, alpha / sampleCount);
+        }
+    }
+
+    m_transformedVertices.clear();
+    m_rasterTriangles.clear();
+    m_tileTriangles.clear();
+    m_fragments.clear();
+    m_toonNormals.clear();
+    m_toonDepths.clear();
+    m_pixels.clear();
+    m_textureImage = QImage();
+    m_normalMapImage = QImage();
+    m_metalnessRoughnessAmbientOcclusionImage = QImage();
+    m_triangleVertices = nullptr;
+    m_unpackedTriangleVertices.clear();
+
+    delete m_mesh;
+    m_mesh = nullptr;
+
+    return image;
+}
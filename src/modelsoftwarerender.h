@@ -0,0 +1,113 @@
+#ifndef DUST3D_MODEL_SOFTWARE_RENDER_H
+#define DUST3D_MODEL_SOFTWARE_RENDER_H
+#include <QImage>
+#include <QVector3D>
+#include <QVector4D>
+#include <QMatrix4x4>
+#include <QSize>
+#include <vector>
+#include "model.h"
+#include "toonline.h"
+
+// CPU counterpart of ModelOffscreenRender for machines without an OpenGL context,
+// it follows the default shader: the direct PBR lights, toon shading and toon lines
+class ModelSoftwareRender
+{
+public:
+    ~ModelSoftwareRender();
+    void setXRotation(int angle);
+    void setYRotation(int angle);
+    void setZRotation(int angle);
+    void setEyePosition(const QVector3D &eyePosition);
+    void setMoveToPosition(const QVector3D &moveToPosition);
+    void enableWireframe();
+    void setToonShading(bool toonShading);
+    void setToonLine(ToonLine toonLine);
+    void updateMesh(Model *mesh);
+    QImage toImage(const QSize &size);
+private:
+    friend class SoftwareVertexTransformer;
+    friend class SoftwareTileRasterizer;
+    friend class SoftwareToonMapBuilder;
+    friend class SoftwarePixelShader;
+
+    struct TransformedVertex
+    {
+        QVector4D clip;
+        QVector3D position;
+        QVector3D normal;
+        QVector3D tangent;
+    };
+
+    struct RasterVertex
+    {
+        float screenX;
+        float screenY;
+        float depth;
+        float inverseW;
+        float barycentricU;
+        float barycentricV;
+    };
+
+    // A triangle, or a piece of it cut by the near plane, barycentrics refer to the source triangle
+    struct RasterTriangle
+    {
+        int triangleIndex;
+        RasterVertex vertices[3];
+    };
+
+    struct Fragment
+    {
+        int triangleIndex = -1;
+        float barycentricU = 0;
+        float barycentricV = 0;
+        float depth = 1;
+        float inverseW = 0;
+        bool isLine = false;
+    };
+
+    int m_xRot = 0;
+    int m_yRot = 0;
+    int m_zRot = 0;
+    QVector3D m_eyePosition;
+    QVector3D m_moveToPosition;
+    bool m_isWireframeVisible = false;
+    bool m_toonShading = false;
+    ToonLine m_toonLine = ToonLine::WithoutLine;
+    Model *m_mesh = nullptr;
+    int m_supersampling = 2;
+    int m_tileSize = 32;
+
+    int m_width = 0;
+    int m_height = 0;
+    QMatrix4x4 m_world;
+    QMatrix4x4 m_viewProjection;
+    const ShaderVertex *m_triangleVertices = nullptr;
+    std::vector<ShaderVertex> m_unpackedTriangleVertices;
+    std::vector<TransformedVertex> m_transformedVertices;
+    std::vector<RasterTriangle> m_rasterTriangles;
+    std::vector<std::vector<int>> m_tileTriangles;
+    int m_tileColumns = 0;
+    std::vector<Fragment> m_fragments;
+    std::vector<float> m_toonNormals;
+    std::vector<float> m_toonDepths;
+    std::vector<QRgb> m_pixels;
+    QImage m_textureImage;
+    QImage m_normalMapImage;
+    QImage m_metalnessRoughnessAmbientOcclusionImage;
+    bool m_hasMetalnessInImage = false;
+    bool m_hasRoughnessInImage = false;
+    bool m_hasAmbientOcclusionInImage = false;
+
+    void transformVertex(const ShaderVertex &vertex, TransformedVertex *transformed) const;
+    void projectVertex(const QVector4D &clip, RasterVertex *vertex) const;
+    void clipTriangle(int triangleIndex);
+    void binTriangles();
+    void rasterizeTile(size_t tileIndex);
+    void rasterizeEdges();
+    void buildToonMaps(int y);
+    void shadeRow(int y);
+    bool isToonEdge(int x, int y) const;
+};
+
+#endif
@@ -44,8 +44,34 @@ ModelWidget::ModelWidget(QWidget *parent) :
 	
     zoom(200);
     
+    m_meshBinder.enableIncrementalUpload();
+    
     connect(&Preferences::instance(), &Preferences::toonShadingChanged, this, &ModelWidget::reRender);
     connect(&Preferences::instance(), &Preferences::toonLineChanged, this, &ModelWidget::reRender);
+    
+    // Toon normal and depth maps are only painted once the view and mesh have settled
+    m_toonMapsTimer = new QTimer(this);
+    m_toonMapsTimer->setInterval(250);
+    m_toonMapsTimer->setSingleShot(true);
+    connect(m_toonMapsTimer, &QTimer::timeout, this, [&]() {
+        update();
+    });
+    connect(this, &ModelWidget::renderParametersChanged, this, [&]() {
+        m_toonMapsOutdated = true;
+        m_toonMapsTimer->start();
+    });
+}
+
+bool ModelWidget::shouldPaintToonMaps()
+{
+    if (!m_toonMapsEnabled)
+        return false;
+    if (!Preferences::instance().toonShading() ||
+            ToonLine::WithoutLine == Preferences::instance().toonLine())
+        return false;
+    if (m_toonMapsTimer->isActive() || m_meshBinder.isUploading())
+        return false;
+    return m_toonMapsOutdated || m_toonMapsMeshGeneration != m_meshBinder.meshGeneration();
 }
 
 const QVector3D &ModelWidget::eyePosition()
@@ -237,9 +263,20 @@ void ModelWidget::paintGL()
     }
     m_program->setUniformValue(m_program->mousePickRadiusLoc(), m_mousePickRadius);
     
+    if (shouldPaintToonMaps()) {
+        m_meshBinder.paintToonNormalAndDepthMaps(m_program, QSize(m_widthInPixels, m_heightInPixels),
+            defaultFramebufferObject());
+        glViewport(0, 0, m_widthInPixels, m_heightInPixels);
+        m_toonMapsOutdated = false;
+        m_toonMapsMeshGeneration = m_meshBinder.meshGeneration();
+    }
+    
     m_meshBinder.paint(m_program);
 
     m_program->release();
+    
+    if (m_meshBinder.isUploading() || shouldPaintToonMaps())
+        update();
 }
 
 void ModelWidget::updateProjectionMatrix()
@@ -502,9 +539,17 @@ void ModelWidget::updateColorTexture(QImage *colorTextureImage)
     update();
 }
 
+void ModelWidget::updateColorTextureRect(QImage *colorTextureImage, const QRect &rect)
+{
+    m_meshBinder.updateColorTextureRect(colorTextureImage, rect);
+    update();
+}
+
 void ModelWidget::fetchCurrentToonNormalAndDepthMaps(QImage *normalMap, QImage *depthMap)
 {
+    makeCurrent();
     m_meshBinder.fetchCurrentToonNormalAndDepthMaps(normalMap, depthMap);
+    doneCurrent();
 }
 
 void ModelWidget::updateToonNormalAndDepthMaps(QImage *normalMap, QImage *depthMap)
@@ -538,6 +583,12 @@ void ModelWidget::enableMousePicking(bool enabled)
     m_mousePickingEnabled = enabled;
 }
 
+void ModelWidget::enableToonMaps(bool enabled)
+{
+    m_toonMapsEnabled = enabled;
+    update();
+}
+
 void ModelWidget::setMoveAndZoomByWindow(bool byWindow)
 {
     m_moveAndZoomByWindow = byWindow;
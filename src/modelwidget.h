@@ -43,6 +43,7 @@ public:
     Model *fetchCurrentMesh();
     void updateMesh(Model *mesh);
     void updateColorTexture(QImage *colorTextureImage);
+    void updateColorTextureRect(QImage *colorTextureImage, const QRect &rect);
     void setGraphicsFunctions(SkeletonGraphicsFunctions *graphicsFunctions);
     void toggleWireframe();
     bool isWireframeVisible();
@@ -53,6 +54,7 @@ public:
     void enableMove(bool enabled);
     void enableZoom(bool enabled);
     void enableMousePicking(bool enabled);
+    void enableToonMaps(bool enabled);
     void setMoveAndZoomByWindow(bool byWindow);
     void disableCullFace();
     void setMoveToPosition(const QVector3D &moveToPosition);
@@ -122,7 +124,12 @@ private:
     bool m_moveAndZoomByWindow = true;
     bool m_enableCullFace = true;
     bool m_notGraphics = false;
+    bool m_toonMapsEnabled = false;
+    QTimer *m_toonMapsTimer = nullptr;
+    bool m_toonMapsOutdated = true;
+    quint64 m_toonMapsMeshGeneration = 0;
     std::pair<QVector3D, QVector3D> screenPositionToMouseRay(const QPoint &screenPosition);
+    bool shouldPaintToonMaps();
     void updateProjectionMatrix();
 public:
     static int m_defaultXRotation;
@@ -0,0 +1,74 @@
+#include "motionclip.h"
+#include "jointnodetree.h"
+
+MotionClip::MotionClip()
+{
+}
+
+MotionClip::MotionClip(size_t boneCount, size_t frameCount, float frameDuration) :
+    m_boneCount(boneCount),
+    m_frameDurations(frameCount, frameDuration),
+    m_translations(boneCount * frameCount),
+    m_rotations(boneCount * frameCount)
+{
+}
+
+size_t MotionClip::boneCount() const
+{
+    return m_boneCount;
+}
+
+size_t MotionClip::frameCount() const
+{
+    return m_frameDurations.size();
+}
+
+bool MotionClip::isEmpty() const
+{
+    return 0 == m_boneCount || m_frameDurations.empty();
+}
+
+float MotionClip::frameDuration(size_t frameIndex) const
+{
+    return m_frameDurations[frameIndex];
+}
+
+void MotionClip::setFrameDuration(size_t frameIndex, float duration)
+{
+    m_frameDurations[frameIndex] = duration;
+}
+
+const QVector3D &MotionClip::translation(size_t boneIndex, size_t frameIndex) const
+{
+    return m_translations[boneIndex * m_frameDurations.size() + frameIndex];
+}
+
+const QQuaternion &MotionClip::rotation(size_t boneIndex, size_t frameIndex) const
+{
+    return m_rotations[boneIndex * m_frameDurations.size() + frameIndex];
+}
+
+void MotionClip::setTransform(size_t boneIndex, size_t frameIndex, const QVector3D &translation, const QQuaternion &rotation)
+{
+    size_t offset = boneIndex * m_frameDurations.size() + frameIndex;
+    m_translations[offset] = translation;
+    m_rotations[offset] = rotation;
+}
+
+void MotionClip::setMatrix(size_t boneIndex, size_t frameIndex, const QMatrix4x4 &matrix)
+{
+    QVector3D translation;
+    QQuaternion rotation;
+    JointNodeTree::decomposeMatrix(matrix, &translation, &rotation);
+    setTransform(boneIndex, frameIndex, translation, rotation);
+}
+
+float MotionClip::groundY() const
+{
+    return m_groundY;
+}
+
+void MotionClip::setGroundY(float groundY)
+{
+    m_groundY = groundY;
+}
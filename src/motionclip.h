@@ -0,0 +1,32 @@
+#ifndef DUST3D_MOTION_CLIP_H
+#define DUST3D_MOTION_CLIP_H
+#include <QVector3D>
+#include <QQuaternion>
+#include <QMatrix4x4>
+#include <vector>
+
+class MotionClip
+{
+public:
+    MotionClip();
+    MotionClip(size_t boneCount, size_t frameCount, float frameDuration);
+    size_t boneCount() const;
+    size_t frameCount() const;
+    bool isEmpty() const;
+    float frameDuration(size_t frameIndex) const;
+    void setFrameDuration(size_t frameIndex, float duration);
+    const QVector3D &translation(size_t boneIndex, size_t frameIndex) const;
+    const QQuaternion &rotation(size_t boneIndex, size_t frameIndex) const;
+    void setTransform(size_t boneIndex, size_t frameIndex, const QVector3D &translation, const QQuaternion &rotation);
+    void setMatrix(size_t boneIndex, size_t frameIndex, const QMatrix4x4 &matrix);
+    float groundY() const;
+    void setGroundY(float groundY);
+private:
+    size_t m_boneCount = 0;
+    std::vector<float> m_frameDurations;
+    std::vector<QVector3D> m_translations;
+    std::vector<QQuaternion> m_rotations;
+    float m_groundY = 0;
+};
+
+#endif
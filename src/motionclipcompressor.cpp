@@ -0,0 +1,250 @@
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+#include "motionclipcompressor.h"
+#include "jointnodetree.h"
+
+MotionClipCompressor::MotionClipCompressor(const MotionClip &motionClip, const std::vector<RigBone> *rigBones) :
+    m_motionClip(motionClip),
+    m_rigBones(rigBones)
+{
+}
+
+void MotionClipCompressor::setTranslationTolerance(float tolerance)
+{
+    m_translationTolerance = tolerance;
+}
+
+void MotionClipCompressor::setRotationTolerance(float tolerance)
+{
+    m_rotationTolerance = tolerance;
+}
+
+void MotionClipCompressor::setRestTranslations(const std::vector<QVector3D> &restTranslations)
+{
+    m_restTranslations = restTranslations;
+    m_hasRestTranslations = true;
+}
+
+void MotionClipCompressor::setEulerAngles(std::function<QVector3D (const QQuaternion &)> toEulerAngles,
+    std::function<QQuaternion (const QVector3D &)> fromEulerAngles)
+{
+    m_toEulerAngles = toEulerAngles;
+    m_fromEulerAngles = fromEulerAngles;
+}
+
+const std::vector<MotionClipCompressor::TranslationChannel> &MotionClipCompressor::translationChannels() const
+{
+    return m_translationChannels;
+}
+
+const std::vector<MotionClipCompressor::RotationChannel> &MotionClipCompressor::rotationChannels() const
+{
+    return m_rotationChannels;
+}
+
+size_t MotionClipCompressor::sampledKeyCount() const
+{
+    return m_sampledKeyCount;
+}
+
+size_t MotionClipCompressor::compressedKeyCount() const
+{
+    return m_compressedKeyCount;
+}
+
+float MotionClipCompressor::rotationAngle(const QQuaternion &first, const QQuaternion &second)
+{
+    float dot = std::abs(QQuaternion::dotProduct(first.normalized(), second.normalized()));
+    return 2.0 * std::acos(std::min(dot, 1.0f));
+}
+
+QVector3D MotionClipCompressor::unwrapEulerAngles(const QVector3D &angles, const QVector3D &previous)
+{
+    auto unwrap = [&](const QVector3D &candidate) {
+        QVector3D result;
+        for (int i = 0; i < 3; ++i)
+            result[i] = candidate[i] - 360.0f * std::round((candidate[i] - previous[i]) / 360.0f);
+        return result;
+    };
+    // (x, y, z) and (x + 180, 180 - y, z + 180) are the same rotation, take the one closer to the previous key
+    QVector3D direct = unwrap(angles);
+    QVector3D flipped = unwrap(QVector3D(angles.x() + 180.0f, 180.0f - angles.y(), angles.z() + 180.0f));
+    if ((flipped - previous).lengthSquared() < (direct - previous).lengthSquared())
+        return flipped;
+    return direct;
+}
+
+std::vector<size_t> MotionClipCompressor::reduceKeys(size_t sampleCount,
+    const std::function<float (size_t from, size_t to, size_t at)> &errorAt,
+    float tolerance, float *maxError)
+{
+    std::vector<size_t> keys;
+    *maxError = 0;
+    if (0 == sampleCount)
+        return keys;
+    keys.push_back(0);
+    size_t from = 0;
+    size_t to = from + 2;
+    float acceptedError = 0;
+    while (to < sampleCount) {
+        float error = 0;
+        for (size_t at = from + 1; at < to && error <= tolerance; ++at)
+            error = std::max(error, errorAt(from, to, at));
+        if (error > tolerance) {
+            keys.push_back(to - 1);
+            *maxError = std::max(*maxError, acceptedError);
+            from = to - 1;
+            to = from + 2;
+            acceptedError = 0;
+            continue;
+        }
+        acceptedError = error;
+        ++to;
+    }
+    if (sampleCount > 1) {
+        keys.push_back(sampleCount - 1);
+        *maxError = std::max(*maxError, acceptedError);
+    }
+    return keys;
+}
+
+void MotionClipCompressor::compressTranslation(int boneIndex, const QVector3D &restTranslation)
+{
+    size_t frameCount = m_motionClip.frameCount();
+    
+    float constantError = 0;
+    float restError = 0;
+    const QVector3D &first = m_motionClip.translation(boneIndex, 0);
+    for (size_t i = 0; i < frameCount; ++i) {
+        const QVector3D &value = m_motionClip.translation(boneIndex, i);
+        constantError = std::max(constantError, (value - first).length());
+        restError = std::max(restError, (value - restTranslation).length());
+    }
+    if (restError <= m_translationTolerance)
+        return;
+    
+    TranslationChannel channel;
+    channel.boneIndex = boneIndex;
+    if (constantError <= m_translationTolerance) {
+        channel.times.push_back(m_times[0]);
+        channel.values.push_back(first);
+        channel.maxError = constantError;
+    } else {
+        auto errorAt = [&](size_t from, size_t to, size_t at) {
+            float t = (m_times[at] - m_times[from]) / (m_times[to] - m_times[from]);
+            const QVector3D &fromValue = m_motionClip.translation(boneIndex, from);
+            const QVector3D &toValue = m_motionClip.translation(boneIndex, to);
+            QVector3D interpolated = fromValue + (toValue - fromValue) * t;
+            return (interpolated - m_motionClip.translation(boneIndex, at)).length();
+        };
+        std::vector<size_t> keys = reduceKeys(frameCount, errorAt, m_translationTolerance, &channel.maxError);
+        for (const auto &key: keys) {
+            channel.times.push_back(m_times[key]);
+            channel.values.push_back(m_motionClip.translation(boneIndex, key));
+        }
+    }
+    m_compressedKeyCount += channel.times.size();
+    m_translationChannels.push_back(channel);
+}
+
+void MotionClipCompressor::compressRotation(int boneIndex, const QQuaternion &restRotation)
+{
+    size_t frameCount = m_motionClip.frameCount();
+    
+    // Keep neighbouring samples on the same hemisphere, so slerp takes the short path between keys
+    std::vector<QQuaternion> samples(frameCount);
+    for (size_t i = 0; i < frameCount; ++i) {
+        samples[i] = m_motionClip.rotation(boneIndex, i);
+        if (i > 0 && QQuaternion::dotProduct(samples[i - 1], samples[i]) < 0)
+            samples[i] = -samples[i];
+    }
+    
+    float constantError = 0;
+    float restError = 0;
+    for (size_t i = 0; i < frameCount; ++i) {
+        constantError = std::max(constantError, rotationAngle(samples[i], samples[0]));
+        restError = std::max(restError, rotationAngle(samples[i], restRotation));
+    }
+    if (restError <= m_rotationTolerance)
+        return;
+    
+    bool useEulerAngles = m_toEulerAngles && m_fromEulerAngles;
+    std::vector<QVector3D> eulerAngles;
+    if (useEulerAngles) {
+        eulerAngles.resize(frameCount);
+        for (size_t i = 0; i < frameCount; ++i) {
+            eulerAngles[i] = m_toEulerAngles(samples[i]);
+            if (i > 0)
+                eulerAngles[i] = unwrapEulerAngles(eulerAngles[i], eulerAngles[i - 1]);
+        }
+    }
+    
+    RotationChannel channel;
+    channel.boneIndex = boneIndex;
+    if (constantError <= m_rotationTolerance) {
+        channel.times.push_back(m_times[0]);
+        channel.values.push_back(samples[0]);
+        if (useEulerAngles)
+            channel.eulerAngles.push_back(eulerAngles[0]);
+        channel.maxError = constantError;
+    } else {
+        auto errorAt = [&](size_t from, size_t to, size_t at) {
+            float t = (m_times[at] - m_times[from]) / (m_times[to] - m_times[from]);
+            QQuaternion interpolated = useEulerAngles ?
+                m_fromEulerAngles(eulerAngles[from] + (eulerAngles[to] - eulerAngles[from]) * t) :
+                QQuaternion::slerp(samples[from], samples[to], t);
+            return rotationAngle(interpolated, samples[at]);
+        };
+        std::vector<size_t> keys = reduceKeys(frameCount, errorAt, m_rotationTolerance, &channel.maxError);
+        for (const auto &key: keys) {
+            channel.times.push_back(m_times[key]);
+            channel.values.push_back(samples[key]);
+            if (useEulerAngles)
+                channel.eulerAngles.push_back(eulerAngles[key]);
+        }
+    }
+    m_compressedKeyCount += channel.times.size();
+    m_rotationChannels.push_back(channel);
+}
+
+void MotionClipCompressor::compress()
+{
+    m_translationChannels.clear();
+    m_rotationChannels.clear();
+    m_sampledKeyCount = 0;
+    m_compressedKeyCount = 0;
+    
+    size_t frameCount = m_motionClip.frameCount();
+    if (0 == frameCount || nullptr == m_rigBones)
+        return;
+    
+    m_times.resize(frameCount);
+    float timePoint = 0;
+    for (size_t i = 0; i < frameCount; ++i) {
+        m_times[i] = timePoint;
+        timePoint += m_motionClip.frameDuration(i);
+    }
+    
+    JointNodeTree jointNodeTree(m_rigBones);
+    const auto &boneNodes = jointNodeTree.nodes();
+    size_t boneCount = std::min(m_motionClip.boneCount(), boneNodes.size());
+    const QQuaternion noneRotation;
+    for (size_t i = 0; i < boneCount; ++i) {
+        if (m_hasRestTranslations)
+            compressTranslation((int)i, i < m_restTranslations.size() ? m_restTranslations[i] : QVector3D());
+        else
+            compressTranslation((int)i, boneNodes[i].bindTranslation);
+        compressRotation((int)i, noneRotation);
+    }
+    m_sampledKeyCount = boneCount * 2 * frameCount;
+    
+    float maxTranslationError = 0;
+    for (const auto &channel: m_translationChannels)
+        maxTranslationError = std::max(maxTranslationError, channel.maxError);
+    float maxRotationError = 0;
+    for (const auto &channel: m_rotationChannels)
+        maxRotationError = std::max(maxRotationError, channel.maxError);
+    qDebug() << "Motion keys compressed from" << m_sampledKeyCount << "to" << m_compressedKeyCount
+        << "max error" << maxTranslationError << "/" << maxRotationError << "radians";
+}
@@ -0,0 +1,67 @@
+#ifndef DUST3D_MOTION_CLIP_COMPRESSOR_H
+#define DUST3D_MOTION_CLIP_COMPRESSOR_H
+#include <QVector3D>
+#include <QQuaternion>
+#include <vector>
+#include <functional>
+#include "motionclip.h"
+#include "rig.h"
+
+class MotionClipCompressor
+{
+public:
+    struct TranslationChannel
+    {
+        int boneIndex = 0;
+        std::vector<float> times;
+        std::vector<QVector3D> values;
+        float maxError = 0;
+    };
+    
+    struct RotationChannel
+    {
+        int boneIndex = 0;
+        std::vector<float> times;
+        std::vector<QQuaternion> values;
+        std::vector<QVector3D> eulerAngles;
+        float maxError = 0;
+    };
+    
+    MotionClipCompressor(const MotionClip &motionClip, const std::vector<RigBone> *rigBones);
+    void setTranslationTolerance(float tolerance);
+    void setRotationTolerance(float tolerance);
+    void setRestTranslations(const std::vector<QVector3D> &restTranslations);
+    // For formats that key rotations as Euler angles and interpolate each angle linearly,
+    // keys are then fitted against that interpolation and eulerAngles are filled, unwrapped between keys
+    void setEulerAngles(std::function<QVector3D (const QQuaternion &)> toEulerAngles,
+        std::function<QQuaternion (const QVector3D &)> fromEulerAngles);
+    void compress();
+    const std::vector<TranslationChannel> &translationChannels() const;
+    const std::vector<RotationChannel> &rotationChannels() const;
+    size_t sampledKeyCount() const;
+    size_t compressedKeyCount() const;
+private:
+    const MotionClip &m_motionClip;
+    const std::vector<RigBone> *m_rigBones = nullptr;
+    float m_translationTolerance = 0.0001;
+    float m_rotationTolerance = 0.0005;
+    bool m_hasRestTranslations = false;
+    std::vector<QVector3D> m_restTranslations;
+    std::function<QVector3D (const QQuaternion &)> m_toEulerAngles;
+    std::function<QQuaternion (const QVector3D &)> m_fromEulerAngles;
+    std::vector<float> m_times;
+    std::vector<TranslationChannel> m_translationChannels;
+    std::vector<RotationChannel> m_rotationChannels;
+    size_t m_sampledKeyCount = 0;
+    size_t m_compressedKeyCount = 0;
+    
+    std::vector<size_t> reduceKeys(size_t sampleCount,
+        const std::function<float (size_t from, size_t to, size_t at)> &errorAt,
+        float tolerance, float *maxError);
+    void compressTranslation(int boneIndex, const QVector3D &restTranslation);
+    void compressRotation(int boneIndex, const QQuaternion &restRotation);
+    static float rotationAngle(const QQuaternion &first, const QQuaternion &second);
+    static QVector3D unwrapEulerAngles(const QVector3D &angles, const QVector3D &previous);
+};
+
+#endif
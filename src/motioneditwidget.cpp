@@ -11,6 +11,7 @@
 #include "simpleshaderwidget.h"
 #include "simplerendermeshgenerator.h"
 #include "motionsgenerator.h"
+#include "motionskinner.h"
 #include "util.h"
 #include "version.h"
 #include "vertebratamovemotionparameterswidget.h"
@@ -18,12 +19,7 @@
 
 MotionEditWidget::~MotionEditWidget()
 {
-    for (auto &it: m_frames)
-        delete it;
-    while (!m_renderQueue.empty()) {
-        delete m_renderQueue.front();
-        m_renderQueue.pop();
-    }
+    delete m_motionSkinner;
     delete m_bones;
     delete m_rigWeights;
     delete m_object;
@@ -71,19 +67,7 @@ MotionEditWidget::MotionEditWidget()
     
     QTimer *timer = new QTimer(this);
     timer->setInterval(17);
-    connect(timer, &QTimer::timeout, [this] {
-        if (m_renderQueue.size() > 600) {
-            checkRenderQueue();
-            return;
-        }
-        if (this->m_frames.empty())
-            return;
-        if (this->m_frameIndex < this->m_frames.size()) {
-            m_renderQueue.push(new SimpleShaderMesh(*this->m_frames[this->m_frameIndex]));
-            checkRenderQueue();
-        }
-        this->m_frameIndex = (this->m_frameIndex + 1) % this->m_frames.size();
-    });
+    connect(timer, &QTimer::timeout, this, &MotionEditWidget::playNextFrame);
     timer->start();
     
     connect(this, &MotionEditWidget::parametersChanged, this, &MotionEditWidget::updateParameters);
@@ -203,12 +187,19 @@ void MotionEditWidget::updateBones(RigType rigType,
     delete m_object;
     m_object = nullptr;
     
+    delete m_motionSkinner;
+    m_motionSkinner = nullptr;
+    
+    m_motionClip = MotionClip();
+    m_frameIndex = 0;
+    
     if (nullptr != rigBones &&
             nullptr != rigWeights &&
             nullptr != object) {
         m_bones = new std::vector<RigBone>(*rigBones);
         m_rigWeights = new std::map<int, RigVertexWeights>(*rigWeights);
         m_object = new Object(*object);
+        m_motionSkinner = new MotionSkinner(*m_bones, *m_rigWeights, *m_object);
         
         generatePreview();
     }
@@ -229,7 +220,6 @@ void MotionEditWidget::generatePreview()
     QThread *thread = new QThread;
     
     m_previewGenerator = new MotionsGenerator(m_rigType, *m_bones, *m_rigWeights, *m_object);
-    m_previewGenerator->enablePreviewMeshes();
     m_previewGenerator->addMotion(QUuid(), m_parameters);
     m_previewGenerator->moveToThread(thread);
     connect(thread, &QThread::started, m_previewGenerator, &MotionsGenerator::process);
@@ -241,14 +231,8 @@ void MotionEditWidget::generatePreview()
 
 void MotionEditWidget::previewReady()
 {
-    for (auto &it: m_frames)
-        delete it;
-    m_frames.clear();
-    
-    std::vector<std::pair<float, SimpleShaderMesh *>> frames = m_previewGenerator->takeResultPreviewMeshes(QUuid());
-    for (const auto &frame: frames) {
-        m_frames.push_back(frame.second);
-    }
+    m_motionClip = m_previewGenerator->takeResultMotionClip(QUuid());
+    m_frameIndex = 0;
     
     delete m_previewGenerator;
     m_previewGenerator = nullptr;
@@ -262,12 +246,12 @@ void MotionEditWidget::previewReady()
         generatePreview();
 }
 
-void MotionEditWidget::checkRenderQueue()
+void MotionEditWidget::playNextFrame()
 {
-    if (m_renderQueue.empty())
+    if (nullptr == m_motionSkinner || m_motionClip.isEmpty())
         return;
     
-    SimpleShaderMesh *mesh = m_renderQueue.front();
-    m_renderQueue.pop();
-    m_modelRenderWidget->updateMesh(mesh);
+    m_frameIndex = m_frameIndex % m_motionClip.frameCount();
+    m_modelRenderWidget->updateMesh(m_motionSkinner->createPreviewMesh(m_motionClip, m_frameIndex));
+    m_frameIndex = (m_frameIndex + 1) % m_motionClip.frameCount();
 }
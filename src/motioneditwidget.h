@@ -2,17 +2,17 @@
 #define DUST3D_MOTION_EDIT_WIDGET_H
 #include <QMainWindow>
 #include <QCloseEvent>
-#include <queue>
 #include <QLineEdit>
 #include <QUuid>
 #include <QPushButton>
 #include <QLabel>
 #include "rig.h"
 #include "object.h"
+#include "motionclip.h"
 
 class SimpleShaderWidget;
 class MotionsGenerator;
-class SimpleShaderMesh;
+class MotionSkinner;
 class QScrollArea;
 
 class MotionEditWidget : public QMainWindow
@@ -28,7 +28,7 @@ signals:
     void setMotionParameters(const QUuid &motionId, const std::map<QString, QString> &parameters);
     void renameMotion(const QUuid &motionId, const QString &name);
 public slots:
-    void checkRenderQueue();
+    void playNextFrame();
     void generatePreview();
     void previewReady();
     void updateBones(RigType rigType,
@@ -50,10 +50,10 @@ private:
     QString m_name;
     std::map<QString, QString> m_parameters;
     SimpleShaderWidget *m_modelRenderWidget = nullptr;
-    std::queue<SimpleShaderMesh *> m_renderQueue;
     MotionsGenerator *m_previewGenerator = nullptr;
     bool m_isPreviewObsolete = false;
-    std::vector<SimpleShaderMesh *> m_frames;
+    MotionSkinner *m_motionSkinner = nullptr;
+    MotionClip m_motionClip;
     size_t m_frameIndex = 0;
     RigType m_rigType = RigType::None;
     std::vector<RigBone> *m_bones = nullptr;
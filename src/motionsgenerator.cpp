@@ -1,3 +1,5 @@
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <QGuiApplication>
 #include <QElapsedTimer>
 #include <cmath>
@@ -5,10 +7,53 @@
 #include <QMatrix4x4>
 #include "motionsgenerator.h"
 #include "vertebratamovemotionbuilder.h"
-#include "blockmesh.h"
 #include "vertebratamovemotionparameterswidget.h"
 #include "util.h"
 
+class MotionEvaluator
+{
+public:
+    MotionEvaluator(const MotionsGenerator *motionsGenerator,
+            const std::vector<QUuid> *motionIds,
+            std::vector<MotionsGenerator::MotionResult> *motionResults) :
+        m_motionsGenerator(motionsGenerator),
+        m_motionIds(motionIds),
+        m_motionResults(motionResults)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i)
+            m_motionsGenerator->generateMotion((*m_motionIds)[i], &(*m_motionResults)[i]);
+    }
+private:
+    const MotionsGenerator *m_motionsGenerator = nullptr;
+    const std::vector<QUuid> *m_motionIds = nullptr;
+    std::vector<MotionsGenerator::MotionResult> *m_motionResults = nullptr;
+};
+
+class MotionFrameEvaluator
+{
+public:
+    MotionFrameEvaluator(const MotionsGenerator *motionsGenerator,
+            const std::vector<std::vector<MotionBuilder::Node>> *frames,
+            MotionClip *motionClip) :
+        m_motionsGenerator(motionsGenerator),
+        m_frames(frames),
+        m_motionClip(motionClip)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i)
+            m_motionsGenerator->evaluateFrame((*m_frames)[i], i, m_motionClip);
+    }
+private:
+    const MotionsGenerator *m_motionsGenerator = nullptr;
+    const std::vector<std::vector<MotionBuilder::Node>> *m_frames = nullptr;
+    MotionClip *m_motionClip = nullptr;
+};
+
 MotionsGenerator::MotionsGenerator(RigType rigType,
         const std::vector<RigBone> &bones,
         const std::map<int, RigVertexWeights> &rigWeights,
@@ -24,17 +69,7 @@ MotionsGenerator::~MotionsGenerator()
 {
     for (auto &it: m_resultSnapshotMeshes)
         delete it.second;
-    
-    for (auto &item: m_resultPreviewMeshes) {
-        for (auto &subItem: item.second) {
-            delete subItem.second;
-        }
-    }
-}
-
-void MotionsGenerator::enablePreviewMeshes()
-{
-    m_previewMeshesEnabled = true;
+    delete m_motionSkinner;
 }
 
 void MotionsGenerator::enableSnapshotMeshes()
@@ -62,25 +97,17 @@ Model *MotionsGenerator::takeResultSnapshotMesh(const QUuid &motionId)
     return result;
 }
 
-std::vector<std::pair<float, SimpleShaderMesh *>> MotionsGenerator::takeResultPreviewMeshes(const QUuid &motionId)
+MotionClip MotionsGenerator::takeResultMotionClip(const QUuid &motionId)
 {
-    auto findResult = m_resultPreviewMeshes.find(motionId);
-    if (findResult == m_resultPreviewMeshes.end())
-        return {};
-    auto result = findResult->second;
-    m_resultPreviewMeshes.erase(findResult);
+    auto findResult = m_resultMotionClips.find(motionId);
+    if (findResult == m_resultMotionClips.end())
+        return MotionClip();
+    MotionClip result = std::move(findResult->second);
+    m_resultMotionClips.erase(findResult);
     return result;
 }
-
-std::vector<std::pair<float, JointNodeTree>> MotionsGenerator::takeResultJointNodeTrees(const QUuid &motionId)
-{
-    auto findResult = m_resultJointNodeTrees.find(motionId);
-    if (findResult == m_resultJointNodeTrees.end())
-        return {};
-    return findResult->second;
-}
         
-void MotionsGenerator::generateMotion(const QUuid &motionId)
+void MotionsGenerator::generateMotion(const QUuid &motionId, MotionResult *result) const
 {
     if (m_bones.empty())
         return;
@@ -178,7 +205,7 @@ void MotionsGenerator::generateMotion(const QUuid &motionId)
     VertebrataMoveMotionBuilder *vertebrataMoveMotionBuilder = new VertebrataMoveMotionBuilder;
     
     VertebrataMoveMotionBuilder::Parameters parameters = 
-        VertebrataMoveMotionParametersWidget::toVertebrataMoveMotionParameters(m_motions[motionId]);
+        VertebrataMoveMotionParametersWidget::toVertebrataMoveMotionParameters(m_motions.at(motionId));
     if ("Vertical" == valueOfKeyInMapOrEmpty(m_bones[0].attributes, "spineDirection"))
         parameters.biped = true;
     vertebrataMoveMotionBuilder->setParameters(parameters);
@@ -230,191 +257,94 @@ void MotionsGenerator::generateMotion(const QUuid &motionId)
     vertebrataMoveMotionBuilder->setGroundY(groundY);
     vertebrataMoveMotionBuilder->generate();
     
-    std::vector<std::pair<float, JointNodeTree>> jointNodeTrees;
-    std::vector<std::pair<float, SimpleShaderMesh *>> previewMeshes;
-    Model *snapshotMesh = nullptr;
+    const auto &frames = vertebrataMoveMotionBuilder->frames();
+    result->motionClip = MotionClip(m_bones.size(), frames.size(), 0.017f);
+    result->motionClip.setGroundY(groundY + parameters.groundOffset);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, frames.size()),
+        MotionFrameEvaluator(this, &frames, &result->motionClip));
     
-    std::vector<QMatrix4x4> bindTransforms(m_bones.size());
-    for (size_t i = 0; i < m_bones.size(); ++i) {
-        const auto &bone = m_bones[i];
+    if (nullptr != m_motionSkinner && !frames.empty())
+        result->snapshotMesh = m_motionSkinner->createModel(result->motionClip, frames.size() / 2);
+    
+    delete vertebrataMoveMotionBuilder;
+}
+
+void MotionsGenerator::evaluateFrame(const std::vector<MotionBuilder::Node> &frame, size_t frameIndex,
+    MotionClip *motionClip) const
+{
+    std::vector<RigBone> transformedBones = m_bones;
+    for (const auto &node: frame) {
+        if (-1 == node.boneIndex)
+            continue;
+        if (node.isTail) {
+            transformedBones[node.boneIndex].tailPosition = node.position;
+            for (const auto &childIndex: m_bones[node.boneIndex].children)
+                transformedBones[childIndex].headPosition = node.position;
+        } else {
+            transformedBones[node.boneIndex].headPosition = node.position;
+            auto parentIndex = m_bones[node.boneIndex].parent;
+            if (-1 != parentIndex) {
+                transformedBones[parentIndex].tailPosition = node.position;
+                for (const auto &childIndex: m_bones[parentIndex].children)
+                    transformedBones[childIndex].headPosition = node.position;
+            }
+        }
+    }
+    
+    std::vector<QMatrix4x4> poseTransforms(transformedBones.size());
+    std::vector<QMatrix4x4> poseRotations(transformedBones.size());
+    for (size_t i = 0; i < transformedBones.size(); ++i) {
+        const auto &oldBone = m_bones[i];
+        const auto &bone = transformedBones[i];
         QMatrix4x4 parentMatrix;
         QMatrix4x4 translationMatrix;
+        QMatrix4x4 rotationMatrix;
+        QMatrix4x4 parentRotation;
         if (-1 != bone.parent) {
-            const auto &parentBone = m_bones[bone.parent];
-            parentMatrix = bindTransforms[bone.parent];
-            translationMatrix.translate(bone.headPosition - parentBone.headPosition);
+            const auto &oldParentBone = m_bones[oldBone.parent];
+            parentMatrix = poseTransforms[bone.parent];
+            parentRotation = poseRotations[bone.parent];
+            translationMatrix.translate(oldBone.headPosition - oldParentBone.headPosition);
+            QQuaternion rotation = QQuaternion::rotationTo((oldBone.tailPosition - oldBone.headPosition).normalized(),
+                (bone.tailPosition - bone.headPosition).normalized());
+            rotationMatrix.rotate(rotation);
         } else {
-            translationMatrix.translate(bone.headPosition);
+            translationMatrix.translate(bone.headPosition + (bone.tailPosition - oldBone.tailPosition));
         }
-        bindTransforms[i] = parentMatrix * translationMatrix;
+        poseTransforms[i] = parentMatrix * translationMatrix * parentRotation.inverted() * rotationMatrix;
+        poseRotations[i] = rotationMatrix;
     }
     
-    const auto &vertebrataMoveMotionBuilderFrames = vertebrataMoveMotionBuilder->frames();
-    for (size_t frameIndex = 0; frameIndex < vertebrataMoveMotionBuilderFrames.size(); ++frameIndex) {
-        const auto &frame = vertebrataMoveMotionBuilderFrames[frameIndex];
-        std::vector<RigBone> transformedBones = m_bones;
-        for (const auto &node: frame) {
-            if (-1 == node.boneIndex)
-                continue;
-            if (node.isTail) {
-                transformedBones[node.boneIndex].tailPosition = node.position;
-                for (const auto &childIndex: m_bones[node.boneIndex].children)
-                    transformedBones[childIndex].headPosition = node.position;
-            } else {
-                transformedBones[node.boneIndex].headPosition = node.position;
-                auto parentIndex = m_bones[node.boneIndex].parent;
-                if (-1 != parentIndex) {
-                    transformedBones[parentIndex].tailPosition = node.position;
-                    for (const auto &childIndex: m_bones[parentIndex].children)
-                        transformedBones[childIndex].headPosition = node.position;
-                }
-            }
-        }
-        
-        std::vector<QMatrix4x4> poseTransforms(transformedBones.size());
-        std::vector<QMatrix4x4> poseRotations(transformedBones.size());
-        for (size_t i = 0; i < transformedBones.size(); ++i) {
-            const auto &oldBone = m_bones[i];
-            const auto &bone = transformedBones[i];
-            QMatrix4x4 parentMatrix;
-            QMatrix4x4 translationMatrix;
-            QMatrix4x4 rotationMatrix;
-            QMatrix4x4 parentRotation;
-            if (-1 != bone.parent) {
-                const auto &oldParentBone = m_bones[oldBone.parent];
-                parentMatrix = poseTransforms[bone.parent];
-                parentRotation = poseRotations[bone.parent];
-                translationMatrix.translate(oldBone.headPosition - oldParentBone.headPosition);
-                QQuaternion rotation = QQuaternion::rotationTo((oldBone.tailPosition - oldBone.headPosition).normalized(),
-                    (bone.tailPosition - bone.headPosition).normalized());
-                rotationMatrix.rotate(rotation);
-            } else {
-                translationMatrix.translate(bone.headPosition + (bone.tailPosition - oldBone.tailPosition));
-            }
-            poseTransforms[i] = parentMatrix * translationMatrix * parentRotation.inverted() * rotationMatrix;
-            poseRotations[i] = rotationMatrix;
-        }
-        
-        JointNodeTree jointNodeTree(&m_bones);
-        for (size_t i = 0; i < m_bones.size(); ++i) {
-            const auto &bone = transformedBones[i];
-            if (-1 != bone.parent) {
-                jointNodeTree.updateMatrix(i, poseTransforms[bone.parent].inverted() * poseTransforms[i]);
-            } else {
-                jointNodeTree.updateMatrix(i, poseTransforms[i]);
-            }
-        }
-        
-        jointNodeTrees.push_back({0.017f, jointNodeTree});
-        
-        const std::vector<JointNode> &jointNodes = jointNodeTree.nodes();
-        std::vector<QMatrix4x4> jointNodeMatrices(m_bones.size());
-        for (size_t i = 0; i < m_bones.size(); ++i) {
-            const auto &bone = transformedBones[i];
-            QMatrix4x4 translationMatrix;
-            translationMatrix.translate(jointNodes[i].translation);
-            QMatrix4x4 rotationMatrix;
-            rotationMatrix.rotate(jointNodes[i].rotation);
-            if (-1 != bone.parent) {
-                jointNodeMatrices[i] *= jointNodeMatrices[bone.parent];
-            }
-            jointNodeMatrices[i] *= translationMatrix * rotationMatrix;
-        }
-        for (size_t i = 0; i < m_bones.size(); ++i)
-            jointNodeMatrices[i] = jointNodeMatrices[i] * bindTransforms[i].inverted();
-        
-        std::vector<QVector3D> transformedVertices(m_object.vertices.size());
-        for (size_t i = 0; i < m_object.vertices.size(); ++i) {
-            const auto &weight = m_rigWeights[i];
-            for (int x = 0; x < MAX_WEIGHT_NUM; x++) {
-                float factor = weight.boneWeights[x];
-                if (factor > 0) {
-                    transformedVertices[i] += jointNodeMatrices[weight.boneIndices[x]] * m_object.vertices[i] * factor;
-                }
-            }
-        }
-        
-        std::vector<QVector3D> frameVertices = transformedVertices;
-        std::vector<std::vector<size_t>> frameFaces = m_object.triangles;
-        std::vector<std::vector<QVector3D>> frameCornerNormals;
-        const std::vector<std::vector<QVector3D>> *triangleVertexNormals = m_object.triangleVertexNormals();
-        if (nullptr == triangleVertexNormals) {
-            frameCornerNormals.resize(frameFaces.size());
-            for (size_t i = 0; i < m_object.triangles.size(); ++i) {
-                const auto &triangle = m_object.triangles[i];
-                QVector3D triangleNormal = QVector3D::normal(
-                    transformedVertices[triangle[0]],
-                    transformedVertices[triangle[1]],
-                    transformedVertices[triangle[2]]
-                );
-                frameCornerNormals[i] = {
-                    triangleNormal, triangleNormal, triangleNormal
-                };
-            }
+    for (size_t i = 0; i < m_bones.size(); ++i) {
+        const auto &bone = transformedBones[i];
+        if (-1 != bone.parent) {
+            motionClip->setMatrix(i, frameIndex, poseTransforms[bone.parent].inverted() * poseTransforms[i]);
         } else {
-            frameCornerNormals = *triangleVertexNormals;
-        }
-        
-        if (m_snapshotMeshesEnabled) {
-            if (frameIndex == vertebrataMoveMotionBuilderFrames.size() / 2) {
-                delete snapshotMesh;
-                snapshotMesh = new Model(frameVertices, frameFaces, frameCornerNormals);
-            }
-        }
-        
-        if (m_previewMeshesEnabled) {
-            BlockMesh blockMesh;
-            blockMesh.addBlock(
-                QVector3D(0.0, groundY + parameters.groundOffset, 0.0), 100.0,
-                QVector3D(0.0, groundY + parameters.groundOffset - 0.02, 0.0), 100.0);
-            for (const auto &bone: transformedBones) {
-                if (0 == bone.index)
-                    continue;
-                blockMesh.addBlock(bone.headPosition, bone.headRadius * 0.5,
-                    bone.tailPosition, bone.tailRadius * 0.5);
-            }
-            blockMesh.build();
-            std::vector<QVector3D> *resultVertices = blockMesh.takeResultVertices();
-            std::vector<std::vector<size_t>> *resultFaces = blockMesh.takeResultFaces();
-            size_t oldVertexCount = frameVertices.size();
-            for (const auto &v: *resultVertices)
-                frameVertices.push_back(QVector3D(v.x() - 0.5, v.y(), v.z()));
-            for (const auto &f: *resultFaces) {
-                std::vector<size_t> newF = f;
-                for (auto &v: newF)
-                    v += oldVertexCount;
-                frameFaces.push_back(newF);
-
-                QVector3D triangleNormal = QVector3D::normal(
-                    (*resultVertices)[f[0]],
-                    (*resultVertices)[f[1]],
-                    (*resultVertices)[f[2]]
-                );
-                frameCornerNormals.push_back({
-                    triangleNormal, triangleNormal, triangleNormal
-                });
-            }
-            delete resultFaces;
-            delete resultVertices;
-            
-            previewMeshes.push_back({0.017f, new SimpleShaderMesh(
-                new std::vector<QVector3D>(frameVertices), 
-                new std::vector<std::vector<size_t>>(frameFaces),
-                new std::vector<std::vector<QVector3D>>(frameCornerNormals))});
+            motionClip->setMatrix(i, frameIndex, poseTransforms[i]);
         }
     }
-    
-    if (m_previewMeshesEnabled)
-        m_resultPreviewMeshes[motionId] = previewMeshes;
-    m_resultJointNodeTrees[motionId] = jointNodeTrees;
-    m_resultSnapshotMeshes[motionId] = snapshotMesh;
 }
 
 void MotionsGenerator::generate()
 {
-    for (const auto &it: m_motions) {
-        generateMotion(it.first);
-        m_generatedMotionIds.insert(it.first);
+    if (m_snapshotMeshesEnabled && !m_bones.empty())
+        m_motionSkinner = new MotionSkinner(m_bones, m_rigWeights, m_object);
+    
+    std::vector<QUuid> motionIds;
+    motionIds.reserve(m_motions.size());
+    for (const auto &it: m_motions)
+        motionIds.push_back(it.first);
+    
+    std::vector<MotionResult> motionResults(motionIds.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, motionIds.size()),
+        MotionEvaluator(this, &motionIds, &motionResults));
+    
+    for (size_t i = 0; i < motionIds.size(); ++i) {
+        const auto &motionId = motionIds[i];
+        auto &motionResult = motionResults[i];
+        m_resultMotionClips[motionId] = std::move(motionResult.motionClip);
+        m_resultSnapshotMeshes[motionId] = motionResult.snapshotMesh;
+        m_generatedMotionIds.insert(motionId);
     }
 }
 
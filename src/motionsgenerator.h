@@ -5,9 +5,10 @@
 #include <map>
 #include <set>
 #include "model.h"
-#include "simpleshadermesh.h"
 #include "rig.h"
-#include "jointnodetree.h"
+#include "motionclip.h"
+#include "motionskinner.h"
+#include "motionbuilder.h"
 
 class MotionsGenerator : public QObject
 {
@@ -20,10 +21,8 @@ public:
     ~MotionsGenerator();
     void addMotion(const QUuid &motionId, const std::map<QString, QString> &parameters);
     Model *takeResultSnapshotMesh(const QUuid &motionId);
-    std::vector<std::pair<float, SimpleShaderMesh *>> takeResultPreviewMeshes(const QUuid &motionId);
-    std::vector<std::pair<float, JointNodeTree>> takeResultJointNodeTrees(const QUuid &motionId);
+    MotionClip takeResultMotionClip(const QUuid &motionId);
     const std::set<QUuid> &generatedMotionIds();
-    void enablePreviewMeshes();
     void enableSnapshotMeshes();
     void generate();
 signals:
@@ -40,12 +39,22 @@ private:
     std::map<QUuid, std::map<QString, QString>> m_motions;
     std::set<QUuid> m_generatedMotionIds;
     std::map<QUuid, Model *> m_resultSnapshotMeshes;
-    std::map<QUuid, std::vector<std::pair<float, SimpleShaderMesh *>>> m_resultPreviewMeshes;
-    std::map<QUuid, std::vector<std::pair<float, JointNodeTree>>> m_resultJointNodeTrees;
-    bool m_previewMeshesEnabled = false;
+    std::map<QUuid, MotionClip> m_resultMotionClips;
     bool m_snapshotMeshesEnabled = false;
+    MotionSkinner *m_motionSkinner = nullptr;
     
-    void generateMotion(const QUuid &motionId);
+    struct MotionResult
+    {
+        MotionClip motionClip;
+        Model *snapshotMesh = nullptr;
+    };
+    
+    friend class MotionEvaluator;
+    friend class MotionFrameEvaluator;
+    
+    void generateMotion(const QUuid &motionId, MotionResult *result) const;
+    void evaluateFrame(const std::vector<MotionBuilder::Node> &frame, size_t frameIndex,
+        MotionClip *motionClip) const;
 };
 
 #endif
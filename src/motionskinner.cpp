@@ -0,0 +1,236 @@
+#include "motionskinner.h"
+#include "blockmesh.h"
+
+MotionSkinner::MotionSkinner(const std::vector<RigBone> &bones,
+        const std::map<int, RigVertexWeights> &rigWeights,
+        const Object &object) :
+    m_bones(bones),
+    m_triangles(object.triangles)
+{
+    size_t vertexCount = object.vertices.size();
+    m_vertexPositionsX.resize(vertexCount);
+    m_vertexPositionsY.resize(vertexCount);
+    m_vertexPositionsZ.resize(vertexCount);
+    m_vertexBoneIndices.assign(vertexCount * MAX_WEIGHT_NUM, 0);
+    m_vertexBoneWeights.assign(vertexCount * MAX_WEIGHT_NUM, 0.0f);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        const auto &position = object.vertices[i];
+        m_vertexPositionsX[i] = position.x();
+        m_vertexPositionsY[i] = position.y();
+        m_vertexPositionsZ[i] = position.z();
+        auto findWeights = rigWeights.find((int)i);
+        if (findWeights == rigWeights.end())
+            continue;
+        const auto &weight = findWeights->second;
+        for (int x = 0; x < MAX_WEIGHT_NUM; x++) {
+            float factor = weight.boneWeights[x];
+            if (factor > 0) {
+                m_vertexBoneIndices[i * MAX_WEIGHT_NUM + x] = weight.boneIndices[x];
+                m_vertexBoneWeights[i * MAX_WEIGHT_NUM + x] = factor;
+            }
+        }
+    }
+    
+    const std::vector<std::vector<QVector3D>> *triangleVertexNormals = object.triangleVertexNormals();
+    if (nullptr != triangleVertexNormals) {
+        m_triangleVertexNormals = *triangleVertexNormals;
+        m_hasTriangleVertexNormals = true;
+    }
+    
+    std::vector<QMatrix4x4> bindTransforms(m_bones.size());
+    m_inverseBindTransforms.resize(m_bones.size());
+    for (size_t i = 0; i < m_bones.size(); ++i) {
+        const auto &bone = m_bones[i];
+        QMatrix4x4 parentMatrix;
+        QMatrix4x4 translationMatrix;
+        if (-1 != bone.parent) {
+            const auto &parentBone = m_bones[bone.parent];
+            parentMatrix = bindTransforms[bone.parent];
+            translationMatrix.translate(bone.headPosition - parentBone.headPosition);
+        } else {
+            translationMatrix.translate(bone.headPosition);
+        }
+        bindTransforms[i] = parentMatrix * translationMatrix;
+        m_inverseBindTransforms[i] = bindTransforms[i].inverted();
+    }
+}
+
+void MotionSkinner::computeBoneMatrices(const MotionClip &clip, size_t frameIndex, std::vector<float> *boneMatrices) const
+{
+    std::vector<QMatrix4x4> jointNodeMatrices(m_bones.size());
+    boneMatrices->resize(m_bones.size() * 12);
+    for (size_t i = 0; i < m_bones.size(); ++i) {
+        const auto &bone = m_bones[i];
+        if (i < clip.boneCount()) {
+            QMatrix4x4 translationMatrix;
+            translationMatrix.translate(clip.translation(i, frameIndex));
+            QMatrix4x4 rotationMatrix;
+            rotationMatrix.rotate(clip.rotation(i, frameIndex));
+            if (-1 != bone.parent) {
+                jointNodeMatrices[i] *= jointNodeMatrices[bone.parent];
+            }
+            jointNodeMatrices[i] *= translationMatrix * rotationMatrix;
+        }
+        QMatrix4x4 skinMatrix = jointNodeMatrices[i] * m_inverseBindTransforms[i];
+        float *boneMatrix = &(*boneMatrices)[i * 12];
+        for (int row = 0; row < 3; ++row) {
+            for (int column = 0; column < 4; ++column)
+                boneMatrix[row * 4 + column] = skinMatrix(row, column);
+        }
+    }
+}
+
+void MotionSkinner::skinVertices(const std::vector<float> &boneMatrices, std::vector<QVector3D> *vertices) const
+{
+    size_t vertexCount = m_vertexPositionsX.size();
+    vertices->resize(vertexCount);
+    const float *positionsX = m_vertexPositionsX.data();
+    const float *positionsY = m_vertexPositionsY.data();
+    const float *positionsZ = m_vertexPositionsZ.data();
+    const int *boneIndices = m_vertexBoneIndices.data();
+    const float *boneWeights = m_vertexBoneWeights.data();
+    const float *matrices = boneMatrices.data();
+    QVector3D *result = vertices->data();
+    for (size_t i = 0; i < vertexCount; ++i) {
+        float x = positionsX[i];
+        float y = positionsY[i];
+        float z = positionsZ[i];
+        float resultX = 0;
+        float resultY = 0;
+        float resultZ = 0;
+        for (int j = 0; j < MAX_WEIGHT_NUM; ++j) {
+            float weight = boneWeights[i * MAX_WEIGHT_NUM + j];
+            const float *m = &matrices[boneIndices[i * MAX_WEIGHT_NUM + j] * 12];
+            resultX += weight * (m[0] * x + m[1] * y + m[2] * z + m[3]);
+            resultY += weight * (m[4] * x + m[5] * y + m[6] * z + m[7]);
+            resultZ += weight * (m[8] * x + m[9] * y + m[10] * z + m[11]);
+        }
+        result[i] = QVector3D(resultX, resultY, resultZ);
+    }
+}
+
+void MotionSkinner::computeTriangleNormals(const std::vector<QVector3D> &vertices,
+    const std::vector<std::vector<size_t>> &triangles,
+    size_t vertexOffset,
+    size_t normalOffset,
+    std::vector<std::vector<QVector3D>> *triangleNormals) const
+{
+    if (triangleNormals->size() < normalOffset + triangles.size())
+        triangleNormals->resize(normalOffset + triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        const auto &triangle = triangles[i];
+        QVector3D triangleNormal = QVector3D::normal(
+            vertices[vertexOffset + triangle[0]],
+            vertices[vertexOffset + triangle[1]],
+            vertices[vertexOffset + triangle[2]]
+        );
+        (*triangleNormals)[normalOffset + i] = {
+            triangleNormal, triangleNormal, triangleNormal
+        };
+    }
+}
+
+Model *MotionSkinner::createModel(const MotionClip &clip, size_t frameIndex) const
+{
+    std::vector<float> boneMatrices;
+    computeBoneMatrices(clip, frameIndex, &boneMatrices);
+    std::vector<QVector3D> vertices;
+    skinVertices(boneMatrices, &vertices);
+    if (m_hasTriangleVertexNormals)
+        return new Model(vertices, m_triangles, m_triangleVertexNormals);
+    std::vector<std::vector<QVector3D>> triangleNormals;
+    triangleNormals.reserve(m_triangles.size());
+    computeTriangleNormals(vertices, m_triangles, 0, 0, &triangleNormals);
+    return new Model(vertices, m_triangles, triangleNormals);
+}
+
+void MotionSkinner::preparePreview()
+{
+    if (m_previewPrepared)
+        return;
+    m_previewPrepared = true;
+    
+    auto addBlock = [&](int boneIndex, const QVector3D &fromPosition, double fromRadius,
+            const QVector3D &toPosition, double toRadius) {
+        BlockMesh blockMesh;
+        blockMesh.addBlock(fromPosition, fromRadius, toPosition, toRadius);
+        blockMesh.build();
+        std::vector<QVector3D> *resultVertices = blockMesh.takeResultVertices();
+        std::vector<std::vector<size_t>> *resultFaces = blockMesh.takeResultFaces();
+        size_t oldVertexCount = m_blockVertices.size();
+        for (const auto &v: *resultVertices) {
+            m_blockVertices.push_back(v);
+            m_blockVertexBoneIndices.push_back(boneIndex);
+        }
+        for (const auto &f: *resultFaces) {
+            std::vector<size_t> newF = f;
+            for (auto &v: newF)
+                v += oldVertexCount;
+            m_blockTriangles.push_back(newF);
+        }
+        delete resultFaces;
+        delete resultVertices;
+    };
+    
+    // The ground block is built at zero height and lifted to the ground of each clip
+    addBlock(-1, QVector3D(0.0, 0.0, 0.0), 100.0, QVector3D(0.0, -0.02, 0.0), 100.0);
+    for (size_t i = 0; i < m_bones.size(); ++i) {
+        const auto &bone = m_bones[i];
+        if (0 == bone.index)
+            continue;
+        addBlock((int)i, bone.headPosition, bone.headRadius * 0.5,
+            bone.tailPosition, bone.tailRadius * 0.5);
+    }
+    
+    size_t vertexCount = m_vertexPositionsX.size();
+    auto previewTriangles = std::make_shared<std::vector<std::vector<size_t>>>(m_triangles);
+    previewTriangles->reserve(m_triangles.size() + m_blockTriangles.size());
+    for (const auto &f: m_blockTriangles) {
+        std::vector<size_t> newF = f;
+        for (auto &v: newF)
+            v += vertexCount;
+        previewTriangles->push_back(newF);
+    }
+    m_previewTriangles = previewTriangles;
+}
+
+SimpleShaderMesh *MotionSkinner::createPreviewMesh(const MotionClip &clip, size_t frameIndex)
+{
+    preparePreview();
+    
+    computeBoneMatrices(clip, frameIndex, &m_previewBoneMatrices);
+    
+    // The buffers of the previous frame are written over once no mesh holds them anymore,
+    // the faces never change and are shared by every frame
+    if (nullptr == m_previewVertices || m_previewVertices.use_count() > 1)
+        m_previewVertices = std::make_shared<std::vector<QVector3D>>();
+    if (nullptr == m_previewTriangleNormals || m_previewTriangleNormals.use_count() > 1) {
+        m_previewTriangleNormals = m_hasTriangleVertexNormals ?
+            std::make_shared<std::vector<std::vector<QVector3D>>>(m_triangleVertexNormals) :
+            std::make_shared<std::vector<std::vector<QVector3D>>>();
+    }
+    
+    size_t vertexCount = m_vertexPositionsX.size();
+    std::vector<QVector3D> &vertices = *m_previewVertices;
+    skinVertices(m_previewBoneMatrices, &vertices);
+    vertices.resize(vertexCount + m_blockVertices.size());
+    for (size_t i = 0; i < m_blockVertices.size(); ++i) {
+        const auto &v = m_blockVertices[i];
+        int boneIndex = m_blockVertexBoneIndices[i];
+        if (-1 == boneIndex) {
+            vertices[vertexCount + i] = QVector3D(v.x() - 0.5, v.y() + clip.groundY(), v.z());
+            continue;
+        }
+        const float *m = &m_previewBoneMatrices[boneIndex * 12];
+        vertices[vertexCount + i] = QVector3D(
+            m[0] * v.x() + m[1] * v.y() + m[2] * v.z() + m[3] - 0.5,
+            m[4] * v.x() + m[5] * v.y() + m[6] * v.z() + m[7],
+            m[8] * v.x() + m[9] * v.y() + m[10] * v.z() + m[11]);
+    }
+    
+    if (!m_hasTriangleVertexNormals)
+        computeTriangleNormals(vertices, m_triangles, 0, 0, m_previewTriangleNormals.get());
+    computeTriangleNormals(vertices, m_blockTriangles, vertexCount, m_triangles.size(), m_previewTriangleNormals.get());
+    
+    return new SimpleShaderMesh(m_previewVertices, m_previewTriangles, m_previewTriangleNormals);
+}
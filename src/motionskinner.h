@@ -0,0 +1,52 @@
+#ifndef DUST3D_MOTION_SKINNER_H
+#define DUST3D_MOTION_SKINNER_H
+#include <QMatrix4x4>
+#include <vector>
+#include <map>
+#include <memory>
+#include "rig.h"
+#include "object.h"
+#include "model.h"
+#include "simpleshadermesh.h"
+#include "motionclip.h"
+
+class MotionSkinner
+{
+public:
+    MotionSkinner(const std::vector<RigBone> &bones,
+        const std::map<int, RigVertexWeights> &rigWeights,
+        const Object &object);
+    void computeBoneMatrices(const MotionClip &clip, size_t frameIndex, std::vector<float> *boneMatrices) const;
+    void skinVertices(const std::vector<float> &boneMatrices, std::vector<QVector3D> *vertices) const;
+    Model *createModel(const MotionClip &clip, size_t frameIndex) const;
+    SimpleShaderMesh *createPreviewMesh(const MotionClip &clip, size_t frameIndex);
+private:
+    std::vector<RigBone> m_bones;
+    std::vector<QMatrix4x4> m_inverseBindTransforms;
+    std::vector<float> m_vertexPositionsX;
+    std::vector<float> m_vertexPositionsY;
+    std::vector<float> m_vertexPositionsZ;
+    std::vector<int> m_vertexBoneIndices;
+    std::vector<float> m_vertexBoneWeights;
+    std::vector<std::vector<size_t>> m_triangles;
+    bool m_hasTriangleVertexNormals = false;
+    std::vector<std::vector<QVector3D>> m_triangleVertexNormals;
+    
+    bool m_previewPrepared = false;
+    std::vector<QVector3D> m_blockVertices;
+    std::vector<int> m_blockVertexBoneIndices;
+    std::vector<std::vector<size_t>> m_blockTriangles;
+    std::shared_ptr<const std::vector<std::vector<size_t>>> m_previewTriangles;
+    std::vector<float> m_previewBoneMatrices;
+    std::shared_ptr<std::vector<QVector3D>> m_previewVertices;
+    std::shared_ptr<std::vector<std::vector<QVector3D>>> m_previewTriangleNormals;
+    
+    void preparePreview();
+    void computeTriangleNormals(const std::vector<QVector3D> &vertices,
+        const std::vector<std::vector<size_t>> &triangles,
+        size_t vertexOffset,
+        size_t normalOffset,
+        std::vector<std::vector<QVector3D>> *triangleNormals) const;
+};
+
+#endif
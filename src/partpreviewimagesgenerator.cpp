@@ -30,16 +30,24 @@ void PartPreviewImagesGenerator::generate()
     m_offscreenRender->setEyePosition(QVector3D(0, 0, -4.0));
     m_offscreenRender->enableEnvironmentLight();
     m_offscreenRender->setRenderPurpose(0);
+    
+    std::vector<ModelOffscreenRender::BatchItem> items;
+    std::vector<QUuid> partIds;
+    items.reserve(m_partPreviews.size());
+    partIds.reserve(m_partPreviews.size());
     for (auto &it: m_partPreviews) {
-        if (it.second.isCutFace) {
-            m_offscreenRender->setXRotation(0);
-            m_offscreenRender->setYRotation(0);
-        } else {
-            m_offscreenRender->setXRotation(30 * 16);
-            m_offscreenRender->setYRotation(-45 * 16);
-        }
-        m_offscreenRender->updateMesh(it.second.mesh);
+        ModelOffscreenRender::BatchItem item;
+        item.mesh = it.second.mesh;
         it.second.mesh = nullptr;
-        (*m_partImages)[it.first] = m_offscreenRender->toImage(QSize(Theme::partPreviewImageSize, Theme::partPreviewImageSize));
+        if (!it.second.isCutFace) {
+            item.xRotation = 30 * 16;
+            item.yRotation = -45 * 16;
+        }
+        items.push_back(item);
+        partIds.push_back(it.first);
     }
+    std::vector<QImage> images = m_offscreenRender->toImages(&items,
+        QSize(Theme::partPreviewImageSize, Theme::partPreviewImageSize));
+    for (size_t i = 0; i < partIds.size(); ++i)
+        (*m_partImages)[partIds[i]] = images[i];
 }
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include "positionkdtree.h"
+
+PositionKdTree::PositionKdTree(const std::vector<QVector3D> &positions) :
+    m_positions(positions)
+{
+    std::vector<size_t> positionIndices(m_positions.size());
+    std::iota(positionIndices.begin(), positionIndices.end(), 0);
+    m_nodes.reserve(m_positions.size());
+    m_root = buildNode(positionIndices, 0, positionIndices.size());
+}
+
+size_t PositionKdTree::buildNode(std::vector<size_t> &positionIndices, size_t begin, size_t end)
+{
+    if (begin >= end)
+        return m_positions.size();
+    
+    QVector3D boundMin = m_positions[positionIndices[begin]];
+    QVector3D boundMax = boundMin;
+    for (size_t i = begin + 1; i < end; ++i) {
+        const auto &position = m_positions[positionIndices[i]];
+        for (int axis = 0; axis < 3; ++axis) {
+            boundMin[axis] = std::min(boundMin[axis], position[axis]);
+            boundMax[axis] = std::max(boundMax[axis], position[axis]);
+        }
+    }
+    QVector3D extent = boundMax - boundMin;
+    int axis = 0;
+    if (extent.y() > extent[axis])
+        axis = 1;
+    if (extent.z() > extent[axis])
+        axis = 2;
+    
+    size_t middle = (begin + end) / 2;
+    std::nth_element(positionIndices.begin() + begin,
+        positionIndices.begin() + middle,
+        positionIndices.begin() + end,
+        [&](size_t first, size_t second) {
+            return m_positions[first][axis] < m_positions[second][axis];
+        });
+    
+    size_t nodeIndex = m_nodes.size();
+    m_nodes.push_back(Node());
+    m_nodes[nodeIndex].positionIndex = positionIndices[middle];
+    m_nodes[nodeIndex].axis = axis;
+    size_t left = buildNode(positionIndices, begin, middle);
+    size_t right = buildNode(positionIndices, middle + 1, end);
+    m_nodes[nodeIndex].left = left;
+    m_nodes[nodeIndex].right = right;
+    return nodeIndex;
+}
+
+void PositionKdTree::searchNode(size_t nodeIndex, const QVector3D &position,
+    const std::function<bool (size_t)> &filter,
+    size_t *nearestIndex, float *nearestDistance2) const
+{
+    if (nodeIndex >= m_nodes.size())
+        return;
+    
+    const auto &node = m_nodes[nodeIndex];
+    const auto &nodePosition = m_positions[node.positionIndex];
+    if (nullptr == filter || filter(node.positionIndex)) {
+        float distance2 = (nodePosition - position).lengthSquared();
+        // Ties go to the lower index, the same as a linear scan with std::min_element
+        if (distance2 < *nearestDistance2 ||
+                (distance2 == *nearestDistance2 && node.positionIndex < *nearestIndex)) {
+            *nearestDistance2 = distance2;
+            *nearestIndex = node.positionIndex;
+        }
+    }
+    
+    float offset = position[node.axis] - nodePosition[node.axis];
+    size_t nearChild = offset < 0 ? node.left : node.right;
+    size_t farChild = offset < 0 ? node.right : node.left;
+    searchNode(nearChild, position, filter, nearestIndex, nearestDistance2);
+    if (offset * offset <= *nearestDistance2)
+        searchNode(farChild, position, filter, nearestIndex, nearestDistance2);
+}
+
+size_t PositionKdTree::nearest(const QVector3D &position,
+    const std::function<bool (size_t)> &filter,
+    float *distance2) const
+{
+    size_t nearestIndex = m_positions.size();
+    float nearestDistance2 = std::numeric_limits<float>::max();
+    searchNode(m_root, position, filter, &nearestIndex, &nearestDistance2);
+    if (nullptr != distance2)
+        *distance2 = nearestDistance2;
+    return nearestIndex;
+}
@@ -0,0 +1,33 @@
+#ifndef DUST3D_POSITION_KD_TREE_H
+#define DUST3D_POSITION_KD_TREE_H
+#include <vector>
+#include <functional>
+#include <QVector3D>
+
+class PositionKdTree
+{
+public:
+    PositionKdTree(const std::vector<QVector3D> &positions);
+    size_t nearest(const QVector3D &position,
+        const std::function<bool (size_t)> &filter=nullptr,
+        float *distance2=nullptr) const;
+private:
+    struct Node
+    {
+        size_t positionIndex = 0;
+        int axis = 0;
+        size_t left = 0;
+        size_t right = 0;
+    };
+    
+    std::vector<QVector3D> m_positions;
+    std::vector<Node> m_nodes;
+    size_t m_root = 0;
+    
+    size_t buildNode(std::vector<size_t> &positionIndices, size_t begin, size_t end);
+    void searchNode(size_t nodeIndex, const QVector3D &position,
+        const std::function<bool (size_t)> &filter,
+        size_t *nearestIndex, float *nearestDistance2) const;
+};
+
+#endif
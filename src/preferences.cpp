@@ -22,6 +22,8 @@ void Preferences::loadDefault()
     m_textureSize = 1024;
     m_scriptEnabled = false;
     m_interpolationEnabled = true;
+    m_binarySnapshot = false;
+    m_compressedDocument = false;
 }
 
 Preferences::Preferences()
@@ -75,6 +77,20 @@ Preferences::Preferences()
         else
             m_interpolationEnabled = isTrueValueString(value);
     }
+    {
+        QString value = m_settings.value("binarySnapshot").toString();
+        if (value.isEmpty())
+            m_binarySnapshot = false;
+        else
+            m_binarySnapshot = isTrueValueString(value);
+    }
+    {
+        QString value = m_settings.value("compressedDocument").toString();
+        if (value.isEmpty())
+            m_compressedDocument = false;
+        else
+            m_compressedDocument = isTrueValueString(value);
+    }
 }
 
 CombineMode Preferences::componentCombineMode() const
@@ -102,6 +118,16 @@ bool Preferences::interpolationEnabled() const
     return m_interpolationEnabled;
 }
 
+bool Preferences::binarySnapshot() const
+{
+    return m_binarySnapshot;
+}
+
+bool Preferences::compressedDocument() const
+{
+    return m_compressedDocument;
+}
+
 bool Preferences::toonShading() const
 {
     return m_toonShading;
@@ -162,6 +188,24 @@ void Preferences::setInterpolationEnabled(bool enabled)
     emit interpolationEnabledChanged();
 }
 
+void Preferences::setBinarySnapshot(bool binarySnapshot)
+{
+    if (m_binarySnapshot == binarySnapshot)
+        return;
+    m_binarySnapshot = binarySnapshot;
+    m_settings.setValue("binarySnapshot", binarySnapshot ? "true" : "false");
+    emit binarySnapshotChanged();
+}
+
+void Preferences::setCompressedDocument(bool compressedDocument)
+{
+    if (m_compressedDocument == compressedDocument)
+        return;
+    m_compressedDocument = compressedDocument;
+    m_settings.setValue("compressedDocument", compressedDocument ? "true" : "false");
+    emit compressedDocumentChanged();
+}
+
 void Preferences::setToonShading(bool toonShading)
 {
     if (m_toonShading == toonShading)
@@ -236,4 +280,6 @@ void Preferences::reset()
     emit textureSizeChanged();
     emit scriptEnabledChanged();
     emit interpolationEnabledChanged();
+    emit binarySnapshotChanged();
+    emit compressedDocumentChanged();
 }
@@ -19,6 +19,8 @@ public:
     bool scriptEnabled() const;
     bool interpolationEnabled() const;
     bool toonShading() const;
+    bool binarySnapshot() const;
+    bool compressedDocument() const;
     ToonLine toonLine() const;
     QSize documentWindowSize() const;
     void setDocumentWindowSize(const QSize&);
@@ -34,6 +36,8 @@ signals:
     void textureSizeChanged();
     void interpolationEnabledChanged();
     void scriptEnabledChanged();
+    void binarySnapshotChanged();
+    void compressedDocumentChanged();
 public slots:
     void setComponentCombineMode(CombineMode mode);
     void setPartColor(const QColor &color);
@@ -43,6 +47,8 @@ public slots:
     void setTextureSize(int textureSize);
     void setScriptEnabled(bool enabled);
     void setInterpolationEnabled(bool enabled);
+    void setBinarySnapshot(bool binarySnapshot);
+    void setCompressedDocument(bool compressedDocument);
     void setCurrentFile(const QString &fileName);
     void reset();
 private:
@@ -55,6 +61,8 @@ private:
     int m_textureSize;
     bool m_scriptEnabled;
     bool m_interpolationEnabled;
+    bool m_binarySnapshot;
+    bool m_compressedDocument;
 private:
     void loadDefault();
 };
@@ -107,6 +107,18 @@ PreferencesWidget::PreferencesWidget(const Document *document, QWidget *parent)
         Preferences::instance().setScriptEnabled(scriptEnabledBox->isChecked());
     });
     
+    QCheckBox *binarySnapshotBox = new QCheckBox();
+    Theme::initCheckbox(binarySnapshotBox);
+    connect(binarySnapshotBox, &QCheckBox::stateChanged, this, [=]() {
+        Preferences::instance().setBinarySnapshot(binarySnapshotBox->isChecked());
+    });
+    
+    QCheckBox *compressedDocumentBox = new QCheckBox();
+    Theme::initCheckbox(compressedDocumentBox);
+    connect(compressedDocumentBox, &QCheckBox::stateChanged, this, [=]() {
+        Preferences::instance().setCompressedDocument(compressedDocumentBox->isChecked());
+    });
+    
     QFormLayout *formLayout = new QFormLayout;
     formLayout->addRow(tr("Part color:"), colorLayout);
     formLayout->addRow(tr("Combine mode:"), combineModeSelectBox);
@@ -115,6 +127,8 @@ PreferencesWidget::PreferencesWidget(const Document *document, QWidget *parent)
     formLayout->addRow(tr("Toon shading:"), toonShadingLayout);
     formLayout->addRow(tr("Texture size:"), textureSizeSelectBox);
     formLayout->addRow(tr("Script:"), scriptEnabledBox);
+    formLayout->addRow(tr("Binary skeleton:"), binarySnapshotBox);
+    formLayout->addRow(tr("Compressed document:"), compressedDocumentBox);
     
     auto loadFromPreferences = [=]() {
         updatePickButtonColor();
@@ -127,6 +141,8 @@ PreferencesWidget::PreferencesWidget(const Document *document, QWidget *parent)
         );
         interpolationEnabledBox->setChecked(Preferences::instance().interpolationEnabled());
         scriptEnabledBox->setChecked(Preferences::instance().scriptEnabled());
+        binarySnapshotBox->setChecked(Preferences::instance().binarySnapshot());
+        compressedDocumentBox->setChecked(Preferences::instance().compressedDocument());
     };
     
     loadFromPreferences();
@@ -1,6 +1,3 @@
-#include <set>
-#include <unordered_set>
-#include <unordered_map>
 #include <QDebug>
 #include "ragdoll.h"
 #include "util.h"
@@ -10,15 +7,10 @@ void Ragdoll::prepareChains()
     for (const auto &it: *m_links) {
         m_chains.push_back({it.first, it.second,
             ((*m_vertices)[it.first] - (*m_vertices)[it.second]).length()});
+        m_solver.addDistanceConstraint(it.first, it.second);
     }
 }
 
-void Ragdoll::initializeVertexMotions()
-{
-    for (size_t i = 0; i < m_vertices->size(); ++i)
-        m_vertexMotions[i].position = m_vertexMotions[i].lastPosition = (*m_vertices)[i];
-}
-
 void Ragdoll::outputChainsForDebug(const char *filename, const std::vector<Chain> &springs)
 {
     FILE *fp = fopen(filename, "wb");
@@ -33,81 +25,34 @@ void Ragdoll::outputChainsForDebug(const char *filename, const std::vector<Chain
 
 void Ragdoll::start()
 {
-    initializeVertexMotions();
+    m_solver.setAcceleration(QVector3D(0.0, -9.80665, 0.0) + m_externalForce);
+    m_solver.setGroundY(m_groundY);
     prepareChains();
 
     //outputChainsForDebug("debug-chains.obj", m_chains);
 }
 
-const Ragdoll::VertexMotion &Ragdoll::getVertexMotion(size_t vertexIndex)
+QVector3D Ragdoll::getVertexPosition(size_t vertexIndex) const
 {
-    return m_vertexMotions[vertexIndex];
-}
-
-void Ragdoll::updateVertexForces()
-{
-    for (auto &it: m_vertexMotions)
-        it.second.force = QVector3D();
-    
-    QVector3D combinedForce = QVector3D(0.0, -9.80665, 0.0) + m_externalForce;
-    for (auto &it: m_vertexMotions) {
-        it.second.force += combinedForce;
-    }
-}
-
-void Ragdoll::doVerletIntegration(double stepSize)
-{
-    for (auto &it: m_vertexMotions) {
-        if (it.second.fixed)
-            continue;
-        QVector3D &x = it.second.position;
-        QVector3D temp = x;
-        QVector3D &oldX = it.second.lastPosition;
-        QVector3D a = it.second.force;
-        x += x - oldX + a * stepSize * stepSize;
-        oldX = temp;
-        applyBoundingConstraints(&it.second);
-    }
-}
-
-void Ragdoll::applyBoundingConstraints(VertexMotion *vertexMotion)
-{
-    if (vertexMotion->position.y() < m_groundY + vertexMotion->radius)
-        vertexMotion->position.setY(m_groundY + vertexMotion->radius);
+    return m_solver.position(vertexIndex);
 }
 
 void Ragdoll::applyConstraints()
 {
     for (size_t iteration = 0; iteration < m_parameters.iterations; ++iteration) {
-        for (auto &it: m_chains) {
-            auto &from = m_vertexMotions[it.from];
-            auto &to = m_vertexMotions[it.to];
-            auto delta = from.position - to.position;
-            auto deltaLength = delta.length();
-            if (qFuzzyCompare(deltaLength, 0.0f))
-                continue;
-            auto diff = (it.restLength - deltaLength) / deltaLength;
-            auto offset = delta * 0.5 * diff;
-            if (!from.fixed) {
-                from.position += offset;
-                applyBoundingConstraints(&from);
-            }
-            if (!to.fixed) {
-                to.position += -offset;
-                applyBoundingConstraints(&to);
-            }
-        }
+        m_solver.projectDistanceConstraints();
         
         for (const auto &it: m_jointConstraints) {
-            auto &from = m_vertexMotions[it.first];
-            auto &to = m_vertexMotions[it.second];
-            auto &joint = m_vertexMotions[it.joint];
-            double degrees = degreesBetweenVectors(from.position - joint.position,
-                to.position - joint.position);
+            QVector3D fromPosition = m_solver.position(it.first);
+            QVector3D toPosition = m_solver.position(it.second);
+            QVector3D jointPosition = m_solver.position(it.joint);
+            double degrees = degreesBetweenVectors(fromPosition - jointPosition,
+                toPosition - jointPosition);
             if (degrees < it.minDegrees) {
-                QVector3D straightPosition = (from.position + to.position) * 0.5;
-                joint.position += (it.minDegrees - degrees) * (straightPosition - joint.position) / (180 - degrees);
-                applyBoundingConstraints(&joint);
+                QVector3D straightPosition = (fromPosition + toPosition) * 0.5;
+                jointPosition += (it.minDegrees - degrees) * (straightPosition - jointPosition) / (180 - degrees);
+                m_solver.setPosition(it.joint, jointPosition);
+                m_solver.applyGroundConstraint(it.joint);
             } else if (degrees > it.maxDegrees) {
                 // TODO:
             }
@@ -117,22 +62,21 @@ void Ragdoll::applyConstraints()
 
 void Ragdoll::updateVertexPosition(size_t vertexIndex, const QVector3D &position)
 {
-    m_vertexMotions[vertexIndex].position = position;
+    m_solver.setPosition(vertexIndex, position);
 }
 
 void Ragdoll::fixVertexPosition(size_t vertexIndex)
 {
-    m_vertexMotions[vertexIndex].fixed = true;
+    m_solver.setInverseMass(vertexIndex, 0.0);
 }
 
 void Ragdoll::updateVertexRadius(size_t vertexIndex, double radius)
 {
-    m_vertexMotions[vertexIndex].radius = radius;
+    m_solver.setRadius(vertexIndex, radius);
 }
 
 void Ragdoll::simulate(double stepSize)
 {
-    updateVertexForces();
-    doVerletIntegration(stepSize);
+    m_solver.integrate(stepSize);
     applyConstraints();
 }
@@ -2,7 +2,7 @@
 #define DUST3D_RAGDOLL_H
 #include <vector>
 #include <QVector3D>
-#include <unordered_map>
+#include "verletsolver.h"
 
 class Ragdoll
 {
@@ -19,15 +19,6 @@ public:
         double restLength;
     };
     
-    struct VertexMotion
-    {
-        QVector3D position;
-        QVector3D lastPosition;
-        QVector3D force;
-        bool fixed = false;
-        double radius = 0.0;
-    };
-    
     struct JointConstraint
     {
         size_t joint;
@@ -40,7 +31,8 @@ public:
     Ragdoll(const std::vector<QVector3D> *vertices,
             const std::vector<std::pair<size_t, size_t>> *links) :
         m_vertices(vertices),
-        m_links(links)
+        m_links(links),
+        m_solver(*vertices)
     {
     }
     
@@ -63,7 +55,7 @@ public:
     
     void start();
     void simulate(double stepSize);
-    const VertexMotion &getVertexMotion(size_t vertexIndex);
+    QVector3D getVertexPosition(size_t vertexIndex) const;
     void updateVertexPosition(size_t vertexIndex, const QVector3D &position);
     void updateVertexRadius(size_t vertexIndex, double radius);
     void fixVertexPosition(size_t vertexIndex);
@@ -74,16 +66,12 @@ private:
     const std::vector<QVector3D> *m_vertices = nullptr;
     const std::vector<std::pair<size_t, size_t>> *m_links = nullptr;
     std::vector<JointConstraint> m_jointConstraints;
-    std::unordered_map<size_t, VertexMotion> m_vertexMotions;
+    VerletSolver m_solver;
     QVector3D m_externalForce;
     double m_groundY = 0.0;
     
-    void initializeVertexMotions();
     void prepareChains();
-    void updateVertexForces();
     void applyConstraints();
-    void doVerletIntegration(double stepSize);
-    void applyBoundingConstraints(VertexMotion *vertexMotion);
     
     void outputChainsForDebug(const char *filename, const std::vector<Chain> &springs);
 };
@@ -7,20 +7,24 @@
 #include <QVector2D>
 #include <queue>
 #include <unordered_map>
+#include <limits>
 #include "riggenerator.h"
 #include "util.h"
 #include "boundingboxmesh.h"
 #include "theme.h"
+#include "positionkdtree.h"
 
 class GroupEndpointsStitcher
 {
 public:
     GroupEndpointsStitcher(const std::vector<ObjectNode> *nodes,
-            const std::vector<std::unordered_set<size_t>> *groups,
+            const PositionKdTree *nodeKdTree,
+            const std::vector<size_t> *nodeGroupIndices,
             const std::vector<std::pair<size_t, size_t>> *groupEndpoints,
             std::vector<std::pair<size_t, float>> *stitchResult) :
         m_nodes(nodes),
-        m_groups(groups),
+        m_nodeKdTree(nodeKdTree),
+        m_nodeGroupIndices(nodeGroupIndices),
         m_groupEndpoints(groupEndpoints),
         m_stitchResult(stitchResult)
     {
@@ -28,37 +32,62 @@ public:
     void operator()(const tbb::blocked_range<size_t> &range) const
     {
         for (size_t i = range.begin(); i != range.end(); ++i) {
-            std::vector<std::pair<size_t, float>> distance2WithNodes;
             const auto &endpoint = (*m_groupEndpoints)[i];
             const auto &endpointNode = (*m_nodes)[endpoint.second];
-            for (size_t groupIndex = 0; groupIndex < m_groups->size(); ++groupIndex) {
-                if (endpoint.first == groupIndex)
-                    continue;
-                for (const auto &j: (*m_groups)[groupIndex]) {
-                    const auto &node = (*m_nodes)[j];
-                    if (node.partId == endpointNode.partId ||
-                            node.mirroredByPartId == endpointNode.partId ||
-                            node.mirrorFromPartId == endpointNode.partId) {
-                        continue;
-                    }
-                    distance2WithNodes.push_back({j,
-                        (endpointNode.origin - node.origin).lengthSquared()});
-                }
-            }
-            if (distance2WithNodes.empty())
+            float distance2 = 0;
+            size_t nearestNodeIndex = m_nodeKdTree->nearest(endpointNode.origin, [&](size_t j) {
+                const auto &groupIndex = (*m_nodeGroupIndices)[j];
+                if (groupIndex == endpoint.first || groupIndex == std::numeric_limits<size_t>::max())
+                    return false;
+                const auto &node = (*m_nodes)[j];
+                return !(node.partId == endpointNode.partId ||
+                    node.mirroredByPartId == endpointNode.partId ||
+                    node.mirrorFromPartId == endpointNode.partId);
+            }, &distance2);
+            if (nearestNodeIndex == m_nodes->size())
                 continue;
-            (*m_stitchResult)[i] = *std::min_element(distance2WithNodes.begin(), distance2WithNodes.end(), [](const std::pair<size_t, float> &first, const std::pair<size_t, float> &second) {
-                return first.second < second.second;
-            });
+            (*m_stitchResult)[i] = {nearestNodeIndex, distance2};
         }
     }
 private:
     const std::vector<ObjectNode> *m_nodes = nullptr;
-    const std::vector<std::unordered_set<size_t>> *m_groups = nullptr;
+    const PositionKdTree *m_nodeKdTree = nullptr;
+    const std::vector<size_t> *m_nodeGroupIndices = nullptr;
     const std::vector<std::pair<size_t, size_t>> *m_groupEndpoints = nullptr;
     std::vector<std::pair<size_t, float>> *m_stitchResult = nullptr;
 };
 
+class BranchSkinWeightsComputer
+{
+public:
+    BranchSkinWeightsComputer(RigGenerator *rigGenerator,
+            const std::vector<RigGenerator::BranchSkinWeightsJob> *jobs,
+            std::vector<std::map<int, RigVertexWeights>> *jobWeights,
+            std::vector<std::vector<size_t>> *jobDiscardedVertexIndices) :
+        m_rigGenerator(rigGenerator),
+        m_jobs(jobs),
+        m_jobWeights(jobWeights),
+        m_jobDiscardedVertexIndices(jobDiscardedVertexIndices)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+            const auto &job = (*m_jobs)[i];
+            m_rigGenerator->computeBranchSkinWeights(job.fromBoneIndex,
+                job.boneNamePrefix,
+                *job.vertexIndices,
+                &(*m_jobWeights)[i],
+                &(*m_jobDiscardedVertexIndices)[i]);
+        }
+    }
+private:
+    RigGenerator *m_rigGenerator = nullptr;
+    const std::vector<RigGenerator::BranchSkinWeightsJob> *m_jobs = nullptr;
+    std::vector<std::map<int, RigVertexWeights>> *m_jobWeights = nullptr;
+    std::vector<std::vector<size_t>> *m_jobDiscardedVertexIndices = nullptr;
+};
+
 RigGenerator::RigGenerator(RigType rigType, const Object &object) :
     m_rigType(rigType),
     m_object(new Object(object))
@@ -164,6 +193,11 @@ void RigGenerator::buildNeighborMap()
         m_neighborMap[findTarget->second].insert(findSource->second);
     }
     
+    std::vector<QVector3D> nodePositions(m_object->nodes.size());
+    for (size_t i = 0; i < m_object->nodes.size(); ++i)
+        nodePositions[i] = m_object->nodes[i].origin;
+    PositionKdTree nodeKdTree(nodePositions);
+    
     //std::vector<std::tuple<QVector3D, QVector3D, float, float, QColor>> debugBoxes;
     while (true) {
         std::vector<std::unordered_set<size_t>> groups;
@@ -184,10 +218,16 @@ void RigGenerator::buildNeighborMap()
         if (groupEndpoints.empty())
             break;
         
+        std::vector<size_t> nodeGroupIndices(m_object->nodes.size(), std::numeric_limits<size_t>::max());
+        for (size_t groupIndex = 0; groupIndex < groups.size(); ++groupIndex) {
+            for (const auto &nodeIndex: groups[groupIndex])
+                nodeGroupIndices[nodeIndex] = groupIndex;
+        }
+        
         std::vector<std::pair<size_t, float>> stitchResult(groupEndpoints.size(),
             {m_object->nodes.size(), std::numeric_limits<float>::max()});
         tbb::parallel_for(tbb::blocked_range<size_t>(0, groupEndpoints.size()),
-            GroupEndpointsStitcher(&m_object->nodes, &groups, &groupEndpoints,
+            GroupEndpointsStitcher(&m_object->nodes, &nodeKdTree, &nodeGroupIndices, &groupEndpoints,
                 &stitchResult));
         auto minDistantMatch = std::min_element(stitchResult.begin(), stitchResult.end(), [&](
                 const std::pair<size_t, float> &first,
@@ -606,40 +646,41 @@ void RigGenerator::computeSkinWeights()
     if (!m_isSuccessful)
         return;
 
-    auto collectNodeIndices = [&](size_t chainIndex,
-            std::unordered_map<size_t, size_t> *nodeIndexToContainerMap,
-            size_t containerIndex) {
-        const auto &chain = m_boneNodeChain[chainIndex];
-        for (const auto &it: chain.nodeIndices) {
-            for (const auto &subIt: it)
-                nodeIndexToContainerMap->insert({subIt, containerIndex});
-        }
-        nodeIndexToContainerMap->insert({chain.fromNodeIndex, containerIndex});
-    };
-    
     const size_t neckIndex = 0;
     const size_t tailIndex = 1;
     const size_t spineIndex = 2;
     const size_t limbStartIndex = 3;
     
-    std::unordered_map<size_t, size_t> nodeIndicesToBranchMap;
+    const size_t noBranch = std::numeric_limits<size_t>::max();
+    std::vector<size_t> nodeBranchIndices(m_object->nodes.size(), noBranch);
+    auto collectNodeIndices = [&](size_t chainIndex, size_t branchIndex) {
+        const auto &chain = m_boneNodeChain[chainIndex];
+        for (const auto &it: chain.nodeIndices) {
+            for (const auto &subIt: it) {
+                if (noBranch == nodeBranchIndices[subIt])
+                    nodeBranchIndices[subIt] = branchIndex;
+            }
+        }
+        if (noBranch == nodeBranchIndices[chain.fromNodeIndex])
+            nodeBranchIndices[chain.fromNodeIndex] = branchIndex;
+    };
     
     if (!m_neckChains.empty())
-        collectNodeIndices(m_neckChains[0], &nodeIndicesToBranchMap, neckIndex);
+        collectNodeIndices(m_neckChains[0], neckIndex);
     
     if (!m_tailChains.empty())
-        collectNodeIndices(m_tailChains[0], &nodeIndicesToBranchMap, tailIndex);
+        collectNodeIndices(m_tailChains[0], tailIndex);
 
     if (!m_spineChains.empty())
-        collectNodeIndices(m_spineChains[0], &nodeIndicesToBranchMap, spineIndex);
+        collectNodeIndices(m_spineChains[0], spineIndex);
     
     for (size_t i = 0; i < m_leftLimbChains.size(); ++i) {
-        collectNodeIndices(m_leftLimbChains[i], &nodeIndicesToBranchMap,
+        collectNodeIndices(m_leftLimbChains[i],
             limbStartIndex + i);
     }
     
     for (size_t i = 0; i < m_rightLimbChains.size(); ++i) {
-        collectNodeIndices(m_rightLimbChains[i], &nodeIndicesToBranchMap,
+        collectNodeIndices(m_rightLimbChains[i],
             limbStartIndex + m_leftLimbChains.size() + i);
     }
     
@@ -648,64 +689,56 @@ void RigGenerator::computeSkinWeights()
         m_rightLimbChains.size() +
         1);
     
+    // Every node maps to its nearest node (itself, or the first node sharing the same origin),
+    // the k-d tree keeps this near-linear instead of scanning all the node pairs
+    std::vector<QVector3D> nodePositions(m_object->nodes.size());
+    for (size_t nodeIndex = 0; nodeIndex < m_object->nodes.size(); ++nodeIndex)
+        nodePositions[nodeIndex] = m_object->nodes[nodeIndex].origin;
+    PositionKdTree nodeKdTree(nodePositions);
     std::map<std::pair<QUuid, QUuid>, size_t> nodeIdToIndexMap;
     for (size_t nodeIndex = 0; nodeIndex < m_object->nodes.size(); ++nodeIndex) {
         const auto &node = m_object->nodes[nodeIndex];
-        nodeIdToIndexMap[{node.partId, node.nodeId}] = nodeIndex;
-    }
-    if (!nodeIdToIndexMap.empty()) {
-        for (size_t nonBodyNodeIndex = 0; nonBodyNodeIndex < m_object->nodes.size(); ++nonBodyNodeIndex) {
-            const auto &nonBodyNode = m_object->nodes[nonBodyNodeIndex];
-            std::vector<std::pair<size_t, float>> distance2s;
-            distance2s.reserve(m_object->nodes.size());
-            for (size_t nodeIndex = 0; nodeIndex < m_object->nodes.size(); ++nodeIndex) {
-                const auto &node = m_object->nodes[nodeIndex];
-                distance2s.push_back(std::make_pair(nodeIndex,
-                    (nonBodyNode.origin - node.origin).lengthSquared()));
-            }
-            nodeIdToIndexMap[{nonBodyNode.partId, nonBodyNode.nodeId}] = std::min_element(distance2s.begin(), distance2s.end(), [](const std::pair<size_t, float> &first,
-                    const std::pair<size_t, float> &second) {
-                return first.second < second.second;
-            })->first;
-        }
+        nodeIdToIndexMap[{node.partId, node.nodeId}] = nodeKdTree.nearest(node.origin);
     }
+    
+    // Vertices of the same source node usually come in runs, so the map is only consulted when the source changes
+    const std::pair<QUuid, QUuid> *lastVertexSourceId = nullptr;
+    size_t lastBranchIndex = spineIndex;
     for (size_t vertexIndex = 0; vertexIndex < m_object->vertices.size(); ++vertexIndex) {
         const auto &vertexSourceId = m_object->vertexSourceNodes[vertexIndex];
-        auto findNodeIndex = nodeIdToIndexMap.find(vertexSourceId);
-        if (findNodeIndex == nodeIdToIndexMap.end()) {
-            vertexBranches[spineIndex].push_back(vertexIndex);
-            continue;
-        }
-        const auto &nodeIndex = findNodeIndex->second;
-        auto findBranch = nodeIndicesToBranchMap.find(nodeIndex);
-        if (findBranch == nodeIndicesToBranchMap.end()) {
-            vertexBranches[spineIndex].push_back(vertexIndex);
-            continue;
+        if (nullptr == lastVertexSourceId || *lastVertexSourceId != vertexSourceId) {
+            lastVertexSourceId = &vertexSourceId;
+            lastBranchIndex = spineIndex;
+            auto findNodeIndex = nodeIdToIndexMap.find(vertexSourceId);
+            if (findNodeIndex != nodeIdToIndexMap.end()) {
+                const auto &branchIndex = nodeBranchIndices[findNodeIndex->second];
+                if (noBranch != branchIndex)
+                    lastBranchIndex = branchIndex;
+            }
         }
-        vertexBranches[findBranch->second].push_back(vertexIndex);
+        vertexBranches[lastBranchIndex].push_back(vertexIndex);
     }
     
+    std::vector<BranchSkinWeightsJob> jobs;
+    
     auto findNeckBoneIndex = m_boneNameToIndexMap.find(QString("Neck_Joint1"));
     if (findNeckBoneIndex != m_boneNameToIndexMap.end()) {
-        computeBranchSkinWeights(findNeckBoneIndex->second,
-            QString("Neck_"), vertexBranches[neckIndex],
-            &vertexBranches[spineIndex]);
+        jobs.push_back({(size_t)findNeckBoneIndex->second,
+            QString("Neck_"), &vertexBranches[neckIndex]});
     }
     
     auto findTailBoneIndex = m_boneNameToIndexMap.find(QString("Tail_Joint1"));
     if (findTailBoneIndex != m_boneNameToIndexMap.end()) {
-        computeBranchSkinWeights(findTailBoneIndex->second,
-            QString("Tail_"), vertexBranches[tailIndex],
-            &vertexBranches[spineIndex]);
+        jobs.push_back({(size_t)findTailBoneIndex->second,
+            QString("Tail_"), &vertexBranches[tailIndex]});
     }
     
     for (size_t i = 0; i < m_leftLimbChains.size(); ++i) {
         auto namePrefix = QString("LeftLimb") + QString::number(i + 1) + "_";
         auto findLimbBoneIndex = m_boneNameToIndexMap.find(namePrefix + "Joint1");
         if (findLimbBoneIndex != m_boneNameToIndexMap.end()) {
-            computeBranchSkinWeights(findLimbBoneIndex->second,
-                namePrefix, vertexBranches[limbStartIndex + i],
-                &vertexBranches[spineIndex]);
+            jobs.push_back({(size_t)findLimbBoneIndex->second,
+                namePrefix, &vertexBranches[limbStartIndex + i]});
         }
     }
     
@@ -713,25 +746,39 @@ void RigGenerator::computeSkinWeights()
         auto namePrefix = QString("RightLimb") + QString::number(i + 1) + "_";
         auto findLimbBoneIndex = m_boneNameToIndexMap.find(namePrefix + "Joint1");
         if (findLimbBoneIndex != m_boneNameToIndexMap.end()) {
-            computeBranchSkinWeights(findLimbBoneIndex->second,
-                namePrefix, vertexBranches[limbStartIndex + m_leftLimbChains.size() + i],
-                &vertexBranches[spineIndex]);
+            jobs.push_back({(size_t)findLimbBoneIndex->second,
+                namePrefix, &vertexBranches[limbStartIndex + m_leftLimbChains.size() + i]});
         }
     }
     
+    // The neck, tail and limb branches own disjoint vertices, so they are weighted concurrently into their own maps,
+    // the vertices they discard go to the spine, which runs afterwards
+    std::vector<std::map<int, RigVertexWeights>> jobWeights(jobs.size());
+    std::vector<std::vector<size_t>> jobDiscardedVertexIndices(jobs.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, jobs.size()),
+        BranchSkinWeightsComputer(this, &jobs, &jobWeights, &jobDiscardedVertexIndices));
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        for (auto &it: jobWeights[i])
+            (*m_resultWeights)[it.first] = it.second;
+        vertexBranches[spineIndex].insert(vertexBranches[spineIndex].end(),
+            jobDiscardedVertexIndices[i].begin(), jobDiscardedVertexIndices[i].end());
+    }
+    
     auto findBackSpineBoneIndex = m_boneNameToIndexMap.find(QString("Spine01"));
     std::vector<size_t> backSpineVertices;
     auto findSpineBoneIndex = m_boneNameToIndexMap.find(QString("Spine1"));
     if (findSpineBoneIndex != m_boneNameToIndexMap.end()) {
         computeBranchSkinWeights(findSpineBoneIndex->second,
             QString("Spine"), vertexBranches[spineIndex],
+            m_resultWeights,
             findBackSpineBoneIndex != m_boneNameToIndexMap.end() ?
                 &backSpineVertices : nullptr);
     }
     
     if (findBackSpineBoneIndex != m_boneNameToIndexMap.end()) {
         computeBranchSkinWeights(findBackSpineBoneIndex->second,
-            QString("Spine"), backSpineVertices);
+            QString("Spine"), backSpineVertices,
+            m_resultWeights);
     }
     
     fixVirtualBoneSkinWeights();
@@ -912,6 +959,7 @@ void RigGenerator::fixVirtualBoneSkinWeights()
 void RigGenerator::computeBranchSkinWeights(size_t fromBoneIndex,
         const QString &boneNamePrefix,
         const std::vector<size_t> &vertexIndices,
+        std::map<int, RigVertexWeights> *vertexWeights,
         std::vector<size_t> *discardedVertexIndices)
 {
     //qDebug() << "computeBranchSkinWeights boneNamePrefix:" << boneNamePrefix;
@@ -941,7 +989,7 @@ void RigGenerator::computeBranchSkinWeights(size_t fromBoneIndex,
 					projectedLength = 0;
                 if (projectedLength <= endGradientLength) {
                     auto factor = 0.1 + 0.4 * (1.0 - projectedLength / endGradientLength);
-                    (*m_resultWeights)[vertexIndex].addBone(previousBoneIndex, factor);
+                    (*vertexWeights)[vertexIndex].addBone(previousBoneIndex, factor);
                 }
                 newRemainVertexIndices.push_back(vertexIndex);
                 continue;
@@ -950,7 +998,7 @@ void RigGenerator::computeBranchSkinWeights(size_t fromBoneIndex,
                 if (nullptr != discardedVertexIndices)
                     discardedVertexIndices->push_back(vertexIndex);
                 else
-                    (*m_resultWeights)[vertexIndex].addBone(currentBoneIndex, 1.0);
+                    (*vertexWeights)[vertexIndex].addBone(currentBoneIndex, 1.0);
                 continue;
             }
             float angle = radianBetweenVectors(direction, -parentDirection);
@@ -958,27 +1006,27 @@ void RigGenerator::computeBranchSkinWeights(size_t fromBoneIndex,
             if (projectedLength < 0)
 				projectedLength = 0;
             if (projectedLength <= endGradientLength) {
-                (*m_resultWeights)[vertexIndex].addBone(previousBoneIndex, 0.5 + 0.5 * projectedLength / endGradientLength);
-                (*m_resultWeights)[vertexIndex].addBone(currentBoneIndex, 0.5 * (1.0 - projectedLength / endGradientLength));
+                (*vertexWeights)[vertexIndex].addBone(previousBoneIndex, 0.5 + 0.5 * projectedLength / endGradientLength);
+                (*vertexWeights)[vertexIndex].addBone(currentBoneIndex, 0.5 * (1.0 - projectedLength / endGradientLength));
                 continue;
             }
             if (projectedLength <= parentLength - beginGradientLength) {
-                (*m_resultWeights)[vertexIndex].addBone(previousBoneIndex, 1.0);
+                (*vertexWeights)[vertexIndex].addBone(previousBoneIndex, 1.0);
                 continue;
             }
             if (projectedLength <= parentLength) {
                 auto factor = 0.5 + 0.5 * (parentLength - projectedLength) / beginGradientLength;
-                (*m_resultWeights)[vertexIndex].addBone(previousBoneIndex, factor);
+                (*vertexWeights)[vertexIndex].addBone(previousBoneIndex, factor);
                 continue;
             }
             auto factor = 0.1 + 0.4 * (1.0 - (projectedLength - parentLength) / beginGradientLength);
-            (*m_resultWeights)[vertexIndex].addBone(previousBoneIndex, factor);
+            (*vertexWeights)[vertexIndex].addBone(previousBoneIndex, factor);
             continue;
         }
         remainVertexIndices = newRemainVertexIndices;
         if (currentBone.children.empty() || !currentBone.name.startsWith(boneNamePrefix)) {
             for (const auto &vertexIndex: remainVertexIndices) {
-                (*m_resultWeights)[vertexIndex].addBone(currentBoneIndex, 0.5);
+                (*vertexWeights)[vertexIndex].addBone(currentBoneIndex, 0.5);
             }
             break;
         }
@@ -27,6 +27,8 @@ signals:
 public slots:
     void process();
 private:
+    friend class BranchSkinWeightsComputer;
+    
     struct BoneNodeChain
     {
         size_t fromNodeIndex;
@@ -35,6 +37,13 @@ private:
         size_t attachNodeIndex;
     };
     
+    struct BranchSkinWeightsJob
+    {
+        size_t fromBoneIndex;
+        QString boneNamePrefix;
+        const std::vector<size_t> *vertexIndices;
+    };
+    
     RigType m_rigType = RigType::None;
     Object *m_object = nullptr;
     Model *m_resultMesh = nullptr;
@@ -85,6 +94,7 @@ private:
     void computeBranchSkinWeights(size_t fromBoneIndex,
         const QString &boneNamePrefix,
         const std::vector<size_t> &vertexIndices,
+        std::map<int, RigVertexWeights> *vertexWeights,
         std::vector<size_t> *discardedVertexIndices=nullptr);
     void splitByNodeIndex(size_t nodeIndex,
         std::unordered_set<size_t> *left,
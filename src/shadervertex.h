@@ -24,6 +24,26 @@ typedef struct
     GLfloat tangentZ;
     GLfloat alpha = 1.0;
 } ShaderVertex;
+
+typedef struct
+{
+    GLfloat posX;
+    GLfloat posY;
+    GLfloat posZ;
+    GLshort normX;
+    GLshort normY;
+    GLshort tangentX;
+    GLshort tangentY;
+    GLushort texU;
+    GLushort texV;
+    GLubyte colorR;
+    GLubyte colorG;
+    GLubyte colorB;
+    GLubyte alpha;
+    GLubyte metalness;
+    GLubyte roughness;
+    GLubyte reserved[2];
+} PackedShaderVertex;
 #pragma pack(pop)
 
 #endif
@@ -0,0 +1,156 @@
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include "shadervertexpacker.h"
+
+static GLshort packSignedNormalized(float value)
+{
+    if (value > 1.0f)
+        value = 1.0f;
+    else if (value < -1.0f)
+        value = -1.0f;
+    return (GLshort)std::round(value * 32767.0f);
+}
+
+static GLushort packUnsignedShortNormalized(float value)
+{
+    if (value > 1.0f)
+        value = 1.0f;
+    else if (value < 0.0f)
+        value = 0.0f;
+    return (GLushort)std::round(value * 65535.0f);
+}
+
+static GLubyte packUnsignedByteNormalized(float value)
+{
+    if (value > 1.0f)
+        value = 1.0f;
+    else if (value < 0.0f)
+        value = 0.0f;
+    return (GLubyte)std::round(value * 255.0f);
+}
+
+static void packOctahedral(float x, float y, float z, GLshort *packedX, GLshort *packedY)
+{
+    float sum = std::abs(x) + std::abs(y) + std::abs(z);
+    if (sum <= 0.0f) {
+        *packedX = 0;
+        *packedY = 0;
+        return;
+    }
+    x /= sum;
+    y /= sum;
+    if (z < 0.0f) {
+        float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+    *packedX = packSignedNormalized(x);
+    *packedY = packSignedNormalized(y);
+}
+
+void packShaderVertex(const ShaderVertex &source, PackedShaderVertex *packed)
+{
+    memset(packed, 0, sizeof(PackedShaderVertex));
+    packed->posX = source.posX;
+    packed->posY = source.posY;
+    packed->posZ = source.posZ;
+    packOctahedral(source.normX, source.normY, source.normZ, &packed->normX, &packed->normY);
+    packOctahedral(source.tangentX, source.tangentY, source.tangentZ, &packed->tangentX, &packed->tangentY);
+    packed->texU = packUnsignedShortNormalized(source.texU);
+    packed->texV = packUnsignedShortNormalized(source.texV);
+    packed->colorR = packUnsignedByteNormalized(source.colorR);
+    packed->colorG = packUnsignedByteNormalized(source.colorG);
+    packed->colorB = packUnsignedByteNormalized(source.colorB);
+    packed->alpha = packUnsignedByteNormalized(source.alpha);
+    packed->metalness = packUnsignedByteNormalized(source.metalness);
+    packed->roughness = packUnsignedByteNormalized(source.roughness);
+}
+
+static void unpackOctahedral(GLshort packedX, GLshort packedY, GLfloat *x, GLfloat *y, GLfloat *z)
+{
+    float octX = packedX / 32767.0f;
+    float octY = packedY / 32767.0f;
+    float octZ = 1.0f - std::abs(octX) - std::abs(octY);
+    if (octZ < 0.0f) {
+        float unfoldedX = (1.0f - std::abs(octY)) * (octX >= 0.0f ? 1.0f : -1.0f);
+        float unfoldedY = (1.0f - std::abs(octX)) * (octY >= 0.0f ? 1.0f : -1.0f);
+        octX = unfoldedX;
+        octY = unfoldedY;
+    }
+    float length = std::sqrt(octX * octX + octY * octY + octZ * octZ);
+    *x = octX / length;
+    *y = octY / length;
+    *z = octZ / length;
+}
+
+void unpackShaderVertex(const PackedShaderVertex &packed, ShaderVertex *vertex)
+{
+    vertex->posX = packed.posX;
+    vertex->posY = packed.posY;
+    vertex->posZ = packed.posZ;
+    unpackOctahedral(packed.normX, packed.normY, &vertex->normX, &vertex->normY, &vertex->normZ);
+    unpackOctahedral(packed.tangentX, packed.tangentY, &vertex->tangentX, &vertex->tangentY, &vertex->tangentZ);
+    vertex->texU = packed.texU / 65535.0f;
+    vertex->texV = packed.texV / 65535.0f;
+    vertex->colorR = packed.colorR / 255.0f;
+    vertex->colorG = packed.colorG / 255.0f;
+    vertex->colorB = packed.colorB / 255.0f;
+    vertex->alpha = packed.alpha / 255.0f;
+    vertex->metalness = packed.metalness / 255.0f;
+    vertex->roughness = packed.roughness / 255.0f;
+}
+
+void packShaderVertices(const ShaderVertex *vertices, int vertexCount,
+    std::vector<PackedShaderVertex> *packedVertices)
+{
+    packedVertices->resize(vertexCount > 0 ? vertexCount : 0);
+    for (int i = 0; i < vertexCount; ++i)
+        packShaderVertex(vertices[i], &(*packedVertices)[i]);
+}
+
+struct PackedShaderVertexHash
+{
+    size_t operator()(const PackedShaderVertex &vertex) const
+    {
+        quint32 words[sizeof(PackedShaderVertex) / sizeof(quint32)];
+        memcpy(words, &vertex, sizeof(words));
+        size_t hash = 2166136261u;
+        for (const auto &word: words)
+            hash = (hash ^ word) * 16777619u;
+        return hash;
+    }
+};
+
+struct PackedShaderVertexEqual
+{
+    bool operator()(const PackedShaderVertex &first, const PackedShaderVertex &second) const
+    {
+        return 0 == memcmp(&first, &second, sizeof(PackedShaderVertex));
+    }
+};
+
+void packIndexedShaderVertices(const ShaderVertex *vertices, int vertexCount,
+    std::vector<PackedShaderVertex> *packedVertices, std::vector<GLuint> *indices)
+{
+    packedVertices->clear();
+    indices->clear();
+    if (vertexCount <= 0)
+        return;
+    
+    // Corners are merged after quantization, so only those identical in every
+    // attribute as seen by the GPU share a vertex
+    std::unordered_map<PackedShaderVertex, GLuint, PackedShaderVertexHash, PackedShaderVertexEqual> vertexMap;
+    vertexMap.reserve(vertexCount);
+    indices->reserve(vertexCount);
+    packedVertices->reserve(vertexCount / 2);
+    PackedShaderVertex packed;
+    for (int i = 0; i < vertexCount; ++i) {
+        packShaderVertex(vertices[i], &packed);
+        auto insertResult = vertexMap.insert({packed, (GLuint)packedVertices->size()});
+        if (insertResult.second)
+            packedVertices->push_back(packed);
+        indices->push_back(insertResult.first->second);
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef DUST3D_SHADER_VERTEX_PACKER_H
+#define DUST3D_SHADER_VERTEX_PACKER_H
+#include <vector>
+#include "shadervertex.h"
+
+// Normals and tangents are octahedral encoded into two normalized shorts,
+// texture coordinates are normalized unsigned shorts,
+// color, alpha and material are normalized bytes.
+void packShaderVertex(const ShaderVertex &source, PackedShaderVertex *packed);
+void unpackShaderVertex(const PackedShaderVertex &packed, ShaderVertex *vertex);
+void packShaderVertices(const ShaderVertex *vertices, int vertexCount,
+    std::vector<PackedShaderVertex> *packedVertices);
+void packIndexedShaderVertices(const ShaderVertex *vertices, int vertexCount,
+    std::vector<PackedShaderVertex> *packedVertices, std::vector<GLuint> *indices);
+
+#endif
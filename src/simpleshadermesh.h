@@ -2,6 +2,7 @@
 #define DUST3D_SIMPLE_SHADER_MESH_H
 #include <QVector3D>
 #include <vector>
+#include <memory>
 
 class SimpleShaderMesh
 {
@@ -15,42 +16,35 @@ public:
     {
     }
     
-    SimpleShaderMesh(const SimpleShaderMesh &mesh)
-    {
-        if (nullptr != mesh.m_vertices)
-            m_vertices = new std::vector<QVector3D>(*mesh.m_vertices);
-        if (nullptr != mesh.m_triangles)
-            m_triangles = new std::vector<std::vector<size_t>>(*mesh.m_triangles);
-        if (nullptr != mesh.m_triangleCornerNormals)
-            m_triangleCornerNormals = new std::vector<std::vector<QVector3D>>(*mesh.m_triangleCornerNormals);
-    }
-    
-    ~SimpleShaderMesh()
+    // The data may be shared with other meshes and must not change while this mesh is alive
+    SimpleShaderMesh(std::shared_ptr<const std::vector<QVector3D>> vertices,
+            std::shared_ptr<const std::vector<std::vector<size_t>>> triangles,
+            std::shared_ptr<const std::vector<std::vector<QVector3D>>> triangleCornerNormals) :
+        m_vertices(vertices),
+        m_triangles(triangles),
+        m_triangleCornerNormals(triangleCornerNormals)
     {
-        delete m_vertices;
-        delete m_triangles;
-        delete m_triangleCornerNormals;
     }
     
     const std::vector<QVector3D> *vertices()
     {
-        return m_vertices;
+        return m_vertices.get();
     }
     
     const std::vector<std::vector<size_t>> *triangles()
     {
-        return m_triangles;
+        return m_triangles.get();
     }
     
     const std::vector<std::vector<QVector3D>> *triangleCornerNormals()
     {
-        return m_triangleCornerNormals;
+        return m_triangleCornerNormals.get();
     }
     
 private:
-    std::vector<QVector3D> *m_vertices = nullptr;
-    std::vector<std::vector<size_t>> *m_triangles = nullptr;
-    std::vector<std::vector<QVector3D>> *m_triangleCornerNormals = nullptr;
+    std::shared_ptr<const std::vector<QVector3D>> m_vertices;
+    std::shared_ptr<const std::vector<std::vector<size_t>>> m_triangles;
+    std::shared_ptr<const std::vector<std::vector<QVector3D>>> m_triangleCornerNormals;
 };
 
 #endif
@@ -0,0 +1,428 @@
+#include <QHash>
+#include <QtEndian>
+#include <QXmlStreamReader>
+#include <QDebug>
+#include <cstring>
+#include "snapshotbinary.h"
+
+// All integers are little endian:
+//
+// "DS3SNAPB" quint32:version
+// quint32:stringCount { quint32:utf8Size bytes }
+// canvas: attributes
+// nodes, edges, parts, motions: quint32:count { quint32:keyString attributes }
+// components: quint32:childCount { quint32:idString attributes component... }
+// materials: quint32:count { attributes quint32:layerCount { attributes quint32:mapCount { attributes } } }
+//
+// attributes: quint32:count { quint32:nameString quint8:valueType value }
+// Values which format back to the exact same text are stored as qint32 or float,
+// anything else is an index into the string table
+
+#define SNAPSHOT_BINARY_MAGIC               "DS3SNAPB"
+#define SNAPSHOT_BINARY_MAGIC_SIZE          8
+#define SNAPSHOT_BINARY_VERSION             1
+#define SNAPSHOT_BINARY_MAX_COMPONENT_DEPTH 4096
+
+enum SnapshotBinaryValueType
+{
+    SnapshotBinaryValueString = 0,
+    SnapshotBinaryValueInteger,
+    SnapshotBinaryValueFloat
+};
+
+class SnapshotBinaryWriter
+{
+public:
+    void writeUInt8(quint8 value)
+    {
+        m_body.append((char)value);
+    }
+
+    void writeUInt32(quint32 value)
+    {
+        uchar buffer[sizeof(value)];
+        qToLittleEndian(value, buffer);
+        m_body.append((const char *)buffer, sizeof(buffer));
+    }
+
+    void writeString(const QString &string)
+    {
+        auto findString = m_stringIndices.find(string);
+        if (findString != m_stringIndices.end()) {
+            writeUInt32(findString.value());
+            return;
+        }
+        quint32 index = (quint32)m_strings.size();
+        m_stringIndices.insert(string, index);
+        m_strings.push_back(string);
+        writeUInt32(index);
+    }
+
+    void writeValue(const QString &value)
+    {
+        if (!value.isEmpty() && value.size() <= 16 &&
+                (value[0].isDigit() || value[0] == '-' || value[0] == '.')) {
+            bool isNumber = false;
+            int integer = value.toInt(&isNumber);
+            if (isNumber && QString::number(integer) == value) {
+                writeUInt8(SnapshotBinaryValueInteger);
+                writeUInt32((quint32)integer);
+                return;
+            }
+            float number = value.toFloat(&isNumber);
+            if (isNumber && QString::number(number) == value) {
+                quint32 bits;
+                memcpy(&bits, &number, sizeof(bits));
+                writeUInt8(SnapshotBinaryValueFloat);
+                writeUInt32(bits);
+                return;
+            }
+        }
+        writeUInt8(SnapshotBinaryValueString);
+        writeString(value);
+    }
+
+    void writeAttributes(const std::map<QString, QString> &attributes, bool skipInternal=false,
+        const QString &skipName=QString())
+    {
+        quint32 count = 0;
+        for (const auto &it: attributes) {
+            if (skipInternal && it.first.startsWith("__"))
+                continue;
+            if (!skipName.isEmpty() && it.first == skipName)
+                continue;
+            ++count;
+        }
+        writeUInt32(count);
+        for (const auto &it: attributes) {
+            if (skipInternal && it.first.startsWith("__"))
+                continue;
+            if (!skipName.isEmpty() && it.first == skipName)
+                continue;
+            writeString(it.first);
+            writeValue(it.second);
+        }
+    }
+
+    void writeKeyedAttributes(const std::map<QString, std::map<QString, QString>> &items, bool skipInternal=false)
+    {
+        writeUInt32((quint32)items.size());
+        for (const auto &it: items) {
+            writeString(it.first);
+            writeAttributes(it.second, skipInternal);
+        }
+    }
+
+    void writeComponents(const Snapshot *snapshot, const QString &childrenIds)
+    {
+        std::vector<const std::pair<const QString, std::map<QString, QString>> *> children;
+        for (const auto &childId: childrenIds.split(",")) {
+            if (childId.isEmpty())
+                continue;
+            auto findComponent = snapshot->components.find(childId);
+            if (findComponent == snapshot->components.end())
+                continue;
+            children.push_back(&(*findComponent));
+        }
+        writeUInt32((quint32)children.size());
+        for (const auto &child: children) {
+            writeString(child->first);
+            writeAttributes(child->second, true, "children");
+            auto findChildren = child->second.find("children");
+            writeComponents(snapshot, findChildren == child->second.end() ? QString() : findChildren->second);
+        }
+    }
+
+    void finish(QByteArray *byteArray)
+    {
+        QByteArray header;
+        auto appendUInt32 = [&](quint32 value) {
+            uchar buffer[sizeof(value)];
+            qToLittleEndian(value, buffer);
+            header.append((const char *)buffer, sizeof(buffer));
+        };
+        header.append(SNAPSHOT_BINARY_MAGIC, SNAPSHOT_BINARY_MAGIC_SIZE);
+        appendUInt32(SNAPSHOT_BINARY_VERSION);
+        appendUInt32((quint32)m_strings.size());
+        for (const auto &string: m_strings) {
+            QByteArray utf8 = string.toUtf8();
+            appendUInt32((quint32)utf8.size());
+            header.append(utf8);
+        }
+        byteArray->clear();
+        byteArray->reserve(header.size() + m_body.size());
+        byteArray->append(header);
+        byteArray->append(m_body);
+    }
+
+private:
+    QByteArray m_body;
+    QHash<QString, quint32> m_stringIndices;
+    std::vector<QString> m_strings;
+};
+
+class SnapshotBinaryReader
+{
+public:
+    SnapshotBinaryReader(const QByteArray &byteArray) :
+        m_data(byteArray.constData()),
+        m_size((size_t)byteArray.size())
+    {
+    }
+
+    bool ok() const
+    {
+        return m_ok;
+    }
+
+    bool readHeader()
+    {
+        if (!isSkeletonBinary(QByteArray::fromRawData(m_data, (int)m_size)))
+            return fail();
+        m_position = SNAPSHOT_BINARY_MAGIC_SIZE;
+        quint32 version = readUInt32();
+        if (!m_ok || version > SNAPSHOT_BINARY_VERSION) {
+            qDebug() << "Unsupported binary snapshot version:" << version;
+            return fail();
+        }
+        quint32 stringCount = readCount();
+        m_strings.reserve(stringCount);
+        for (quint32 i = 0; i < stringCount && m_ok; ++i) {
+            quint32 utf8Size = readUInt32();
+            if (!m_ok || utf8Size > m_size - m_position)
+                return fail();
+            m_strings.push_back(QString::fromUtf8(m_data + m_position, (int)utf8Size));
+            m_position += utf8Size;
+        }
+        return m_ok;
+    }
+
+    quint8 readUInt8()
+    {
+        if (!m_ok || m_position + 1 > m_size) {
+            fail();
+            return 0;
+        }
+        return (quint8)m_data[m_position++];
+    }
+
+    quint32 readUInt32()
+    {
+        if (!m_ok || m_position + sizeof(quint32) > m_size) {
+            fail();
+            return 0;
+        }
+        quint32 value = qFromLittleEndian<quint32>((const uchar *)m_data + m_position);
+        m_position += sizeof(quint32);
+        return value;
+    }
+
+    // Every counted record takes at least four bytes, so a count beyond that is corrupted data
+    quint32 readCount()
+    {
+        quint32 count = readUInt32();
+        if (m_ok && count > (m_size - m_position) / sizeof(quint32)) {
+            fail();
+            return 0;
+        }
+        return count;
+    }
+
+    const QString &readString()
+    {
+        quint32 index = readUInt32();
+        if (!m_ok || index >= m_strings.size()) {
+            fail();
+            return m_emptyString;
+        }
+        return m_strings[index];
+    }
+
+    QString readValue()
+    {
+        quint8 type = readUInt8();
+        switch (type) {
+        case SnapshotBinaryValueString:
+            return readString();
+        case SnapshotBinaryValueInteger:
+            return QString::number((qint32)readUInt32());
+        case SnapshotBinaryValueFloat: {
+                quint32 bits = readUInt32();
+                float number;
+                memcpy(&number, &bits, sizeof(number));
+                return QString::number(number);
+            }
+        default:
+            fail();
+            return QString();
+        }
+    }
+
+    // Attributes are written in map order, so inserting at the end is constant time
+    void readAttributes(std::map<QString, QString> *attributes)
+    {
+        quint32 count = readCount();
+        for (quint32 i = 0; i < count && m_ok; ++i) {
+            const QString &name = readString();
+            QString value = readValue();
+            if (nullptr != attributes)
+                attributes->emplace_hint(attributes->end(), name, value);
+        }
+    }
+
+    void readKeyedAttributes(std::map<QString, std::map<QString, QString>> *items)
+    {
+        quint32 count = readCount();
+        for (quint32 i = 0; i < count && m_ok; ++i) {
+            const QString &key = readString();
+            if (nullptr == items) {
+                readAttributes(nullptr);
+                continue;
+            }
+            auto it = items->emplace_hint(items->end(), key, std::map<QString, QString>());
+            readAttributes(&it->second);
+        }
+    }
+
+    void readComponents(Snapshot *snapshot, QString *parentChildrenIds, int depth=0)
+    {
+        if (depth > SNAPSHOT_BINARY_MAX_COMPONENT_DEPTH) {
+            fail();
+            return;
+        }
+        quint32 count = readCount();
+        for (quint32 i = 0; i < count && m_ok; ++i) {
+            const QString &componentId = readString();
+            if (nullptr == snapshot) {
+                readAttributes(nullptr);
+                readComponents(nullptr, nullptr, depth + 1);
+                continue;
+            }
+            std::map<QString, QString> &component = snapshot->components[componentId];
+            readAttributes(&component);
+            if (!parentChildrenIds->isEmpty())
+                parentChildrenIds->append(",");
+            parentChildrenIds->append(componentId);
+            QString childrenIds;
+            readComponents(snapshot, &childrenIds, depth + 1);
+            if (!childrenIds.isEmpty())
+                component["children"] = childrenIds;
+        }
+    }
+
+private:
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_position = 0;
+    bool m_ok = true;
+    std::vector<QString> m_strings;
+    QString m_emptyString;
+
+    bool fail()
+    {
+        m_ok = false;
+        return false;
+    }
+};
+
+bool isSkeletonBinary(const QByteArray &byteArray)
+{
+    return byteArray.size() >= SNAPSHOT_BINARY_MAGIC_SIZE &&
+        0 == memcmp(byteArray.constData(), SNAPSHOT_BINARY_MAGIC, SNAPSHOT_BINARY_MAGIC_SIZE);
+}
+
+void saveSkeletonToBinary(Snapshot *snapshot, QByteArray *byteArray)
+{
+    SnapshotBinaryWriter writer;
+
+    writer.writeAttributes(snapshot->canvas);
+    writer.writeKeyedAttributes(snapshot->nodes);
+    writer.writeKeyedAttributes(snapshot->edges);
+    writer.writeKeyedAttributes(snapshot->parts, true);
+
+    const auto &childrenIds = snapshot->rootComponent.find("children");
+    writer.writeComponents(snapshot, childrenIds == snapshot->rootComponent.end() ? QString() : childrenIds->second);
+
+    writer.writeUInt32((quint32)snapshot->materials.size());
+    for (const auto &material: snapshot->materials) {
+        writer.writeAttributes(material.first);
+        writer.writeUInt32((quint32)material.second.size());
+        for (const auto &layer: material.second) {
+            writer.writeAttributes(layer.first);
+            writer.writeUInt32((quint32)layer.second.size());
+            for (const auto &map: layer.second)
+                writer.writeAttributes(map);
+        }
+    }
+
+    writer.writeKeyedAttributes(snapshot->motions);
+
+    writer.finish(byteArray);
+}
+
+bool loadSkeletonFromBinary(Snapshot *snapshot, const QByteArray &byteArray, quint32 flags)
+{
+    SnapshotBinaryReader reader(byteArray);
+    if (!reader.readHeader())
+        return false;
+
+    reader.readAttributes((flags & SNAPSHOT_ITEM_CANVAS) ? &snapshot->canvas : nullptr);
+
+    bool loadComponents = flags & SNAPSHOT_ITEM_COMPONENT;
+    reader.readKeyedAttributes(loadComponents ? &snapshot->nodes : nullptr);
+    reader.readKeyedAttributes(loadComponents ? &snapshot->edges : nullptr);
+    reader.readKeyedAttributes(loadComponents ? &snapshot->parts : nullptr);
+    if (loadComponents) {
+        QString childrenIds;
+        reader.readComponents(snapshot, &childrenIds);
+        if (!childrenIds.isEmpty()) {
+            auto &rootChildrenIds = snapshot->rootComponent["children"];
+            if (!rootChildrenIds.isEmpty())
+                rootChildrenIds += ",";
+            rootChildrenIds += childrenIds;
+        }
+    } else {
+        reader.readComponents(nullptr, nullptr);
+    }
+
+    quint32 materialCount = reader.readCount();
+    for (quint32 i = 0; i < materialCount && reader.ok(); ++i) {
+        decltype(snapshot->materials)::value_type material;
+        reader.readAttributes(&material.first);
+        quint32 layerCount = reader.readCount();
+        for (quint32 j = 0; j < layerCount && reader.ok(); ++j) {
+            decltype(material.second)::value_type layer;
+            reader.readAttributes(&layer.first);
+            quint32 mapCount = reader.readCount();
+            for (quint32 k = 0; k < mapCount && reader.ok(); ++k) {
+                std::map<QString, QString> map;
+                reader.readAttributes(&map);
+                layer.second.push_back(map);
+            }
+            material.second.push_back(layer);
+        }
+        if (!(flags & SNAPSHOT_ITEM_MATERIAL))
+            continue;
+        auto findId = material.first.find("id");
+        if (findId == material.first.end() || findId->second.isEmpty())
+            continue;
+        snapshot->materials.push_back(material);
+    }
+
+    reader.readKeyedAttributes((flags & SNAPSHOT_ITEM_MOTION) ? &snapshot->motions : nullptr);
+
+    if (!reader.ok()) {
+        qDebug() << "Corrupted binary snapshot";
+        return false;
+    }
+    return true;
+}
+
+bool loadSkeletonFromByteArray(Snapshot *snapshot, const QByteArray &byteArray, quint32 flags)
+{
+    if (isSkeletonBinary(byteArray))
+        return loadSkeletonFromBinary(snapshot, byteArray, flags);
+    QXmlStreamReader stream(byteArray);
+    loadSkeletonFromXmlStream(snapshot, stream, flags);
+    return !stream.hasError();
+}
@@ -0,0 +1,16 @@
+#ifndef DUST3D_SNAPSHOT_BINARY_H
+#define DUST3D_SNAPSHOT_BINARY_H
+#include <QByteArray>
+#include "snapshot.h"
+#include "snapshotxml.h"
+
+bool isSkeletonBinary(const QByteArray &byteArray);
+void saveSkeletonToBinary(Snapshot *snapshot, QByteArray *byteArray);
+bool loadSkeletonFromBinary(Snapshot *snapshot, const QByteArray &byteArray,
+    quint32 flags=SNAPSHOT_ITEM_ALL);
+
+// Loads either the binary or the xml encoding, detected by the leading magic
+bool loadSkeletonFromByteArray(Snapshot *snapshot, const QByteArray &byteArray,
+    quint32 flags=SNAPSHOT_ITEM_ALL);
+
+#endif
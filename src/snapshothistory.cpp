@@ -0,0 +1,168 @@
+#include "snapshothistory.h"
+
+SnapshotHistory::SnapshotHistory(size_t maxSteps) :
+    m_maxSteps(maxSteps)
+{
+}
+
+void SnapshotHistory::stage(Section section, const QString &id, const std::map<QString, QString> *attributes)
+{
+    auto &items = m_sections[(int)section];
+    auto findItem = items.find(id);
+    Attributes current = findItem == items.end() ? nullptr : findItem->second;
+    if (nullptr == attributes) {
+        if (nullptr == current)
+            return;
+    } else if (nullptr != current && *current == *attributes) {
+        return;
+    }
+
+    Attributes after = nullptr == attributes ? nullptr : std::make_shared<const std::map<QString, QString>>(*attributes);
+    auto insertResult = m_staged.changes.insert({{(int)section, id}, Change()});
+    if (insertResult.second)
+        insertResult.first->second.before = current;
+    insertResult.first->second.after = after;
+
+    if (nullptr == after)
+        items.erase(findItem);
+    else if (findItem == items.end())
+        items.insert({id, after});
+    else
+        findItem->second = after;
+}
+
+void SnapshotHistory::stageAll(Section section, const std::map<QString, std::map<QString, QString>> &items)
+{
+    std::vector<QString> removedIds;
+    for (const auto &it: m_sections[(int)section]) {
+        if (items.find(it.first) == items.end())
+            removedIds.push_back(it.first);
+    }
+    for (const auto &id: removedIds)
+        stage(section, id, nullptr);
+    for (const auto &it: items)
+        stage(section, it.first, &it.second);
+}
+
+void SnapshotHistory::stageMaterials(const Materials &materials)
+{
+    if (*m_materials == materials)
+        return;
+    if (!m_staged.materialsChanged) {
+        m_staged.materialsChanged = true;
+        m_staged.materialsBefore = m_materials;
+    }
+    m_materials = std::make_shared<const Materials>(materials);
+    m_staged.materialsAfter = m_materials;
+}
+
+bool SnapshotHistory::commit()
+{
+    Step step;
+    std::swap(step, m_staged);
+
+    // An element changed and changed back within the same step is not a change
+    for (auto it = step.changes.begin(); it != step.changes.end(); ) {
+        const auto &change = it->second;
+        if (change.before == change.after ||
+                (nullptr != change.before && nullptr != change.after && *change.before == *change.after))
+            it = step.changes.erase(it);
+        else
+            ++it;
+    }
+    if (step.materialsChanged && *step.materialsBefore == *step.materialsAfter)
+        step.materialsChanged = false;
+
+    if (!m_hasBase) {
+        m_hasBase = true;
+        return false;
+    }
+    if (step.isEmpty())
+        return false;
+
+    m_redoSteps.clear();
+    m_undoSteps.push_back(std::move(step));
+    while (m_undoSteps.size() > m_maxSteps)
+        m_undoSteps.pop_front();
+    return true;
+}
+
+void SnapshotHistory::settle()
+{
+    m_staged = Step();
+}
+
+void SnapshotHistory::apply(const Step &step, bool forward)
+{
+    for (const auto &it: step.changes) {
+        auto &items = m_sections[it.first.first];
+        const Attributes &attributes = forward ? it.second.after : it.second.before;
+        if (nullptr == attributes)
+            items.erase(it.first.second);
+        else
+            items[it.first.second] = attributes;
+    }
+    if (step.materialsChanged)
+        m_materials = forward ? step.materialsAfter : step.materialsBefore;
+}
+
+bool SnapshotHistory::undo()
+{
+    if (m_undoSteps.empty())
+        return false;
+    settle();
+    apply(m_undoSteps.back(), false);
+    m_redoSteps.push_back(std::move(m_undoSteps.back()));
+    m_undoSteps.pop_back();
+    return true;
+}
+
+bool SnapshotHistory::redo()
+{
+    if (m_redoSteps.empty())
+        return false;
+    settle();
+    apply(m_redoSteps.back(), true);
+    m_undoSteps.push_back(std::move(m_redoSteps.back()));
+    m_redoSteps.pop_back();
+    return true;
+}
+
+bool SnapshotHistory::undoable() const
+{
+    return !m_undoSteps.empty();
+}
+
+bool SnapshotHistory::redoable() const
+{
+    return !m_redoSteps.empty();
+}
+
+void SnapshotHistory::clear()
+{
+    m_hasBase = false;
+    for (auto &items: m_sections)
+        items.clear();
+    m_materials = std::make_shared<const Materials>();
+    m_staged = Step();
+    m_undoSteps.clear();
+    m_redoSteps.clear();
+}
+
+void SnapshotHistory::toSnapshot(Snapshot *snapshot) const
+{
+    auto copySection = [&](Section section, std::map<QString, std::map<QString, QString>> *items) {
+        for (const auto &it: m_sections[(int)section])
+            items->emplace_hint(items->end(), it.first, *it.second);
+    };
+    for (const auto &it: m_sections[(int)Section::Canvas])
+        snapshot->canvas = *it.second;
+    copySection(Section::Node, &snapshot->nodes);
+    copySection(Section::Edge, &snapshot->edges);
+    copySection(Section::Part, &snapshot->parts);
+    copySection(Section::Component, &snapshot->components);
+    for (const auto &it: m_sections[(int)Section::RootComponent])
+        snapshot->rootComponent = *it.second;
+    copySection(Section::Motion, &snapshot->motions);
+    snapshot->materials = *m_materials;
+}
@@ -0,0 +1,75 @@
+#ifndef DUST3D_SNAPSHOT_HISTORY_H
+#define DUST3D_SNAPSHOT_HISTORY_H
+#include <deque>
+#include <map>
+#include <memory>
+#include <QString>
+#include "snapshot.h"
+
+// Undo history kept as per element changes on top of one shared state,
+// an element's attributes are shared by the state and every step which didn't touch it
+class SnapshotHistory
+{
+public:
+    enum class Section
+    {
+        Canvas = 0,
+        Node,
+        Edge,
+        Part,
+        Component,
+        RootComponent,
+        Motion,
+        Count
+    };
+    typedef std::shared_ptr<const std::map<QString, QString>> Attributes;
+    typedef decltype(Snapshot::materials) Materials;
+
+    SnapshotHistory(size_t maxSteps);
+
+    // Stages the current attributes of an element, nullptr if the element is removed
+    void stage(Section section, const QString &id, const std::map<QString, QString> *attributes);
+    void stageAll(Section section, const std::map<QString, std::map<QString, QString>> &items);
+    void stageMaterials(const Materials &materials);
+
+    // Records the staged changes as one undo step, the first commit after clear() is the base state
+    bool commit();
+    // Takes the staged changes into the state without making them undoable
+    void settle();
+
+    bool undo();
+    bool redo();
+    bool undoable() const;
+    bool redoable() const;
+    void clear();
+    void toSnapshot(Snapshot *snapshot) const;
+private:
+    struct Change
+    {
+        Attributes before;
+        Attributes after;
+    };
+    struct Step
+    {
+        std::map<std::pair<int, QString>, Change> changes;
+        bool materialsChanged = false;
+        std::shared_ptr<const Materials> materialsBefore;
+        std::shared_ptr<const Materials> materialsAfter;
+        bool isEmpty() const
+        {
+            return changes.empty() && !materialsChanged;
+        }
+    };
+
+    size_t m_maxSteps = 0;
+    bool m_hasBase = false;
+    std::map<QString, Attributes> m_sections[(int)Section::Count];
+    std::shared_ptr<const Materials> m_materials = std::make_shared<const Materials>();
+    Step m_staged;
+    std::deque<Step> m_undoSteps;
+    std::deque<Step> m_redoSteps;
+
+    void apply(const Step &step, bool forward);
+};
+
+#endif
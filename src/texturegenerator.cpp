@@ -1,10 +1,9 @@
-#include <QPainter>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <QGuiApplication>
-#include <QRegion>
-#include <QPolygon>
 #include <QElapsedTimer>
-#include <QRadialGradient>
 #include "texturegenerator.h"
+#include "texturerasterizer.h"
 #include "theme.h"
 #include "util.h"
 #include "texturetype.h"
@@ -13,6 +12,45 @@
 
 QColor TextureGenerator::m_defaultTextureColor = Qt::transparent;
 
+class MetalnessRoughnessAmbientOcclusionCombiner
+{
+public:
+    MetalnessRoughnessAmbientOcclusionCombiner(const QImage *metalnessImage,
+            const QImage *roughnessImage,
+            const QImage *ambientOcclusionImage,
+            uchar *targetBits,
+            int targetBytesPerLine,
+            int width) :
+        m_metalnessImage(metalnessImage),
+        m_roughnessImage(roughnessImage),
+        m_ambientOcclusionImage(ambientOcclusionImage),
+        m_targetBits(targetBits),
+        m_targetBytesPerLine(targetBytesPerLine),
+        m_width(width)
+    {
+    }
+    void operator()(const tbb::blocked_range<int> &range) const
+    {
+        std::vector<uchar> fullLine(m_width, 255);
+        std::vector<uchar> emptyLine(m_width, 0);
+        for (int row = range.begin(); row != range.end(); ++row) {
+            const uchar *metalnessLine = m_metalnessImage->isNull() ? emptyLine.data() : m_metalnessImage->constScanLine(row);
+            const uchar *roughnessLine = m_roughnessImage->isNull() ? fullLine.data() : m_roughnessImage->constScanLine(row);
+            const uchar *ambientOcclusionLine = m_ambientOcclusionImage->isNull() ? fullLine.data() : m_ambientOcclusionImage->constScanLine(row);
+            QRgb *targetLine = (QRgb *)(m_targetBits + row * m_targetBytesPerLine);
+            for (int col = 0; col < m_width; ++col)
+                targetLine[col] = qRgb(ambientOcclusionLine[col], roughnessLine[col], metalnessLine[col]);
+        }
+    }
+private:
+    const QImage *m_metalnessImage = nullptr;
+    const QImage *m_roughnessImage = nullptr;
+    const QImage *m_ambientOcclusionImage = nullptr;
+    uchar *m_targetBits = nullptr;
+    int m_targetBytesPerLine = 0;
+    int m_width = 0;
+};
+
 TextureGenerator::TextureGenerator(const Object &object, Snapshot *snapshot) :
     m_snapshot(snapshot)
 {
@@ -30,6 +68,7 @@ TextureGenerator::~TextureGenerator()
     delete m_resultTextureRoughnessImage;
     delete m_resultTextureMetalnessImage;
     delete m_resultTextureAmbientOcclusionImage;
+    delete m_resultTextureMetalnessRoughnessAmbientOcclusionImage;
     delete m_resultMesh;
     delete m_snapshot;
 }
@@ -69,6 +108,13 @@ QImage *TextureGenerator::takeResultTextureAmbientOcclusionImage()
     return resultTextureAmbientOcclusionImage;
 }
 
+QImage *TextureGenerator::takeResultTextureMetalnessRoughnessAmbientOcclusionImage()
+{
+    QImage *resultTextureMetalnessRoughnessAmbientOcclusionImage = m_resultTextureMetalnessRoughnessAmbientOcclusionImage;
+    m_resultTextureMetalnessRoughnessAmbientOcclusionImage = nullptr;
+    return resultTextureMetalnessRoughnessAmbientOcclusionImage;
+}
+
 Object *TextureGenerator::takeObject()
 {
     Object *object = m_object;
@@ -118,6 +164,61 @@ void TextureGenerator::addPartAmbientOcclusionMap(QUuid partId, const QImage *im
     m_partAmbientOcclusionTextureMap[partId] = std::make_pair(*image, tileScale);
 }
 
+void TextureGenerator::setGeneratedCacheContext(TextureGeneratedCacheContext *cacheContext)
+{
+    m_cacheContext = cacheContext;
+}
+
+quint64 TextureGenerator::calculateUvLayoutHash()
+{
+    quint64 hash = 0;
+    for (const auto &it: m_object->triangles) {
+        for (const auto &index: it) {
+            quint64 value = index;
+            hash = crc64(hash, (const unsigned char *)&value, sizeof(value));
+        }
+    }
+    for (const auto &it: *m_object->triangleVertexUvs()) {
+        for (const auto &uv: it) {
+            float values[] = {uv.x(), uv.y()};
+            hash = crc64(hash, (const unsigned char *)values, sizeof(values));
+        }
+    }
+    for (const auto &it: *m_object->triangleSourceNodes()) {
+        QByteArray partId = it.first.toRfc4122();
+        hash = crc64(hash, (const unsigned char *)partId.constData(), partId.size());
+    }
+    for (const auto &it: *m_object->partUvRects()) {
+        QByteArray partId = it.first.toRfc4122();
+        hash = crc64(hash, (const unsigned char *)partId.constData(), partId.size());
+        for (const auto &rect: it.second) {
+            qreal values[] = {rect.left(), rect.top(), rect.width(), rect.height()};
+            hash = crc64(hash, (const unsigned char *)values, sizeof(values));
+        }
+    }
+    return hash;
+}
+
+QString TextureGenerator::partTextureSignature(const QUuid &partId, const ObjectNode &node)
+{
+    auto textureSignature = [&](const std::map<QUuid, std::pair<QImage, float>> &map) {
+        auto findTexture = map.find(partId);
+        if (findTexture == map.end())
+            return QString("none");
+        return QString::number(findTexture->second.first.cacheKey()) + "*" + QString::number(findTexture->second.second);
+    };
+    return node.color.name(QColor::HexArgb) + "," +
+        QString::number(node.colorSolubility) + "," +
+        QString::number(node.metalness) + "," +
+        QString::number(node.roughness) + "," +
+        (m_countershadedPartIds.find(partId) != m_countershadedPartIds.end() ? "countershaded" : "") + "," +
+        textureSignature(m_partColorTextureMap) + "," +
+        textureSignature(m_partNormalTextureMap) + "," +
+        textureSignature(m_partMetalnessTextureMap) + "," +
+        textureSignature(m_partRoughnessTextureMap) + "," +
+        textureSignature(m_partAmbientOcclusionTextureMap);
+}
+
 void TextureGenerator::prepare()
 {
     if (nullptr == m_snapshot)
@@ -218,55 +319,76 @@ void TextureGenerator::generate()
         partRoughnessMap.insert({item.partId, item.roughness});
     }
     
-    auto createImageBeginTime = countTimeConsumed.elapsed();
+    std::map<QUuid, QString> partTextureSignatures;
+    for (const auto &item: m_object->nodes) {
+        if (partTextureSignatures.find(item.partId) != partTextureSignatures.end())
+            continue;
+        partTextureSignatures.insert({item.partId, partTextureSignature(item.partId, item)});
+    }
     
-    m_resultTextureColorImage = new QImage(TextureGenerator::m_textureSize, TextureGenerator::m_textureSize, QImage::Format_ARGB32);
-    m_resultTextureColorImage->fill(m_hasTransparencySettings ? m_defaultTextureColor : Qt::white);
+    for (const auto &it: partUvRects) {
+        if (it.second.empty())
+            continue;
+        auto findMetalnessResult = partMetalnessMap.find(it.first);
+        if (findMetalnessResult != partMetalnessMap.end() &&
+                !qFuzzyCompare(findMetalnessResult->second, (float)0.0))
+            hasMetalnessMap = true;
+        auto findRoughnessResult = partRoughnessMap.find(it.first);
+        if (findRoughnessResult != partRoughnessMap.end() &&
+                !qFuzzyCompare(findRoughnessResult->second, (float)1.0))
+            hasRoughnessMap = true;
+    }
+    hasNormalMap = !m_partNormalTextureMap.empty();
+    if (!m_partMetalnessTextureMap.empty())
+        hasMetalnessMap = true;
+    if (!m_partRoughnessTextureMap.empty())
+        hasRoughnessMap = true;
+    hasAmbientOcclusionMap = !m_partAmbientOcclusionTextureMap.empty();
+
+    quint64 uvLayoutHash = calculateUvLayoutHash();
+    bool incremental = nullptr != m_cacheContext &&
+        m_cacheContext->textureSize == TextureGenerator::m_textureSize &&
+        m_cacheContext->uvLayoutHash == uvLayoutHash &&
+        m_cacheContext->hasTransparencySettings == m_hasTransparencySettings &&
+        m_cacheContext->hasNormalMap == hasNormalMap &&
+        m_cacheContext->hasMetalnessMap == hasMetalnessMap &&
+        m_cacheContext->hasRoughnessMap == hasRoughnessMap &&
+        m_cacheContext->hasAmbientOcclusionMap == hasAmbientOcclusionMap;
     
-    m_resultTextureNormalImage = new QImage(TextureGenerator::m_textureSize, TextureGenerator::m_textureSize, QImage::Format_ARGB32);
-    m_resultTextureNormalImage->fill(QColor(128, 128, 255));
+    auto createImageBeginTime = countTimeConsumed.elapsed();
     
-    m_resultTextureMetalnessImage = new QImage(TextureGenerator::m_textureSize, TextureGenerator::m_textureSize, QImage::Format_ARGB32);
-    m_resultTextureMetalnessImage->fill(Qt::black);
+    auto createImage = [&](const QImage *cachedImage, const QColor &fillColor, QImage::Format format) {
+        if (incremental && nullptr != cachedImage && !cachedImage->isNull())
+            return new QImage(*cachedImage);
+        QImage *image = new QImage(TextureGenerator::m_textureSize, TextureGenerator::m_textureSize, format);
+        image->fill(fillColor);
+        return image;
+    };
     
-    m_resultTextureRoughnessImage = new QImage(TextureGenerator::m_textureSize, TextureGenerator::m_textureSize, QImage::Format_ARGB32);
-    m_resultTextureRoughnessImage->fill(Qt::white);
+    QColor colorFillColor = m_hasTransparencySettings ? m_defaultTextureColor : Qt::white;
+    QColor normalFillColor = QColor(128, 128, 255);
+    QColor metalnessFillColor = Qt::black;
+    QColor roughnessFillColor = Qt::white;
+    QColor ambientOcclusionFillColor = Qt::white;
     
-    m_resultTextureAmbientOcclusionImage = new QImage(TextureGenerator::m_textureSize, TextureGenerator::m_textureSize, QImage::Format_ARGB32);
-    m_resultTextureAmbientOcclusionImage->fill(Qt::white);
+    m_resultTextureColorImage = createImage(incremental ? &m_cacheContext->colorImage : nullptr, colorFillColor, QImage::Format_ARGB32);
+    if (hasNormalMap)
+        m_resultTextureNormalImage = createImage(incremental ? &m_cacheContext->normalImage : nullptr, normalFillColor, QImage::Format_ARGB32);
+    if (hasMetalnessMap || hasRoughnessMap || hasAmbientOcclusionMap) {
+        m_resultTextureMetalnessImage = createImage(incremental ? &m_cacheContext->metalnessImage : nullptr, metalnessFillColor, QImage::Format_Grayscale8);
+        m_resultTextureRoughnessImage = createImage(incremental ? &m_cacheContext->roughnessImage : nullptr, roughnessFillColor, QImage::Format_Grayscale8);
+        m_resultTextureAmbientOcclusionImage = createImage(incremental ? &m_cacheContext->ambientOcclusionImage : nullptr, ambientOcclusionFillColor, QImage::Format_Grayscale8);
+    }
     
     auto createImageEndTime = countTimeConsumed.elapsed();
     
-    QColor borderColor = Qt::darkGray;
-    QPen pen(borderColor);
-    
-    QPainter texturePainter;
-    texturePainter.begin(m_resultTextureColorImage);
-    texturePainter.setRenderHint(QPainter::Antialiasing);
-    texturePainter.setRenderHint(QPainter::HighQualityAntialiasing);
-    
-    QPainter textureNormalPainter;
-    textureNormalPainter.begin(m_resultTextureNormalImage);
-    textureNormalPainter.setRenderHint(QPainter::Antialiasing);
-    textureNormalPainter.setRenderHint(QPainter::HighQualityAntialiasing);
-    
-    QPainter textureMetalnessPainter;
-    textureMetalnessPainter.begin(m_resultTextureMetalnessImage);
-    textureMetalnessPainter.setRenderHint(QPainter::Antialiasing);
-    textureMetalnessPainter.setRenderHint(QPainter::HighQualityAntialiasing);
-    
-    QPainter textureRoughnessPainter;
-    textureRoughnessPainter.begin(m_resultTextureRoughnessImage);
-    textureRoughnessPainter.setRenderHint(QPainter::Antialiasing);
-    textureRoughnessPainter.setRenderHint(QPainter::HighQualityAntialiasing);
-    
-    QPainter textureAmbientOcclusionPainter;
-    textureAmbientOcclusionPainter.begin(m_resultTextureAmbientOcclusionImage);
-    textureAmbientOcclusionPainter.setRenderHint(QPainter::Antialiasing);
-    textureAmbientOcclusionPainter.setRenderHint(QPainter::HighQualityAntialiasing);
+    TextureRasterizer textureRasterizer(m_resultTextureColorImage);
+    TextureRasterizer textureNormalRasterizer(m_resultTextureNormalImage);
+    TextureRasterizer textureMetalnessRasterizer(m_resultTextureMetalnessImage);
+    TextureRasterizer textureRoughnessRasterizer(m_resultTextureRoughnessImage);
+    TextureRasterizer textureAmbientOcclusionRasterizer(m_resultTextureAmbientOcclusionImage);
     
     auto paintTextureBeginTime = countTimeConsumed.elapsed();
-    texturePainter.setPen(Qt::NoPen);
     
     for (const auto &it: partUvRects) {
         const auto &partId = it.first;
@@ -274,7 +396,6 @@ void TextureGenerator::generate()
         auto findSourceColorResult = partColorMap.find(partId);
         if (findSourceColorResult != partColorMap.end()) {
             const auto &color = findSourceColorResult->second;
-            QBrush brush(color);
             float fillExpandSize = 2;
             for (const auto &rect: rects) {
                 QRectF translatedRect = {
@@ -283,7 +404,7 @@ void TextureGenerator::generate()
                     rect.width() * TextureGenerator::m_textureSize + fillExpandSize * 2,
                     rect.height() * TextureGenerator::m_textureSize + fillExpandSize * 2
                 };
-                texturePainter.fillRect(translatedRect, brush);
+                textureRasterizer.fillRect(translatedRect, color);
             }
         }
     }
@@ -298,7 +419,6 @@ void TextureGenerator::generate()
             const auto &color = QColor(findMetalnessResult->second * 255,
                 findMetalnessResult->second * 255,
                 findMetalnessResult->second * 255);
-            QBrush brush(color);
             float fillExpandSize = 2;
             for (const auto &rect: rects) {
                 QRectF translatedRect = {
@@ -307,8 +427,7 @@ void TextureGenerator::generate()
                     rect.width() * TextureGenerator::m_textureSize + fillExpandSize * 2,
                     rect.height() * TextureGenerator::m_textureSize + fillExpandSize * 2
                 };
-                textureMetalnessPainter.fillRect(translatedRect, brush);
-                hasMetalnessMap = true;
+                textureMetalnessRasterizer.fillRect(translatedRect, color);
             }
         }
     }
@@ -323,7 +442,6 @@ void TextureGenerator::generate()
             const auto &color = QColor(findRoughnessResult->second * 255,
                 findRoughnessResult->second * 255,
                 findRoughnessResult->second * 255);
-            QBrush brush(color);
             float fillExpandSize = 2;
             for (const auto &rect: rects) {
                 QRectF translatedRect = {
@@ -332,13 +450,12 @@ void TextureGenerator::generate()
                     rect.width() * TextureGenerator::m_textureSize + fillExpandSize * 2,
                     rect.height() * TextureGenerator::m_textureSize + fillExpandSize * 2
                 };
-                textureRoughnessPainter.fillRect(translatedRect, brush);
-                hasRoughnessMap = true;
+                textureRoughnessRasterizer.fillRect(translatedRect, color);
             }
         }
     }
     
-    auto drawTexture = [&](const std::map<QUuid, std::pair<QPixmap, QPixmap>> &map, QPainter &painter, bool useAlpha) {
+    auto drawTexture = [&](const std::map<QUuid, QImage> &map, TextureRasterizer &rasterizer, bool useAlpha) {
         for (const auto &it: partUvRects) {
             const auto &partId = it.first;
             const auto &rects = it.second;
@@ -352,9 +469,7 @@ void TextureGenerator::generate()
             }
             auto findTextureResult = map.find(partId);
             if (findTextureResult != map.end()) {
-                const auto &pixmap = findTextureResult->second.first;
-                const auto &rotatedPixmap = findTextureResult->second.second;
-                painter.setOpacity(alpha);
+                const auto &image = findTextureResult->second;
                 for (const auto &rect: rects) {
                     QRectF translatedRect = {
                         rect.left() * TextureGenerator::m_textureSize,
@@ -363,50 +478,41 @@ void TextureGenerator::generate()
                         rect.height() * TextureGenerator::m_textureSize
                     };
                     if (translatedRect.width() < translatedRect.height()) {
-                        painter.drawTiledPixmap(translatedRect, rotatedPixmap, QPointF(rect.top(), rect.left()));
+                        rasterizer.drawTiledImage(translatedRect, &image, QPointF(rect.top(), rect.left()), true, alpha);
                     } else {
-                        painter.drawTiledPixmap(translatedRect, pixmap, rect.topLeft());
+                        rasterizer.drawTiledImage(translatedRect, &image, rect.topLeft(), false, alpha);
                     }
                 }
-                painter.setOpacity(1.0);
             }
         }
     };
     
-    auto convertTextureImageToPixmap = [&](const std::map<QUuid, std::pair<QImage, float>> &sourceMap,
-            std::map<QUuid, std::pair<QPixmap, QPixmap>> &targetMap) {
+    auto convertTextureImageToTileImage = [&](const std::map<QUuid, std::pair<QImage, float>> &sourceMap,
+            std::map<QUuid, QImage> &targetMap) {
         for (const auto &it: sourceMap) {
             float tileScale = it.second.second;
             const auto &image = it.second.first;
-            auto newSize = image.size() * tileScale;
-            QImage scaledImage = image.scaled(newSize);
-            QPoint center = scaledImage.rect().center();
-            QMatrix matrix;
-            matrix.translate(center.x(), center.y());
-            matrix.rotate(90);
-            auto rotatedImage = scaledImage.transformed(matrix).mirrored(true, false);
-            targetMap[it.first] = std::make_pair(QPixmap::fromImage(scaledImage),
-                QPixmap::fromImage(rotatedImage));
+            targetMap[it.first] = TextureRasterizer::prepareTileImage(image, tileScale);
         }
     };
     
-    std::map<QUuid, std::pair<QPixmap, QPixmap>> partColorTexturePixmaps;
-    std::map<QUuid, std::pair<QPixmap, QPixmap>> partNormalTexturePixmaps;
-    std::map<QUuid, std::pair<QPixmap, QPixmap>> partMetalnessTexturePixmaps;
-    std::map<QUuid, std::pair<QPixmap, QPixmap>> partRoughnessTexturePixmaps;
-    std::map<QUuid, std::pair<QPixmap, QPixmap>> partAmbientOcclusionTexturePixmaps;
+    std::map<QUuid, QImage> partColorTextureImages;
+    std::map<QUuid, QImage> partNormalTextureImages;
+    std::map<QUuid, QImage> partMetalnessTextureImages;
+    std::map<QUuid, QImage> partRoughnessTextureImages;
+    std::map<QUuid, QImage> partAmbientOcclusionTextureImages;
     
-    convertTextureImageToPixmap(m_partColorTextureMap, partColorTexturePixmaps);
-    convertTextureImageToPixmap(m_partNormalTextureMap, partNormalTexturePixmaps);
-    convertTextureImageToPixmap(m_partMetalnessTextureMap, partMetalnessTexturePixmaps);
-    convertTextureImageToPixmap(m_partRoughnessTextureMap, partRoughnessTexturePixmaps);
-    convertTextureImageToPixmap(m_partAmbientOcclusionTextureMap, partAmbientOcclusionTexturePixmaps);
+    convertTextureImageToTileImage(m_partColorTextureMap, partColorTextureImages);
+    convertTextureImageToTileImage(m_partNormalTextureMap, partNormalTextureImages);
+    convertTextureImageToTileImage(m_partMetalnessTextureMap, partMetalnessTextureImages);
+    convertTextureImageToTileImage(m_partRoughnessTextureMap, partRoughnessTextureImages);
+    convertTextureImageToTileImage(m_partAmbientOcclusionTextureMap, partAmbientOcclusionTextureImages);
     
-    drawTexture(partColorTexturePixmaps, texturePainter, true);
-    drawTexture(partNormalTexturePixmaps, textureNormalPainter, false);
-    drawTexture(partMetalnessTexturePixmaps, textureMetalnessPainter, false);
-    drawTexture(partRoughnessTexturePixmaps, textureRoughnessPainter, false);
-    drawTexture(partAmbientOcclusionTexturePixmaps, textureAmbientOcclusionPainter, false);
+    drawTexture(partColorTextureImages, textureRasterizer, true);
+    drawTexture(partNormalTextureImages, textureNormalRasterizer, false);
+    drawTexture(partMetalnessTextureImages, textureMetalnessRasterizer, false);
+    drawTexture(partRoughnessTextureImages, textureRoughnessRasterizer, false);
+    drawTexture(partAmbientOcclusionTextureImages, textureAmbientOcclusionRasterizer, false);
     
     auto drawBySolubility = [&](const QUuid &partId, size_t triangleIndex, size_t firstVertexIndex, size_t secondVertexIndex,
             const QUuid &neighborPartId) {
@@ -450,50 +556,27 @@ void TextureGenerator::generate()
                     clippedRect.width() * TextureGenerator::m_textureSize,
                     clippedRect.height() * TextureGenerator::m_textureSize
                 };
-                texturePainter.setOpacity(alpha);
-                auto findTextureResult = partColorTexturePixmaps.find(neighborPartId);
-                if (findTextureResult != partColorTexturePixmaps.end()) {
-                    const auto &pixmap = findTextureResult->second.first;
-                    const auto &rotatedPixmap = findTextureResult->second.second;
-                    
-                    QImage tmpImage(translatedRect.width(), translatedRect.height(), QImage::Format_ARGB32);
-                    QPixmap tmpPixmap = QPixmap::fromImage(tmpImage);
-                    QPainter tmpPainter;
-                    QRectF tmpImageFrame = QRectF(0, 0, translatedRect.width(), translatedRect.height());
-                    
-                    // Fill tiled texture
-                    tmpPainter.begin(&tmpPixmap);
-                    tmpPainter.setOpacity(alpha);
+                QPointF gradientCenter(middlePoint.x() * TextureGenerator::m_textureSize,
+                    middlePoint.y() * TextureGenerator::m_textureSize);
+                auto findTextureResult = partColorTextureImages.find(neighborPartId);
+                if (findTextureResult != partColorTextureImages.end()) {
+                    const auto &image = findTextureResult->second;
                     if (it.width() < it.height()) {
-                        tmpPainter.drawTiledPixmap(tmpImageFrame, rotatedPixmap, QPointF(translatedRect.top(), translatedRect.left()));
+                        textureRasterizer.drawTiledImageWithRadialGradient(translatedRect, &image,
+                            QPointF(translatedRect.top(), translatedRect.left()), true,
+                            gradientCenter, finalRadius * TextureGenerator::m_textureSize,
+                            findNeighborColor->second, alpha);
                     } else {
-                        tmpPainter.drawTiledPixmap(tmpImageFrame, pixmap, translatedRect.topLeft());
+                        textureRasterizer.drawTiledImageWithRadialGradient(translatedRect, &image,
+                            translatedRect.topLeft(), false,
+                            gradientCenter, finalRadius * TextureGenerator::m_textureSize,
+                            findNeighborColor->second, alpha);
                     }
-                    tmpPainter.setOpacity(1.0);
-                    tmpPainter.end();
-                    
-                    // Apply gradient
-                    QRadialGradient gradient(QPointF(middlePoint.x() * TextureGenerator::m_textureSize - translatedRect.left(),
-                        middlePoint.y() * TextureGenerator::m_textureSize - translatedRect.top()),
-                        finalRadius * TextureGenerator::m_textureSize);
-                    gradient.setColorAt(0.0, findNeighborColor->second);
-                    gradient.setColorAt(1.0, Qt::transparent);
-                    
-                    tmpPainter.begin(&tmpPixmap);
-                    tmpPainter.setCompositionMode(QPainter::CompositionMode_DestinationIn);
-                    tmpPainter.fillRect(tmpImageFrame, gradient);
-                    tmpPainter.end();
-                    
-                    texturePainter.drawPixmap(translatedRect, tmpPixmap, tmpImageFrame);
                 } else {
-                    QRadialGradient gradient(QPointF(middlePoint.x() * TextureGenerator::m_textureSize,
-                        middlePoint.y() * TextureGenerator::m_textureSize),
-                        finalRadius * TextureGenerator::m_textureSize);
-                    gradient.setColorAt(0.0, findNeighborColor->second);
-                    gradient.setColorAt(1.0, Qt::transparent);
-                    texturePainter.fillRect(translatedRect, gradient);
+                    textureRasterizer.fillRadialGradient(translatedRect, gradientCenter,
+                        finalRadius * TextureGenerator::m_textureSize,
+                        findNeighborColor->second, alpha);
                 }
-                texturePainter.setOpacity(1.0);
                 break;
             }
         }
@@ -512,6 +595,7 @@ void TextureGenerator::generate()
                 std::make_tuple(i, j, k)));
         }
     }
+    std::set<std::pair<QUuid, QUuid>> neighborPartIds;
     for (const auto &it: halfEdgeToTriangleMap) {
         auto oppositeHalfEdge = std::make_pair(it.first.second, it.first.first);
         const auto &opposite = halfEdgeToTriangleMap.find(oppositeHalfEdge);
@@ -521,12 +605,12 @@ void TextureGenerator::generate()
         const std::pair<QUuid, QUuid> &oppositeSource = triangleSourceNodes[std::get<0>(opposite->second)];
         if (source.first == oppositeSource.first)
             continue;
+        neighborPartIds.insert({source.first, oppositeSource.first});
         drawBySolubility(source.first, std::get<0>(it.second), std::get<1>(it.second), std::get<2>(it.second), oppositeSource.first);
         drawBySolubility(oppositeSource.first, std::get<0>(opposite->second), std::get<1>(opposite->second), std::get<2>(opposite->second), source.first);
     }
     
     // Draw belly white
-    texturePainter.setCompositionMode(QPainter::CompositionMode_SoftLight);
     for (size_t triangleIndex = 0; triangleIndex < m_object->triangles.size(); ++triangleIndex) {
         const auto &normal = triangleNormals[triangleIndex];
         const std::pair<QUuid, QUuid> &source = triangleSourceNodes[triangleIndex];
@@ -563,11 +647,8 @@ void TextureGenerator::generate()
         float finalRadius = (uv[0].distanceToPoint(uv[1]) +
             uv[1].distanceToPoint(uv[2]) +
             uv[2].distanceToPoint(uv[0])) / 3.0;
-        QRadialGradient gradient(QPointF(middlePoint.x() * TextureGenerator::m_textureSize,
-            middlePoint.y() * TextureGenerator::m_textureSize),
-            finalRadius * TextureGenerator::m_textureSize);
-        gradient.setColorAt(0.0, Qt::white);
-        gradient.setColorAt(1.0, Qt::transparent);
+        QPointF gradientCenter(middlePoint.x() * TextureGenerator::m_textureSize,
+            middlePoint.y() * TextureGenerator::m_textureSize);
         for (const auto &it: allRects->second) {
             if (it.contains(middlePoint.x(), middlePoint.y())) {
                 QRectF fillTarget((middlePoint.x() - finalRadius),
@@ -581,7 +662,9 @@ void TextureGenerator::generate()
                     clippedRect.width() * TextureGenerator::m_textureSize,
                     clippedRect.height() * TextureGenerator::m_textureSize
                 };
-                texturePainter.fillRect(translatedRect, gradient);
+                textureRasterizer.fillRadialGradient(translatedRect, gradientCenter,
+                    finalRadius * TextureGenerator::m_textureSize, Qt::white, 1.0,
+                    TextureRasterizer::BlendMode::SoftLight);
             }
         }
         
@@ -603,11 +686,8 @@ void TextureGenerator::generate()
             }
             const std::vector<QVector2D> &oppositeUv = triangleVertexUvs[oppositeTriangleIndex];
             QVector2D oppositeMiddlePoint = (oppositeUv[std::get<1>(opposite->second)] + oppositeUv[std::get<2>(opposite->second)]) * 0.5;
-            QRadialGradient oppositeGradient(QPointF(oppositeMiddlePoint.x() * TextureGenerator::m_textureSize,
-                oppositeMiddlePoint.y() * TextureGenerator::m_textureSize),
-                finalRadius * TextureGenerator::m_textureSize);
-            oppositeGradient.setColorAt(0.0, Qt::white);
-            oppositeGradient.setColorAt(1.0, Qt::transparent);
+            QPointF oppositeGradientCenter(oppositeMiddlePoint.x() * TextureGenerator::m_textureSize,
+                oppositeMiddlePoint.y() * TextureGenerator::m_textureSize);
             for (const auto &it: oppositeAllRects->second) {
                 if (it.contains(oppositeMiddlePoint.x(), oppositeMiddlePoint.y())) {
                     QRectF fillTarget((oppositeMiddlePoint.x() - finalRadius),
@@ -621,26 +701,59 @@ void TextureGenerator::generate()
                         clippedRect.width() * TextureGenerator::m_textureSize,
                         clippedRect.height() * TextureGenerator::m_textureSize
                     };
-                    texturePainter.fillRect(translatedRect, oppositeGradient);
+                    textureRasterizer.fillRadialGradient(translatedRect, oppositeGradientCenter,
+                        finalRadius * TextureGenerator::m_textureSize, Qt::white, 1.0,
+                        TextureRasterizer::BlendMode::SoftLight);
                 }
             }
         }
     }
     
-    hasNormalMap = !m_partNormalTextureMap.empty();
-    if (!m_partMetalnessTextureMap.empty())
-        hasMetalnessMap = true;
-    if (!m_partRoughnessTextureMap.empty())
-        hasRoughnessMap = true;
-    hasAmbientOcclusionMap = !m_partAmbientOcclusionTextureMap.empty();
+    if (incremental) {
+        std::set<QUuid> dirtyPartIds;
+        for (const auto &it: partTextureSignatures) {
+            auto findCached = m_cacheContext->partTextureSignatures.find(it.first);
+            if (findCached == m_cacheContext->partTextureSignatures.end() ||
+                    findCached->second != it.second)
+                dirtyPartIds.insert(it.first);
+        }
+        for (const auto &it: m_cacheContext->partTextureSignatures) {
+            if (partTextureSignatures.find(it.first) == partTextureSignatures.end())
+                dirtyPartIds.insert(it.first);
+        }
+        std::set<QUuid> affectedPartIds = dirtyPartIds;
+        for (const auto &it: neighborPartIds) {
+            if (dirtyPartIds.find(it.second) != dirtyPartIds.end())
+                affectedPartIds.insert(it.first);
+        }
+        std::vector<QRect> clipRects;
+        float clipExpandSize = 3;
+        for (const auto &partId: affectedPartIds) {
+            auto findRects = partUvRects.find(partId);
+            if (findRects == partUvRects.end())
+                continue;
+            for (const auto &rect: findRects->second) {
+                clipRects.push_back(QRectF(rect.left() * TextureGenerator::m_textureSize - clipExpandSize,
+                    rect.top() * TextureGenerator::m_textureSize - clipExpandSize,
+                    rect.width() * TextureGenerator::m_textureSize + clipExpandSize * 2,
+                    rect.height() * TextureGenerator::m_textureSize + clipExpandSize * 2).toAlignedRect());
+            }
+        }
+        qDebug() << "Texture incremental generation for" << dirtyPartIds.size() << "changed parts," << clipRects.size() << "rects";
+        textureRasterizer.setClipRects(clipRects, colorFillColor);
+        textureNormalRasterizer.setClipRects(clipRects, normalFillColor);
+        textureMetalnessRasterizer.setClipRects(clipRects, metalnessFillColor);
+        textureRoughnessRasterizer.setClipRects(clipRects, roughnessFillColor);
+        textureAmbientOcclusionRasterizer.setClipRects(clipRects, ambientOcclusionFillColor);
+    }
+    
+    textureRasterizer.rasterize();
+    textureNormalRasterizer.rasterize();
+    textureMetalnessRasterizer.rasterize();
+    textureRoughnessRasterizer.rasterize();
+    textureAmbientOcclusionRasterizer.rasterize();
     
     auto paintTextureEndTime = countTimeConsumed.elapsed();
-
-    texturePainter.end();
-    textureNormalPainter.end();
-    textureMetalnessPainter.end();
-    textureRoughnessPainter.end();
-    textureAmbientOcclusionPainter.end();
     
     if (!hasNormalMap) {
         delete m_resultTextureNormalImage;
@@ -658,15 +771,32 @@ void TextureGenerator::generate()
         m_resultTextureAmbientOcclusionImage = nullptr;
     }
     
+    if (nullptr != m_cacheContext) {
+        m_cacheContext->textureSize = TextureGenerator::m_textureSize;
+        m_cacheContext->uvLayoutHash = uvLayoutHash;
+        m_cacheContext->hasTransparencySettings = m_hasTransparencySettings;
+        m_cacheContext->hasNormalMap = hasNormalMap;
+        m_cacheContext->hasMetalnessMap = hasMetalnessMap;
+        m_cacheContext->hasRoughnessMap = hasRoughnessMap;
+        m_cacheContext->hasAmbientOcclusionMap = hasAmbientOcclusionMap;
+        m_cacheContext->partTextureSignatures = partTextureSignatures;
+        m_cacheContext->colorImage = *m_resultTextureColorImage;
+        m_cacheContext->normalImage = nullptr != m_resultTextureNormalImage ? *m_resultTextureNormalImage : QImage();
+        m_cacheContext->metalnessImage = nullptr != m_resultTextureMetalnessImage ? *m_resultTextureMetalnessImage : QImage();
+        m_cacheContext->roughnessImage = nullptr != m_resultTextureRoughnessImage ? *m_resultTextureRoughnessImage : QImage();
+        m_cacheContext->ambientOcclusionImage = nullptr != m_resultTextureAmbientOcclusionImage ? *m_resultTextureAmbientOcclusionImage : QImage();
+    }
+    
     auto createResultBeginTime = countTimeConsumed.elapsed();
     m_resultMesh->setTextureImage(new QImage(*m_resultTextureColorImage));
     if (nullptr != m_resultTextureNormalImage)
         m_resultMesh->setNormalMapImage(new QImage(*m_resultTextureNormalImage));
     if (hasMetalnessMap || hasRoughnessMap || hasAmbientOcclusionMap) {
-        m_resultMesh->setMetalnessRoughnessAmbientOcclusionImage(combineMetalnessRoughnessAmbientOcclusionImages(
+        m_resultTextureMetalnessRoughnessAmbientOcclusionImage = combineMetalnessRoughnessAmbientOcclusionImages(
             m_resultTextureMetalnessImage,
             m_resultTextureRoughnessImage,
-            m_resultTextureAmbientOcclusionImage));
+            m_resultTextureAmbientOcclusionImage);
+        m_resultMesh->setMetalnessRoughnessAmbientOcclusionImage(new QImage(*m_resultTextureMetalnessRoughnessAmbientOcclusionImage));
         m_resultMesh->setHasMetalnessInImage(hasMetalnessMap);
         m_resultMesh->setHasRoughnessInImage(hasRoughnessMap);
         m_resultMesh->setHasAmbientOcclusionInImage(hasAmbientOcclusionMap);
@@ -676,9 +806,9 @@ void TextureGenerator::generate()
     qDebug() << "The texture[" << TextureGenerator::m_textureSize << "x" << TextureGenerator::m_textureSize << "] generation took" << countTimeConsumed.elapsed() << "milliseconds";
 }
 
-QImage *TextureGenerator::combineMetalnessRoughnessAmbientOcclusionImages(QImage *metalnessImage,
-        QImage *roughnessImage,
-        QImage *ambientOcclusionImage)
+QImage *TextureGenerator::combineMetalnessRoughnessAmbientOcclusionImages(const QImage *metalnessImage,
+        const QImage *roughnessImage,
+        const QImage *ambientOcclusionImage)
 {
     QImage *textureMetalnessRoughnessAmbientOcclusionImage = nullptr;
     if (nullptr != metalnessImage ||
@@ -692,20 +822,29 @@ QImage *TextureGenerator::combineMetalnessRoughnessAmbientOcclusionImages(QImage
         if (nullptr != ambientOcclusionImage)
             textureSize = ambientOcclusionImage->height();
         if (textureSize > 0) {
+            auto toGrayscale = [&](const QImage *image) {
+                if (nullptr == image || image->isNull())
+                    return QImage();
+                QImage grayscaleImage = *image;
+                if (grayscaleImage.width() != textureSize || grayscaleImage.height() != textureSize)
+                    grayscaleImage = grayscaleImage.scaled(textureSize, textureSize);
+                if (QImage::Format_Grayscale8 != grayscaleImage.format())
+                    grayscaleImage = grayscaleImage.convertToFormat(QImage::Format_Grayscale8);
+                return grayscaleImage;
+            };
+            QImage metalnessGrayscaleImage = toGrayscale(metalnessImage);
+            QImage roughnessGrayscaleImage = toGrayscale(roughnessImage);
+            QImage ambientOcclusionGrayscaleImage = toGrayscale(ambientOcclusionImage);
             textureMetalnessRoughnessAmbientOcclusionImage = new QImage(textureSize, textureSize, QImage::Format_ARGB32);
-            textureMetalnessRoughnessAmbientOcclusionImage->fill(QColor(255, 255, 0));
-            for (int row = 0; row < textureMetalnessRoughnessAmbientOcclusionImage->height(); ++row) {
-                for (int col = 0; col < textureMetalnessRoughnessAmbientOcclusionImage->width(); ++col) {
-                    QColor color(255, 255, 0);
-                    if (nullptr != metalnessImage)
-                        color.setBlue(qGray(metalnessImage->pixel(col, row)));
-                    if (nullptr != roughnessImage)
-                        color.setGreen(qGray(roughnessImage->pixel(col, row)));
-                    if (nullptr != ambientOcclusionImage)
-                        color.setRed(qGray(ambientOcclusionImage->pixel(col, row)));
-                    textureMetalnessRoughnessAmbientOcclusionImage->setPixelColor(col, row, color);
-                }
-            }
+            uchar *targetBits = textureMetalnessRoughnessAmbientOcclusionImage->bits();
+            int targetBytesPerLine = textureMetalnessRoughnessAmbientOcclusionImage->bytesPerLine();
+            tbb::parallel_for(tbb::blocked_range<int>(0, textureSize),
+                MetalnessRoughnessAmbientOcclusionCombiner(&metalnessGrayscaleImage,
+                    &roughnessGrayscaleImage,
+                    &ambientOcclusionGrayscaleImage,
+                    targetBits,
+                    targetBytesPerLine,
+                    textureSize));
         }
     }
     return textureMetalnessRoughnessAmbientOcclusionImage;
@@ -10,6 +10,24 @@
 #include "snapshot.h"
 #include "preferences.h"
 
+class TextureGeneratedCacheContext
+{
+public:
+    int textureSize = 0;
+    quint64 uvLayoutHash = 0;
+    bool hasTransparencySettings = false;
+    bool hasNormalMap = false;
+    bool hasMetalnessMap = false;
+    bool hasRoughnessMap = false;
+    bool hasAmbientOcclusionMap = false;
+    std::map<QUuid, QString> partTextureSignatures;
+    QImage colorImage;
+    QImage normalImage;
+    QImage metalnessImage;
+    QImage roughnessImage;
+    QImage ambientOcclusionImage;
+};
+
 class TextureGenerator : public QObject
 {
     Q_OBJECT
@@ -21,6 +39,7 @@ public:
     QImage *takeResultTextureRoughnessImage();
     QImage *takeResultTextureMetalnessImage();
     QImage *takeResultTextureAmbientOcclusionImage();
+    QImage *takeResultTextureMetalnessRoughnessAmbientOcclusionImage();
     Object *takeObject();
     Model *takeResultMesh();
     bool hasTransparencySettings();
@@ -29,10 +48,11 @@ public:
     void addPartMetalnessMap(QUuid partId, const QImage *image, float tileScale);
     void addPartRoughnessMap(QUuid partId, const QImage *image, float tileScale);
     void addPartAmbientOcclusionMap(QUuid partId, const QImage *image, float tileScale);
+    void setGeneratedCacheContext(TextureGeneratedCacheContext *cacheContext);
     void generate();
-    static QImage *combineMetalnessRoughnessAmbientOcclusionImages(QImage *metalnessImage,
-            QImage *roughnessImage,
-            QImage *ambientOcclusionImage);
+    static QImage *combineMetalnessRoughnessAmbientOcclusionImages(const QImage *metalnessImage,
+            const QImage *roughnessImage,
+            const QImage *ambientOcclusionImage);
 signals:
     void finished();
 public slots:
@@ -41,6 +61,8 @@ public:
     static QColor m_defaultTextureColor;
 private:
     void prepare();
+    quint64 calculateUvLayoutHash();
+    QString partTextureSignature(const QUuid &partId, const ObjectNode &node);
 private:
     Object *m_object = nullptr;
     QImage *m_resultTextureColorImage = nullptr;
@@ -48,6 +70,7 @@ private:
     QImage *m_resultTextureRoughnessImage = nullptr;
     QImage *m_resultTextureMetalnessImage = nullptr;
     QImage *m_resultTextureAmbientOcclusionImage = nullptr;
+    QImage *m_resultTextureMetalnessRoughnessAmbientOcclusionImage = nullptr;
     Model *m_resultMesh = nullptr;
     std::map<QUuid, std::pair<QImage, float>> m_partColorTextureMap;
     std::map<QUuid, std::pair<QImage, float>> m_partNormalTextureMap;
@@ -56,6 +79,7 @@ private:
     std::map<QUuid, std::pair<QImage, float>> m_partAmbientOcclusionTextureMap;
     std::set<QUuid> m_countershadedPartIds;
     Snapshot *m_snapshot = nullptr;
+    TextureGeneratedCacheContext *m_cacheContext = nullptr;
     bool m_hasTransparencySettings = false;
     int m_textureSize = Preferences::instance().textureSize();
 };
@@ -7,9 +7,8 @@
 #include "texturepainter.h"
 #include "util.h"
 
-TexturePainter::TexturePainter(const QVector3D &mouseRayNear, const QVector3D &mouseRayFar) :
-    m_mouseRayNear(mouseRayNear),
-    m_mouseRayFar(mouseRayFar)
+TexturePainter::TexturePainter(const std::vector<TexturePainterStroke> &strokes) :
+    m_strokes(strokes)
 {
 }
 
@@ -20,7 +19,7 @@ void TexturePainter::setContext(TexturePainterContext *context)
 
 TexturePainter::~TexturePainter()
 {
-    delete m_colorImage;
+    delete m_dirtyColorImage;
 }
 
 void TexturePainter::setPaintMode(PaintMode paintMode)
@@ -43,13 +42,18 @@ void TexturePainter::setBrushColor(const QColor &color)
     m_brushColor = color;
 }
 
-QImage *TexturePainter::takeColorImage()
+QImage *TexturePainter::takeDirtyColorImage()
 {
-    QImage *colorImage = m_colorImage;
-    m_colorImage = nullptr;
+    QImage *colorImage = m_dirtyColorImage;
+    m_dirtyColorImage = nullptr;
     return colorImage;
 }
 
+const QRect &TexturePainter::dirtyRect()
+{
+    return m_dirtyRect;
+}
+
 /*
 void TexturePainter::buildFaceAroundVertexMap()
 {
@@ -73,18 +77,25 @@ void TexturePainter::collectNearbyTriangles(size_t triangleIndex, std::unordered
 }
 */
 
-bool TexturePainter::paintStroke(QPainter &painter, const TexturePainterStroke &stroke)
+bool TexturePainter::paintStroke(QPainter &painter, const TexturePainterStroke &stroke, QRect *dirtyRect)
 {
+    if (nullptr == m_context->triangleBvh) {
+        m_context->triangleBvh = new TriangleBvh(m_context->object->vertices,
+            m_context->object->triangles,
+            m_context->object->triangleNormals);
+    }
+    
+    // Only the last stroke's hit is reported, a miss must not leave an earlier stroke's position behind
+    m_targetPosition = QVector3D();
+    QVector3D targetPosition;
     size_t targetTriangleIndex = 0;
-    if (!intersectRayAndPolyhedron(stroke.mouseRayNear,
+    if (!m_context->triangleBvh->intersectRay(stroke.mouseRayNear,
             stroke.mouseRayFar,
-            m_context->object->vertices,
-            m_context->object->triangles,
-            m_context->object->triangleNormals,
-            &m_targetPosition,
+            &targetPosition,
             &targetTriangleIndex)) {
         return false; 
     }
+    m_targetPosition = targetPosition;
     
     if (PaintMode::None == m_paintMode)
         return false;
@@ -160,6 +171,8 @@ bool TexturePainter::paintStroke(QPainter &painter, const TexturePainterStroke &
         });
         clipRegion.setRects(&rects[0], rects.size());
         painter.setClipRegion(clipRegion);
+    } else {
+        painter.setClipping(false);
     }
     
     double radius = m_radius * radiusFactor * m_context->colorImage->height();
@@ -169,12 +182,17 @@ bool TexturePainter::paintStroke(QPainter &painter, const TexturePainterStroke &
     QRadialGradient gradient(QPointF(middlePoint.x(), middlePoint.y()), radius);
     gradient.setColorAt(0.0, m_brushColor);
     gradient.setColorAt(1.0, Qt::transparent);
-                    
-    painter.fillRect(middlePoint.x() - radius, 
+    
+    QRectF dabRect(middlePoint.x() - radius, 
         middlePoint.y() - radius, 
         radius + radius, 
-        radius + radius,
-        gradient);
+        radius + radius);
+    painter.fillRect(dabRect, gradient);
+    
+    QRect paintedRect = dabRect.toAlignedRect();
+    if (!rects.empty())
+        paintedRect = paintedRect.intersected(clipRegion.boundingRect());
+    *dirtyRect = dirtyRect->united(paintedRect);
     return true;
 }
 
@@ -185,14 +203,19 @@ void TexturePainter::paint()
         return;
     }
     
-    QPainter painter(m_context->colorImage);
-    painter.setPen(Qt::NoPen);
+    QRect dirtyRect;
+    {
+        QPainter painter(m_context->colorImage);
+        painter.setPen(Qt::NoPen);
+        for (const auto &stroke: m_strokes)
+            paintStroke(painter, stroke, &dirtyRect);
+    }
     
-    TexturePainterStroke stroke = {m_mouseRayNear, m_mouseRayFar};
-    if (!paintStroke(painter, stroke))
+    // Only the touched area is handed back, instead of copying the whole texture for every stroke
+    m_dirtyRect = dirtyRect.intersected(m_context->colorImage->rect());
+    if (m_dirtyRect.isEmpty())
         return;
-    
-    m_colorImage = new QImage(*m_context->colorImage);
+    m_dirtyColorImage = new QImage(m_context->colorImage->copy(m_dirtyRect));
 }
 
 void TexturePainter::process()
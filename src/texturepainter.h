@@ -13,6 +13,7 @@
 #include "object.h"
 #include "paintmode.h"
 #include "model.h"
+#include "trianglebvh.h"
 
 struct TexturePainterStroke
 {
@@ -25,12 +26,14 @@ class TexturePainterContext
 public:
     Object *object = nullptr;
     QImage *colorImage = nullptr;
+    TriangleBvh *triangleBvh = nullptr;
     //std::unordered_map<size_t, std::unordered_set<size_t>> *faceAroundVertexMap = nullptr;
     
     ~TexturePainterContext()
     {
         delete object;
         delete colorImage;
+        delete triangleBvh;
     }
 };
 
@@ -38,14 +41,15 @@ class TexturePainter : public QObject
 {
     Q_OBJECT
 public:
-    TexturePainter(const QVector3D &mouseRayNear, const QVector3D &mouseRayFar);
+    TexturePainter(const std::vector<TexturePainterStroke> &strokes);
     void setContext(TexturePainterContext *context);
     void setRadius(float radius);
     void setBrushColor(const QColor &color);
     void setPaintMode(PaintMode paintMode);
     void setMaskNodeIds(const std::set<QUuid> &nodeIds);
     
-    QImage *takeColorImage();
+    QImage *takeDirtyColorImage();
+    const QRect &dirtyRect();
     
     ~TexturePainter();
     const QVector3D &targetPosition();
@@ -58,16 +62,16 @@ private:
     float m_radius = 0.0;
     PaintMode m_paintMode = PaintMode::None;
     std::set<QUuid> m_mousePickMaskNodeIds;
-    QVector3D m_mouseRayNear;
-    QVector3D m_mouseRayFar;
+    std::vector<TexturePainterStroke> m_strokes;
     QVector3D m_targetPosition;
     QColor m_brushColor;
     TexturePainterContext *m_context = nullptr;
-    QImage *m_colorImage = nullptr;
+    QImage *m_dirtyColorImage = nullptr;
+    QRect m_dirtyRect;
     
     //void buildFaceAroundVertexMap();
     //void collectNearbyTriangles(size_t triangleIndex, std::unordered_set<size_t> *triangleIndices);
-    bool paintStroke(QPainter &painter, const TexturePainterStroke &stroke);
+    bool paintStroke(QPainter &painter, const TexturePainterStroke &stroke, QRect *dirtyRect);
 };
 
 #endif
@@ -0,0 +1,440 @@
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include "texturerasterizer.h"
+
+static const int g_maxTileSize = 256;
+
+class TextureTileRasterizer
+{
+public:
+    TextureTileRasterizer(int tilesPerRow, const std::vector<std::vector<size_t>> *tileCommands,
+            const std::vector<bool> *tileNeeded,
+            std::function<void (int, int, const std::vector<size_t> &)> rasterizeTile) :
+        m_tilesPerRow(tilesPerRow),
+        m_tileCommands(tileCommands),
+        m_tileNeeded(tileNeeded),
+        m_rasterizeTile(rasterizeTile)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+            if (!(*m_tileNeeded)[i])
+                continue;
+            m_rasterizeTile((int)i % m_tilesPerRow, (int)i / m_tilesPerRow, (*m_tileCommands)[i]);
+        }
+    }
+private:
+    int m_tilesPerRow = 0;
+    const std::vector<std::vector<size_t>> *m_tileCommands = nullptr;
+    const std::vector<bool> *m_tileNeeded = nullptr;
+    std::function<void (int, int, const std::vector<size_t> &)> m_rasterizeTile;
+};
+
+struct TextureRasterizer::TilePlanes
+{
+    int left = 0;
+    int top = 0;
+    int stride = 0;
+    float *red = nullptr;
+    float *green = nullptr;
+    float *blue = nullptr;
+    float *alpha = nullptr;
+};
+
+static inline float coverageOfPixel(int pixel, double from, double to)
+{
+    double overlap = std::min((double)pixel + 1.0, to) - std::max((double)pixel, from);
+    if (overlap <= 0.0)
+        return 0.0;
+    if (overlap >= 1.0)
+        return 1.0;
+    return (float)overlap;
+}
+
+static inline int positiveModulo(int value, int divisor)
+{
+    int result = value % divisor;
+    return result < 0 ? result + divisor : result;
+}
+
+TextureRasterizer::TextureRasterizer(QImage *image, int tileSize) :
+    m_image(image),
+    m_tileSize(std::max(8, std::min(tileSize, g_maxTileSize)))
+{
+    if (nullptr == m_image)
+        return;
+    m_grayscale = QImage::Format_Grayscale8 == m_image->format();
+    if (!m_grayscale && QImage::Format_ARGB32 != m_image->format())
+        *m_image = m_image->convertToFormat(QImage::Format_ARGB32);
+}
+
+QImage TextureRasterizer::prepareTileImage(const QImage &image, float tileScale)
+{
+    QImage scaledImage = image.scaled(image.size() * tileScale);
+    if (QImage::Format_ARGB32 != scaledImage.format())
+        return scaledImage.convertToFormat(QImage::Format_ARGB32);
+    return scaledImage;
+}
+
+bool TextureRasterizer::addCommand(Command &command)
+{
+    if (nullptr == m_image)
+        return false;
+    QRectF bounds = command.rect;
+    if (CommandType::RadialGradient == command.type ||
+            CommandType::TiledImageWithRadialGradient == command.type) {
+        bounds = bounds.intersected(QRectF(command.center.x() - command.radius,
+            command.center.y() - command.radius,
+            command.radius + command.radius,
+            command.radius + command.radius));
+    }
+    command.left = std::max(0, (int)std::floor(bounds.left()));
+    command.top = std::max(0, (int)std::floor(bounds.top()));
+    command.right = std::min(m_image->width(), (int)std::ceil(bounds.right()));
+    command.bottom = std::min(m_image->height(), (int)std::ceil(bounds.bottom()));
+    if (command.left >= command.right || command.top >= command.bottom)
+        return false;
+    if (nullptr != command.image && command.image->isNull())
+        return false;
+    m_commands.push_back(command);
+    return true;
+}
+
+void TextureRasterizer::fillRect(const QRectF &rect, const QColor &color)
+{
+    Command command;
+    command.type = CommandType::FillRect;
+    command.rect = rect;
+    command.color[0] = color.redF();
+    command.color[1] = color.greenF();
+    command.color[2] = color.blueF();
+    command.color[3] = color.alphaF();
+    addCommand(command);
+}
+
+void TextureRasterizer::drawTiledImage(const QRectF &rect, const QImage *image, const QPointF &offset,
+    bool transposed, float opacity)
+{
+    if (nullptr == image)
+        return;
+    Command command;
+    command.type = CommandType::TiledImage;
+    command.rect = rect;
+    command.image = image;
+    command.offset = offset;
+    command.transposed = transposed;
+    command.opacity = opacity;
+    addCommand(command);
+}
+
+void TextureRasterizer::fillRadialGradient(const QRectF &rect, const QPointF &center, float radius,
+    const QColor &color, float opacity, BlendMode blendMode)
+{
+    if (radius <= 0)
+        return;
+    Command command;
+    command.type = CommandType::RadialGradient;
+    command.blendMode = blendMode;
+    command.rect = rect;
+    command.center = center;
+    command.radius = radius;
+    command.color[0] = color.redF();
+    command.color[1] = color.greenF();
+    command.color[2] = color.blueF();
+    command.color[3] = color.alphaF();
+    command.opacity = opacity;
+    addCommand(command);
+}
+
+void TextureRasterizer::drawTiledImageWithRadialGradient(const QRectF &rect, const QImage *image, const QPointF &offset,
+    bool transposed, const QPointF &center, float radius, const QColor &color, float opacity)
+{
+    if (nullptr == image || radius <= 0)
+        return;
+    Command command;
+    command.type = CommandType::TiledImageWithRadialGradient;
+    command.rect = rect;
+    command.image = image;
+    command.offset = offset;
+    command.transposed = transposed;
+    command.center = center;
+    command.radius = radius;
+    command.color[3] = color.alphaF();
+    command.opacity = opacity;
+    addCommand(command);
+}
+
+void TextureRasterizer::setClipRects(const std::vector<QRect> &clipRects, const QColor &background)
+{
+    if (nullptr == m_image)
+        return;
+    m_clipEnabled = true;
+    m_clipRects.clear();
+    QRect imageRect(0, 0, m_image->width(), m_image->height());
+    for (const auto &it: clipRects) {
+        QRect clipRect = it.intersected(imageRect);
+        if (clipRect.isEmpty())
+            continue;
+        m_clipRects.push_back(clipRect);
+    }
+    m_clipBackground = background.rgba();
+}
+
+void TextureRasterizer::rasterize()
+{
+    if (m_clipEnabled && m_clipRects.empty()) {
+        m_commands.clear();
+        m_clipEnabled = false;
+        return;
+    }
+    if (m_commands.empty() && !m_clipEnabled)
+        return;
+
+    m_bits = m_image->bits();
+    m_bytesPerLine = m_image->bytesPerLine();
+
+    int tilesPerRow = (m_image->width() + m_tileSize - 1) / m_tileSize;
+    int tilesPerColumn = (m_image->height() + m_tileSize - 1) / m_tileSize;
+    std::vector<std::vector<size_t>> tileCommands(tilesPerRow * tilesPerColumn);
+    std::vector<bool> tileClipped(tileCommands.size(), !m_clipEnabled);
+    for (const auto &clipRect: m_clipRects) {
+        for (int tileY = clipRect.top() / m_tileSize; tileY <= clipRect.bottom() / m_tileSize; ++tileY) {
+            for (int tileX = clipRect.left() / m_tileSize; tileX <= clipRect.right() / m_tileSize; ++tileX)
+                tileClipped[tileY * tilesPerRow + tileX] = true;
+        }
+    }
+    for (size_t commandIndex = 0; commandIndex < m_commands.size(); ++commandIndex) {
+        const auto &command = m_commands[commandIndex];
+        int tileLeft = command.left / m_tileSize;
+        int tileRight = (command.right - 1) / m_tileSize;
+        int tileTop = command.top / m_tileSize;
+        int tileBottom = (command.bottom - 1) / m_tileSize;
+        for (int tileY = tileTop; tileY <= tileBottom; ++tileY) {
+            for (int tileX = tileLeft; tileX <= tileRight; ++tileX) {
+                size_t tileIndex = tileY * tilesPerRow + tileX;
+                if (!tileClipped[tileIndex])
+                    continue;
+                tileCommands[tileIndex].push_back(commandIndex);
+            }
+        }
+    }
+    if (!m_clipEnabled) {
+        for (size_t tileIndex = 0; tileIndex < tileCommands.size(); ++tileIndex)
+            tileClipped[tileIndex] = !tileCommands[tileIndex].empty();
+    }
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, tileCommands.size()),
+        TextureTileRasterizer(tilesPerRow, &tileCommands, &tileClipped,
+            [=](int tileX, int tileY, const std::vector<size_t> &commandIndices) {
+                rasterizeTile(tileX, tileY, commandIndices);
+            }));
+
+    m_commands.clear();
+    m_bits = nullptr;
+    m_clipEnabled = false;
+    m_clipRects.clear();
+}
+
+void TextureRasterizer::rasterizeTile(int tileX, int tileY, const std::vector<size_t> &commandIndices)
+{
+    TilePlanes planes;
+    planes.left = tileX * m_tileSize;
+    planes.top = tileY * m_tileSize;
+    int right = std::min(planes.left + m_tileSize, m_image->width());
+    int bottom = std::min(planes.top + m_tileSize, m_image->height());
+    int width = right - planes.left;
+    int height = bottom - planes.top;
+    planes.stride = width;
+
+    std::vector<float> buffer(width * height * 4);
+    planes.red = buffer.data();
+    planes.green = planes.red + width * height;
+    planes.blue = planes.green + width * height;
+    planes.alpha = planes.blue + width * height;
+
+    std::vector<uchar> clipMask;
+    if (m_clipEnabled) {
+        clipMask.resize(width * height, 0);
+        QRect tileRect(planes.left, planes.top, width, height);
+        for (const auto &it: m_clipRects) {
+            QRect clipRect = it.intersected(tileRect);
+            if (clipRect.isEmpty())
+                continue;
+            for (int y = clipRect.top(); y <= clipRect.bottom(); ++y) {
+                uchar *maskLine = clipMask.data() + (y - planes.top) * width;
+                std::fill(maskLine + clipRect.left() - planes.left, maskLine + clipRect.right() + 1 - planes.left, (uchar)1);
+            }
+        }
+    }
+
+    const float inverse255 = 1.0f / 255.0f;
+    if (m_grayscale) {
+        float clipGray = qGray(m_clipBackground) * inverse255;
+        for (int y = 0; y < height; ++y) {
+            const uchar *line = m_bits + (planes.top + y) * m_bytesPerLine + planes.left;
+            size_t offset = y * width;
+            for (int x = 0; x < width; ++x) {
+                float gray = (m_clipEnabled && clipMask[offset + x]) ? clipGray : line[x] * inverse255;
+                planes.red[offset + x] = gray;
+                planes.green[offset + x] = gray;
+                planes.blue[offset + x] = gray;
+                planes.alpha[offset + x] = 1.0f;
+            }
+        }
+    } else {
+        for (int y = 0; y < height; ++y) {
+            const QRgb *line = (const QRgb *)(m_bits + (planes.top + y) * m_bytesPerLine) + planes.left;
+            size_t offset = y * width;
+            for (int x = 0; x < width; ++x) {
+                QRgb pixel = (m_clipEnabled && clipMask[offset + x]) ? m_clipBackground : line[x];
+                float alpha = qAlpha(pixel) * inverse255;
+                planes.red[offset + x] = qRed(pixel) * inverse255 * alpha;
+                planes.green[offset + x] = qGreen(pixel) * inverse255 * alpha;
+                planes.blue[offset + x] = qBlue(pixel) * inverse255 * alpha;
+                planes.alpha[offset + x] = alpha;
+            }
+        }
+    }
+
+    for (const auto &commandIndex: commandIndices) {
+        const auto &command = m_commands[commandIndex];
+        int fromY = std::max(command.top, planes.top);
+        int toY = std::min(command.bottom, bottom);
+        int fromX = std::max(command.left, planes.left);
+        int toX = std::min(command.right, right);
+        for (int y = fromY; y < toY; ++y)
+            rasterizeSpan(planes, command, y, fromX, toX);
+    }
+
+    if (m_grayscale) {
+        for (int y = 0; y < height; ++y) {
+            uchar *line = m_bits + (planes.top + y) * m_bytesPerLine + planes.left;
+            size_t offset = y * width;
+            for (int x = 0; x < width; ++x) {
+                if (m_clipEnabled && !clipMask[offset + x])
+                    continue;
+                float gray = planes.red[offset + x] * 11.0f + planes.green[offset + x] * 16.0f + planes.blue[offset + x] * 5.0f;
+                line[x] = (uchar)std::min(std::max((int)(gray * (255.0f / 32.0f) + 0.5f), 0), 255);
+            }
+        }
+        return;
+    }
+
+    for (int y = 0; y < height; ++y) {
+        QRgb *line = (QRgb *)(m_bits + (planes.top + y) * m_bytesPerLine) + planes.left;
+        size_t offset = y * width;
+        for (int x = 0; x < width; ++x) {
+            if (m_clipEnabled && !clipMask[offset + x])
+                continue;
+            float alpha = std::min(std::max(planes.alpha[offset + x], 0.0f), 1.0f);
+            if (alpha <= 0.0f) {
+                line[x] = qRgba(0, 0, 0, 0);
+                continue;
+            }
+            float scale = 255.0f / alpha;
+            line[x] = qRgba(std::min((int)(planes.red[offset + x] * scale + 0.5f), 255),
+                std::min((int)(planes.green[offset + x] * scale + 0.5f), 255),
+                std::min((int)(planes.blue[offset + x] * scale + 0.5f), 255),
+                (int)(alpha * 255.0f + 0.5f));
+        }
+    }
+}
+
+void TextureRasterizer::rasterizeSpan(TilePlanes &planes, const Command &command, int y, int fromX, int toX)
+{
+    if (fromX >= toX)
+        return;
+
+    int count = toX - fromX;
+    float sourceRed[g_maxTileSize];
+    float sourceGreen[g_maxTileSize];
+    float sourceBlue[g_maxTileSize];
+    float sourceAlpha[g_maxTileSize];
+
+    float coverageY = coverageOfPixel(y, command.rect.top(), command.rect.bottom());
+    for (int i = 0; i < count; ++i)
+        sourceAlpha[i] = coverageY * coverageOfPixel(fromX + i, command.rect.left(), command.rect.right()) * command.opacity;
+
+    if (CommandType::FillRect == command.type ||
+            CommandType::RadialGradient == command.type) {
+        for (int i = 0; i < count; ++i) {
+            sourceAlpha[i] *= command.color[3];
+            sourceRed[i] = command.color[0] * sourceAlpha[i];
+            sourceGreen[i] = command.color[1] * sourceAlpha[i];
+            sourceBlue[i] = command.color[2] * sourceAlpha[i];
+        }
+    } else {
+        const QImage &image = *command.image;
+        const float inverse255 = 1.0f / 255.0f;
+        int imageWidth = image.width();
+        int imageHeight = image.height();
+        double v = y - command.rect.top() + command.offset.y();
+        for (int i = 0; i < count; ++i) {
+            double u = fromX + i - command.rect.left() + command.offset.x();
+            int sampleX = (int)std::floor(command.transposed ? v : u);
+            int sampleY = (int)std::floor(command.transposed ? u : v);
+            QRgb pixel = ((const QRgb *)image.constScanLine(positiveModulo(sampleY, imageHeight)))[positiveModulo(sampleX, imageWidth)];
+            float alpha = sourceAlpha[i] * qAlpha(pixel) * inverse255;
+            sourceRed[i] = qRed(pixel) * inverse255 * alpha;
+            sourceGreen[i] = qGreen(pixel) * inverse255 * alpha;
+            sourceBlue[i] = qBlue(pixel) * inverse255 * alpha;
+            sourceAlpha[i] = alpha;
+        }
+    }
+
+    if (CommandType::RadialGradient == command.type ||
+            CommandType::TiledImageWithRadialGradient == command.type) {
+        float inverseRadius = 1.0f / command.radius;
+        float dy = (y + 0.5f - (float)command.center.y()) * inverseRadius;
+        float gradientAlpha = CommandType::TiledImageWithRadialGradient == command.type ? command.color[3] : 1.0f;
+        for (int i = 0; i < count; ++i) {
+            float dx = (fromX + i + 0.5f - (float)command.center.x()) * inverseRadius;
+            float t = std::min(std::sqrt(dx * dx + dy * dy), 1.0f);
+            float factor = (1.0f - t) * gradientAlpha;
+            sourceRed[i] *= factor;
+            sourceGreen[i] *= factor;
+            sourceBlue[i] *= factor;
+            sourceAlpha[i] *= factor;
+        }
+    }
+
+    size_t offset = (y - planes.top) * planes.stride + (fromX - planes.left);
+    float *red = planes.red + offset;
+    float *green = planes.green + offset;
+    float *blue = planes.blue + offset;
+    float *alpha = planes.alpha + offset;
+
+    if (BlendMode::SourceOver == command.blendMode) {
+        for (int i = 0; i < count; ++i) {
+            float inverseSourceAlpha = 1.0f - sourceAlpha[i];
+            red[i] = sourceRed[i] + red[i] * inverseSourceAlpha;
+            green[i] = sourceGreen[i] + green[i] * inverseSourceAlpha;
+            blue[i] = sourceBlue[i] + blue[i] * inverseSourceAlpha;
+            alpha[i] = sourceAlpha[i] + alpha[i] * inverseSourceAlpha;
+        }
+        return;
+    }
+
+    auto softLight = [](float destination, float source, float destinationAlpha, float sourceAlpha) {
+        float source2 = source + source;
+        float destinationNonPremultiplied = destinationAlpha > 0.0f ? destination / destinationAlpha : 0.0f;
+        float temp = source * (1.0f - destinationAlpha) + destination * (1.0f - sourceAlpha);
+        if (source2 < sourceAlpha)
+            return destination * (sourceAlpha + (source2 - sourceAlpha) * (1.0f - destinationNonPremultiplied)) + temp;
+        if (4.0f * destination <= destinationAlpha)
+            return destination * sourceAlpha + destinationAlpha * (source2 - sourceAlpha) *
+                (((16.0f * destinationNonPremultiplied - 12.0f) * destinationNonPremultiplied + 3.0f) * destinationNonPremultiplied) + temp;
+        return destination * sourceAlpha + destinationAlpha * (source2 - sourceAlpha) *
+            (std::sqrt(destinationNonPremultiplied) - destinationNonPremultiplied) + temp;
+    };
+    for (int i = 0; i < count; ++i) {
+        red[i] = softLight(red[i], sourceRed[i], alpha[i], sourceAlpha[i]);
+        green[i] = softLight(green[i], sourceGreen[i], alpha[i], sourceAlpha[i]);
+        blue[i] = softLight(blue[i], sourceBlue[i], alpha[i], sourceAlpha[i]);
+        alpha[i] = sourceAlpha[i] + alpha[i] - sourceAlpha[i] * alpha[i];
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef DUST3D_TEXTURE_RASTERIZER_H
+#define DUST3D_TEXTURE_RASTERIZER_H
+#include <QImage>
+#include <QColor>
+#include <QRectF>
+#include <QPointF>
+#include <QRect>
+#include <vector>
+
+class TextureRasterizer
+{
+public:
+    enum class BlendMode
+    {
+        SourceOver = 0,
+        SoftLight
+    };
+
+    TextureRasterizer(QImage *image, int tileSize=64);
+    void fillRect(const QRectF &rect, const QColor &color);
+    void drawTiledImage(const QRectF &rect, const QImage *image, const QPointF &offset,
+        bool transposed=false, float opacity=1.0);
+    void fillRadialGradient(const QRectF &rect, const QPointF &center, float radius,
+        const QColor &color, float opacity=1.0, BlendMode blendMode=BlendMode::SourceOver);
+    void drawTiledImageWithRadialGradient(const QRectF &rect, const QImage *image, const QPointF &offset,
+        bool transposed, const QPointF &center, float radius, const QColor &color, float opacity=1.0);
+    void setClipRects(const std::vector<QRect> &clipRects, const QColor &background);
+    void rasterize();
+    static QImage prepareTileImage(const QImage &image, float tileScale);
+private:
+    enum class CommandType
+    {
+        FillRect = 0,
+        TiledImage,
+        RadialGradient,
+        TiledImageWithRadialGradient
+    };
+
+    struct Command
+    {
+        CommandType type;
+        BlendMode blendMode = BlendMode::SourceOver;
+        QRectF rect;
+        int left = 0;
+        int top = 0;
+        int right = 0;
+        int bottom = 0;
+        float color[4] = {0, 0, 0, 0};
+        float opacity = 1.0;
+        const QImage *image = nullptr;
+        QPointF offset;
+        bool transposed = false;
+        QPointF center;
+        float radius = 0;
+    };
+
+    struct TilePlanes;
+
+    QImage *m_image = nullptr;
+    int m_tileSize = 64;
+    bool m_grayscale = false;
+    uchar *m_bits = nullptr;
+    int m_bytesPerLine = 0;
+    std::vector<Command> m_commands;
+    bool m_clipEnabled = false;
+    std::vector<QRect> m_clipRects;
+    QRgb m_clipBackground = 0;
+
+    bool addCommand(Command &command);
+    void rasterizeTile(int tileX, int tileY, const std::vector<size_t> &commandIndices);
+    void rasterizeSpan(TilePlanes &planes, const Command &command, int y, int fromX, int toX);
+};
+
+#endif
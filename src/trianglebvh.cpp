@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include "trianglebvh.h"
+
+TriangleBvh::TriangleBvh(const std::vector<QVector3D> &vertices,
+        const std::vector<std::vector<size_t>> &triangles,
+        const std::vector<QVector3D> &triangleNormals)
+{
+    m_triangles.resize(triangles.size());
+    m_triangleIndices.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        auto &triangle = m_triangles[i];
+        const auto &indices = triangles[i];
+        for (size_t j = 0; j < 3; ++j)
+            triangle.positions[j] = vertices[indices[j]];
+        triangle.normal = i < triangleNormals.size() ? triangleNormals[i] :
+            QVector3D::normal(triangle.positions[0], triangle.positions[1], triangle.positions[2]);
+        triangle.center = (triangle.positions[0] + triangle.positions[1] + triangle.positions[2]) / 3.0;
+        m_triangleIndices[i] = i;
+    }
+    if (!m_triangles.empty()) {
+        m_nodes.reserve(m_triangles.size() * 2 / m_maxLeafSize + 1);
+        buildNode(0, m_triangles.size());
+    }
+}
+
+size_t TriangleBvh::buildNode(size_t begin, size_t end)
+{
+    size_t nodeIndex = m_nodes.size();
+    m_nodes.push_back(Node());
+    
+    float boundMin[3], boundMax[3];
+    float centerMin[3], centerMax[3];
+    for (size_t axis = 0; axis < 3; ++axis) {
+        boundMin[axis] = centerMin[axis] = std::numeric_limits<float>::max();
+        boundMax[axis] = centerMax[axis] = std::numeric_limits<float>::lowest();
+    }
+    for (size_t i = begin; i < end; ++i) {
+        const auto &triangle = m_triangles[m_triangleIndices[i]];
+        for (size_t axis = 0; axis < 3; ++axis) {
+            for (size_t j = 0; j < 3; ++j) {
+                boundMin[axis] = std::min(boundMin[axis], triangle.positions[j][axis]);
+                boundMax[axis] = std::max(boundMax[axis], triangle.positions[j][axis]);
+            }
+            centerMin[axis] = std::min(centerMin[axis], triangle.center[axis]);
+            centerMax[axis] = std::max(centerMax[axis], triangle.center[axis]);
+        }
+    }
+    for (size_t axis = 0; axis < 3; ++axis) {
+        m_nodes[nodeIndex].boundMin[axis] = boundMin[axis];
+        m_nodes[nodeIndex].boundMax[axis] = boundMax[axis];
+    }
+    m_nodes[nodeIndex].begin = begin;
+    m_nodes[nodeIndex].end = end;
+    
+    size_t splitAxis = 0;
+    for (size_t axis = 1; axis < 3; ++axis) {
+        if (centerMax[axis] - centerMin[axis] > centerMax[splitAxis] - centerMin[splitAxis])
+            splitAxis = axis;
+    }
+    if (end - begin <= m_maxLeafSize || centerMax[splitAxis] <= centerMin[splitAxis]) {
+        m_nodes[nodeIndex].isLeaf = true;
+        return nodeIndex;
+    }
+    
+    size_t middle = (begin + end) / 2;
+    std::nth_element(m_triangleIndices.begin() + begin,
+        m_triangleIndices.begin() + middle,
+        m_triangleIndices.begin() + end,
+        [&](size_t first, size_t second) {
+            return m_triangles[first].center[splitAxis] < m_triangles[second].center[splitAxis];
+        });
+    buildNode(begin, middle);
+    size_t rightChild = buildNode(middle, end);
+    m_nodes[nodeIndex].rightChild = rightChild;
+    return nodeIndex;
+}
+
+bool TriangleBvh::intersectNodeBound(const Node &node, const QVector3D &origin, const QVector3D &inverseDirection,
+    float maxDistance, float *nearDistance) const
+{
+    float tMin = 0;
+    float tMax = maxDistance;
+    for (size_t axis = 0; axis < 3; ++axis) {
+        float t0 = (node.boundMin[axis] - origin[axis]) * inverseDirection[axis];
+        float t1 = (node.boundMax[axis] - origin[axis]) * inverseDirection[axis];
+        if (t0 > t1)
+            std::swap(t0, t1);
+        if (std::isnan(t0) || std::isnan(t1))
+            continue;
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+        if (tMin > tMax)
+            return false;
+    }
+    *nearDistance = tMin;
+    return true;
+}
+
+bool TriangleBvh::intersectTriangle(const Triangle &triangle, const QVector3D &origin, const QVector3D &direction,
+    float *distance) const
+{
+    // Only the triangles facing towards the ray origin can be picked
+    if (QVector3D::dotProduct(triangle.normal, direction) >= 0)
+        return false;
+    
+    auto edge1 = triangle.positions[1] - triangle.positions[0];
+    auto edge2 = triangle.positions[2] - triangle.positions[0];
+    auto p = QVector3D::crossProduct(direction, edge2);
+    float determinant = QVector3D::dotProduct(edge1, p);
+    if (std::abs(determinant) < 1e-12)
+        return false;
+    float inverseDeterminant = 1.0 / determinant;
+    auto s = origin - triangle.positions[0];
+    float u = QVector3D::dotProduct(s, p) * inverseDeterminant;
+    if (u < 0 || u > 1)
+        return false;
+    auto q = QVector3D::crossProduct(s, edge1);
+    float v = QVector3D::dotProduct(direction, q) * inverseDeterminant;
+    if (v < 0 || u + v > 1)
+        return false;
+    float t = QVector3D::dotProduct(edge2, q) * inverseDeterminant;
+    if (t < 0 || t > 1)
+        return false;
+    *distance = t;
+    return true;
+}
+
+bool TriangleBvh::intersectRay(const QVector3D &rayNear,
+    const QVector3D &rayFar,
+    QVector3D *intersection,
+    size_t *intersectedTriangleIndex) const
+{
+    if (m_nodes.empty())
+        return false;
+    
+    // The ray is parameterized as rayNear + t * (rayFar - rayNear), t in [0, 1]
+    QVector3D direction = rayFar - rayNear;
+    QVector3D inverseDirection(1.0 / direction.x(), 1.0 / direction.y(), 1.0 / direction.z());
+    float nearestDistance = 1.0;
+    bool foundTriangle = false;
+    size_t nearestTriangleIndex = 0;
+    
+    std::vector<size_t> nodeStack = {0};
+    while (!nodeStack.empty()) {
+        size_t nodeIndex = nodeStack.back();
+        nodeStack.pop_back();
+        const auto &node = m_nodes[nodeIndex];
+        float nodeDistance = 0;
+        if (!intersectNodeBound(node, rayNear, inverseDirection, nearestDistance, &nodeDistance))
+            continue;
+        if (node.isLeaf) {
+            for (size_t i = node.begin; i < node.end; ++i) {
+                size_t triangleIndex = m_triangleIndices[i];
+                float distance = 0;
+                if (!intersectTriangle(m_triangles[triangleIndex], rayNear, direction, &distance))
+                    continue;
+                if (distance <= nearestDistance) {
+                    nearestDistance = distance;
+                    nearestTriangleIndex = triangleIndex;
+                    foundTriangle = true;
+                }
+            }
+            continue;
+        }
+        size_t leftChild = nodeIndex + 1;
+        size_t rightChild = node.rightChild;
+        float leftDistance = 0;
+        float rightDistance = 0;
+        bool hitLeft = intersectNodeBound(m_nodes[leftChild], rayNear, inverseDirection, nearestDistance, &leftDistance);
+        bool hitRight = intersectNodeBound(m_nodes[rightChild], rayNear, inverseDirection, nearestDistance, &rightDistance);
+        if (hitLeft && hitRight) {
+            // Visit the nearer child first, so farther subtrees are culled by the shortened ray
+            if (leftDistance < rightDistance) {
+                nodeStack.push_back(rightChild);
+                nodeStack.push_back(leftChild);
+            } else {
+                nodeStack.push_back(leftChild);
+                nodeStack.push_back(rightChild);
+            }
+        } else if (hitLeft) {
+            nodeStack.push_back(leftChild);
+        } else if (hitRight) {
+            nodeStack.push_back(rightChild);
+        }
+    }
+    
+    if (!foundTriangle)
+        return false;
+    if (nullptr != intersection)
+        *intersection = rayNear + direction * nearestDistance;
+    if (nullptr != intersectedTriangleIndex)
+        *intersectedTriangleIndex = nearestTriangleIndex;
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef DUST3D_TRIANGLE_BVH_H
+#define DUST3D_TRIANGLE_BVH_H
+#include <vector>
+#include <QVector3D>
+
+class TriangleBvh
+{
+public:
+    TriangleBvh(const std::vector<QVector3D> &vertices,
+        const std::vector<std::vector<size_t>> &triangles,
+        const std::vector<QVector3D> &triangleNormals);
+    bool intersectRay(const QVector3D &rayNear,
+        const QVector3D &rayFar,
+        QVector3D *intersection=nullptr,
+        size_t *intersectedTriangleIndex=nullptr) const;
+private:
+    struct Node
+    {
+        float boundMin[3];
+        float boundMax[3];
+        size_t begin = 0;
+        size_t end = 0;
+        size_t rightChild = 0;
+        bool isLeaf = false;
+    };
+    
+    struct Triangle
+    {
+        QVector3D positions[3];
+        QVector3D normal;
+        QVector3D center;
+    };
+    
+    std::vector<Node> m_nodes;
+    std::vector<Triangle> m_triangles;
+    std::vector<size_t> m_triangleIndices;
+    size_t m_maxLeafSize = 4;
+    
+    size_t buildNode(size_t begin, size_t end);
+    bool intersectNodeBound(const Node &node, const QVector3D &origin, const QVector3D &inverseDirection,
+        float maxDistance, float *nearDistance) const;
+    bool intersectTriangle(const Triangle &triangle, const QVector3D &origin, const QVector3D &direction,
+        float *distance) const;
+};
+
+#endif
@@ -556,46 +556,6 @@ bool intersectSegmentAndTriangle(const QVector3D &segmentPoint0, const QVector3D
     return true;
 }
 
-bool intersectRayAndPolyhedron(const QVector3D &rayNear,
-    const QVector3D &rayFar,
-    const std::vector<QVector3D> &vertices,
-    const std::vector<std::vector<size_t>> &triangles,
-    const std::vector<QVector3D> &triangleNormals,
-    QVector3D *intersection,
-    size_t *intersectedTriangleIndex)
-{
-    bool foundPosition = false;
-    auto ray = (rayNear - rayFar).normalized();
-    float minDistance2 = std::numeric_limits<float>::max();
-    for (size_t i = 0; i < triangles.size(); ++i) {
-        const auto &triangleIndices = triangles[i];
-        std::vector<QVector3D> triangle = {
-            vertices[triangleIndices[0]],
-            vertices[triangleIndices[1]],
-            vertices[triangleIndices[2]],
-        };
-        const auto &triangleNormal = triangleNormals[i];
-        if (QVector3D::dotProduct(triangleNormal, ray) <= 0)
-            continue;
-        QVector3D point;
-        if (intersectSegmentAndTriangle(rayNear, rayFar,
-                triangle,
-                triangleNormal,
-                &point)) {
-            float distance2 = (point - rayNear).lengthSquared();
-            if (distance2 < minDistance2) {
-                if (nullptr != intersection)
-                    *intersection = point;
-                if (nullptr != intersectedTriangleIndex)
-                    *intersectedTriangleIndex = i;
-                minDistance2 = distance2;
-                foundPosition = true;
-            }
-        }
-    }
-    return foundPosition;
-}
-
 QVector3D barycentricCoordinates(const QVector3D &a, const QVector3D &b, const QVector3D &c, 
     const QVector3D &point)
 {
@@ -54,13 +54,6 @@ bool intersectSegmentAndTriangle(const QVector3D &segmentPoint0, const QVector3D
     const std::vector<QVector3D> &triangle,
     const QVector3D &triangleNormal,
     QVector3D *intersection=nullptr);
-bool intersectRayAndPolyhedron(const QVector3D &rayNear,
-    const QVector3D &rayFar,
-    const std::vector<QVector3D> &vertices,
-    const std::vector<std::vector<size_t>> &triangles,
-    const std::vector<QVector3D> &triangleNormals,
-    QVector3D *intersection=nullptr,
-    size_t *intersectedTriangleIndex=nullptr);
 QVector3D barycentricCoordinates(const QVector3D &a, const QVector3D &b, const QVector3D &c, 
     const QVector3D &point);
     
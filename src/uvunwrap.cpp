@@ -6,7 +6,8 @@
 void uvUnwrap(const Object &object,
     std::vector<std::vector<QVector2D>> &triangleVertexUvs,
     std::set<int> &seamVertices,
-    std::map<QUuid, std::vector<QRectF>> &uvRects)
+    std::map<QUuid, std::vector<QRectF>> &uvRects,
+    UvUnwrapCacheContext *cacheContext)
 {
     const auto &choosenVertices = object.vertices;
     const auto &choosenTriangles = object.triangles;
@@ -56,8 +57,10 @@ void uvUnwrap(const Object &object,
     
     simpleuv::UvUnwrapper uvUnwrapper;
     uvUnwrapper.setMesh(inputMesh);
+    if (nullptr != cacheContext)
+        uvUnwrapper.setCache(&cacheContext->unwrapperCache);
     uvUnwrapper.unwrap();
-    qDebug() << "Texture size:" << uvUnwrapper.getTextureSize();
+    qDebug() << "Texture size:" << uvUnwrapper.getTextureSize() << "occupancy:" << uvUnwrapper.getOccupancy();
     const std::vector<simpleuv::FaceTextureCoords> &resultFaceUvs = uvUnwrapper.getFaceUvs();
     const std::vector<simpleuv::Rect> &resultChartRects = uvUnwrapper.getChartRects();
     const std::vector<int> &resultChartSourcePartitions = uvUnwrapper.getChartSourcePartitions();
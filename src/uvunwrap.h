@@ -2,11 +2,19 @@
 #define DUST3D_UV_UNWRAP_H
 #include <set>
 #include <QVector2D>
+#include <simpleuv/uvunwrapper.h>
 #include "object.h"
 
+class UvUnwrapCacheContext
+{
+public:
+    simpleuv::UvUnwrapperCache unwrapperCache;
+};
+
 void uvUnwrap(const Object &object,
     std::vector<std::vector<QVector2D>> &triangleVertexUvs,
     std::set<int> &seamVertices,
-    std::map<QUuid, std::vector<QRectF>> &uvRects);
+    std::map<QUuid, std::vector<QRectF>> &uvRects,
+    UvUnwrapCacheContext *cacheContext=nullptr);
 
 #endif
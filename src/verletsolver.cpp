@@ -0,0 +1,207 @@
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <cmath>
+#include <algorithm>
+#include "verletsolver.h"
+
+// A projection costs about 8ns, so a task of 256 takes about 2us, which is what waking
+// the TBB workers costs; smaller batches run faster on the calling thread
+static const size_t g_projectionGrainSize = 256;
+static const size_t g_minParallelBatchSize = 2 * g_projectionGrainSize;
+
+class DistanceConstraintProjector
+{
+public:
+    DistanceConstraintProjector(VerletSolver *solver,
+            const std::vector<size_t> *batch) :
+        m_solver(solver),
+        m_batch(batch)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i)
+            m_solver->projectDistanceConstraint(m_solver->m_distanceConstraints[(*m_batch)[i]]);
+    }
+private:
+    VerletSolver *m_solver = nullptr;
+    const std::vector<size_t> *m_batch = nullptr;
+};
+
+VerletSolver::VerletSolver(const std::vector<QVector3D> &positions) :
+    m_positionsX(positions.size()),
+    m_positionsY(positions.size()),
+    m_positionsZ(positions.size()),
+    m_inverseMasses(positions.size(), 1.0f),
+    m_radiuses(positions.size(), 0.0f)
+{
+    for (size_t i = 0; i < positions.size(); ++i) {
+        m_positionsX[i] = positions[i].x();
+        m_positionsY[i] = positions[i].y();
+        m_positionsZ[i] = positions[i].z();
+    }
+    m_lastPositionsX = m_positionsX;
+    m_lastPositionsY = m_positionsY;
+    m_lastPositionsZ = m_positionsZ;
+}
+
+size_t VerletSolver::particleCount() const
+{
+    return m_positionsX.size();
+}
+
+void VerletSolver::setAcceleration(const QVector3D &acceleration)
+{
+    m_acceleration = acceleration;
+}
+
+void VerletSolver::setGroundY(float groundY)
+{
+    m_groundY = groundY;
+}
+
+void VerletSolver::setInverseMass(size_t particleIndex, float inverseMass)
+{
+    m_inverseMasses[particleIndex] = inverseMass;
+}
+
+void VerletSolver::setRadius(size_t particleIndex, float radius)
+{
+    m_radiuses[particleIndex] = radius;
+}
+
+void VerletSolver::addDistanceConstraint(size_t from, size_t to)
+{
+    m_distanceConstraints.push_back({from, to, (position(from) - position(to)).length()});
+    m_constraintBatchesDirty = true;
+}
+
+QVector3D VerletSolver::position(size_t particleIndex) const
+{
+    return QVector3D(m_positionsX[particleIndex], m_positionsY[particleIndex], m_positionsZ[particleIndex]);
+}
+
+void VerletSolver::setPosition(size_t particleIndex, const QVector3D &position)
+{
+    m_positionsX[particleIndex] = position.x();
+    m_positionsY[particleIndex] = position.y();
+    m_positionsZ[particleIndex] = position.z();
+}
+
+bool VerletSolver::isFixed(size_t particleIndex) const
+{
+    return m_inverseMasses[particleIndex] <= 0;
+}
+
+void VerletSolver::colorConstraints()
+{
+    // Constraints in one batch never share a particle, so a batch can be projected in parallel
+    m_constraintBatches.clear();
+    std::vector<std::vector<size_t>> particleColors(particleCount());
+    for (size_t i = 0; i < m_distanceConstraints.size(); ++i) {
+        const auto &constraint = m_distanceConstraints[i];
+        const auto &fromColors = particleColors[constraint.from];
+        const auto &toColors = particleColors[constraint.to];
+        size_t color = 0;
+        while (std::find(fromColors.begin(), fromColors.end(), color) != fromColors.end() ||
+                std::find(toColors.begin(), toColors.end(), color) != toColors.end())
+            ++color;
+        if (color >= m_constraintBatches.size())
+            m_constraintBatches.resize(color + 1);
+        m_constraintBatches[color].push_back(i);
+        particleColors[constraint.from].push_back(color);
+        particleColors[constraint.to].push_back(color);
+    }
+    m_constraintBatchesDirty = false;
+}
+
+void VerletSolver::integrate(float stepSize)
+{
+    size_t count = particleCount();
+    float stepSize2 = stepSize * stepSize;
+    float accelerationX = m_acceleration.x() * stepSize2;
+    float accelerationY = m_acceleration.y() * stepSize2;
+    float accelerationZ = m_acceleration.z() * stepSize2;
+    float *positionsX = m_positionsX.data();
+    float *positionsY = m_positionsY.data();
+    float *positionsZ = m_positionsZ.data();
+    float *lastPositionsX = m_lastPositionsX.data();
+    float *lastPositionsY = m_lastPositionsY.data();
+    float *lastPositionsZ = m_lastPositionsZ.data();
+    const float *inverseMasses = m_inverseMasses.data();
+    const float *radiuses = m_radiuses.data();
+    for (size_t i = 0; i < count; ++i) {
+        float movable = inverseMasses[i] > 0 ? 1.0f : 0.0f;
+        float x = positionsX[i];
+        float y = positionsY[i];
+        float z = positionsZ[i];
+        float newY = y + movable * (y - lastPositionsY[i] + accelerationY);
+        float minY = m_groundY + radiuses[i];
+        positionsX[i] = x + movable * (x - lastPositionsX[i] + accelerationX);
+        positionsY[i] = movable > 0 && newY < minY ? minY : newY;
+        positionsZ[i] = z + movable * (z - lastPositionsZ[i] + accelerationZ);
+        lastPositionsX[i] = x;
+        lastPositionsY[i] = y;
+        lastPositionsZ[i] = z;
+    }
+}
+
+void VerletSolver::applyGroundConstraint(size_t particleIndex)
+{
+    float minY = m_groundY + m_radiuses[particleIndex];
+    if (m_positionsY[particleIndex] < minY)
+        m_positionsY[particleIndex] = minY;
+}
+
+void VerletSolver::projectDistanceConstraint(const DistanceConstraint &constraint)
+{
+    float fromWeight = m_inverseMasses[constraint.from];
+    float toWeight = m_inverseMasses[constraint.to];
+    float totalWeight = fromWeight + toWeight;
+    if (totalWeight <= 0)
+        return;
+    float deltaX = m_positionsX[constraint.from] - m_positionsX[constraint.to];
+    float deltaY = m_positionsY[constraint.from] - m_positionsY[constraint.to];
+    float deltaZ = m_positionsZ[constraint.from] - m_positionsZ[constraint.to];
+    float deltaLength = std::sqrt(deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ);
+    if (qFuzzyIsNull(deltaLength))
+        return;
+    float diff = (constraint.restLength - deltaLength) / (deltaLength * totalWeight);
+    if (fromWeight > 0) {
+        float factor = diff * fromWeight;
+        m_positionsX[constraint.from] += deltaX * factor;
+        m_positionsY[constraint.from] += deltaY * factor;
+        m_positionsZ[constraint.from] += deltaZ * factor;
+        applyGroundConstraint(constraint.from);
+    }
+    if (toWeight > 0) {
+        float factor = diff * toWeight;
+        m_positionsX[constraint.to] -= deltaX * factor;
+        m_positionsY[constraint.to] -= deltaY * factor;
+        m_positionsZ[constraint.to] -= deltaZ * factor;
+        applyGroundConstraint(constraint.to);
+    }
+}
+
+void VerletSolver::projectDistanceConstraints()
+{
+    if (m_constraintBatchesDirty)
+        colorConstraints();
+    
+    for (const auto &batch: m_constraintBatches) {
+        if (batch.size() < g_minParallelBatchSize) {
+            for (const auto &constraintIndex: batch)
+                projectDistanceConstraint(m_distanceConstraints[constraintIndex]);
+            continue;
+        }
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, batch.size(), g_projectionGrainSize),
+            DistanceConstraintProjector(this, &batch));
+    }
+}
+
+void VerletSolver::simulate(float stepSize, size_t iterations)
+{
+    integrate(stepSize);
+    for (size_t iteration = 0; iteration < iterations; ++iteration)
+        projectDistanceConstraints();
+}
@@ -0,0 +1,51 @@
+#ifndef DUST3D_VERLET_SOLVER_H
+#define DUST3D_VERLET_SOLVER_H
+#include <vector>
+#include <QVector3D>
+
+class VerletSolver
+{
+public:
+    struct DistanceConstraint
+    {
+        size_t from;
+        size_t to;
+        float restLength;
+    };
+    
+    VerletSolver(const std::vector<QVector3D> &positions);
+    size_t particleCount() const;
+    void setAcceleration(const QVector3D &acceleration);
+    void setGroundY(float groundY);
+    void setInverseMass(size_t particleIndex, float inverseMass);
+    void setRadius(size_t particleIndex, float radius);
+    void addDistanceConstraint(size_t from, size_t to);
+    QVector3D position(size_t particleIndex) const;
+    void setPosition(size_t particleIndex, const QVector3D &position);
+    bool isFixed(size_t particleIndex) const;
+    void integrate(float stepSize);
+    void projectDistanceConstraints();
+    void applyGroundConstraint(size_t particleIndex);
+    void simulate(float stepSize, size_t iterations);
+private:
+    friend class DistanceConstraintProjector;
+    
+    std::vector<float> m_positionsX;
+    std::vector<float> m_positionsY;
+    std::vector<float> m_positionsZ;
+    std::vector<float> m_lastPositionsX;
+    std::vector<float> m_lastPositionsY;
+    std::vector<float> m_lastPositionsZ;
+    std::vector<float> m_inverseMasses;
+    std::vector<float> m_radiuses;
+    std::vector<DistanceConstraint> m_distanceConstraints;
+    std::vector<std::vector<size_t>> m_constraintBatches;
+    bool m_constraintBatchesDirty = false;
+    QVector3D m_acceleration;
+    float m_groundY = 0;
+    
+    void colorConstraints();
+    void projectDistanceConstraint(const DistanceConstraint &constraint);
+};
+
+#endif
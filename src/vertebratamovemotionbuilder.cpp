@@ -277,7 +277,7 @@ void VertebrataMoveMotionBuilder::generate()
                 tailSimulator->updateVertexPosition(0, m_updatedSpineNodes[tailNodeIndex].position - tailSpineOffset);
                 tailSimulator->simulate(1.0 / 60);
                 for (size_t nodeIndex = tailNodeIndex; nodeIndex < m_spineNodes.size(); ++nodeIndex) {
-                    m_updatedSpineNodes[nodeIndex].position = tailSimulator->getVertexMotion(nodeIndex - tailNodeIndex).position + tailSpineOffset;
+                    m_updatedSpineNodes[nodeIndex].position = tailSimulator->getVertexPosition(nodeIndex - tailNodeIndex) + tailSpineOffset;
                 }
             }
 
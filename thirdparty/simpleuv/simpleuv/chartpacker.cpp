@@ -1,5 +1,8 @@
 #include <simpleuv/chartpacker.h>
 #include <cmath>
+#include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 extern "C" {
 #include <maxrects.h>
 }
@@ -7,6 +10,45 @@ extern "C" {
 namespace simpleuv
 {
 
+class MaxRectsHeuristicEvaluator
+{
+public:
+    MaxRectsHeuristicEvaluator(int width, int height,
+            const std::vector<maxRectsSize> *rects,
+            const std::vector<maxRectsFreeRectChoiceHeuristic> *methods,
+            std::vector<std::vector<maxRectsPosition>> *positions,
+            std::vector<float> *occupancies) :
+        m_width(width),
+        m_height(height),
+        m_rects(rects),
+        m_methods(methods),
+        m_positions(positions),
+        m_occupancies(occupancies)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+            auto &positions = (*m_positions)[i];
+            positions.resize(m_rects->size());
+            float occupancy = 0;
+            if (0 != maxRects(m_width, m_height, m_rects->size(), const_cast<maxRectsSize *>(m_rects->data()),
+                    (*m_methods)[i], true, positions.data(), &occupancy)) {
+                positions.clear();
+                continue;
+            }
+            (*m_occupancies)[i] = occupancy;
+        }
+    }
+private:
+    int m_width = 0;
+    int m_height = 0;
+    const std::vector<maxRectsSize> *m_rects = nullptr;
+    const std::vector<maxRectsFreeRectChoiceHeuristic> *m_methods = nullptr;
+    std::vector<std::vector<maxRectsPosition>> *m_positions = nullptr;
+    std::vector<float> *m_occupancies = nullptr;
+};
+
 void ChartPacker::setCharts(const std::vector<std::pair<float, float>> &chartSizes)
 {
     m_chartSizes = chartSizes;
@@ -17,6 +59,11 @@ const std::vector<std::tuple<float, float, float, float, bool>> &ChartPacker::ge
     return m_result;
 }
 
+float ChartPacker::getOccupancy() const
+{
+    return m_occupancy;
+}
+
 double ChartPacker::calculateTotalArea()
 {
     double totalArea = 0;
@@ -26,51 +73,61 @@ double ChartPacker::calculateTotalArea()
     return totalArea;
 }
 
+float ChartPacker::calculateMaxChartSide()
+{
+    float maxSide = 0;
+    for (const auto &chartSize: m_chartSizes) {
+        maxSide = std::max(maxSide, std::max(chartSize.first, chartSize.second));
+    }
+    return maxSide;
+}
+
+static bool packWithMaxRects(int width, int height, const std::vector<maxRectsSize> &rects,
+    std::vector<maxRectsPosition> &positions)
+{
+    const std::vector<maxRectsFreeRectChoiceHeuristic> methods = {
+        rectBestShortSideFit,
+        rectBestLongSideFit,
+        rectBestAreaFit,
+        rectBottomLeftRule,
+        rectContactPointRule
+    };
+    std::vector<std::vector<maxRectsPosition>> methodPositions(methods.size());
+    std::vector<float> methodOccupancies(methods.size(), 0.0);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, methods.size()),
+        MaxRectsHeuristicEvaluator(width, height, &rects, &methods, &methodPositions, &methodOccupancies));
+    int bestMethod = -1;
+    for (size_t i = 0; i < methods.size(); ++i) {
+        if (methodPositions[i].size() != rects.size())
+            continue;
+        if (-1 == bestMethod || methodOccupancies[i] > methodOccupancies[bestMethod])
+            bestMethod = i;
+    }
+    if (-1 == bestMethod)
+        return false;
+    positions.swap(methodPositions[bestMethod]);
+    return true;
+}
+
 bool ChartPacker::tryPack(float textureSize)
 {
     std::vector<maxRectsSize> rects;
     int width = textureSize * m_floatToIntFactor;
     int height = width;
-    //if (m_tryNum > 50) {
-    //    qDebug() << "Try the " << m_tryNum << "nth times pack with factor:" << m_textureSizeFactor << " size:" << width << "x" << height;
-    //}
     float paddingSize = m_paddingSize * width;
     float paddingSize2 = paddingSize + paddingSize;
     for (const auto &chartSize: m_chartSizes) {
         maxRectsSize r;
         r.width = chartSize.first * m_floatToIntFactor + paddingSize2;
         r.height = chartSize.second * m_floatToIntFactor + paddingSize2;
-        //qDebug() << "  :chart " << r.width << "x" << r.height;
         rects.push_back(r);
     }
-    const maxRectsFreeRectChoiceHeuristic methods[] = {
-        rectBestShortSideFit,
-        rectBestLongSideFit,
-        rectBestAreaFit,
-        rectBottomLeftRule,
-        rectContactPointRule
-    };
-    float occupancy = 0;
-    float bestOccupancy = 0;
-    std::vector<maxRectsPosition> bestResult;
-    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); ++i) {
-        //qDebug() << "Test method[" << methods[i] << "]";
-        std::vector<maxRectsPosition> result(rects.size());
-        if (0 != maxRects(width, height, rects.size(), rects.data(), methods[i], true, result.data(), &occupancy)) {
-            //qDebug() << "  method[" << methods[i] << "] failed";
-            continue;
-        }
-        //qDebug() << "  method[" << methods[i] << "] occupancy:" << occupancy;
-        if (occupancy > bestOccupancy) {
-            bestResult = result;
-            bestOccupancy = occupancy;
-        }
-    }
-    if (bestResult.size() != rects.size())
+    std::vector<maxRectsPosition> positions;
+    if (!packWithMaxRects(width, height, rects, positions))
         return false;
-    m_result.resize(bestResult.size());
-    for (decltype(bestResult.size()) i = 0; i < bestResult.size(); ++i) {
-        const auto &result = bestResult[i];
+    m_result.resize(positions.size());
+    for (decltype(positions.size()) i = 0; i < positions.size(); ++i) {
+        const auto &result = positions[i];
         const auto &rect = rects[i];
         auto &dest = m_result[i];
         std::get<0>(dest) = (float)(result.left + paddingSize) / width;
@@ -78,27 +135,38 @@ bool ChartPacker::tryPack(float textureSize)
         std::get<2>(dest) = (float)(rect.width - paddingSize2) / width;
         std::get<3>(dest) = (float)(rect.height - paddingSize2) / height;
         std::get<4>(dest) = result.rotated;
-        //qDebug() << "result[" << i << "]:" << std::get<0>(dest) << std::get<1>(dest) << std::get<2>(dest) << std::get<3>(dest) << std::get<4>(dest);
     }
+    m_occupancy = calculateTotalArea() / ((double)textureSize * textureSize);
     return true;
 }
 
 float ChartPacker::pack()
 {
-    float textureSize = 0;
-    float initialGuessSize = std::sqrt(calculateTotalArea() * m_initialAreaGuessFactor);
-    while (true) {
-        textureSize = initialGuessSize * m_textureSizeFactor;
-        ++m_tryNum;
-        if (tryPack(textureSize))
-            break;
-        m_textureSizeFactor += m_textureSizeGrowFactor;
-        if (m_tryNum >= m_maxTryNum) {
-            //qDebug() << "Tried too many times:" << m_tryNum;
-            break;
-        }
+    m_result.clear();
+    m_occupancy = 0;
+    if (m_chartSizes.empty())
+        return 0;
+    
+    // No layout can be smaller than the total chart area or the longest chart side,
+    // so grow from the initial guess until one fits, then binary search down towards that bound
+    float lowSize = std::max((float)std::sqrt(calculateTotalArea()), calculateMaxChartSide());
+    float highSize = std::max(lowSize, (float)std::sqrt(calculateTotalArea() * m_initialAreaGuessFactor));
+    size_t tryNum = 0;
+    while (!tryPack(highSize)) {
+        if (++tryNum >= m_maxTryNum)
+            return highSize;
+        lowSize = highSize;
+        highSize *= 1.0 + m_textureSizeGrowFactor;
+    }
+    while (tryNum < m_maxTryNum && highSize - lowSize > highSize * m_searchTolerance) {
+        ++tryNum;
+        float middleSize = (lowSize + highSize) * 0.5;
+        if (tryPack(middleSize))
+            highSize = middleSize;
+        else
+            lowSize = middleSize;
     }
-    return textureSize;
+    return highSize;
 }
 
 }
@@ -1,5 +1,6 @@
 #include <map>
 #include <unordered_set>
+#include <unordered_map>
 #include <set>
 #include <queue>
 #include <cmath>
@@ -9,10 +10,39 @@
 #include <simpleuv/triangulate.h>
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 namespace simpleuv 
 {
 
+class IslandUnwrapper
+{
+public:
+    IslandUnwrapper(UvUnwrapper *unwrapper,
+            const std::vector<std::vector<size_t>> *islands,
+            const std::vector<size_t> *islandIndices,
+            std::vector<std::vector<std::pair<std::vector<size_t>, std::vector<FaceTextureCoords>>>> *islandCharts) :
+        m_unwrapper(unwrapper),
+        m_islands(islands),
+        m_islandIndices(islandIndices),
+        m_islandCharts(islandCharts)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+            size_t islandIndex = (*m_islandIndices)[i];
+            m_unwrapper->unwrapSingleIsland((*m_islands)[islandIndex], (*m_islandCharts)[islandIndex]);
+        }
+    }
+private:
+    UvUnwrapper *m_unwrapper = nullptr;
+    const std::vector<std::vector<size_t>> *m_islands = nullptr;
+    const std::vector<size_t> *m_islandIndices = nullptr;
+    std::vector<std::vector<std::pair<std::vector<size_t>, std::vector<FaceTextureCoords>>>> *m_islandCharts = nullptr;
+};
+
 const std::vector<float> UvUnwrapper::m_rotateDegrees = {5, 15, 20, 25, 30, 35, 40, 45};
 
 void UvUnwrapper::setMesh(const Mesh &mesh)
@@ -25,6 +55,11 @@ void UvUnwrapper::setTexelSize(float texelSize)
     m_texelSizePerUnit = texelSize;
 }
 
+void UvUnwrapper::setCache(UvUnwrapperCache *cache)
+{
+    m_cache = cache;
+}
+
 const std::vector<FaceTextureCoords> &UvUnwrapper::getFaceUvs() const
 {
     return m_faceUvs;
@@ -426,11 +461,27 @@ void UvUnwrapper::calculateSizeAndRemoveInvalidCharts()
 
 void UvUnwrapper::packCharts()
 {
-    ChartPacker chartPacker;
-    chartPacker.setCharts(m_scaledChartSizes);
-    m_resultTextureSize = chartPacker.pack();
+    std::vector<std::tuple<float, float, float, float, bool>> packedResult;
+    if (nullptr != m_cache &&
+            !m_cache->packedResult.empty() &&
+            m_cache->packedChartSizes == m_scaledChartSizes) {
+        m_resultTextureSize = m_cache->packedTextureSize;
+        m_resultOccupancy = m_cache->packedOccupancy;
+        packedResult = m_cache->packedResult;
+    } else {
+        ChartPacker chartPacker;
+        chartPacker.setCharts(m_scaledChartSizes);
+        m_resultTextureSize = chartPacker.pack();
+        m_resultOccupancy = chartPacker.getOccupancy();
+        packedResult = chartPacker.getResult();
+        if (nullptr != m_cache) {
+            m_cache->packedChartSizes = m_scaledChartSizes;
+            m_cache->packedResult = packedResult;
+            m_cache->packedTextureSize = m_resultTextureSize;
+            m_cache->packedOccupancy = m_resultOccupancy;
+        }
+    }
     m_chartRects.resize(m_chartSizes.size());
-    const std::vector<std::tuple<float, float, float, float, bool>> &packedResult = chartPacker.getResult();
     for (decltype(m_charts.size()) i = 0; i < m_charts.size(); ++i) {
         const auto &chartSize = m_chartSizes[i];
         auto &chart = m_charts[i];
@@ -499,7 +550,9 @@ void UvUnwrapper::partition()
     }
 }
 
-void UvUnwrapper::unwrapSingleIsland(const std::vector<size_t> &group, int sourcePartition, bool skipCheckHoles)
+void UvUnwrapper::unwrapSingleIsland(const std::vector<size_t> &group,
+        std::vector<std::pair<std::vector<size_t>, std::vector<FaceTextureCoords>>> &charts,
+        bool skipCheckHoles)
 {
     if (group.empty())
         return;
@@ -535,7 +588,7 @@ void UvUnwrapper::unwrapSingleIsland(const std::vector<size_t> &group, int sourc
         return;
     }
     if (1 == remainingHoleNumAfterFix) {
-        parametrizeSingleGroup(localVertices, localFaces, localToGlobalFacesMap, faceNumBeforeFix, sourcePartition);
+        parametrizeSingleGroup(localVertices, localFaces, localToGlobalFacesMap, faceNumBeforeFix, charts);
         return;
     }
     
@@ -547,8 +600,8 @@ void UvUnwrapper::unwrapSingleIsland(const std::vector<size_t> &group, int sourc
             //qDebug() << "Cut mesh failed";
             return;
         }
-        unwrapSingleIsland(firstGroup, sourcePartition, true);
-        unwrapSingleIsland(secondGroup, sourcePartition, true);
+        unwrapSingleIsland(firstGroup, charts, true);
+        unwrapSingleIsland(secondGroup, charts, true);
         return;
     }
 }
@@ -557,7 +610,7 @@ void UvUnwrapper::parametrizeSingleGroup(const std::vector<Vertex> &verticies,
         const std::vector<Face> &faces,
         std::map<size_t, size_t> &localToGlobalFacesMap,
         size_t faceNumToChart,
-        int sourcePartition)
+        std::vector<std::pair<std::vector<size_t>, std::vector<FaceTextureCoords>>> &charts)
 {
     std::vector<TextureCoord> localVertexUvs;
     if (!parametrize(verticies, faces, localVertexUvs))
@@ -578,8 +631,27 @@ void UvUnwrapper::parametrizeSingleGroup(const std::vector<Vertex> &verticies,
     }
     if (chart.first.empty())
         return;
-    m_charts.push_back(chart);
-    m_chartSourcePartitions.push_back(sourcePartition);
+    charts.push_back(chart);
+}
+
+uint64_t UvUnwrapper::calculateIslandHash(const std::vector<size_t> &island)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    auto addBytes = [&](const void *data, size_t size) {
+        const unsigned char *bytes = (const unsigned char *)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    uint64_t faceNum = island.size();
+    addBytes(&faceNum, sizeof(faceNum));
+    for (const auto &faceIndex: island) {
+        const auto &face = m_mesh.faces[faceIndex];
+        for (size_t j = 0; j < 3; ++j)
+            addBytes(m_mesh.vertices[face.indices[j]].xyz, sizeof(m_mesh.vertices[face.indices[j]].xyz));
+    }
+    return hash;
 }
 
 float UvUnwrapper::getTextureSize() const
@@ -587,16 +659,76 @@ float UvUnwrapper::getTextureSize() const
     return m_resultTextureSize;
 }
 
+float UvUnwrapper::getOccupancy() const
+{
+    return m_resultOccupancy;
+}
+
 void UvUnwrapper::unwrap()
 {
     partition();
 
     m_faceUvs.resize(m_mesh.faces.size());
+    std::vector<std::vector<size_t>> islands;
+    std::vector<int> islandSourcePartitions;
     for (const auto &group: m_partitions) {
-        std::vector<std::vector<size_t>> islands;
-        splitPartitionToIslands(group.second, islands);
-        for (const auto &island: islands)
-            unwrapSingleIsland(island, group.first);
+        std::vector<std::vector<size_t>> groupIslands;
+        splitPartitionToIslands(group.second, groupIslands);
+        for (auto &island: groupIslands) {
+            islands.push_back(std::move(island));
+            islandSourcePartitions.push_back(group.first);
+        }
+    }
+    
+    // Islands are parametrized concurrently, but each one writes into its own slot,
+    // so the chart order stays the same as the serial version before packing
+    std::vector<std::vector<std::pair<std::vector<size_t>, std::vector<FaceTextureCoords>>>> islandCharts(islands.size());
+    std::vector<uint64_t> islandHashes;
+    std::vector<size_t> islandIndicesToUnwrap;
+    if (nullptr != m_cache) {
+        // Cached charts store face indices relative to the island, because the global face indices shift whenever other parts change
+        islandHashes.resize(islands.size());
+        for (size_t i = 0; i < islands.size(); ++i) {
+            islandHashes[i] = calculateIslandHash(islands[i]);
+            auto findCacheResult = m_cache->islandCharts.find(islandHashes[i]);
+            if (findCacheResult == m_cache->islandCharts.end()) {
+                islandIndicesToUnwrap.push_back(i);
+                continue;
+            }
+            islandCharts[i] = findCacheResult->second;
+            for (auto &chart: islandCharts[i]) {
+                for (auto &faceIndex: chart.first)
+                    faceIndex = islands[i][faceIndex];
+            }
+        }
+    } else {
+        for (size_t i = 0; i < islands.size(); ++i)
+            islandIndicesToUnwrap.push_back(i);
+    }
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, islandIndicesToUnwrap.size()),
+        IslandUnwrapper(this, &islands, &islandIndicesToUnwrap, &islandCharts));
+    if (nullptr != m_cache) {
+        std::map<uint64_t, std::vector<std::pair<std::vector<size_t>, std::vector<FaceTextureCoords>>>> newIslandCharts;
+        for (size_t i = 0; i < islands.size(); ++i) {
+            auto &charts = newIslandCharts[islandHashes[i]];
+            if (!charts.empty())
+                continue;
+            std::unordered_map<size_t, size_t> globalToLocalFacesMap;
+            for (size_t j = 0; j < islands[i].size(); ++j)
+                globalToLocalFacesMap[islands[i][j]] = j;
+            charts = islandCharts[i];
+            for (auto &chart: charts) {
+                for (auto &faceIndex: chart.first)
+                    faceIndex = globalToLocalFacesMap[faceIndex];
+            }
+        }
+        m_cache->islandCharts.swap(newIslandCharts);
+    }
+    for (size_t i = 0; i < islandCharts.size(); ++i) {
+        for (auto &chart: islandCharts[i]) {
+            m_charts.push_back(std::move(chart));
+            m_chartSourcePartitions.push_back(islandSourcePartitions[i]);
+        }
     }
     
     calculateSizeAndRemoveInvalidCharts();
@@ -5,30 +5,48 @@
 #include <simpleuv/meshdatatype.h>
 #include <Eigen/Dense>
 #include <tuple>
+#include <cstdint>
 
 namespace simpleuv 
 {
 
+class UvUnwrapperCache
+{
+public:
+    std::map<uint64_t, std::vector<std::pair<std::vector<size_t>, std::vector<FaceTextureCoords>>>> islandCharts;
+    std::vector<std::pair<float, float>> packedChartSizes;
+    std::vector<std::tuple<float, float, float, float, bool>> packedResult;
+    float packedTextureSize = 0;
+    float packedOccupancy = 0;
+};
+
 class UvUnwrapper
 {
 public:
     void setMesh(const Mesh &mesh);
     void setTexelSize(float texelSize);
+    void setCache(UvUnwrapperCache *cache);
     void unwrap();
     const std::vector<FaceTextureCoords> &getFaceUvs() const;
     const std::vector<Rect> &getChartRects() const;
     const std::vector<int> &getChartSourcePartitions() const;
     float getTextureSize() const;
+    float getOccupancy() const;
 
 private:
     void partition();
+    uint64_t calculateIslandHash(const std::vector<size_t> &island);
     void splitPartitionToIslands(const std::vector<size_t> &group, std::vector<std::vector<size_t>> &islands);
-    void unwrapSingleIsland(const std::vector<size_t> &group, int sourcePartition, bool skipCheckHoles=false);
+    friend class IslandUnwrapper;
+
+    void unwrapSingleIsland(const std::vector<size_t> &group,
+        std::vector<std::pair<std::vector<size_t>, std::vector<FaceTextureCoords>>> &charts,
+        bool skipCheckHoles=false);
     void parametrizeSingleGroup(const std::vector<Vertex> &verticies,
         const std::vector<Face> &faces,
         std::map<size_t, size_t> &localToGlobalFacesMap,
         size_t faceNumToChart,
-        int sourcePartition);
+        std::vector<std::pair<std::vector<size_t>, std::vector<FaceTextureCoords>>> &charts);
     bool fixHolesExceptTheLongestRing(const std::vector<Vertex> &verticies, std::vector<Face> &faces, size_t *remainingHoleNum=nullptr);
     void makeSeamAndCut(const std::vector<Vertex> &verticies,
         const std::vector<Face> &faces,
@@ -55,10 +73,12 @@ private:
     std::vector<std::pair<float, float>> m_scaledChartSizes;
     std::vector<Rect> m_chartRects;
     std::vector<int> m_chartSourcePartitions;
+    UvUnwrapperCache *m_cache = nullptr;
     bool m_segmentByNormal = true;
     float m_segmentDotProductThreshold = 0.0;    //90 degrees
     float m_texelSizePerUnit = 1.0;
     float m_resultTextureSize = 0;
+    float m_resultOccupancy = 0;
     bool m_segmentPreferMorePieces = true;
     bool m_enableRotation = true;
     static const std::vector<float> m_rotateDegrees;